@@ -78,6 +78,17 @@ function(rdma_set_library_map DEST VERSION_SCRIPT)
     LINK_DEPENDS ${VERSION_SCRIPT})
 endfunction()
 
+# Build the provider sources as an object library that libibverbs links in,
+# see STATIC_PROVIDERS. The objects go into both the shared and static
+# libibverbs so they must be PIC.
+function(rdma_static_provider_objects DEST)
+  add_library(${DEST}-static-obj OBJECT ${ARGN})
+  set_target_properties(${DEST}-static-obj PROPERTIES
+    POSITION_INDEPENDENT_CODE TRUE)
+  set_property(TARGET ${DEST}-static-obj APPEND PROPERTY
+    COMPILE_DEFINITIONS "VERBS_STATIC_PROVIDER")
+endfunction()
+
 # Basic function to produce a standard libary with a GNU LD version script.
 function(rdma_library DEST VERSION_SCRIPT SOVERSION VERSION)
   # Create a static library
@@ -108,16 +119,26 @@ endfunction()
 # other convections. The system library is symlinked into the
 # VERBS_PROVIDER_DIR so it can be dlopened as a provider as well.
 function(rdma_shared_provider DEST VERSION_SCRIPT SOVERSION VERSION)
-  # Installed driver file
-  file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" "driver ${DEST}\n")
-  install(FILES "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" DESTINATION "${CONFIG_DIR}")
+  # A built in provider keeps its shared library for its exported API, but
+  # libibverbs already carries the code so it is not a plugin: no driver
+  # file and no module in VERBS_PROVIDER_DIR.
+  list(FIND STATIC_PROVIDERS ${DEST} IS_STATIC)
+  if (NOT IS_STATIC EQUAL -1)
+    rdma_static_provider_objects(${DEST} ${ARGN})
+    file(REMOVE "${BUILD_ETC}/libibverbs.d/${DEST}.driver"
+      "${BUILD_LIB}/lib${DEST}-rdmav2.so")
+  else()
+    # Installed driver file
+    file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" "driver ${DEST}\n")
+    install(FILES "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" DESTINATION "${CONFIG_DIR}")
 
-  # Uninstalled driver file
-  file(MAKE_DIRECTORY "${BUILD_ETC}/libibverbs.d/")
-  file(WRITE "${BUILD_ETC}/libibverbs.d/${DEST}.driver" "driver ${BUILD_LIB}/lib${DEST}\n")
+    # Uninstalled driver file
+    file(MAKE_DIRECTORY "${BUILD_ETC}/libibverbs.d/")
+    file(WRITE "${BUILD_ETC}/libibverbs.d/${DEST}.driver" "driver ${BUILD_LIB}/lib${DEST}\n")
+  endif()
 
   # Create a static provider library
-  if (ENABLE_STATIC)
+  if (ENABLE_STATIC AND IS_STATIC EQUAL -1)
     add_library(${DEST} STATIC ${ARGN})
     set_target_properties(${DEST} PROPERTIES LIBRARY_OUTPUT_DIRECTORY "${BUILD_LIB}")
     install(TARGETS ${DEST} DESTINATION "${CMAKE_INSTALL_LIBDIR}")
@@ -139,6 +160,10 @@ function(rdma_shared_provider DEST VERSION_SCRIPT SOVERSION VERSION)
     LIBRARY_OUTPUT_DIRECTORY "${BUILD_LIB}")
   install(TARGETS ${DEST} DESTINATION "${CMAKE_INSTALL_LIBDIR}")
 
+  if (NOT IS_STATIC EQUAL -1)
+    return()
+  endif()
+
   # Compute a relative symlink from VERBS_PROVIDER_DIR to LIBDIR
   execute_process(COMMAND python ${CMAKE_SOURCE_DIR}/buildlib/relpath
     "${CMAKE_INSTALL_FULL_LIBDIR}/lib${DEST}.so.${VERSION}"
@@ -155,6 +180,14 @@ endfunction()
 
 # Create a provider shared library for libibverbs
 function(rdma_provider DEST)
+  # Built in providers are not plugins at all
+  list(FIND STATIC_PROVIDERS ${DEST} IS_STATIC)
+  if (NOT IS_STATIC EQUAL -1)
+    rdma_static_provider_objects(${DEST} ${ARGN})
+    file(REMOVE "${BUILD_ETC}/libibverbs.d/${DEST}.driver")
+    return()
+  endif()
+
   # Installed driver file
   file(WRITE "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" "driver ${DEST}\n")
   install(FILES "${CMAKE_CURRENT_BINARY_DIR}/${DEST}.driver" DESTINATION "${CONFIG_DIR}")
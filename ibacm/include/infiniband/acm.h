@@ -117,6 +117,25 @@ enum {
 	ACM_MAX_COUNTER
 };
 
+/*
+ * Endpoint performance data is followed by log2 latency histograms, one
+ * per ACM_LAT_* type.  Bucket i counts operations that completed in less
+ * than (ACM_LAT_MIN_US << i) microseconds, and the last bucket counts
+ * everything slower.
+ */
+enum {
+	ACM_LAT_RESOLVE,	/* client resolve, request to response */
+	ACM_LAT_QUERY,		/* client SA path query */
+	ACM_LAT_ADDR,		/* multicast address resolution */
+	ACM_LAT_ROUTE,		/* SA path record query for a destination */
+	ACM_MAX_LAT_HIST
+};
+
+#define ACM_LAT_MIN_US          32
+#define ACM_LAT_BUCKETS         16
+#define ACM_MAX_PERF_DATA       (ACM_MAX_COUNTER + \
+				 ACM_MAX_LAT_HIST * ACM_LAT_BUCKETS)
+
 /*
  * Performance messages are sent/received in network byte order.
  */
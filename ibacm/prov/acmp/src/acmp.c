@@ -123,6 +123,17 @@ struct acmp_dest {
 	uint64_t	       route_timeout;
 	uint8_t                addr_type;
 	struct acmp_ep         *ep;
+	struct list_node       lru_entry;	/* protected by ep lock */
+	struct list_node       refresh_entry;
+	uint32_t               hits;		/* since last refresh */
+	int                    refreshing;	/* queries outstanding, dest lock */
+	struct acm_ep_addr_data saddr;		/* source for address refresh */
+};
+
+/* Context of an SA path query issued for a destination */
+struct acmp_route_query {
+	struct acmp_dest       *dest;
+	uint64_t               start;		/* issue time, us */
 };
 
 struct acmp_device;
@@ -190,6 +201,9 @@ struct acmp_ep {
 	enum acmp_state       state;
 	struct acmp_addr      addr_info[MAX_EP_ADDR];
 	atomic_t              counters[ACM_MAX_COUNTER];
+	atomic_t              lat_hist[ACM_MAX_LAT_HIST][ACM_LAT_BUCKETS];
+	struct list_head      dest_lru;		/* least recently used first */
+	int                   dest_cnt;
 };
 
 struct acmp_send_msg {
@@ -205,12 +219,14 @@ struct acmp_send_msg {
 	struct ibv_send_wr   wr;
 	struct ibv_sge       sge;
 	uint64_t             expires;
+	uint64_t             start;
 	int                  tries;
 	uint8_t              data[ACM_SEND_SIZE];
 };
 
 struct acmp_request {
 	uint64_t	id;
+	uint64_t	start;
 	struct list_node entry;
 	struct acm_msg	msg;
 	struct acmp_ep	*ep;
@@ -259,6 +275,7 @@ static event_t timeout_event;
 static atomic_t wait_cnt;
 static pthread_t retry_thread_id;
 static int retry_thread_started = 0;
+static pthread_t refresh_thread_id;
 
 static __thread char log_data[ACM_MAX_ADDRESS];
 
@@ -281,6 +298,8 @@ static uint8_t min_mtu = IBV_MTU_2048;
 static uint8_t min_rate = IBV_RATE_10_GBPS;
 static enum acmp_route_preload route_preload;
 static enum acmp_addr_preload addr_preload;
+static int refresh_ahead = 0;
+static int dest_cache_max = 0;
 
 static int acmp_initialized = 0;
 
@@ -363,9 +382,49 @@ acmp_remove_dest(struct acmp_ep *ep, struct acmp_dest *dest)
 	acm_log(2, "%s\n", dest->name);
 	tdelete(dest->address, &ep->dest_map[dest->addr_type - 1],
 		acmp_compare_dest);
+	list_del_from(&ep->dest_lru, &dest->lru_entry);
+	ep->dest_cnt--;
 	acmp_put_dest(dest);
 }
 
+/*
+ * Drop the least recently used destinations once the cache grows past
+ * dest_cache_max.  Only resolved records referenced solely by the cache
+ * are released; anything still being resolved, or with an outstanding
+ * request or client, is skipped.
+ * Caller must hold ep lock.
+ */
+static void acmp_evict_dests(struct acmp_ep *ep)
+{
+	struct acmp_dest *dest, *next;
+
+	list_for_each_safe(&ep->dest_lru, dest, next, lru_entry) {
+		if (ep->dest_cnt <= dest_cache_max)
+			break;
+		if (dest->state != ACMP_READY ||
+		    dest->addr_timeout == (uint64_t)~0ULL ||
+		    atomic_get(&dest->refcnt) > 1)
+			continue;
+
+		acm_log(2, "evicting %s\n", dest->name);
+		acmp_remove_dest(ep, dest);
+	}
+}
+
+/*
+ * The new record is pinned while the cache is trimmed, so that it can
+ * never be evicted by its own insertion.  Caller must hold ep lock.
+ */
+static void acmp_insert_dest(struct acmp_ep *ep, struct acmp_dest *dest)
+{
+	(void) atomic_inc(&dest->refcnt);
+	list_add_tail(&ep->dest_lru, &dest->lru_entry);
+	ep->dest_cnt++;
+	if (dest_cache_max && ep->dest_cnt > dest_cache_max)
+		acmp_evict_dests(ep);
+	(void) atomic_dec(&dest->refcnt);
+}
+
 static struct acmp_dest *
 acmp_acquire_dest(struct acmp_ep *ep, uint8_t addr_type, const uint8_t *addr)
 {
@@ -389,18 +448,35 @@ acmp_acquire_dest(struct acmp_ep *ep, uint8_t addr_type, const uint8_t *addr)
 				rec_expr_minutes);
 		}
 	}
-	if (!dest) {
+	if (dest) {
+		list_del_from(&ep->dest_lru, &dest->lru_entry);
+		list_add_tail(&ep->dest_lru, &dest->lru_entry);
+		dest->hits++;
+	} else {
 		dest = acmp_alloc_dest(addr_type, addr);
 		if (dest) {
 			dest->ep = ep;
 			tsearch(dest, &ep->dest_map[addr_type - 1], acmp_compare_dest);
 			(void) atomic_inc(&dest->refcnt);
+			acmp_insert_dest(ep, dest);
 		}
 	}
 	pthread_mutex_unlock(&ep->lock);
 	return dest;
 }
 
+static void acmp_record_latency(struct acmp_ep *ep, int hist, uint64_t start)
+{
+	uint64_t usec = time_stamp_us() - start;
+	int i;
+
+	for (i = 0; i < ACM_LAT_BUCKETS - 1; i++) {
+		if (usec < ((uint64_t) ACM_LAT_MIN_US << i))
+			break;
+	}
+	atomic_inc(&ep->lat_hist[hist][i]);
+}
+
 static struct acmp_request *acmp_alloc_req(uint64_t id, struct acm_msg *msg)
 {
 	struct acmp_request *req;
@@ -412,6 +488,7 @@ static struct acmp_request *acmp_alloc_req(uint64_t id, struct acm_msg *msg)
 	}
 
 	req->id = id;
+	req->start = time_stamp_us();
 	memcpy(&req->msg, msg, sizeof(req->msg));
 	acm_log(2, "id %" PRIu64 ", req %p\n", id, req);
 	return req;
@@ -785,42 +862,58 @@ static void acmp_init_path_query(struct ib_sa_mad *mad)
 	mad->attr_id = IB_SA_ATTR_PATH_REC;
 }
 
-/* Caller must hold dest lock */
-static uint8_t acmp_resolve_path_sa(struct acmp_ep *ep, struct acmp_dest *dest,
-				    void (*handler)(struct acm_sa_mad *))
+static uint8_t acmp_send_path_sa(struct acmp_ep *ep, struct acmp_dest *dest,
+				 struct ibv_path_record *path,
+				 void (*handler)(struct acm_sa_mad *))
 {
+	struct acmp_route_query *query;
 	struct ib_sa_mad *mad;
-	uint8_t ret;
 	struct acm_sa_mad *sa_mad;
 
-	acm_log(2, "%s\n", dest->name);
+	query = malloc(sizeof(*query));
+	if (!query) {
+		acm_log(0, "Error - failed to allocate route query\n");
+		return ACM_STATUS_ENOMEM;
+	}
+	query->dest = dest;
 
-	sa_mad = acm_alloc_sa_mad(ep->endpoint, dest, handler);
+	sa_mad = acm_alloc_sa_mad(ep->endpoint, query, handler);
 	if (!sa_mad) {
 		acm_log(0, "Error - failed to allocate sa_mad\n");
-		ret = ACM_STATUS_ENOMEM;
-		goto err;
+		free(query);
+		return ACM_STATUS_ENOMEM;
 	}
 
 	mad = (struct ib_sa_mad *) &sa_mad->sa_mad;
 	acmp_init_path_query(mad);
 
-	memcpy(mad->data, &dest->path, sizeof(dest->path));
-	mad->comp_mask = acm_path_comp_mask(&dest->path);
+	memcpy(mad->data, path, sizeof(*path));
+	mad->comp_mask = acm_path_comp_mask(path);
 
 	acm_increment_counter(ACM_CNTR_ROUTE_QUERY);
 	atomic_inc(&ep->counters[ACM_CNTR_ROUTE_QUERY]);
-	dest->state = ACMP_QUERY_ROUTE;
+	query->start = time_stamp_us();
 	if (acm_send_sa_mad(sa_mad)) {
 		acm_log(0, "Error - Failed to send sa mad\n");
-		ret = ACM_STATUS_ENODATA;
-		goto free_mad;
+		acm_free_sa_mad(sa_mad);
+		free(query);
+		return ACM_STATUS_ENODATA;
 	}
 	return ACM_STATUS_SUCCESS;
-free_mad:
-	acm_free_sa_mad(sa_mad);
-err:
-	dest->state = ACMP_INIT;
+}
+
+/* Caller must hold dest lock */
+static uint8_t acmp_resolve_path_sa(struct acmp_ep *ep, struct acmp_dest *dest,
+				    void (*handler)(struct acm_sa_mad *))
+{
+	uint8_t ret;
+
+	acm_log(2, "%s\n", dest->name);
+
+	dest->state = ACMP_QUERY_ROUTE;
+	ret = acmp_send_path_sa(ep, dest, &dest->path, handler);
+	if (ret)
+		dest->state = ACMP_INIT;
 	return ret;
 }
 
@@ -926,7 +1019,7 @@ acmp_send_addr_resp(struct acmp_ep *ep, struct acmp_dest *dest)
 
 static int
 acmp_resolve_response(uint64_t id, struct acm_msg *req_msg,
-		      struct acmp_dest *dest, uint8_t status)
+		      struct acmp_dest *dest, uint8_t status, uint64_t start)
 {
 	struct acm_msg msg;
 
@@ -934,6 +1027,7 @@ acmp_resolve_response(uint64_t id, struct acm_msg *req_msg,
 	memset(&msg, 0, sizeof msg);
 
 	if (dest) {
+		acmp_record_latency(dest->ep, ACM_LAT_RESOLVE, start);
 		if (status == ACM_STATUS_ENODATA)
 			atomic_inc(&dest->ep->counters[ACM_CNTR_NODATA]);
 		else if (status)
@@ -973,7 +1067,8 @@ acmp_complete_queued_req(struct acmp_dest *dest, uint8_t status)
 		pthread_mutex_unlock(&dest->lock);
 
 		acm_log(2, "completing request, client %" PRIu64 "\n", req->id);
-		acmp_resolve_response(req->id, &req->msg, dest, status);
+		acmp_resolve_response(req->id, &req->msg, dest, status,
+				      req->start);
 		acmp_free_req(req);
 
 		pthread_mutex_lock(&dest->lock);
@@ -984,7 +1079,8 @@ acmp_complete_queued_req(struct acmp_dest *dest, uint8_t status)
 static void
 acmp_dest_sa_resp(struct acm_sa_mad *mad)
 {
-	struct acmp_dest *dest = (struct acmp_dest *) mad->context;
+	struct acmp_route_query *query = mad->context;
+	struct acmp_dest *dest = query->dest;
 	struct ib_sa_mad *sa_mad = (struct ib_sa_mad *) &mad->sa_mad;
 	uint8_t status;
 
@@ -1001,6 +1097,7 @@ acmp_dest_sa_resp(struct acm_sa_mad *mad)
 		pthread_mutex_unlock(&dest->lock);
 		goto out;
 	}
+	acmp_record_latency(dest->ep, ACM_LAT_ROUTE, query->start);
 
 	if (!status) {
 		memcpy(&dest->path, sa_mad->data, sizeof(dest->path));
@@ -1018,12 +1115,14 @@ acmp_dest_sa_resp(struct acm_sa_mad *mad)
 	acmp_complete_queued_req(dest, status);
 out:
 	acm_free_sa_mad(mad);
+	free(query);
 }
 
 static void
 acmp_resolve_sa_resp(struct acm_sa_mad *mad)
 {
-	struct acmp_dest *dest = (struct acmp_dest *) mad->context;
+	struct acmp_route_query *query = mad->context;
+	struct acmp_dest *dest = query->dest;
 	int send_resp;
 
 	acm_log(2, "\n");
@@ -1037,6 +1136,58 @@ acmp_resolve_sa_resp(struct acm_sa_mad *mad)
 		acmp_send_addr_resp(dest->ep, dest);
 }
 
+/*
+ * LID and GID destinations are named by their path, so a fresh path
+ * record is also a fresh address.
+ */
+static int acmp_addr_in_path(struct acmp_dest *dest)
+{
+	return dest->addr_type == ACM_ADDRESS_LID ||
+	       dest->addr_type == ACM_ADDRESS_GID;
+}
+
+/*
+ * Completion of a refresh-ahead path query.  The record stays READY while
+ * the query is outstanding, so clients continue to be served from the
+ * cache.  On failure the record is left to expire normally.
+ */
+static void
+acmp_dest_refresh_resp(struct acm_sa_mad *mad)
+{
+	struct acmp_route_query *query = mad->context;
+	struct acmp_dest *dest = query->dest;
+	struct ib_sa_mad *sa_mad = (struct ib_sa_mad *) &mad->sa_mad;
+	uint8_t status;
+
+	if (!mad->umad.status)
+		status = (uint8_t) (be16toh(sa_mad->status) >> 8);
+	else
+		status = ACM_STATUS_ETIMEDOUT;
+
+	pthread_mutex_lock(&dest->lock);
+	if (dest->state == ACMP_READY)
+		acmp_record_latency(dest->ep, ACM_LAT_ROUTE, query->start);
+	if (!status && dest->state == ACMP_READY) {
+		memcpy(&dest->path, sa_mad->data, sizeof(dest->path));
+		acmp_init_path_av(dest->ep->port, dest);
+		dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
+		if (acmp_addr_in_path(dest))
+			dest->addr_timeout = time_stamp_min() +
+					     (unsigned) addr_timeout;
+		acm_log(2, "%s refreshed, route timeout %" PRIu64 "\n",
+			dest->name, dest->route_timeout);
+	} else {
+		acm_log(1, "notice - refresh of %s failed, status 0x%x\n",
+			dest->name, status);
+	}
+	dest->refreshing--;
+	pthread_mutex_unlock(&dest->lock);
+
+	acm_free_sa_mad(mad);
+	free(query);
+	acmp_put_dest(dest);
+}
+
 static struct acmp_addr *
 acmp_addr_lookup(struct acmp_ep *ep, uint8_t *addr, uint16_t type)
 {
@@ -1084,6 +1235,10 @@ acmp_process_addr_req(struct acmp_ep *ep, struct ibv_wc *wc, struct acm_mad *mad
 		dest->req_id = mad->tid;
 
 	pthread_mutex_lock(&dest->lock);
+	if (addr && !dest->saddr.type) {
+		dest->saddr.type = addr->type;
+		dest->saddr.info = addr->info;
+	}
 	acm_log(2, "dest state %d\n", dest->state);
 	switch (dest->state) {
 	case ACMP_READY:
@@ -1144,6 +1299,7 @@ acmp_process_addr_resp(struct acmp_send_msg *msg, struct ibv_wc *wc, struct acm_
 		pthread_mutex_unlock(&dest->lock);
 		goto put;
 	}
+	acmp_record_latency(msg->ep, ACM_LAT_ADDR, msg->start);
 
 	if (!status) {
 		status = acmp_record_acm_addr(msg->ep, dest, wc, resp_rec);
@@ -1168,6 +1324,71 @@ put:
 	acmp_put_dest(dest);
 }
 
+/*
+ * Completion of a refresh-ahead address query.  If the remote service
+ * answers from the same port and QP the record just gets a new lease.
+ * If it moved, the record is resolved again as for a new destination,
+ * and clients queue behind the route query until it completes.
+ */
+static void
+acmp_process_addr_refresh(struct acmp_send_msg *msg, struct ibv_wc *wc,
+			  struct acm_mad *mad)
+{
+	struct acm_resolve_rec *resp_rec;
+	struct acmp_dest *dest = (struct acmp_dest *) msg->context;
+	union ibv_gid *sgid;
+	uint8_t status;
+
+	status = mad ? acm_class_status(mad->status) : ACM_STATUS_ETIMEDOUT;
+	acm_log(2, "%s resp status 0x%x\n", dest->name, status);
+
+	pthread_mutex_lock(&dest->lock);
+	dest->refreshing--;
+	if (dest->state == ACMP_READY)
+		acmp_record_latency(msg->ep, ACM_LAT_ADDR, msg->start);
+	if (status || dest->state != ACMP_READY) {
+		if (status)
+			acm_log(1, "notice - refresh of %s failed, status 0x%x\n",
+				dest->name, status);
+		pthread_mutex_unlock(&dest->lock);
+		goto put;
+	}
+
+	sgid = &((struct ibv_grh *) (uintptr_t) wc->wr_id)->sgid;
+	if (dest->remote_qpn == wc->src_qp && dest->av.dlid == wc->slid &&
+	    !memcmp(&dest->av.grh.dgid, sgid, sizeof(*sgid))) {
+		dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
+		if (route_prot == ACMP_ROUTE_PROT_ACM)
+			dest->route_timeout = time_stamp_min() +
+					      (unsigned) route_timeout;
+		acm_log(2, "%s refreshed, addr timeout %" PRIu64 "\n",
+			dest->name, dest->addr_timeout);
+		pthread_mutex_unlock(&dest->lock);
+		goto put;
+	}
+
+	acm_log(2, "%s moved, resolving again\n", dest->name);
+	resp_rec = (struct acm_resolve_rec *) mad->data;
+	status = acmp_record_acm_addr(msg->ep, dest, wc, resp_rec);
+	if (!status) {
+		if (route_prot == ACMP_ROUTE_PROT_ACM) {
+			status = acmp_record_acm_route(msg->ep, dest);
+		} else {
+			status = acmp_resolve_path_sa(msg->ep, dest,
+						      acmp_dest_sa_resp);
+			if (!status) {
+				pthread_mutex_unlock(&dest->lock);
+				goto put;
+			}
+		}
+	}
+	pthread_mutex_unlock(&dest->lock);
+
+	acmp_complete_queued_req(dest, status);
+put:
+	acmp_put_dest(dest);
+}
+
 static void acmp_process_acm_recv(struct acmp_ep *ep, struct ibv_wc *wc, struct acm_mad *mad)
 {
 	struct acmp_send_msg *req;
@@ -1228,6 +1449,7 @@ acmp_sa_resp(struct acm_sa_mad *mad)
 
 	if (req->msg.hdr.status)
 		atomic_inc(&req->ep->counters[ACM_CNTR_ERROR]);
+	acmp_record_latency(req->ep, ACM_LAT_QUERY, req->start);
 	acm_query_response(req->id, &req->msg);
 	acm_free_sa_mad(mad);
 	acmp_free_req(req);
@@ -1590,6 +1812,139 @@ static void *acmp_retry_handler(void *context)
 	return NULL;
 }
 
+static uint8_t
+acmp_send_resolve(struct acmp_ep *ep, struct acmp_dest *dest,
+	struct acm_ep_addr_data *saddr,
+	void (*resp_handler)(struct acmp_send_msg *req,
+		struct ibv_wc *wc, struct acm_mad *resp));
+
+/* Caller must hold dest lock */
+static uint8_t acmp_refresh_path_sa(struct acmp_ep *ep, struct acmp_dest *dest)
+{
+	struct ibv_path_record path;
+
+	memset(&path, 0, sizeof(path));
+	path.sgid = dest->path.sgid;
+	path.dgid = dest->path.dgid;
+	path.slid = dest->path.slid;
+	path.pkey = dest->path.pkey;
+	path.reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
+
+	acm_log(2, "%s\n", dest->name);
+	return acmp_send_path_sa(ep, dest, &path, acmp_dest_refresh_resp);
+}
+
+/* Caller must hold dest lock */
+static void acmp_refresh_dest(struct acmp_ep *ep, struct acmp_dest *dest,
+			      uint64_t deadline)
+{
+	int addr_due, route_due, can_query_addr;
+
+	addr_due = dest->addr_timeout <= deadline;
+	route_due = dest->route_timeout <= deadline;
+	can_query_addr = dest->saddr.type && !acmp_addr_in_path(dest);
+
+	/* An ACM route comes with the address, so refresh both at once */
+	if (route_prot == ACMP_ROUTE_PROT_ACM) {
+		addr_due |= route_due;
+		route_due = 0;
+	} else if (addr_due && acmp_addr_in_path(dest)) {
+		route_due = 1;
+	}
+
+	if (addr_due && can_query_addr &&
+	    !acmp_send_resolve(ep, dest, &dest->saddr,
+			       acmp_process_addr_refresh))
+		dest->refreshing++;
+
+	if (route_due && route_prot == ACMP_ROUTE_PROT_SA) {
+		(void) atomic_inc(&dest->refcnt);
+		if (!acmp_refresh_path_sa(ep, dest))
+			dest->refreshing++;
+		else
+			(void) atomic_dec(&dest->refcnt);
+	}
+}
+
+/*
+ * Refresh records that have been used since they were last resolved and
+ * whose address or route lease runs out within refresh_ahead minutes,
+ * whichever comes first, so that a destination in steady use never
+ * expires in front of a client.  Addresses are re-resolved with an ACM
+ * query, routes with an SA path query.  Records that were not used, and
+ * addresses learned from a hosts file, are left to expire.
+ */
+static void acmp_refresh_ep(struct acmp_ep *ep, uint64_t now)
+{
+	struct list_head refresh_list;
+	struct acmp_dest *dest;
+	uint64_t deadline;
+
+	/* The scan runs once a minute; the extra minute covers its drift */
+	deadline = now + (unsigned) refresh_ahead + 1;
+
+	list_head_init(&refresh_list);
+
+	pthread_mutex_lock(&ep->lock);
+	list_for_each(&ep->dest_lru, dest, lru_entry) {
+		if (!dest->hits || dest->state != ACMP_READY)
+			continue;
+
+		if (min(dest->addr_timeout, dest->route_timeout) > deadline)
+			continue;
+
+		dest->hits = 0;
+		(void) atomic_inc(&dest->refcnt);
+		list_add_tail(&refresh_list, &dest->refresh_entry);
+	}
+	pthread_mutex_unlock(&ep->lock);
+
+	while ((dest = list_pop(&refresh_list, struct acmp_dest, refresh_entry))) {
+		pthread_mutex_lock(&dest->lock);
+		if (!dest->refreshing && dest->state == ACMP_READY)
+			acmp_refresh_dest(ep, dest, deadline);
+		pthread_mutex_unlock(&dest->lock);
+		acmp_put_dest(dest);
+	}
+}
+
+static void *acmp_refresh_handler(void *context)
+{
+	struct acmp_device *dev;
+	struct acmp_port *port;
+	struct acmp_ep *ep;
+	uint64_t now;
+	int i;
+
+	acm_log(0, "started\n");
+	while (1) {
+		sleep(60);
+
+		now = time_stamp_min();
+		pthread_mutex_lock(&acmp_dev_lock);
+		list_for_each(&acmp_dev_list, dev, entry) {
+			pthread_mutex_unlock(&acmp_dev_lock);
+
+			for (i = 0; i < dev->port_cnt; i++) {
+				port = &dev->port[i];
+
+				pthread_mutex_lock(&port->lock);
+				list_for_each(&port->ep_list, ep, entry) {
+					pthread_mutex_unlock(&port->lock);
+					if (ep->state == ACMP_READY)
+						acmp_refresh_ep(ep, now);
+					pthread_mutex_lock(&port->lock);
+				}
+				pthread_mutex_unlock(&port->lock);
+			}
+			pthread_mutex_lock(&acmp_dev_lock);
+		}
+		pthread_mutex_unlock(&acmp_dev_lock);
+	}
+
+	return NULL;
+}
+
 static int
 acmp_query(void *addr_context, struct acm_msg *msg, uint64_t id)
 {
@@ -1651,7 +2006,9 @@ resp:
 
 static uint8_t
 acmp_send_resolve(struct acmp_ep *ep, struct acmp_dest *dest,
-	struct acm_ep_addr_data *saddr)
+	struct acm_ep_addr_data *saddr,
+	void (*resp_handler)(struct acmp_send_msg *req,
+		struct ibv_wc *wc, struct acm_mad *resp))
 {
 	struct acmp_send_msg *msg;
 	struct acm_mad *mad;
@@ -1665,7 +2022,7 @@ acmp_send_resolve(struct acmp_ep *ep, struct acmp_dest *dest,
 		return ACM_STATUS_ENOMEM;
 	}
 
-	acmp_init_send_req(msg, (void *) dest, acmp_process_addr_resp);
+	acmp_init_send_req(msg, (void *) dest, resp_handler);
 	(void) atomic_inc(&dest->refcnt);
 
 	mad = (struct acm_mad *) msg->data;
@@ -1690,6 +2047,7 @@ acmp_send_resolve(struct acmp_ep *ep, struct acmp_dest *dest,
 
 	acm_increment_counter(ACM_CNTR_ADDR_QUERY);
 	atomic_inc(&ep->counters[ACM_CNTR_ADDR_QUERY]);
+	msg->start = time_stamp_us();
 	acmp_post_send(&ep->resolve_queue, msg);
 	return 0;
 }
@@ -1799,6 +2157,7 @@ acmp_resolve_dest(struct acmp_ep *ep, struct acm_msg *msg, uint64_t id)
 {
 	struct acmp_dest *dest;
 	struct acm_ep_addr_data *saddr, *daddr;
+	uint64_t start = time_stamp_us();
 	uint8_t status;
 	int ret;
 
@@ -1812,10 +2171,11 @@ acmp_resolve_dest(struct acmp_ep *ep, struct acm_msg *msg, uint64_t id)
 	if (!dest) {
 		acm_log(0, "ERROR - unable to allocate destination in request\n");
 		atomic_inc(&ep->counters[ACM_CNTR_ERROR]);
-		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENOMEM);
+		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENOMEM, 0);
 	}
 
 	pthread_mutex_lock(&dest->lock);
+	dest->saddr = *saddr;
 test:
 	switch (dest->state) {
 	case ACMP_READY:
@@ -1838,7 +2198,8 @@ test:
 		goto queue;
 	case ACMP_INIT:
 		acm_log(2, "sending resolve msg to dest\n");
-		status = acmp_send_resolve(ep, dest, saddr);
+		status = acmp_send_resolve(ep, dest, saddr,
+					   acmp_process_addr_resp);
 		if (status) {
 			break;
 		}
@@ -1860,7 +2221,7 @@ queue:
 		goto put;
 	}
 	pthread_mutex_unlock(&dest->lock);
-	ret = acmp_resolve_response(id, msg, dest, status);
+	ret = acmp_resolve_response(id, msg, dest, status, start);
 put:
 	acmp_put_dest(dest);
 	return ret;
@@ -1871,6 +2232,7 @@ acmp_resolve_path(struct acmp_ep *ep, struct acm_msg *msg, uint64_t id)
 {
 	struct acmp_dest *dest;
 	struct ibv_path_record *path;
+	uint64_t start = time_stamp_us();
 	uint8_t *addr;
 	uint8_t status;
 	int ret;
@@ -1888,7 +2250,7 @@ acmp_resolve_path(struct acmp_ep *ep, struct acm_msg *msg, uint64_t id)
 	if (!dest) {
 		acm_log(0, "ERROR - unable to allocate destination in request\n");
 		atomic_inc(&ep->counters[ACM_CNTR_ERROR]);
-		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENOMEM);
+		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENOMEM, 0);
 	}
 
 	pthread_mutex_lock(&dest->lock);
@@ -1928,7 +2290,7 @@ test:
 		goto put;
 	}
 	pthread_mutex_unlock(&dest->lock);
-	ret = acmp_resolve_response(id, msg, dest, status);
+	ret = acmp_resolve_response(id, msg, dest, status, start);
 put:
 	acmp_put_dest(dest);
 	return ret;
@@ -1942,7 +2304,7 @@ acmp_resolve(void *addr_context, struct acm_msg *msg, uint64_t id)
 
 	if (ep->state != ACMP_READY) {
 		atomic_inc(&ep->counters[ACM_CNTR_NODATA]);
-		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENODATA);
+		return acmp_resolve_response(id, msg, NULL, ACM_STATUS_ENODATA, 0);
 	}
 
 	atomic_inc(&ep->counters[ACM_CNTR_RESOLVE]);
@@ -1955,11 +2317,16 @@ acmp_resolve(void *addr_context, struct acm_msg *msg, uint64_t id)
 static void acmp_query_perf(void *ep_context, uint64_t *values, uint8_t *cnt)
 {
 	struct acmp_ep *ep = ep_context;
-	int i;
+	int i, j;
 
 	for (i = 0; i < ACM_MAX_COUNTER; i++)
 		values[i] = htobe64((uint64_t) atomic_get(&ep->counters[i]));
-	*cnt = ACM_MAX_COUNTER;
+	for (i = 0; i < ACM_MAX_LAT_HIST; i++) {
+		for (j = 0; j < ACM_LAT_BUCKETS; j++)
+			values[ACM_MAX_COUNTER + i * ACM_LAT_BUCKETS + j] =
+				htobe64((uint64_t) atomic_get(&ep->lat_hist[i][j]));
+	}
+	*cnt = ACM_MAX_PERF_DATA;
 }
 
 static enum acmp_addr_prot acmp_convert_addr_prot(char *param)
@@ -2038,154 +2405,360 @@ err:
 	return -1;
 }
 
-/* Parse "opensm full v1" file to build LID to GUID table */
-static void acmp_parse_osm_fullv1_lid2guid(FILE *f, __be64 *lid2guid)
+/*
+ * The "opensm full v1" route file is read into memory once and indexed by
+ * LID, so each endpoint only walks the section that describes its own
+ * port.  The copy is shared by all endpoints.  It is read again when the
+ * file's identity, size or mtime changes, and the previous copy is kept
+ * if the new one cannot be loaded.  Endpoints parse it under
+ * route_map_lock, so a reload never frees a copy that is in use.
+ */
+struct acmp_route_map {
+	char		*data;
+	size_t		len;
+	__be64		*lid2guid;
+	uint32_t	*lid2sect;	/* offset of the first path line + 1 */
+	dev_t		dev;
+	ino_t		ino;
+	off_t		size;
+	struct timespec	mtime;
+};
+
+static struct acmp_route_map route_map;
+static pthread_mutex_t route_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *
+acmp_osm_next_line(const char *pos, const char *end, const char **eol)
 {
-	char s[128];
-	char *p, *ptr, *p_guid, *p_lid;
-	uint64_t guid;
-	uint16_t lid;
+	const char *nl;
 
-	while (fgets(s, sizeof s, f)) {
-		if (s[0] == '#')
-			continue;
-		if (!(p = strtok_r(s, " \n", &ptr)))
-			continue;	/* ignore blank lines */
+	nl = memchr(pos, '\n', end - pos);
+	*eol = nl ? nl : end;
+	return nl ? nl + 1 : end;
+}
 
-		if (strncmp(p, "Switch", sizeof("Switch") - 1) &&
-		    strncmp(p, "Channel", sizeof("Channel") - 1) &&
-		    strncmp(p, "Router", sizeof("Router") - 1))
-			continue;
+static const char *acmp_osm_skip_ws(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	return p;
+}
+
+/* strtoull(p, NULL, 0) without the locale and errno overhead */
+static const char *
+acmp_osm_parse_num(const char *p, const char *end, uint64_t *val)
+{
+	const char *start;
+	uint64_t v = 0;
+	int base = 10, d;
+
+	p = acmp_osm_skip_ws(p, end);
+	if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		base = 16;
+		p += 2;
+	}
+
+	for (start = p; p < end; p++) {
+		if (*p >= '0' && *p <= '9')
+			d = *p - '0';
+		else if (base == 16 && *p >= 'a' && *p <= 'f')
+			d = *p - 'a' + 10;
+		else if (base == 16 && *p >= 'A' && *p <= 'F')
+			d = *p - 'A' + 10;
+		else
+			break;
+		v = v * base + d;
+	}
+
+	*val = v;
+	return p == start ? NULL : p;
+}
+
+static int acmp_osm_match(const char *p, const char *end, const char *word,
+			  size_t len)
+{
+	return (size_t) (end - p) >= len && !memcmp(p, word, len);
+}
+
+/*
+ * Parse a port header line:
+ *   Channel Adapter 0x0002c903000e0b72, base LID 1, LMC 0, port 1
+ *   Switch 0x0002c903000e0b70, base LID 2, LMC 0, port 0
+ * Returns 1 for a port header, 0 for any other line.
+ */
+static int acmp_osm_parse_port(const char *p, const char *end,
+			       uint64_t *guid, uint16_t *lid)
+{
+	uint64_t val;
+
+	if (acmp_osm_match(p, end, "Channel Adapter ", 16))
+		p += 16;
+	else if (acmp_osm_match(p, end, "Switch ", 7))
+		p += 7;
+	else if (acmp_osm_match(p, end, "Router ", 7))
+		p += 7;
+	else
+		return 0;
+
+	p = acmp_osm_parse_num(p, end, guid);
+	if (!p)
+		return -1;
+
+	for (; p < end; p++) {
+		if (acmp_osm_match(p, end, "base LID", 8))
+			break;
+	}
+	if (p == end || !acmp_osm_parse_num(p + 8, end, &val))
+		return -1;
+
+	*lid = (uint16_t) val;
+	return 1;
+}
+
+/*
+ * Parse a path line:
+ *   0x0001 : 0 : 4 : 3
+ *   0x0005 : UNREACHABLE
+ */
+static int acmp_osm_parse_path(const char *p, const char *end, uint16_t *dlid,
+			       int *sl, int *mtu, int *rate)
+{
+	uint64_t val[4];
+	int i;
 
-		if (!strncmp(p, "Channel", sizeof("Channel") - 1)) {
-			p = strtok_r(NULL, " ", &ptr); /* skip 'Adapter' */
-			if (!p)
-				continue;
+	for (i = 0; i < 4; i++) {
+		if (i) {
+			p = acmp_osm_skip_ws(p, end);
+			if (p == end || *p++ != ':')
+				return -1;
 		}
+		p = acmp_osm_parse_num(p, end, &val[i]);
+		if (!p)
+			return -1;
+	}
 
-		p_guid = strtok_r(NULL, ",", &ptr);
-		if (!p_guid)
-			continue;
+	*dlid = (uint16_t) val[0];
+	*sl = (int) val[1];
+	*mtu = (int) val[2];
+	*rate = (int) val[3];
+	return 0;
+}
+
+/* Single pass over the file to build the LID to GUID and section tables */
+static void acmp_index_osm_fullv1(struct acmp_route_map *map)
+{
+	const char *pos, *eol, *end = map->data + map->len;
+	uint64_t guid;
+	uint16_t lid;
 
-		guid = (uint64_t) strtoull(p_guid, NULL, 16);
+	for (pos = map->data; pos < end; ) {
+		const char *line = pos;
 
-		ptr = strstr(ptr, "base LID");
-		if (!ptr)
+		pos = acmp_osm_next_line(pos, end, &eol);
+		if (line == eol || *line == '#')
 			continue;
-		ptr += sizeof("base LID");
-		p_lid = strtok_r(NULL, ",", &ptr);
-		if (!p_lid)
+
+		if (acmp_osm_parse_port(line, eol, &guid, &lid) <= 0)
 			continue;
 
-		lid = (uint16_t) strtoul(p_lid, NULL, 0);
 		if (lid >= IB_LID_MCAST_START)
 			continue;
-		if (lid2guid[lid])
+		if (map->lid2guid[lid]) {
 			acm_log(0, "ERROR - duplicate lid %u\n", lid);
-		else
-			lid2guid[lid] = htobe64(guid);
+		} else {
+			map->lid2guid[lid] = htobe64(guid);
+			map->lid2sect[lid] = (uint32_t) (pos - map->data) + 1;
+		}
 	}
 }
 
-/* Parse 'opensm full v1' file to populate PR cache */
-static int acmp_parse_osm_fullv1_paths(FILE *f, __be64 *lid2guid, struct acmp_ep *ep)
+static void acmp_clear_route_map(struct acmp_route_map *map)
 {
-	union ibv_gid sgid, dgid;
-	struct ibv_port_attr attr = {};
-	struct acmp_dest *dest;
-	char s[128];
-	char *p, *ptr, *p_guid, *p_lid;
-	uint64_t guid;
-	uint16_t lid, dlid;
-	__be16 net_dlid;
-	int sl, mtu, rate;
-	int ret = 1, i;
-	uint8_t addr[ACM_MAX_ADDRESS];
-	uint8_t addr_type;
+	free(map->data);
+	free(map->lid2guid);
+	free(map->lid2sect);
+	memset(map, 0, sizeof(*map));
+}
 
-	acm_get_gid((struct acm_port *)ep->port->port, 0, &sgid);
+static int acmp_route_map_current(struct acmp_route_map *map,
+				  struct stat *st)
+{
+	return map->data && map->dev == st->st_dev &&
+	       map->ino == st->st_ino && map->size == st->st_size &&
+	       map->mtime.tv_sec == st->st_mtim.tv_sec &&
+	       map->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
 
-	/* Search for endpoint's SLID */
-	while (fgets(s, sizeof s, f)) {
-		if (s[0] == '#')
-			continue;
-		if (!(p = strtok_r(s, " \n", &ptr)))
-			continue;	/* ignore blank lines */
+/*
+ * A file that shrinks while it is being read only yields a shorter copy;
+ * a torn last line fails to parse and is skipped like any other bad line.
+ */
+static int acmp_load_route_map(struct acmp_route_map *map, int fd,
+			       struct stat *st)
+{
+	ssize_t ret;
 
-		if (strncmp(p, "Switch", sizeof("Switch") - 1) &&
-		    strncmp(p, "Channel", sizeof("Channel") - 1) &&
-		    strncmp(p, "Router", sizeof("Router") - 1))
-			continue;
+	map->data = malloc(st->st_size);
+	map->lid2guid = calloc(IB_LID_MCAST_START, sizeof(*map->lid2guid));
+	map->lid2sect = calloc(IB_LID_MCAST_START, sizeof(*map->lid2sect));
+	if (!map->data || !map->lid2guid || !map->lid2sect) {
+		acm_log(0, "ERROR - no memory for path record parsing\n");
+		goto err;
+	}
 
-		if (!strncmp(p, "Channel", sizeof("Channel") - 1)) {
-			p = strtok_r(NULL, " ", &ptr); /* skip 'Adapter' */
-			if (!p)
-				continue;
+	while (map->len < (size_t) st->st_size) {
+		ret = read(fd, map->data + map->len, st->st_size - map->len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			acm_log(0, "ERROR - couldn't read %s\n", route_data_file);
+			goto err;
 		}
+		if (!ret)
+			break;
+		map->len += ret;
+	}
 
-		p_guid = strtok_r(NULL, ",", &ptr);
-		if (!p_guid)
-			continue;
+	map->dev = st->st_dev;
+	map->ino = st->st_ino;
+	map->size = st->st_size;
+	map->mtime = st->st_mtim;
+	acmp_index_osm_fullv1(map);
+	return 0;
 
-		guid = (uint64_t) strtoull(p_guid, NULL, 16);
-		if (guid != be64toh(sgid.global.interface_id))
-			continue;
+err:
+	acmp_clear_route_map(map);
+	return -1;
+}
 
-		ptr = strstr(ptr, "base LID");
-		if (!ptr)
-			continue;
-		ptr += sizeof("base LID");
-		p_lid = strtok_r(NULL, ",", &ptr);
-		if (!p_lid)
-			continue;
+/*
+ * Returns the route map with route_map_lock held, or NULL with the lock
+ * released.  Release a returned map with acmp_put_route_map().
+ */
+static struct acmp_route_map *acmp_get_route_map(void)
+{
+	struct acmp_route_map map;
+	struct stat st;
+	int fd;
 
-		lid = (uint16_t) strtoul(p_lid, NULL, 0);
-		if (lid != ep->port->lid)
-			continue;
+	pthread_mutex_lock(&route_map_lock);
+	fd = open(route_data_file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		acm_log(0, "ERROR - couldn't open %s\n", route_data_file);
+		goto out;
+	}
 
-		ibv_query_port(ep->port->dev->verbs, ep->port->port_num, &attr);
-		ret = 0;
-		break;
+	if (fstat(fd, &st) || !st.st_size || st.st_size >= UINT32_MAX) {
+		acm_log(0, "ERROR - invalid route file %s\n", route_data_file);
+		goto close;
 	}
 
-	while (fgets(s, sizeof s, f)) {
-		if (s[0] == '#')
-			continue;
-		if (!(p = strtok_r(s, " \n", &ptr)))
-			continue;	/* ignore blank lines */
+	if (acmp_route_map_current(&route_map, &st))
+		goto close;
 
-		if (!strncmp(p, "Switch", sizeof("Switch") - 1) ||
-		    !strncmp(p, "Channel", sizeof("Channel") - 1) ||
-		    !strncmp(p, "Router", sizeof("Router") - 1))
-			break;
+	memset(&map, 0, sizeof(map));
+	if (acmp_load_route_map(&map, fd, &st))
+		goto close;
 
-		dlid = strtoul(p, NULL, 0);
-		net_dlid = htobe16(dlid);
+	if (route_map.data)
+		acm_log(1, "reloaded %s\n", route_data_file);
+	acmp_clear_route_map(&route_map);
+	route_map = map;
+close:
+	close(fd);
+out:
+	if (route_map.data)
+		return &route_map;
 
-		p = strtok_r(NULL, ":", &ptr);
-		if (!p)
-			continue;
-		if (strcmp(p, "UNREACHABLE") == 0)
-			continue;
-		sl = atoi(p);
+	pthread_mutex_unlock(&route_map_lock);
+	return NULL;
+}
 
-		p = strtok_r(NULL, ":", &ptr);
-		if (!p)
+static void acmp_put_route_map(struct acmp_route_map *map)
+{
+	pthread_mutex_unlock(&route_map_lock);
+}
+
+static void acmp_free_route_map(void)
+{
+	pthread_mutex_lock(&route_map_lock);
+	acmp_clear_route_map(&route_map);
+	pthread_mutex_unlock(&route_map_lock);
+}
+
+/* Caller must hold ep lock. */
+static struct acmp_dest *
+acmp_preload_dest(struct acmp_ep *ep, uint8_t addr_type, const uint8_t *addr)
+{
+	struct acmp_dest *dest, **tdest;
+
+	tdest = tsearch(addr, &ep->dest_map[addr_type - 1], acmp_compare_dest);
+	if (!tdest)
+		return NULL;
+
+	if (*tdest != (void *) addr)
+		return *tdest;
+
+	dest = acmp_alloc_dest(addr_type, addr);
+	if (!dest) {
+		tdelete(addr, &ep->dest_map[addr_type - 1], acmp_compare_dest);
+		return NULL;
+	}
+
+	dest->ep = ep;
+	*tdest = dest;
+	acmp_insert_dest(ep, dest);
+	return dest;
+}
+
+/* Parse the endpoint's section of the 'opensm full v1' file to populate PR cache */
+static int acmp_parse_osm_fullv1_paths(struct acmp_route_map *map,
+				       struct acmp_ep *ep)
+{
+	union ibv_gid sgid, dgid;
+	struct ibv_port_attr attr = {};
+	struct acmp_dest *dest;
+	const char *pos, *eol, *end = map->data + map->len;
+	uint64_t guid, now;
+	uint16_t lid, dlid;
+	__be16 net_dlid;
+	int sl, mtu, rate;
+	int i, cnt = 0;
+	uint8_t addr[ACM_MAX_ADDRESS];
+	uint8_t addr_type;
+
+	acm_get_gid((struct acm_port *)ep->port->port, 0, &sgid);
+
+	lid = ep->port->lid;
+	if (lid >= IB_LID_MCAST_START || !map->lid2sect[lid] ||
+	    map->lid2guid[lid] != sgid.global.interface_id)
+		return 1;
+
+	ibv_query_port(ep->port->dev->verbs, ep->port->port_num, &attr);
+	now = time_stamp_min();
+
+	pthread_mutex_lock(&ep->lock);
+	for (pos = map->data + map->lid2sect[lid] - 1; pos < end; ) {
+		const char *line = pos;
+
+		pos = acmp_osm_next_line(pos, end, &eol);
+		if (line == eol || *line == '#')
 			continue;
-		mtu = atoi(p);
 
-		p = strtok_r(NULL, ":", &ptr);
-		if (!p)
+		if (acmp_osm_parse_port(line, eol, &guid, &dlid))
+			break;
+
+		if (acmp_osm_parse_path(line, eol, &dlid, &sl, &mtu, &rate))
 			continue;
-		rate = atoi(p);
 
-		if (!lid2guid[dlid]) {
+		if (dlid >= IB_LID_MCAST_START || !map->lid2guid[dlid]) {
 			acm_log(0, "ERROR - dlid %u not found in lid2guid table\n", dlid);
 			continue;
 		}
 
+		net_dlid = htobe16(dlid);
 		dgid.global.subnet_prefix = sgid.global.subnet_prefix;
-		dgid.global.interface_id = lid2guid[dlid];
+		dgid.global.interface_id = map->lid2guid[dlid];
 
 		for (i = 0; i < 2; i++) {
 			memset(addr, 0, ACM_MAX_ADDRESS);
@@ -2196,7 +2769,7 @@ static int acmp_parse_osm_fullv1_paths(FILE *f, __be64 *lid2guid, struct acmp_ep
 				addr_type = ACM_ADDRESS_GID;
 				memcpy(addr, &dgid, sizeof(dgid));
 			}
-			dest = acmp_acquire_dest(ep, addr_type, addr);
+			dest = acmp_preload_dest(ep, addr_type, addr);
 			if (!dest) {
 				acm_log(0, "ERROR - unable to create dest\n");
 				break;
@@ -2217,41 +2790,32 @@ static int acmp_parse_osm_fullv1_paths(FILE *f, __be64 *lid2guid, struct acmp_ep
 				dest->route_timeout = (uint64_t)~0ULL;
 			} else {
 				dest->path.packetlifetime = attr.subnet_timeout;
-				dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
-				dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
+				dest->addr_timeout = now + (unsigned) addr_timeout;
+				dest->route_timeout = now + (unsigned) route_timeout;
 			}
 			dest->remote_qpn = 1;
 			dest->state = ACMP_READY;
-			acmp_put_dest(dest);
 			acm_log(1, "added cached dest %s\n", dest->name);
+			cnt++;
 		}
 	}
-	return ret;
+	pthread_mutex_unlock(&ep->lock);
+
+	acm_log(1, "%s: preloaded %d cached dests\n", ep->id_string, cnt);
+	return 0;
 }
 
 static int acmp_parse_osm_fullv1(struct acmp_ep *ep)
 {
-	FILE *f;
-	__be64 *lid2guid;
-	int ret = 1;
-
-	if (!(f = fopen(route_data_file, "r"))) {
-		acm_log(0, "ERROR - couldn't open %s\n", route_data_file);
-		return ret;
-	}
+	struct acmp_route_map *map;
+	int ret;
 
-	lid2guid = calloc(IB_LID_MCAST_START, sizeof(*lid2guid));
-	if (!lid2guid) {
-		acm_log(0, "ERROR - no memory for path record parsing\n");
-		goto err;
-	}
+	map = acmp_get_route_map();
+	if (!map)
+		return 1;
 
-	acmp_parse_osm_fullv1_lid2guid(f, lid2guid);
-	rewind(f);
-	ret = acmp_parse_osm_fullv1_paths(f, lid2guid, ep);
-	free(lid2guid);
-err:
-	fclose(f);
+	ret = acmp_parse_osm_fullv1_paths(map, ep);
+	acmp_put_route_map(map);
 	return ret;
 }
 
@@ -2483,7 +3047,7 @@ static struct acmp_ep *
 acmp_alloc_ep(struct acmp_port *port, struct acm_endpoint *endpoint)
 {
 	struct acmp_ep *ep;
-	int i;
+	int i, j;
 
 	acm_log(1, "\n");
 	ep = calloc(1, sizeof *ep);
@@ -2499,11 +3063,16 @@ acmp_alloc_ep(struct acmp_port *port, struct acm_endpoint *endpoint)
 	list_head_init(&ep->resp_queue.pending);
 	list_head_init(&ep->active_queue);
 	list_head_init(&ep->wait_queue);
+	list_head_init(&ep->dest_lru);
 	pthread_mutex_init(&ep->lock, NULL);
 	sprintf(ep->id_string, "%s-%d-0x%x", port->dev->verbs->device->name,
 		port->port_num, endpoint->pkey);
 	for (i = 0; i < ACM_MAX_COUNTER; i++)
 		atomic_init(&ep->counters[i]);
+	for (i = 0; i < ACM_MAX_LAT_HIST; i++) {
+		for (j = 0; j < ACM_LAT_BUCKETS; j++)
+			atomic_init(&ep->lat_hist[i][j]);
+	}
 
 	return ep;
 }
@@ -2881,6 +3450,10 @@ static void acmp_set_options(void)
 			addr_preload = acmp_convert_addr_preload(value);
 		else if (!strcasecmp("addr_data_file", opt))
 			strcpy(addr_data_file, value);
+		else if (!strcasecmp("refresh_ahead", opt))
+			refresh_ahead = atoi(value);
+		else if (!strcasecmp("dest_cache_max", opt))
+			dest_cache_max = atoi(value);
 	}
 
 	fclose(f);
@@ -2904,6 +3477,8 @@ static void acmp_log_options(void)
 	acm_log(0, "route data file %s\n", route_data_file);
 	acm_log(0, "address preload %d\n", addr_preload);
 	acm_log(0, "address data file %s\n", addr_data_file);
+	acm_log(0, "refresh ahead %d\n", refresh_ahead);
+	acm_log(0, "destination cache max %d\n", dest_cache_max);
 }
 
 static void __attribute__((constructor)) acmp_init(void)
@@ -2926,9 +3501,21 @@ static void __attribute__((constructor)) acmp_init(void)
 		return;
 	}
 
+	if (refresh_ahead > 0) {
+		acm_log(1, "starting refresh-ahead thread\n");
+		if (pthread_create(&refresh_thread_id, NULL,
+				   acmp_refresh_handler, NULL))
+			acm_log(0, "Error: failed to create the refresh thread");
+	}
+
 	acmp_initialized = 1;
 }
 
+static void __attribute__((destructor)) acmp_exit(void)
+{
+	acmp_free_route_map();
+}
+
 int provider_query(struct acm_provider **provider, uint32_t *version)
 {
 	acm_log(1, "\n");
@@ -177,6 +177,21 @@ static void gen_opts_temp(FILE *f)
 	fprintf(f, "\n");
 	fprintf(f, "route_timeout -1\n");
 	fprintf(f, "\n");
+	fprintf(f, "# refresh_ahead:\n");
+	fprintf(f, "# Number of minutes before a cached address or route expires at which\n");
+	fprintf(f, "# it is re-resolved in the background, if it has been used since it was\n");
+	fprintf(f, "# last resolved.  Whichever of addr_timeout and route_timeout runs out\n");
+	fprintf(f, "# first triggers the refresh.  A value of 0 disables background refresh.\n");
+	fprintf(f, "\n");
+	fprintf(f, "refresh_ahead 0\n");
+	fprintf(f, "\n");
+	fprintf(f, "# dest_cache_max:\n");
+	fprintf(f, "# Maximum number of destinations cached per endpoint.  When exceeded,\n");
+	fprintf(f, "# the least recently used destinations are evicted.  A value of 0\n");
+	fprintf(f, "# indicates no limit.\n");
+	fprintf(f, "\n");
+	fprintf(f, "dest_cache_max 0\n");
+	fprintf(f, "\n");
 	fprintf(f, "# loopback_prot:\n");
 	fprintf(f, "# Address and route resolution protocol to resolve local addresses\n");
 	fprintf(f, "# Supported protocols are:\n");
@@ -37,6 +37,7 @@
 #include <errno.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <inttypes.h>
 
 static pthread_mutex_t acm_lock = PTHREAD_MUTEX_INITIALIZER;
 static int sock = -1;
@@ -449,6 +450,37 @@ out:
 }
 
 
+static char lat_name[ACM_MAX_LAT_HIST * ACM_LAT_BUCKETS][32];
+static pthread_once_t lat_name_once = PTHREAD_ONCE_INIT;
+
+static void acm_init_lat_names(void)
+{
+	static const char *const hist_name[] = {
+		[ACM_LAT_RESOLVE]	= "Resolve",
+		[ACM_LAT_QUERY]		= "Query",
+		[ACM_LAT_ADDR]		= "Addr Query",
+		[ACM_LAT_ROUTE]		= "Route Query",
+	};
+	uint64_t bound;
+	char *name;
+	int i, j;
+
+	for (i = 0; i < ACM_MAX_LAT_HIST; i++) {
+		for (j = 0; j < ACM_LAT_BUCKETS; j++) {
+			name = lat_name[i * ACM_LAT_BUCKETS + j];
+			bound = (uint64_t) ACM_LAT_MIN_US << j;
+			if (j == ACM_LAT_BUCKETS - 1)
+				bound >>= 1;
+
+			snprintf(name, sizeof(lat_name[0]), "%s %s%" PRIu64 "%s",
+				 hist_name[i],
+				 j == ACM_LAT_BUCKETS - 1 ? ">=" : "<",
+				 bound < 1000 ? bound : bound / 1000,
+				 bound < 1000 ? "us" : "ms");
+		}
+	}
+}
+
 const char *ib_acm_cntr_name(int index)
 {
 	static const char *const cntr_name[] = {
@@ -461,8 +493,13 @@ const char *ib_acm_cntr_name(int index)
 		[ACM_CNTR_ROUTE_CACHE]	= "Route Cache Count",
 	};
 
-	if (index < ACM_CNTR_ERROR || index > ACM_MAX_COUNTER)
+	if (index < ACM_CNTR_ERROR || index >= ACM_MAX_PERF_DATA)
 		return "Unknown";
 
+	if (index >= ACM_MAX_COUNTER) {
+		pthread_once(&lat_name_once, acm_init_lat_names);
+		return lat_name[index - ACM_MAX_COUNTER];
+	}
+
 	return cntr_name[index];
 }
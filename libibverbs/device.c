@@ -173,6 +173,28 @@ __lib_ibv_create_cq_ex(struct ibv_context *context,
 	return cq;
 }
 
+int verbs_single_threaded(struct ibv_context *context)
+{
+	struct verbs_context *vctx = verbs_get_ctx(context);
+
+	/* Contexts allocated by the provider have no private area */
+	if (!vctx)
+		return verbs_default_single_threaded;
+
+	return vctx->priv->single_threaded;
+}
+
+int ibv_set_single_threaded(struct ibv_context *context, int single_threaded)
+{
+	struct verbs_context *vctx = verbs_get_ctx(context);
+
+	if (!vctx)
+		return EOPNOTSUPP;
+
+	vctx->priv->single_threaded = !!single_threaded;
+	return 0;
+}
+
 struct ibv_context *__ibv_open_device(struct ibv_device *device)
 {
 	struct verbs_device *verbs_device = verbs_get_device(device);
@@ -216,6 +238,7 @@ struct ibv_context *__ibv_open_device(struct ibv_device *device)
 			goto err;
 		}
 
+		priv->single_threaded = verbs_default_single_threaded;
 		context_ex->priv = priv;
 		context_ex->context.abi_compat  = __VERBS_ABI_IS_EXTENDED;
 		context_ex->sz = sizeof(*context_ex);
@@ -249,6 +272,8 @@ struct ibv_context *__ibv_open_device(struct ibv_device *device)
 	context->cmd_fd = cmd_fd;
 	pthread_mutex_init(&context->mutex, NULL);
 
+	verbs_trace_open(context);
+
 	return context;
 
 verbs_err:
@@ -268,6 +293,8 @@ int __ibv_close_device(struct ibv_context *context)
 	struct verbs_context *context_ex;
 	struct verbs_device *verbs_device = verbs_get_device(context->device);
 
+	verbs_trace_close(context);
+
 	context_ex = verbs_get_ctx(context);
 	if (context_ex) {
 		verbs_device->ops->uninit_context(verbs_device, context);
@@ -99,6 +99,25 @@ struct verbs_qp {
 	struct verbs_xrcd       *xrcd;
 };
 
+/*
+ * Providers without a native extended CQ embed struct verbs_cq in place of
+ * struct ibv_cq and set create_cq_ex to verbs_create_cq_ex_emul.  The
+ * ibv_cq_ex polling interface is then served from batches of work
+ * completions returned by the provider's poll_cq.
+ */
+#define VERBS_CQ_EMUL_BATCH 16
+
+struct verbs_cq {
+	union {
+		struct ibv_cq		cq;
+		struct ibv_cq_ex	cq_ex;
+	};
+	pthread_spinlock_t	emul_lock;
+	int			emul_cur;
+	int			emul_cnt;
+	struct ibv_wc		emul_wc[VERBS_CQ_EMUL_BATCH];
+};
+
 /* Must change the PRIVATE IBVERBS_PRIVATE_ symbol if this is changed */
 struct verbs_device_ops {
 	/* Old interface, do not use in new code. */
@@ -119,6 +138,7 @@ struct verbs_device {
 	const struct verbs_device_ops *ops;
 	size_t	sz;
 	size_t	size_of_context;
+	int	numa_node;	/* -1 if the device has no affinity */
 };
 
 static inline struct verbs_device *
@@ -130,9 +150,85 @@ verbs_get_device(const struct ibv_device *dev)
 typedef struct verbs_device *(*verbs_driver_init_func)(const char *uverbs_sys_path,
 						       int abi_version);
 void verbs_register_driver(const char *name, verbs_driver_init_func init_func);
+
+/*
+ * Declares the function that registers a provider.  drv must match the
+ * provider's CMake target name.  Providers listed in STATIC_PROVIDERS are
+ * linked into libibverbs and registered from a table built by CMake, so
+ * they are also pulled into fully static links, the rest are plugins
+ * registered by an ELF constructor when dlopen()ed.
+ */
+#ifdef VERBS_STATIC_PROVIDER
+#define PROVIDER_DRIVER(drv)						\
+	void verbs_provider_##drv##_register(void);			\
+	void verbs_provider_##drv##_register(void)
+#else
+#define PROVIDER_DRIVER(drv)						\
+	static __attribute__((constructor)) void drv##_register_driver(void)
+#endif
 void verbs_init_cq(struct ibv_cq *cq, struct ibv_context *context,
 		       struct ibv_comp_channel *channel,
 		       void *cq_context);
+struct ibv_cq_ex *verbs_create_cq_ex_emul(struct ibv_context *context,
+					  struct ibv_cq_init_attr_ex *cq_attr);
+
+/*
+ * Zeroed, fork()-protected memory for a ring shared with the device,
+ * placed on the device's NUMA node.  length is rounded up to the system
+ * page size and must be passed unchanged to verbs_free_queue_buf().
+ * Returns NULL and sets errno on failure.
+ */
+void *verbs_alloc_queue_buf(struct ibv_device *device, size_t length);
+void verbs_free_queue_buf(void *buf, size_t length);
+/*
+ * Apply the same NUMA placement to a ring the provider mapped itself
+ * (e.g. a SysV hugetlb segment).  Must be called before the pages are
+ * first touched.
+ */
+void verbs_bind_queue_buf(struct ibv_device *device, void *addr,
+			  size_t length);
+
+/*
+ * True if the application promised (RDMAV_SINGLE_THREADED=1 or
+ * ibv_set_single_threaded()) that each object of this context is only
+ * ever used by one thread at a time.  Providers then skip the locks
+ * protecting their QPs, CQs, SRQs and WQs.  Locks on state shared by
+ * the whole context, such as UAR and BlueFlame registers, must still
+ * be taken, and so must any object lock that a verb on a different
+ * object takes, e.g. an SRQ lock taken by poll_cq to free a WQE.
+ */
+int verbs_single_threaded(struct ibv_context *context);
+
+struct verbs_spinlock {
+	pthread_spinlock_t	lock;
+	int			need_lock;
+};
+
+static inline int verbs_spinlock_init(struct verbs_spinlock *lock,
+				      int need_lock)
+{
+	lock->need_lock = need_lock;
+	return pthread_spin_init(&lock->lock, PTHREAD_PROCESS_PRIVATE);
+}
+
+static inline int verbs_spinlock_destroy(struct verbs_spinlock *lock)
+{
+	return pthread_spin_destroy(&lock->lock);
+}
+
+static inline int verbs_spin_lock(struct verbs_spinlock *lock)
+{
+	if (!lock->need_lock)
+		return 0;
+	return pthread_spin_lock(&lock->lock);
+}
+
+static inline int verbs_spin_unlock(struct verbs_spinlock *lock)
+{
+	if (!lock->need_lock)
+		return 0;
+	return pthread_spin_unlock(&lock->lock);
+}
 
 int ibv_cmd_get_context(struct ibv_context *context, struct ibv_get_context *cmd,
 			size_t cmd_size, struct ibv_get_context_resp *resp,
@@ -48,7 +48,7 @@
 #define default_symver(name, api)                                              \
 	asm(".symver " #name "," #api "@@" DEFAULT_ABI)
 #define private_symver(name, api)                                              \
-	asm(".symver " #name "," #api "@@IBVERBS_PRIVATE_14")
+	asm(".symver " #name "," #api "@@IBVERBS_PRIVATE_15")
 
 #define PFX		"libibverbs: "
 
@@ -60,12 +60,37 @@ struct ibv_abi_compat_v2 {
 extern int abi_ver;
 
 int ibverbs_init(struct ibv_device ***list);
+void verbs_register_static_providers(void);
+
+struct verbs_trace_ctx;
 
 struct verbs_ex_private {
 	struct ibv_cq_ex *(*create_cq_ex)(struct ibv_context *context,
 					  struct ibv_cq_init_attr_ex *init_attr);
+	struct verbs_trace_ctx *trace;
+	int single_threaded;
 };
 
+extern int verbs_default_single_threaded;
+
+extern int verbs_mr_cache_enabled;
+
+struct ibv_mr *verbs_reg_mr_uncached(struct ibv_pd *pd, void *addr,
+				     size_t length, int access);
+int verbs_dereg_mr_uncached(struct ibv_mr *mr);
+void verbs_mr_cache_init(void);
+struct ibv_mr *verbs_mr_cache_reg(struct ibv_pd *pd, void *addr,
+				  size_t length, int access);
+int verbs_mr_cache_put(struct ibv_mr *mr);
+int verbs_mr_cache_detach(struct ibv_mr *mr);
+void verbs_mr_cache_flush(struct ibv_pd *pd);
+
+void verbs_queue_buf_init(void);
+
+void verbs_trace_init(void);
+void verbs_trace_open(struct ibv_context *context);
+void verbs_trace_close(struct ibv_context *context);
+
 #define IBV_INIT_CMD(cmd, size, opcode)					\
 	do {								\
 		if (abi_ver > 2)					\
@@ -53,6 +53,7 @@
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
 
 int abi_ver;
+int verbs_default_single_threaded;
 
 struct ibv_sysfs_dev {
 	char		        sysfs_name[IBV_SYSFS_NAME_MAX];
@@ -165,6 +166,15 @@ void verbs_register_driver(const char *name,
 {
 	struct ibv_driver *driver;
 
+	/*
+	 * A provider linked into libibverbs may also be loaded as a shared
+	 * library, e.g. by an application using its direct verbs API; keep
+	 * the first registration.
+	 */
+	for (driver = head_driver; driver; driver = driver->next)
+		if (!strcmp(driver->name, name))
+			return;
+
 	driver = malloc(sizeof *driver);
 	if (!driver) {
 		fprintf(stderr, PFX "Warning: couldn't allocate driver for %s\n", name);
@@ -406,6 +416,12 @@ static struct ibv_device *try_driver(struct ibv_driver *driver,
 		break;
 	}
 
+	if (ibv_read_sysfs_file(sysfs_dev->ibdev_path, "device/numa_node",
+				value, sizeof value) < 0)
+		vdev->numa_node = -1;
+	else
+		vdev->numa_node = strtol(value, NULL, 10);
+
 	strcpy(dev->dev_name,   sysfs_dev->sysfs_name);
 	strcpy(dev->dev_path,   sysfs_dev->sysfs_path);
 	strcpy(dev->name,       sysfs_dev->ibdev_name);
@@ -489,6 +505,7 @@ static void add_device(struct ibv_device *dev,
 int ibverbs_init(struct ibv_device ***list)
 {
 	const char *sysfs_path;
+	const char *env;
 	struct ibv_sysfs_dev *sysfs_dev, *next_dev;
 	struct ibv_device *device;
 	int num_devices = 0;
@@ -499,11 +516,21 @@ int ibverbs_init(struct ibv_device ***list)
 
 	*list = NULL;
 
+	verbs_register_static_providers();
+
 	if (getenv("RDMAV_FORK_SAFE") || getenv("IBV_FORK_SAFE"))
 		if (ibv_fork_init())
 			fprintf(stderr, PFX "Warning: fork()-safety requested "
 				"but init failed\n");
 
+	env = getenv("RDMAV_SINGLE_THREADED");
+	if (env && !strcmp(env, "1"))
+		verbs_default_single_threaded = 1;
+
+	verbs_mr_cache_init();
+	verbs_queue_buf_init();
+	verbs_trace_init();
+
 	sysfs_path = ibv_get_sysfs_path();
 	if (!sysfs_path)
 		return -ENOSYS;
@@ -575,7 +602,8 @@ out:
 				"driver found for %s\n", sysfs_dev->sysfs_path);
 			if (statically_linked)
 				fprintf(stderr, "	When linking libibverbs statically, "
-					"driver must be statically linked too.\n");
+					"driver must be built in with "
+					"STATIC_PROVIDERS.\n");
 		}
 		free(sysfs_dev);
 	}
@@ -0,0 +1,676 @@
+/* Licensed under the OpenIB.org BSD license (FreeBSD Variant) - See COPYING.md
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include <ccan/list.h>
+
+#include "ibverbs.h"
+
+#ifdef HAVE_USERFAULTFD_EVENTS
+#include <linux/userfaultfd.h>
+#endif
+
+/*
+ * Opt-in registration cache, enabled with RDMAV_MR_CACHE=<max bytes>.
+ *
+ * ibv_dereg_mr() on a cached MR only drops a reference, and a later
+ * ibv_reg_mr() of the same range on the same PD with the same access
+ * flags is handed the same MR.  Only exact matches are returned: a
+ * larger MR would report another addr and length, and its rkey would
+ * expose memory the caller never asked to register.  Unreferenced MRs are kept in
+ * LRU order and deregistered once the cache holds more than the limit.
+ *
+ * Cached ranges are registered with a userfaultfd so that the kernel
+ * reports munmap(), mremap(), brk() shrinking and madvise(MADV_DONTNEED)
+ * on them, including the ones glibc issues from free(), and those MRs
+ * are dropped from the cache.  A range is unregistered again when its
+ * entry leaves the cache, except for pages another entry still covers.
+ * The monitor thread reads events with
+ * cache_lock held: the unmapping thread is only released once its event
+ * has been read, so no one can register new memory at that address and
+ * hit the stale MR before it is invalidated.  In exchange nothing that
+ * may unmap memory - provider calls and free() - runs under cache_lock,
+ * nor on the monitor thread, which would then wait for itself to read
+ * the event.  The MRs it drops are queued on cache_reap and
+ * deregistered by the next thread to use the cache.
+ */
+
+struct mr_ent {
+	/* Treap ordered by (start, address of entry), max_end is the
+	 * largest end in the subtree */
+	struct mr_ent		*left, *right;
+	unsigned int		prio;
+	uintptr_t		start, end, max_end;
+
+	struct list_node	entry;	/* cache_lru when idle, cache_dead
+					   when invalid, else unlinked */
+	struct mr_ent		*next;	/* scratch list under cache_lock */
+	struct ibv_mr		*mr;
+	struct ibv_pd		*pd;
+	int			access;
+	int			refcnt;
+	int			invalid;
+};
+
+int verbs_mr_cache_enabled;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mr_ent *cache_root;
+static LIST_HEAD(cache_lru);
+static LIST_HEAD(cache_dead);
+static struct mr_ent *cache_reap;
+static size_t cache_max;
+static size_t cache_pinned;
+static unsigned int cache_seed = 1;
+static uintptr_t page_mask;
+static int uffd = -1;
+
+static inline uintptr_t tree_max_end(struct mr_ent *e)
+{
+	return e ? e->max_end : 0;
+}
+
+static void tree_update(struct mr_ent *e)
+{
+	uintptr_t left = tree_max_end(e->left), right = tree_max_end(e->right);
+
+	e->max_end = e->end;
+	if (left > e->max_end)
+		e->max_end = left;
+	if (right > e->max_end)
+		e->max_end = right;
+}
+
+static inline int tree_before(struct mr_ent *a, struct mr_ent *b)
+{
+	return a->start < b->start ||
+	       (a->start == b->start && (uintptr_t) a < (uintptr_t) b);
+}
+
+static struct mr_ent *tree_rotate_right(struct mr_ent *e)
+{
+	struct mr_ent *l = e->left;
+
+	e->left = l->right;
+	l->right = e;
+	tree_update(e);
+	tree_update(l);
+	return l;
+}
+
+static struct mr_ent *tree_rotate_left(struct mr_ent *e)
+{
+	struct mr_ent *r = e->right;
+
+	e->right = r->left;
+	r->left = e;
+	tree_update(e);
+	tree_update(r);
+	return r;
+}
+
+static struct mr_ent *tree_insert(struct mr_ent *root, struct mr_ent *e)
+{
+	if (!root) {
+		e->left = e->right = NULL;
+		e->max_end = e->end;
+		return e;
+	}
+
+	if (tree_before(e, root)) {
+		root->left = tree_insert(root->left, e);
+		if (root->left->prio > root->prio)
+			return tree_rotate_right(root);
+	} else {
+		root->right = tree_insert(root->right, e);
+		if (root->right->prio > root->prio)
+			return tree_rotate_left(root);
+	}
+	tree_update(root);
+	return root;
+}
+
+/* Every entry of a sorts before every entry of b */
+static struct mr_ent *tree_merge(struct mr_ent *a, struct mr_ent *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (a->prio > b->prio) {
+		a->right = tree_merge(a->right, b);
+		tree_update(a);
+		return a;
+	}
+	b->left = tree_merge(a, b->left);
+	tree_update(b);
+	return b;
+}
+
+static struct mr_ent *tree_remove(struct mr_ent *root, struct mr_ent *e)
+{
+	if (root == e)
+		return tree_merge(e->left, e->right);
+
+	if (tree_before(e, root))
+		root->left = tree_remove(root->left, e);
+	else
+		root->right = tree_remove(root->right, e);
+	tree_update(root);
+	return root;
+}
+
+/* Find an entry of pd with exactly these access flags for [start, end) */
+static struct mr_ent *tree_find(struct mr_ent *n, uintptr_t start,
+				uintptr_t end, struct ibv_pd *pd, int access)
+{
+	struct mr_ent *e;
+
+	if (!n || n->max_end < end)
+		return NULL;
+
+	e = tree_find(n->left, start, end, pd, access);
+	if (e || n->start > start)
+		return e;
+
+	if (n->start == start && n->end == end && n->pd == pd &&
+	    n->access == access)
+		return n;
+
+	return tree_find(n->right, start, end, pd, access);
+}
+
+static struct mr_ent *tree_find_mr(struct mr_ent *n, struct ibv_mr *mr)
+{
+	uintptr_t start = (uintptr_t) mr->addr;
+	struct mr_ent *e;
+
+	while (n && n->start != start)
+		n = start < n->start ? n->left : n->right;
+	if (!n)
+		return NULL;
+	if (n->mr == mr)
+		return n;
+
+	e = tree_find_mr(n->left, mr);
+	return e ? e : tree_find_mr(n->right, mr);
+}
+
+/* Push every entry overlapping [start, end) onto *list */
+static void tree_overlap(struct mr_ent *n, uintptr_t start, uintptr_t end,
+			 struct mr_ent **list)
+{
+	if (!n || n->max_end <= start)
+		return;
+
+	tree_overlap(n->left, start, end, list);
+	if (n->start >= end)
+		return;
+	if (n->end > start) {
+		n->next = *list;
+		*list = n;
+	}
+	tree_overlap(n->right, start, end, list);
+}
+
+static void uffd_unregister(uintptr_t start, uintptr_t end);
+
+/* Called with cache_lock held, puts entries to deregister on *free_list */
+static void cache_remove(struct mr_ent *e, struct mr_ent **free_list)
+{
+	cache_root = tree_remove(cache_root, e);
+	cache_pinned -= e->end - e->start;
+	uffd_unregister(e->start, e->end);
+	list_del_init(&e->entry);
+
+	if (e->refcnt) {
+		e->invalid = 1;
+		list_add_tail(&cache_dead, &e->entry);
+	} else {
+		e->next = *free_list;
+		*free_list = e;
+	}
+}
+
+static void cache_evict(struct mr_ent **free_list)
+{
+	struct mr_ent *e;
+
+	while (cache_pinned > cache_max) {
+		e = list_top(&cache_lru, struct mr_ent, entry);
+		if (!e)
+			break;
+		cache_remove(e, free_list);
+	}
+}
+
+static void cache_release(struct mr_ent *free_list)
+{
+	struct mr_ent *e;
+
+	while ((e = free_list)) {
+		free_list = e->next;
+		verbs_dereg_mr_uncached(e->mr);
+		free(e);
+	}
+}
+
+/* Take the entries the monitor dropped, called with cache_lock held */
+static void cache_reap_take(struct mr_ent **free_list)
+{
+	struct mr_ent *e;
+
+	while ((e = cache_reap)) {
+		cache_reap = e->next;
+		e->next = *free_list;
+		*free_list = e;
+	}
+}
+
+static void cache_invalidate(uintptr_t start, uintptr_t end,
+			     struct mr_ent **free_list)
+{
+	struct mr_ent *list = NULL, *e;
+
+	tree_overlap(cache_root, start, end, &list);
+	while ((e = list)) {
+		list = e->next;
+		cache_remove(e, free_list);
+	}
+}
+
+#ifdef HAVE_USERFAULTFD_EVENTS
+
+static int uffd_register(uintptr_t start, uintptr_t end)
+{
+	struct uffdio_register reg = {};
+
+	reg.range.start = start & ~page_mask;
+	reg.range.len = ((end + page_mask) & ~page_mask) - reg.range.start;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(uffd, UFFDIO_REGISTER, &reg))
+		return -1;
+
+	/*
+	 * Missing faults should not happen on pinned memory, but the pages
+	 * stay registered until the monitor has handled their removal, so
+	 * we must be able to resolve them.
+	 */
+	if (!(reg.ioctls & (1ULL << _UFFDIO_ZEROPAGE))) {
+		ioctl(uffd, UFFDIO_UNREGISTER, &reg.range);
+		return -1;
+	}
+	return 0;
+}
+
+static inline uintptr_t page_align(uintptr_t addr)
+{
+	return (addr + page_mask) & ~page_mask;
+}
+
+static void uffd_unregister_range(uintptr_t start, uintptr_t end)
+{
+	struct uffdio_range range = { .start = start, .len = end - start };
+
+	ioctl(uffd, UFFDIO_UNREGISTER, &range);
+}
+
+/*
+ * Unregister the pages in [*pos, end) that no entry of the subtree at n
+ * covers, walking the entries in address order.
+ */
+static void uffd_unregister_gaps(struct mr_ent *n, uintptr_t *pos,
+				 uintptr_t end)
+{
+	uintptr_t start;
+
+	if (!n || page_align(n->max_end) <= *pos)
+		return;
+
+	uffd_unregister_gaps(n->left, pos, end);
+	start = n->start & ~page_mask;
+	if (start >= end)
+		return;
+	if (start > *pos)
+		uffd_unregister_range(*pos, start);
+	if (page_align(n->end) > *pos)
+		*pos = page_align(n->end);
+	uffd_unregister_gaps(n->right, pos, end);
+}
+
+/*
+ * Called with cache_lock held once a range has left the tree.  Entries
+ * registered whole pages, so pages shared with a range still in the cache
+ * stay registered.
+ */
+static void uffd_unregister(uintptr_t start, uintptr_t end)
+{
+	uintptr_t pos = start & ~page_mask;
+
+	end = page_align(end);
+	uffd_unregister_gaps(cache_root, &pos, end);
+	if (pos < end)
+		uffd_unregister_range(pos, end);
+}
+
+static void uffd_fault(struct uffd_msg *msg)
+{
+	struct uffdio_zeropage zero = {};
+	struct uffdio_range range;
+
+	zero.range.start = msg->arg.pagefault.address & ~page_mask;
+	zero.range.len = page_mask + 1;
+	if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) && errno == EEXIST) {
+		range = zero.range;
+		ioctl(uffd, UFFDIO_WAKE, &range);
+	}
+}
+
+static void *uffd_monitor(void *arg)
+{
+	struct pollfd fds = { .fd = uffd, .events = POLLIN };
+	struct mr_ent *free_list;
+	struct uffd_msg msg;
+
+	for (;;) {
+		if (poll(&fds, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		free_list = NULL;
+		pthread_mutex_lock(&cache_lock);
+		while (read(uffd, &msg, sizeof(msg)) == sizeof(msg)) {
+			switch (msg.event) {
+			case UFFD_EVENT_PAGEFAULT:
+				uffd_fault(&msg);
+				break;
+			case UFFD_EVENT_UNMAP:
+			case UFFD_EVENT_REMOVE:
+				cache_invalidate(msg.arg.remove.start,
+						 msg.arg.remove.end, &free_list);
+				break;
+			case UFFD_EVENT_REMAP:
+				cache_invalidate(msg.arg.remap.from,
+						 msg.arg.remap.from +
+						 msg.arg.remap.len, &free_list);
+				/* The registration moved along with the pages */
+				uffd_unregister(msg.arg.remap.to,
+						msg.arg.remap.to +
+						msg.arg.remap.len);
+				break;
+			}
+		}
+		cache_reap_take(&free_list);
+		cache_reap = free_list;
+		pthread_mutex_unlock(&cache_lock);
+	}
+
+	return NULL;
+}
+
+static int uffd_init(void)
+{
+	struct uffdio_api api = {};
+	sigset_t set, oldset;
+	pthread_t thread;
+	int ret;
+
+#ifdef UFFD_USER_MODE_ONLY
+	uffd = syscall(__NR_userfaultfd,
+		       O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if (uffd < 0)
+#endif
+		uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd < 0)
+		return errno;
+
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_EVENT_UNMAP | UFFD_FEATURE_EVENT_REMOVE |
+		       UFFD_FEATURE_EVENT_REMAP;
+	if (ioctl(uffd, UFFDIO_API, &api)) {
+		ret = errno;
+		goto err;
+	}
+
+	/* Keep the application's signals away from the monitor */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	ret = pthread_create(&thread, NULL, uffd_monitor, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	if (ret)
+		goto err;
+
+	pthread_detach(thread);
+	return 0;
+
+err:
+	close(uffd);
+	uffd = -1;
+	return ret;
+}
+
+#else
+
+static int uffd_register(uintptr_t start, uintptr_t end)
+{
+	return -1;
+}
+
+static void uffd_unregister(uintptr_t start, uintptr_t end)
+{
+}
+
+static int uffd_init(void)
+{
+	return ENOSYS;
+}
+
+#endif
+
+struct ibv_mr *verbs_mr_cache_reg(struct ibv_pd *pd, void *addr,
+				  size_t length, int access)
+{
+	uintptr_t start = (uintptr_t) addr, end = start + length;
+	struct mr_ent *e, *free_list = NULL;
+	struct ibv_mr *mr;
+
+	if (!length || length > cache_max || (access & IBV_ACCESS_ON_DEMAND))
+		return verbs_reg_mr_uncached(pd, addr, length, access);
+
+	pthread_mutex_lock(&cache_lock);
+	cache_reap_take(&free_list);
+	e = tree_find(cache_root, start, end, pd, access);
+	if (e) {
+		if (!e->refcnt++)
+			list_del_init(&e->entry);
+		pthread_mutex_unlock(&cache_lock);
+		cache_release(free_list);
+		return e->mr;
+	}
+	pthread_mutex_unlock(&cache_lock);
+
+	cache_release(free_list);
+	free_list = NULL;
+
+	mr = verbs_reg_mr_uncached(pd, addr, length, access);
+	if (!mr)
+		return NULL;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return mr;
+
+	e->start = start;
+	e->end = end;
+	e->mr = mr;
+	e->pd = pd;
+	e->access = access;
+	e->refcnt = 1;
+	list_node_init(&e->entry);
+
+	/*
+	 * Register under cache_lock, or removing an entry that shares a page
+	 * with this range could unregister it before it is in the tree.
+	 */
+	pthread_mutex_lock(&cache_lock);
+	if (uffd_register(start, end)) {
+		pthread_mutex_unlock(&cache_lock);
+		free(e);
+		return mr;
+	}
+
+	e->prio = rand_r(&cache_seed);
+	cache_root = tree_insert(cache_root, e);
+	cache_pinned += length;
+	cache_evict(&free_list);
+	pthread_mutex_unlock(&cache_lock);
+
+	cache_release(free_list);
+	return mr;
+}
+
+static struct mr_ent *cache_find_mr(struct ibv_mr *mr)
+{
+	struct mr_ent *e;
+
+	e = tree_find_mr(cache_root, mr);
+	if (e)
+		return e;
+
+	list_for_each(&cache_dead, e, entry)
+		if (e->mr == mr)
+			return e;
+	return NULL;
+}
+
+/* Returns 1 if mr belongs to the cache, which then owns deregistering it */
+int verbs_mr_cache_put(struct ibv_mr *mr)
+{
+	struct mr_ent *e;
+
+	pthread_mutex_lock(&cache_lock);
+	e = cache_find_mr(mr);
+	if (!e) {
+		pthread_mutex_unlock(&cache_lock);
+		return 0;
+	}
+
+	if (--e->refcnt) {
+		pthread_mutex_unlock(&cache_lock);
+		return 1;
+	}
+
+	if (e->invalid) {
+		list_del_init(&e->entry);
+		pthread_mutex_unlock(&cache_lock);
+		e->next = NULL;
+		cache_release(e);
+		return 1;
+	}
+
+	list_add_tail(&cache_lru, &e->entry);
+	pthread_mutex_unlock(&cache_lock);
+	return 1;
+}
+
+/*
+ * ibv_rereg_mr() changes the MR for everyone holding it, so only allow it
+ * when the caller is the sole user, and hand the MR over to them.
+ */
+int verbs_mr_cache_detach(struct ibv_mr *mr)
+{
+	struct mr_ent *e;
+
+	pthread_mutex_lock(&cache_lock);
+	e = cache_find_mr(mr);
+	if (!e) {
+		pthread_mutex_unlock(&cache_lock);
+		return 0;
+	}
+
+	if (e->refcnt > 1) {
+		pthread_mutex_unlock(&cache_lock);
+		return EBUSY;
+	}
+
+	if (!e->invalid) {
+		cache_root = tree_remove(cache_root, e);
+		cache_pinned -= e->end - e->start;
+		uffd_unregister(e->start, e->end);
+	}
+	list_del_init(&e->entry);
+	pthread_mutex_unlock(&cache_lock);
+
+	free(e);
+	return 0;
+}
+
+/* Drop the idle MRs of a PD so that it can be deallocated */
+void verbs_mr_cache_flush(struct ibv_pd *pd)
+{
+	struct mr_ent *e, *tmp, *free_list = NULL;
+
+	pthread_mutex_lock(&cache_lock);
+	cache_reap_take(&free_list);
+	list_for_each_safe(&cache_lru, e, tmp, entry)
+		if (e->pd == pd)
+			cache_remove(e, &free_list);
+	pthread_mutex_unlock(&cache_lock);
+
+	cache_release(free_list);
+}
+
+void verbs_mr_cache_init(void)
+{
+	const char *env;
+	char *end;
+	int ret;
+
+	env = getenv("RDMAV_MR_CACHE");
+	if (!env)
+		return;
+
+	cache_max = strtoull(env, &end, 0);
+	switch (*end) {
+	case 'g': case 'G':
+		cache_max <<= 10;
+		/* fall through */
+	case 'm': case 'M':
+		cache_max <<= 10;
+		/* fall through */
+	case 'k': case 'K':
+		cache_max <<= 10;
+		break;
+	}
+	if (!cache_max) {
+		fprintf(stderr, PFX "Warning: invalid RDMAV_MR_CACHE size %s\n",
+			env);
+		return;
+	}
+
+	page_mask = sysconf(_SC_PAGESIZE) - 1;
+
+	ret = uffd_init();
+	if (ret) {
+		fprintf(stderr, PFX "Warning: MR cache requested but "
+			"userfaultfd is unavailable: %s\n", strerror(ret));
+		return;
+	}
+
+	verbs_mr_cache_enabled = 1;
+}
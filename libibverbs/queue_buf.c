@@ -0,0 +1,294 @@
+/* Licensed under the OpenIB.org BSD license (FreeBSD Variant) - See COPYING.md
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <ccan/list.h>
+
+#include "ibverbs.h"
+
+/*
+ * Memory for the rings providers share with their device.
+ *
+ * Every ring is bound to the NUMA node the device hangs off, so DMA
+ * writes to a CQ and reads from a send queue do not cross the socket
+ * interconnect just because the first thread to touch the pages ran on
+ * the other socket.  RDMAV_QUEUE_NUMA=0 leaves placement to the
+ * process's memory policy.
+ *
+ * With RDMAV_QUEUE_HUGEPAGES set, rings up to half a huge page are
+ * carved out of per-node hugetlb chunks, so an application with many
+ * small QPs and CQs reaches all of them through a handful of TLB
+ * entries.  When no huge pages are reserved the rings silently fall
+ * back to ordinary pages.
+ */
+
+#define QUEUE_MAX_NODES		1024
+#define BITS_PER_LONG		(CHAR_BIT * sizeof(long))
+
+struct queue_chunk {
+	struct list_node	entry;
+	char		       *addr;
+	int			node;
+	unsigned int		used;
+	unsigned long		free[];	/* set bit per unused page */
+};
+
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(chunk_list);
+static size_t queue_page_size;
+static size_t chunk_size;
+static unsigned int chunk_pages;
+static int use_numa = 1;
+static int use_hugepages;
+
+static size_t read_hugepage_size(void)
+{
+	char buf[128];
+	size_t size = 0;
+	FILE *file;
+
+	file = fopen("/proc/meminfo", "r" STREAM_CLOEXEC);
+	if (!file)
+		return 0;
+
+	while (fgets(buf, sizeof(buf), file))
+		if (sscanf(buf, "Hugepagesize: %zu kB", &size) == 1)
+			break;
+
+	fclose(file);
+	return size * 1024;
+}
+
+void verbs_queue_buf_init(void)
+{
+	const char *env;
+
+	queue_page_size = sysconf(_SC_PAGESIZE);
+
+	env = getenv("RDMAV_QUEUE_NUMA");
+	if (env && !strtol(env, NULL, 0))
+		use_numa = 0;
+
+	if (!getenv("RDMAV_QUEUE_HUGEPAGES"))
+		return;
+
+	chunk_size = read_hugepage_size();
+	if (chunk_size <= queue_page_size)
+		return;
+
+	chunk_pages = chunk_size / queue_page_size;
+	use_hugepages = 1;
+}
+
+static void bind_to_node(void *addr, size_t length, int node)
+{
+	unsigned long mask[QUEUE_MAX_NODES / BITS_PER_LONG] = {};
+
+	if (!use_numa || node < 0 || node >= QUEUE_MAX_NODES)
+		return;
+
+	mask[node / BITS_PER_LONG] = 1UL << (node % BITS_PER_LONG);
+
+	/* Best effort, the ring works wherever the kernel puts it */
+	syscall(__NR_mbind, addr, length, MPOL_PREFERRED, mask,
+		QUEUE_MAX_NODES + 1, 0);
+}
+
+static int page_is_free(struct queue_chunk *chunk, unsigned int page)
+{
+	return !!(chunk->free[page / BITS_PER_LONG] &
+		  (1UL << (page % BITS_PER_LONG)));
+}
+
+static void mark_pages(struct queue_chunk *chunk, unsigned int first,
+		       unsigned int npages, int free)
+{
+	unsigned int i;
+
+	for (i = first; i < first + npages; ++i) {
+		if (free)
+			chunk->free[i / BITS_PER_LONG] |= 1UL << (i % BITS_PER_LONG);
+		else
+			chunk->free[i / BITS_PER_LONG] &= ~(1UL << (i % BITS_PER_LONG));
+	}
+}
+
+static int find_pages(struct queue_chunk *chunk, unsigned int npages)
+{
+	unsigned int i, run = 0;
+
+	for (i = 0; i < chunk_pages; ++i) {
+		run = page_is_free(chunk, i) ? run + 1 : 0;
+		if (run == npages)
+			return i + 1 - npages;
+	}
+
+	return -1;
+}
+
+static struct queue_chunk *add_chunk(int node)
+{
+	struct queue_chunk *chunk;
+
+	chunk = calloc(1, sizeof(*chunk) +
+		       (chunk_pages + BITS_PER_LONG - 1) / BITS_PER_LONG *
+		       sizeof(long));
+	if (!chunk)
+		return NULL;
+
+	chunk->addr = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (chunk->addr == MAP_FAILED)
+		goto err;
+
+	bind_to_node(chunk->addr, chunk_size, node);
+
+	if (ibv_dontfork_range(chunk->addr, chunk_size)) {
+		munmap(chunk->addr, chunk_size);
+		goto err;
+	}
+
+	chunk->node = node;
+	mark_pages(chunk, 0, chunk_pages, 1);
+	list_add_tail(&chunk_list, &chunk->entry);
+	return chunk;
+
+err:
+	free(chunk);
+	return NULL;
+}
+
+static void *chunk_alloc(int node, size_t length)
+{
+	unsigned int npages = length / queue_page_size;
+	struct queue_chunk *chunk;
+	void *buf = NULL;
+	int first = -1;
+
+	pthread_mutex_lock(&chunk_lock);
+
+	list_for_each(&chunk_list, chunk, entry) {
+		if (chunk->node != node)
+			continue;
+		first = find_pages(chunk, npages);
+		if (first >= 0)
+			break;
+	}
+
+	if (first < 0) {
+		chunk = add_chunk(node);
+		if (!chunk)
+			goto out;
+		first = 0;
+	}
+
+	mark_pages(chunk, first, npages, 0);
+	chunk->used += npages;
+	buf = chunk->addr + (size_t)first * queue_page_size;
+
+out:
+	pthread_mutex_unlock(&chunk_lock);
+
+	/* Pages come back dirty from the previous ring */
+	if (buf)
+		memset(buf, 0, length);
+	return buf;
+}
+
+static int chunk_free(void *buf, size_t length)
+{
+	unsigned int npages = length / queue_page_size;
+	struct queue_chunk *chunk;
+	int found = 0;
+
+	pthread_mutex_lock(&chunk_lock);
+
+	list_for_each(&chunk_list, chunk, entry) {
+		if ((char *)buf < chunk->addr ||
+		    (char *)buf >= chunk->addr + chunk_size)
+			continue;
+
+		mark_pages(chunk, ((char *)buf - chunk->addr) / queue_page_size,
+			   npages, 1);
+		chunk->used -= npages;
+		if (!chunk->used) {
+			list_del(&chunk->entry);
+			ibv_dofork_range(chunk->addr, chunk_size);
+			munmap(chunk->addr, chunk_size);
+			free(chunk);
+		}
+		found = 1;
+		break;
+	}
+
+	pthread_mutex_unlock(&chunk_lock);
+	return found;
+}
+
+void *verbs_alloc_queue_buf(struct ibv_device *device, size_t length)
+{
+	int node = verbs_get_device(device)->numa_node;
+	void *buf;
+	int ret;
+
+	length = (length + queue_page_size - 1) & ~(queue_page_size - 1);
+	if (!length) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (use_hugepages && length <= chunk_size / 2) {
+		buf = chunk_alloc(node, length);
+		if (buf)
+			return buf;
+	}
+
+	buf = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	/* Must happen before the first touch allocates the pages */
+	bind_to_node(buf, length, node);
+
+	ret = ibv_dontfork_range(buf, length);
+	if (ret) {
+		munmap(buf, length);
+		errno = ret;
+		return NULL;
+	}
+
+	return buf;
+}
+
+void verbs_bind_queue_buf(struct ibv_device *device, void *addr,
+			  size_t length)
+{
+	bind_to_node(addr, length, verbs_get_device(device)->numa_node);
+}
+
+void verbs_free_queue_buf(void *buf, size_t length)
+{
+	if (!buf)
+		return;
+
+	length = (length + queue_page_size - 1) & ~(queue_page_size - 1);
+
+	if (use_hugepages && chunk_free(buf, length))
+		return;
+
+	ibv_dofork_range(buf, length);
+	munmap(buf, length);
+}
@@ -0,0 +1,998 @@
+/* Licensed under the OpenIB.org BSD license (FreeBSD Variant) - See COPYING.md
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "ibverbs.h"
+
+/*
+ * Opt-in verb tracing.  When IBV_TRACE is set, every context opened gets
+ * its provider ops table copied aside and replaced by wrappers that time
+ * each call and record it in a per-context histogram, and at level 2 also
+ * in per-QP and per-CQ histograms for the data path verbs.  With tracing
+ * off the ops table is never touched.
+ *
+ * Context trace state is never freed, so that it can be dumped from a
+ * signal handler without locking and so that closed contexts still show
+ * up in the dump at exit.  A per-object entry is unlinked when its QP or
+ * CQ is destroyed and reused for a later object; data path lookups walk
+ * the hash chains without a lock, so entries are never handed back to
+ * malloc.  Calls on destroyed objects remain in the context totals.
+ */
+
+#define TRACE_BUCKETS	32
+#define TRACE_OBJ_HASH	256
+
+enum {
+	TRACE_OP_QUERY_DEVICE,
+	TRACE_OP_QUERY_PORT,
+	TRACE_OP_ALLOC_PD,
+	TRACE_OP_DEALLOC_PD,
+	TRACE_OP_REG_MR,
+	TRACE_OP_REREG_MR,
+	TRACE_OP_DEREG_MR,
+	TRACE_OP_ALLOC_MW,
+	TRACE_OP_BIND_MW,
+	TRACE_OP_DEALLOC_MW,
+	TRACE_OP_CREATE_CQ,
+	TRACE_OP_POLL_CQ,
+	TRACE_OP_REQ_NOTIFY_CQ,
+	TRACE_OP_RESIZE_CQ,
+	TRACE_OP_DESTROY_CQ,
+	TRACE_OP_CREATE_SRQ,
+	TRACE_OP_MODIFY_SRQ,
+	TRACE_OP_QUERY_SRQ,
+	TRACE_OP_DESTROY_SRQ,
+	TRACE_OP_POST_SRQ_RECV,
+	TRACE_OP_CREATE_QP,
+	TRACE_OP_QUERY_QP,
+	TRACE_OP_MODIFY_QP,
+	TRACE_OP_DESTROY_QP,
+	TRACE_OP_POST_SEND,
+	TRACE_OP_POST_RECV,
+	TRACE_OP_CREATE_AH,
+	TRACE_OP_DESTROY_AH,
+	TRACE_OP_ATTACH_MCAST,
+	TRACE_OP_DETACH_MCAST,
+	TRACE_OP_MAX
+};
+
+static const char *const trace_op_name[TRACE_OP_MAX] = {
+	[TRACE_OP_QUERY_DEVICE]		= "query_device",
+	[TRACE_OP_QUERY_PORT]		= "query_port",
+	[TRACE_OP_ALLOC_PD]		= "alloc_pd",
+	[TRACE_OP_DEALLOC_PD]		= "dealloc_pd",
+	[TRACE_OP_REG_MR]		= "reg_mr",
+	[TRACE_OP_REREG_MR]		= "rereg_mr",
+	[TRACE_OP_DEREG_MR]		= "dereg_mr",
+	[TRACE_OP_ALLOC_MW]		= "alloc_mw",
+	[TRACE_OP_BIND_MW]		= "bind_mw",
+	[TRACE_OP_DEALLOC_MW]		= "dealloc_mw",
+	[TRACE_OP_CREATE_CQ]		= "create_cq",
+	[TRACE_OP_POLL_CQ]		= "poll_cq",
+	[TRACE_OP_REQ_NOTIFY_CQ]	= "req_notify_cq",
+	[TRACE_OP_RESIZE_CQ]		= "resize_cq",
+	[TRACE_OP_DESTROY_CQ]		= "destroy_cq",
+	[TRACE_OP_CREATE_SRQ]		= "create_srq",
+	[TRACE_OP_MODIFY_SRQ]		= "modify_srq",
+	[TRACE_OP_QUERY_SRQ]		= "query_srq",
+	[TRACE_OP_DESTROY_SRQ]		= "destroy_srq",
+	[TRACE_OP_POST_SRQ_RECV]	= "post_srq_recv",
+	[TRACE_OP_CREATE_QP]		= "create_qp",
+	[TRACE_OP_QUERY_QP]		= "query_qp",
+	[TRACE_OP_MODIFY_QP]		= "modify_qp",
+	[TRACE_OP_DESTROY_QP]		= "destroy_qp",
+	[TRACE_OP_POST_SEND]		= "post_send",
+	[TRACE_OP_POST_RECV]		= "post_recv",
+	[TRACE_OP_CREATE_AH]		= "create_ah",
+	[TRACE_OP_DESTROY_AH]		= "destroy_ah",
+	[TRACE_OP_ATTACH_MCAST]		= "attach_mcast",
+	[TRACE_OP_DETACH_MCAST]		= "detach_mcast",
+};
+
+/* Per-object stat slots, kept small since there may be many QPs */
+enum {
+	TRACE_QP_POST_SEND,
+	TRACE_QP_POST_RECV,
+	TRACE_QP_MODIFY,
+	TRACE_CQ_POLL = 0,
+	TRACE_CQ_NOTIFY,
+	TRACE_OBJ_MAX = 3
+};
+
+static const int trace_qp_op[TRACE_OBJ_MAX] = {
+	TRACE_OP_POST_SEND, TRACE_OP_POST_RECV, TRACE_OP_MODIFY_QP
+};
+
+static const int trace_cq_op[TRACE_OBJ_MAX] = {
+	TRACE_OP_POLL_CQ, TRACE_OP_REQ_NOTIFY_CQ, -1
+};
+
+enum {
+	TRACE_OBJ_QP,
+	TRACE_OBJ_CQ
+};
+
+/*
+ * Bucket 0 counts calls under 1 ns; bucket i counts calls taking
+ * [2^(i-1), 2^i) ns.  The last bucket also absorbs anything slower.
+ */
+struct trace_stat {
+	_Atomic(uint64_t)	count;
+	_Atomic(uint64_t)	errors;
+	_Atomic(uint64_t)	total_ns;
+	_Atomic(uint64_t)	max_ns;
+	_Atomic(uint64_t)	hist[TRACE_BUCKETS];
+};
+
+struct trace_obj {
+	_Atomic(struct trace_obj *) next;
+	_Atomic(void *)		obj;	/* NULL while on obj_free */
+	int			type;
+	uint32_t		num;
+	struct trace_stat	stat[TRACE_OBJ_MAX];
+};
+
+struct verbs_trace_ctx {
+	struct verbs_trace_ctx	*next;
+	_Atomic(struct ibv_context *) context;	/* NULL once closed */
+	char			name[IBV_SYSFS_NAME_MAX];
+	struct ibv_context_ops	ops;
+	pthread_mutex_t		obj_lock;
+	_Atomic(struct trace_obj *) obj_hash[TRACE_OBJ_HASH];
+	struct trace_obj	*obj_free;	/* under obj_lock */
+	struct trace_stat	stat[TRACE_OP_MAX];
+};
+
+static int trace_level;
+static int trace_fd = STDERR_FILENO;
+static int trace_sig;
+static _Atomic(struct verbs_trace_ctx *) trace_list;
+
+static inline uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void trace_stat_add(struct trace_stat *stat, uint64_t ns, int err)
+{
+	uint64_t max;
+	int bucket;
+
+	bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+	if (bucket >= TRACE_BUCKETS)
+		bucket = TRACE_BUCKETS - 1;
+
+	atomic_fetch_add_explicit(&stat->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stat->total_ns, ns, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stat->hist[bucket], 1, memory_order_relaxed);
+	if (err)
+		atomic_fetch_add_explicit(&stat->errors, 1,
+					  memory_order_relaxed);
+
+	max = atomic_load_explicit(&stat->max_ns, memory_order_relaxed);
+	while (ns > max &&
+	       !atomic_compare_exchange_weak_explicit(&stat->max_ns, &max, ns,
+						      memory_order_relaxed,
+						      memory_order_relaxed))
+		;
+}
+
+static struct verbs_trace_ctx *trace_get(struct ibv_context *context)
+{
+	struct verbs_context *context_ex = verbs_get_ctx(context);
+	struct verbs_trace_ctx *t;
+
+	if (context_ex)
+		return context_ex->priv->trace;
+
+	for (t = atomic_load(&trace_list); t; t = t->next)
+		if (atomic_load_explicit(&t->context, memory_order_relaxed) ==
+		    context)
+			break;
+	return t;
+}
+
+static inline unsigned int trace_obj_hash(void *obj)
+{
+	return ((uintptr_t) obj >> 6) % TRACE_OBJ_HASH;
+}
+
+static void trace_obj_reset(struct trace_obj *o)
+{
+	struct trace_stat *stat;
+	int i, j;
+
+	for (i = 0; i < TRACE_OBJ_MAX; i++) {
+		stat = &o->stat[i];
+		atomic_store_explicit(&stat->count, 0, memory_order_relaxed);
+		atomic_store_explicit(&stat->errors, 0, memory_order_relaxed);
+		atomic_store_explicit(&stat->total_ns, 0, memory_order_relaxed);
+		atomic_store_explicit(&stat->max_ns, 0, memory_order_relaxed);
+		for (j = 0; j < TRACE_BUCKETS; j++)
+			atomic_store_explicit(&stat->hist[j], 0,
+					      memory_order_relaxed);
+	}
+}
+
+static struct trace_obj *trace_obj_find(struct verbs_trace_ctx *t, void *obj)
+{
+	struct trace_obj *o;
+
+	o = atomic_load_explicit(&t->obj_hash[trace_obj_hash(obj)],
+				 memory_order_acquire);
+	for (; o; o = atomic_load_explicit(&o->next, memory_order_acquire))
+		if (atomic_load_explicit(&o->obj, memory_order_relaxed) == obj)
+			break;
+	return o;
+}
+
+/*
+ * Objects are added on first use rather than at creation, which also
+ * covers QPs and CQs created through the extended verbs.
+ */
+static struct trace_obj *trace_obj_get(struct verbs_trace_ctx *t, void *obj,
+				       int type, uint32_t num)
+{
+	_Atomic(struct trace_obj *) *head;
+	struct trace_obj *o;
+
+	if (trace_level < 2)
+		return NULL;
+
+	o = trace_obj_find(t, obj);
+	if (o)
+		return o;
+
+	pthread_mutex_lock(&t->obj_lock);
+	o = trace_obj_find(t, obj);
+	if (o)
+		goto out;
+
+	if (t->obj_free) {
+		o = t->obj_free;
+		t->obj_free = atomic_load_explicit(&o->next,
+						   memory_order_relaxed);
+		trace_obj_reset(o);
+	} else {
+		o = calloc(1, sizeof(*o));
+		if (!o)
+			goto out;
+	}
+
+	head = &t->obj_hash[trace_obj_hash(obj)];
+	o->type = type;
+	o->num = num;
+	atomic_store_explicit(&o->obj, obj, memory_order_relaxed);
+	atomic_store_explicit(&o->next,
+			      atomic_load_explicit(head, memory_order_relaxed),
+			      memory_order_relaxed);
+	atomic_store_explicit(head, o, memory_order_release);
+out:
+	pthread_mutex_unlock(&t->obj_lock);
+	return o;
+}
+
+/*
+ * A lookup racing with the unlink may follow the entry onto obj_free and
+ * miss; trace_obj_get() then retries under obj_lock.
+ */
+static void trace_obj_put(struct verbs_trace_ctx *t, void *obj)
+{
+	_Atomic(struct trace_obj *) *prev;
+	struct trace_obj *o;
+
+	if (trace_level < 2)
+		return;
+
+	pthread_mutex_lock(&t->obj_lock);
+	prev = &t->obj_hash[trace_obj_hash(obj)];
+	while ((o = atomic_load_explicit(prev, memory_order_relaxed))) {
+		if (atomic_load_explicit(&o->obj, memory_order_relaxed) == obj)
+			break;
+		prev = &o->next;
+	}
+	if (o) {
+		atomic_store_explicit(prev,
+				      atomic_load_explicit(&o->next,
+							   memory_order_relaxed),
+				      memory_order_release);
+		atomic_store_explicit(&o->obj, NULL, memory_order_relaxed);
+		atomic_store_explicit(&o->next, t->obj_free,
+				      memory_order_relaxed);
+		t->obj_free = o;
+	}
+	pthread_mutex_unlock(&t->obj_lock);
+}
+
+static inline void trace_done(struct verbs_trace_ctx *t, int op,
+			      uint64_t start, int err)
+{
+	trace_stat_add(&t->stat[op], trace_now() - start, err);
+}
+
+static inline void trace_obj_done(struct verbs_trace_ctx *t,
+				  struct trace_obj *o, int op, int slot,
+				  uint64_t start, int err)
+{
+	uint64_t ns = trace_now() - start;
+
+	trace_stat_add(&t->stat[op], ns, err);
+	if (o)
+		trace_stat_add(&o->stat[slot], ns, err);
+}
+
+static int trace_query_device(struct ibv_context *context,
+			      struct ibv_device_attr *device_attr)
+{
+	struct verbs_trace_ctx *t = trace_get(context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.query_device(context, device_attr);
+	trace_done(t, TRACE_OP_QUERY_DEVICE, start, ret);
+	return ret;
+}
+
+static int trace_query_port(struct ibv_context *context, uint8_t port_num,
+			    struct ibv_port_attr *port_attr)
+{
+	struct verbs_trace_ctx *t = trace_get(context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.query_port(context, port_num, port_attr);
+	trace_done(t, TRACE_OP_QUERY_PORT, start, ret);
+	return ret;
+}
+
+static struct ibv_pd *trace_alloc_pd(struct ibv_context *context)
+{
+	struct verbs_trace_ctx *t = trace_get(context);
+	uint64_t start = trace_now();
+	struct ibv_pd *pd;
+
+	pd = t->ops.alloc_pd(context);
+	trace_done(t, TRACE_OP_ALLOC_PD, start, !pd);
+	return pd;
+}
+
+static int trace_dealloc_pd(struct ibv_pd *pd)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.dealloc_pd(pd);
+	trace_done(t, TRACE_OP_DEALLOC_PD, start, ret);
+	return ret;
+}
+
+static struct ibv_mr *trace_reg_mr(struct ibv_pd *pd, void *addr,
+				   size_t length, int access)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	struct ibv_mr *mr;
+
+	mr = t->ops.reg_mr(pd, addr, length, access);
+	trace_done(t, TRACE_OP_REG_MR, start, !mr);
+	return mr;
+}
+
+static int trace_rereg_mr(struct ibv_mr *mr, int flags, struct ibv_pd *pd,
+			  void *addr, size_t length, int access)
+{
+	struct verbs_trace_ctx *t = trace_get(mr->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.rereg_mr(mr, flags, pd, addr, length, access);
+	trace_done(t, TRACE_OP_REREG_MR, start, ret);
+	return ret;
+}
+
+static int trace_dereg_mr(struct ibv_mr *mr)
+{
+	struct verbs_trace_ctx *t = trace_get(mr->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.dereg_mr(mr);
+	trace_done(t, TRACE_OP_DEREG_MR, start, ret);
+	return ret;
+}
+
+static struct ibv_mw *trace_alloc_mw(struct ibv_pd *pd,
+				     enum ibv_mw_type type)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	struct ibv_mw *mw;
+
+	mw = t->ops.alloc_mw(pd, type);
+	trace_done(t, TRACE_OP_ALLOC_MW, start, !mw);
+	return mw;
+}
+
+static int trace_bind_mw(struct ibv_qp *qp, struct ibv_mw *mw,
+			 struct ibv_mw_bind *mw_bind)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.bind_mw(qp, mw, mw_bind);
+	trace_done(t, TRACE_OP_BIND_MW, start, ret);
+	return ret;
+}
+
+static int trace_dealloc_mw(struct ibv_mw *mw)
+{
+	struct verbs_trace_ctx *t = trace_get(mw->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.dealloc_mw(mw);
+	trace_done(t, TRACE_OP_DEALLOC_MW, start, ret);
+	return ret;
+}
+
+static struct ibv_cq *trace_create_cq(struct ibv_context *context, int cqe,
+				      struct ibv_comp_channel *channel,
+				      int comp_vector)
+{
+	struct verbs_trace_ctx *t = trace_get(context);
+	uint64_t start = trace_now();
+	struct ibv_cq *cq;
+
+	cq = t->ops.create_cq(context, cqe, channel, comp_vector);
+	trace_done(t, TRACE_OP_CREATE_CQ, start, !cq);
+	return cq;
+}
+
+static int trace_poll_cq(struct ibv_cq *cq, int num_entries,
+			 struct ibv_wc *wc)
+{
+	struct verbs_trace_ctx *t = trace_get(cq->context);
+	struct trace_obj *o = trace_obj_get(t, cq, TRACE_OBJ_CQ, cq->handle);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.poll_cq(cq, num_entries, wc);
+	trace_obj_done(t, o, TRACE_OP_POLL_CQ, TRACE_CQ_POLL, start, ret < 0);
+	return ret;
+}
+
+static int trace_req_notify_cq(struct ibv_cq *cq, int solicited_only)
+{
+	struct verbs_trace_ctx *t = trace_get(cq->context);
+	struct trace_obj *o = trace_obj_get(t, cq, TRACE_OBJ_CQ, cq->handle);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.req_notify_cq(cq, solicited_only);
+	trace_obj_done(t, o, TRACE_OP_REQ_NOTIFY_CQ, TRACE_CQ_NOTIFY, start,
+		       ret);
+	return ret;
+}
+
+static int trace_resize_cq(struct ibv_cq *cq, int cqe)
+{
+	struct verbs_trace_ctx *t = trace_get(cq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.resize_cq(cq, cqe);
+	trace_done(t, TRACE_OP_RESIZE_CQ, start, ret);
+	return ret;
+}
+
+static int trace_destroy_cq(struct ibv_cq *cq)
+{
+	struct verbs_trace_ctx *t = trace_get(cq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.destroy_cq(cq);
+	trace_done(t, TRACE_OP_DESTROY_CQ, start, ret);
+	if (!ret)
+		trace_obj_put(t, cq);
+	return ret;
+}
+
+static struct ibv_srq *trace_create_srq(struct ibv_pd *pd,
+					struct ibv_srq_init_attr *srq_init_attr)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	struct ibv_srq *srq;
+
+	srq = t->ops.create_srq(pd, srq_init_attr);
+	trace_done(t, TRACE_OP_CREATE_SRQ, start, !srq);
+	return srq;
+}
+
+static int trace_modify_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr,
+			    int srq_attr_mask)
+{
+	struct verbs_trace_ctx *t = trace_get(srq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.modify_srq(srq, srq_attr, srq_attr_mask);
+	trace_done(t, TRACE_OP_MODIFY_SRQ, start, ret);
+	return ret;
+}
+
+static int trace_query_srq(struct ibv_srq *srq, struct ibv_srq_attr *srq_attr)
+{
+	struct verbs_trace_ctx *t = trace_get(srq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.query_srq(srq, srq_attr);
+	trace_done(t, TRACE_OP_QUERY_SRQ, start, ret);
+	return ret;
+}
+
+static int trace_destroy_srq(struct ibv_srq *srq)
+{
+	struct verbs_trace_ctx *t = trace_get(srq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.destroy_srq(srq);
+	trace_done(t, TRACE_OP_DESTROY_SRQ, start, ret);
+	return ret;
+}
+
+static int trace_post_srq_recv(struct ibv_srq *srq,
+			       struct ibv_recv_wr *recv_wr,
+			       struct ibv_recv_wr **bad_recv_wr)
+{
+	struct verbs_trace_ctx *t = trace_get(srq->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.post_srq_recv(srq, recv_wr, bad_recv_wr);
+	trace_done(t, TRACE_OP_POST_SRQ_RECV, start, ret);
+	return ret;
+}
+
+static struct ibv_qp *trace_create_qp(struct ibv_pd *pd,
+				      struct ibv_qp_init_attr *attr)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	struct ibv_qp *qp;
+
+	qp = t->ops.create_qp(pd, attr);
+	trace_done(t, TRACE_OP_CREATE_QP, start, !qp);
+	return qp;
+}
+
+static int trace_query_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
+			  int attr_mask, struct ibv_qp_init_attr *init_attr)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.query_qp(qp, attr, attr_mask, init_attr);
+	trace_done(t, TRACE_OP_QUERY_QP, start, ret);
+	return ret;
+}
+
+static int trace_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
+			   int attr_mask)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	struct trace_obj *o = trace_obj_get(t, qp, TRACE_OBJ_QP, qp->qp_num);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.modify_qp(qp, attr, attr_mask);
+	trace_obj_done(t, o, TRACE_OP_MODIFY_QP, TRACE_QP_MODIFY, start, ret);
+	return ret;
+}
+
+static int trace_destroy_qp(struct ibv_qp *qp)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.destroy_qp(qp);
+	trace_done(t, TRACE_OP_DESTROY_QP, start, ret);
+	if (!ret)
+		trace_obj_put(t, qp);
+	return ret;
+}
+
+static int trace_post_send(struct ibv_qp *qp, struct ibv_send_wr *wr,
+			   struct ibv_send_wr **bad_wr)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	struct trace_obj *o = trace_obj_get(t, qp, TRACE_OBJ_QP, qp->qp_num);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.post_send(qp, wr, bad_wr);
+	trace_obj_done(t, o, TRACE_OP_POST_SEND, TRACE_QP_POST_SEND, start,
+		       ret);
+	return ret;
+}
+
+static int trace_post_recv(struct ibv_qp *qp, struct ibv_recv_wr *wr,
+			   struct ibv_recv_wr **bad_wr)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	struct trace_obj *o = trace_obj_get(t, qp, TRACE_OBJ_QP, qp->qp_num);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.post_recv(qp, wr, bad_wr);
+	trace_obj_done(t, o, TRACE_OP_POST_RECV, TRACE_QP_POST_RECV, start,
+		       ret);
+	return ret;
+}
+
+static struct ibv_ah *trace_create_ah(struct ibv_pd *pd,
+				      struct ibv_ah_attr *attr)
+{
+	struct verbs_trace_ctx *t = trace_get(pd->context);
+	uint64_t start = trace_now();
+	struct ibv_ah *ah;
+
+	ah = t->ops.create_ah(pd, attr);
+	trace_done(t, TRACE_OP_CREATE_AH, start, !ah);
+	return ah;
+}
+
+static int trace_destroy_ah(struct ibv_ah *ah)
+{
+	struct verbs_trace_ctx *t = trace_get(ah->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.destroy_ah(ah);
+	trace_done(t, TRACE_OP_DESTROY_AH, start, ret);
+	return ret;
+}
+
+static int trace_attach_mcast(struct ibv_qp *qp, const union ibv_gid *gid,
+			      uint16_t lid)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.attach_mcast(qp, gid, lid);
+	trace_done(t, TRACE_OP_ATTACH_MCAST, start, ret);
+	return ret;
+}
+
+static int trace_detach_mcast(struct ibv_qp *qp, const union ibv_gid *gid,
+			      uint16_t lid)
+{
+	struct verbs_trace_ctx *t = trace_get(qp->context);
+	uint64_t start = trace_now();
+	int ret;
+
+	ret = t->ops.detach_mcast(qp, gid, lid);
+	trace_done(t, TRACE_OP_DETACH_MCAST, start, ret);
+	return ret;
+}
+
+/* Only interpose on ops the provider implements, NULL means unsupported */
+#define TRACE_WRAP(ops, op)				\
+	do {						\
+		if ((ops)->op)				\
+			(ops)->op = trace_##op;		\
+	} while (0)
+
+void verbs_trace_open(struct ibv_context *context)
+{
+	struct verbs_context *context_ex = verbs_get_ctx(context);
+	struct ibv_context_ops *ops = &context->ops;
+	struct verbs_trace_ctx *t;
+
+	if (!trace_level)
+		return;
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		fprintf(stderr, PFX "Warning: unable to trace %s\n",
+			context->device->name);
+		return;
+	}
+
+	snprintf(t->name, sizeof(t->name), "%s", context->device->name);
+	pthread_mutex_init(&t->obj_lock, NULL);
+	t->ops = *ops;
+	atomic_init(&t->context, context);
+	if (context_ex)
+		context_ex->priv->trace = t;
+
+	t->next = atomic_load(&trace_list);
+	while (!atomic_compare_exchange_weak(&trace_list, &t->next, t))
+		;
+
+	TRACE_WRAP(ops, query_device);
+	TRACE_WRAP(ops, query_port);
+	TRACE_WRAP(ops, alloc_pd);
+	TRACE_WRAP(ops, dealloc_pd);
+	TRACE_WRAP(ops, reg_mr);
+	TRACE_WRAP(ops, rereg_mr);
+	TRACE_WRAP(ops, dereg_mr);
+	TRACE_WRAP(ops, alloc_mw);
+	TRACE_WRAP(ops, bind_mw);
+	TRACE_WRAP(ops, dealloc_mw);
+	TRACE_WRAP(ops, create_cq);
+	TRACE_WRAP(ops, poll_cq);
+	TRACE_WRAP(ops, req_notify_cq);
+	TRACE_WRAP(ops, resize_cq);
+	TRACE_WRAP(ops, destroy_cq);
+	TRACE_WRAP(ops, create_srq);
+	TRACE_WRAP(ops, modify_srq);
+	TRACE_WRAP(ops, query_srq);
+	TRACE_WRAP(ops, destroy_srq);
+	TRACE_WRAP(ops, post_srq_recv);
+	TRACE_WRAP(ops, create_qp);
+	TRACE_WRAP(ops, query_qp);
+	TRACE_WRAP(ops, modify_qp);
+	TRACE_WRAP(ops, destroy_qp);
+	TRACE_WRAP(ops, post_send);
+	TRACE_WRAP(ops, post_recv);
+	TRACE_WRAP(ops, create_ah);
+	TRACE_WRAP(ops, destroy_ah);
+	TRACE_WRAP(ops, attach_mcast);
+	TRACE_WRAP(ops, detach_mcast);
+}
+
+void verbs_trace_close(struct ibv_context *context)
+{
+	struct verbs_trace_ctx *t;
+
+	if (!trace_level)
+		return;
+
+	t = trace_get(context);
+	if (t) {
+		context->ops = t->ops;
+		atomic_store(&t->context, NULL);
+	}
+}
+
+/*
+ * The dump runs from a signal handler, so it formats by hand into a small
+ * buffer and emits it with write(2) rather than going through stdio.
+ */
+struct trace_out {
+	int	fd;
+	int	len;
+	char	buf[256];
+};
+
+static void trace_flush(struct trace_out *out)
+{
+	const char *p = out->buf;
+	ssize_t ret;
+
+	while (out->len > 0) {
+		ret = write(out->fd, p, out->len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		p += ret;
+		out->len -= ret;
+	}
+	out->len = 0;
+}
+
+static void trace_putc(struct trace_out *out, char c)
+{
+	if (out->len == sizeof(out->buf))
+		trace_flush(out);
+	out->buf[out->len++] = c;
+}
+
+static void trace_puts(struct trace_out *out, const char *str)
+{
+	while (*str)
+		trace_putc(out, *str++);
+}
+
+/* Like "%-*s" */
+static void trace_putpad(struct trace_out *out, const char *str, int width)
+{
+	int len = strlen(str);
+
+	trace_puts(out, str);
+	for (; len < width; len++)
+		trace_putc(out, ' ');
+}
+
+static void trace_putu(struct trace_out *out, uint64_t val)
+{
+	char digits[20];
+	int i = 0;
+
+	do {
+		digits[i++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	while (i)
+		trace_putc(out, digits[--i]);
+}
+
+static void trace_print_stat(struct trace_out *out, const char *indent,
+			     const char *name, struct trace_stat *stat)
+{
+	uint64_t count, n;
+	int i;
+
+	count = atomic_load_explicit(&stat->count, memory_order_relaxed);
+	if (!count)
+		return;
+
+	trace_puts(out, indent);
+	trace_putpad(out, name, 14);
+	trace_puts(out, " count ");
+	trace_putu(out, count);
+	trace_puts(out, " errors ");
+	trace_putu(out, atomic_load_explicit(&stat->errors,
+					     memory_order_relaxed));
+	trace_puts(out, " avg ");
+	trace_putu(out, atomic_load_explicit(&stat->total_ns,
+					     memory_order_relaxed) / count);
+	trace_puts(out, " ns max ");
+	trace_putu(out, atomic_load_explicit(&stat->max_ns,
+					     memory_order_relaxed));
+	trace_puts(out, " ns\n");
+
+	trace_puts(out, indent);
+	trace_puts(out, "  hist");
+	for (i = 0; i < TRACE_BUCKETS; i++) {
+		n = atomic_load_explicit(&stat->hist[i], memory_order_relaxed);
+		if (!n)
+			continue;
+		if (i < TRACE_BUCKETS - 1) {
+			trace_puts(out, " <");
+			trace_putu(out, (uint64_t) 1 << i);
+		} else {
+			trace_puts(out, " >=");
+			trace_putu(out, (uint64_t) 1 << (i - 1));
+		}
+		trace_puts(out, "ns:");
+		trace_putu(out, n);
+	}
+	trace_putc(out, '\n');
+}
+
+static void trace_print_obj(struct trace_out *out, struct trace_obj *o)
+{
+	const int *op = o->type == TRACE_OBJ_QP ? trace_qp_op : trace_cq_op;
+	int i;
+
+	trace_puts(out, o->type == TRACE_OBJ_QP ? "  qp " : "  cq ");
+	trace_putu(out, o->num);
+	trace_putc(out, '\n');
+	for (i = 0; i < TRACE_OBJ_MAX; i++)
+		if (op[i] >= 0)
+			trace_print_stat(out, "    ", trace_op_name[op[i]],
+					 &o->stat[i]);
+}
+
+/*
+ * Walks the trace state without taking any locks and only calls
+ * async-signal-safe functions, so it may be called from the dump signal
+ * handler.  Entries are never freed, so the walk stays on live memory.  An
+ * entry unlinked by a concurrent destroy is moved onto obj_free and its
+ * next pointer then leads through the free list, whose entries have a
+ * NULL obj and are skipped, so the rest of its old chain may be missed.
+ */
+static void verbs_trace_dump(int fd)
+{
+	struct verbs_trace_ctx *t;
+	struct trace_out out;
+	struct trace_obj *o;
+	int i;
+
+	out.fd = fd;
+	out.len = 0;
+	for (t = atomic_load(&trace_list); t; t = t->next) {
+		trace_puts(&out, "libibverbs trace: ");
+		trace_puts(&out, t->name);
+		trace_puts(&out, atomic_load(&t->context) ? "\n" :
+			   " (closed)\n");
+		for (i = 0; i < TRACE_OP_MAX; i++)
+			trace_print_stat(&out, "  ", trace_op_name[i],
+					 &t->stat[i]);
+
+		for (i = 0; i < TRACE_OBJ_HASH; i++)
+			for (o = atomic_load(&t->obj_hash[i]); o;
+			     o = atomic_load(&o->next))
+				if (atomic_load(&o->obj))
+					trace_print_obj(&out, o);
+	}
+	trace_flush(&out);
+}
+
+static void trace_signal(int sig)
+{
+	int save_errno = errno;
+
+	verbs_trace_dump(trace_fd);
+	errno = save_errno;
+}
+
+/*
+ * A destructor rather than atexit(), so that the report is also written
+ * when libibverbs is unloaded with dlclose() before the process exits.
+ */
+static void __attribute__((destructor)) trace_exit(void)
+{
+	if (trace_level <= 0)
+		return;
+
+	if (trace_sig > 0)
+		signal(trace_sig, SIG_DFL);
+	verbs_trace_dump(trace_fd);
+}
+
+void verbs_trace_init(void)
+{
+	struct sigaction sa;
+	const char *env;
+	int fd, sig;
+
+	env = getenv("IBV_TRACE");
+	if (!env)
+		return;
+
+	trace_level = atoi(env);
+	if (trace_level <= 0)
+		return;
+
+	env = getenv("IBV_TRACE_FILE");
+	if (env) {
+		fd = open(env, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd >= 0)
+			trace_fd = fd;
+		else
+			fprintf(stderr, PFX "Warning: unable to open trace "
+				"file %s, using stderr\n", env);
+	}
+
+	env = getenv("IBV_TRACE_SIGNAL");
+	if (env) {
+		sig = atoi(env);
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = trace_signal;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sig <= 0 || sigaction(sig, &sa, NULL))
+			fprintf(stderr, PFX "Warning: invalid trace signal "
+				"%s\n", env);
+		else
+			trace_sig = sig;
+	}
+}
@@ -254,12 +254,15 @@ default_symver(__ibv_alloc_pd, ibv_alloc_pd);
 
 int __ibv_dealloc_pd(struct ibv_pd *pd)
 {
+	if (verbs_mr_cache_enabled)
+		verbs_mr_cache_flush(pd);
+
 	return pd->context->ops.dealloc_pd(pd);
 }
 default_symver(__ibv_dealloc_pd, ibv_dealloc_pd);
 
-struct ibv_mr *__ibv_reg_mr(struct ibv_pd *pd, void *addr,
-			    size_t length, int access)
+struct ibv_mr *verbs_reg_mr_uncached(struct ibv_pd *pd, void *addr,
+				     size_t length, int access)
 {
 	struct ibv_mr *mr;
 
@@ -277,6 +280,15 @@ struct ibv_mr *__ibv_reg_mr(struct ibv_pd *pd, void *addr,
 
 	return mr;
 }
+
+struct ibv_mr *__ibv_reg_mr(struct ibv_pd *pd, void *addr,
+			    size_t length, int access)
+{
+	if (verbs_mr_cache_enabled)
+		return verbs_mr_cache_reg(pd, addr, length, access);
+
+	return verbs_reg_mr_uncached(pd, addr, length, access);
+}
 default_symver(__ibv_reg_mr, ibv_reg_mr);
 
 int __ibv_rereg_mr(struct ibv_mr *mr, int flags,
@@ -309,6 +321,14 @@ int __ibv_rereg_mr(struct ibv_mr *mr, int flags,
 		return IBV_REREG_MR_ERR_INPUT;
 	}
 
+	if (verbs_mr_cache_enabled) {
+		err = verbs_mr_cache_detach(mr);
+		if (err) {
+			errno = err;
+			return IBV_REREG_MR_ERR_INPUT;
+		}
+	}
+
 	if (flags & IBV_REREG_MR_CHANGE_TRANSLATION) {
 		err = ibv_dontfork_range(addr, length);
 		if (err)
@@ -341,7 +361,7 @@ int __ibv_rereg_mr(struct ibv_mr *mr, int flags,
 }
 default_symver(__ibv_rereg_mr, ibv_rereg_mr);
 
-int __ibv_dereg_mr(struct ibv_mr *mr)
+int verbs_dereg_mr_uncached(struct ibv_mr *mr)
 {
 	int ret;
 	void *addr	= mr->addr;
@@ -353,6 +373,14 @@ int __ibv_dereg_mr(struct ibv_mr *mr)
 
 	return ret;
 }
+
+int __ibv_dereg_mr(struct ibv_mr *mr)
+{
+	if (verbs_mr_cache_enabled && verbs_mr_cache_put(mr))
+		return 0;
+
+	return verbs_dereg_mr_uncached(mr);
+}
 default_symver(__ibv_dereg_mr, ibv_dereg_mr);
 
 static struct ibv_comp_channel *ibv_create_comp_channel_v2(struct ibv_context *context)
@@ -450,6 +478,192 @@ struct ibv_cq *__ibv_create_cq(struct ibv_context *context, int cqe, void *cq_co
 }
 default_symver(__ibv_create_cq, ibv_create_cq);
 
+static inline struct verbs_cq *to_verbs_cq(struct ibv_cq_ex *cq_ex)
+{
+	return container_of(cq_ex, struct verbs_cq, cq_ex);
+}
+
+static inline struct ibv_wc *emul_cur_wc(struct ibv_cq_ex *cq_ex)
+{
+	struct verbs_cq *vcq = to_verbs_cq(cq_ex);
+
+	return &vcq->emul_wc[vcq->emul_cur];
+}
+
+/*
+ * Make the next batched completion current, polling the provider for a new
+ * batch once the previous one has been consumed.
+ */
+static int emul_load_wc(struct verbs_cq *vcq)
+{
+	struct ibv_wc *wc;
+	int ret;
+
+	if (vcq->emul_cur >= vcq->emul_cnt) {
+		ret = vcq->cq.context->ops.poll_cq(&vcq->cq, VERBS_CQ_EMUL_BATCH,
+						   vcq->emul_wc);
+		vcq->emul_cur = 0;
+		vcq->emul_cnt = ret > 0 ? ret : 0;
+		if (ret <= 0)
+			return ret ? EINVAL : ENOENT;
+	}
+
+	wc = &vcq->emul_wc[vcq->emul_cur];
+	vcq->cq_ex.status = wc->status;
+	vcq->cq_ex.wr_id = wc->wr_id;
+	return 0;
+}
+
+static int emul_start_poll(struct ibv_cq_ex *cq_ex,
+			   struct ibv_poll_cq_attr *attr)
+{
+	if (attr->comp_mask)
+		return EINVAL;
+
+	return emul_load_wc(to_verbs_cq(cq_ex));
+}
+
+static int emul_start_poll_lock(struct ibv_cq_ex *cq_ex,
+				struct ibv_poll_cq_attr *attr)
+{
+	struct verbs_cq *vcq = to_verbs_cq(cq_ex);
+	int ret;
+
+	if (attr->comp_mask)
+		return EINVAL;
+
+	pthread_spin_lock(&vcq->emul_lock);
+	ret = emul_load_wc(vcq);
+	if (ret)
+		pthread_spin_unlock(&vcq->emul_lock);
+	return ret;
+}
+
+static int emul_next_poll(struct ibv_cq_ex *cq_ex)
+{
+	struct verbs_cq *vcq = to_verbs_cq(cq_ex);
+
+	vcq->emul_cur++;
+	return emul_load_wc(vcq);
+}
+
+/* The current completion was read by the caller, so it is consumed here. */
+static void emul_end_poll(struct ibv_cq_ex *cq_ex)
+{
+	struct verbs_cq *vcq = to_verbs_cq(cq_ex);
+
+	if (vcq->emul_cur < vcq->emul_cnt)
+		vcq->emul_cur++;
+}
+
+static void emul_end_poll_lock(struct ibv_cq_ex *cq_ex)
+{
+	emul_end_poll(cq_ex);
+	pthread_spin_unlock(&to_verbs_cq(cq_ex)->emul_lock);
+}
+
+static enum ibv_wc_opcode emul_read_opcode(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->opcode;
+}
+
+static uint32_t emul_read_vendor_err(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->vendor_err;
+}
+
+static uint32_t emul_read_byte_len(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->byte_len;
+}
+
+static uint32_t emul_read_imm_data(struct ibv_cq_ex *cq_ex)
+{
+	return (__force uint32_t) emul_cur_wc(cq_ex)->imm_data;
+}
+
+static uint32_t emul_read_qp_num(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->qp_num;
+}
+
+static uint32_t emul_read_src_qp(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->src_qp;
+}
+
+static int emul_read_wc_flags(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->wc_flags;
+}
+
+static uint32_t emul_read_slid(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->slid;
+}
+
+static uint8_t emul_read_sl(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->sl;
+}
+
+static uint8_t emul_read_dlid_path_bits(struct ibv_cq_ex *cq_ex)
+{
+	return emul_cur_wc(cq_ex)->dlid_path_bits;
+}
+
+struct ibv_cq_ex *verbs_create_cq_ex_emul(struct ibv_context *context,
+					  struct ibv_cq_init_attr_ex *cq_attr)
+{
+	struct verbs_cq *vcq;
+	struct ibv_cq *cq;
+	int single = verbs_single_threaded(context);
+
+	if (cq_attr->wc_flags & ~IBV_WC_STANDARD_FLAGS) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	if (cq_attr->comp_mask & IBV_CQ_INIT_ATTR_MASK_FLAGS) {
+		if (cq_attr->flags & ~IBV_CREATE_CQ_ATTR_SINGLE_THREADED) {
+			errno = EOPNOTSUPP;
+			return NULL;
+		}
+		if (cq_attr->flags & IBV_CREATE_CQ_ATTR_SINGLE_THREADED)
+			single = 1;
+	}
+
+	cq = context->ops.create_cq(context, cq_attr->cqe, cq_attr->channel,
+				    cq_attr->comp_vector);
+	if (!cq)
+		return NULL;
+
+	vcq = container_of(cq, struct verbs_cq, cq);
+	pthread_spin_init(&vcq->emul_lock, PTHREAD_PROCESS_PRIVATE);
+	vcq->emul_cur = 0;
+	vcq->emul_cnt = 0;
+
+	vcq->cq_ex.comp_mask = 0;
+	vcq->cq_ex.start_poll = single ? emul_start_poll : emul_start_poll_lock;
+	vcq->cq_ex.next_poll = emul_next_poll;
+	vcq->cq_ex.end_poll = single ? emul_end_poll : emul_end_poll_lock;
+	vcq->cq_ex.read_opcode = emul_read_opcode;
+	vcq->cq_ex.read_vendor_err = emul_read_vendor_err;
+	vcq->cq_ex.read_wc_flags = emul_read_wc_flags;
+	vcq->cq_ex.read_byte_len = emul_read_byte_len;
+	vcq->cq_ex.read_imm_data = emul_read_imm_data;
+	vcq->cq_ex.read_qp_num = emul_read_qp_num;
+	vcq->cq_ex.read_src_qp = emul_read_src_qp;
+	vcq->cq_ex.read_slid = emul_read_slid;
+	vcq->cq_ex.read_sl = emul_read_sl;
+	vcq->cq_ex.read_dlid_path_bits = emul_read_dlid_path_bits;
+	vcq->cq_ex.read_completion_ts = NULL;
+	vcq->cq_ex.read_cvlan = NULL;
+	vcq->cq_ex.read_flow_tag = NULL;
+
+	return &vcq->cq_ex;
+}
+
 int __ibv_resize_cq(struct ibv_cq *cq, int cqe)
 {
 	if (!cq->context->ops.resize_cq)
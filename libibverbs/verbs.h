@@ -2335,6 +2335,14 @@ int ibv_detach_mcast(struct ibv_qp *qp, const union ibv_gid *gid, uint16_t lid);
  */
 int ibv_fork_init(void);
 
+/**
+ * ibv_set_single_threaded - Promise that each QP, CQ, SRQ and WQ
+ * created on @context from now on is only used by one thread at a
+ * time, so the provider may skip the locks protecting them.  Returns 0
+ * on success or EOPNOTSUPP if the provider does not support it.
+ */
+int ibv_set_single_threaded(struct ibv_context *context, int single_threaded);
+
 /**
  * ibv_node_type_str - Return string describing node_type enum value
  */
@@ -48,6 +48,7 @@
 #include <netdb.h>
 #include <syslog.h>
 #include <limits.h>
+#include <search.h>
 
 #include "cma.h"
 #include "indexer.h"
@@ -76,7 +77,14 @@ struct cma_port {
 	uint8_t			link_layer;
 };
 
+/*
+ * Devices are discovered in ucma_init(), but a verbs context is only opened
+ * when an id binds to the device or the application asks for the device
+ * list, and device and port attributes are only queried once an id uses
+ * the device.
+ */
 struct cma_device {
+	struct ibv_device  *dev;		/* until verbs is opened */
 	struct ibv_context *verbs;
 	struct ibv_pd	   *pd;
 	struct ibv_xrcd    *xrcd;
@@ -123,16 +131,29 @@ struct cma_event {
 	uint8_t			private_data[RDMA_MAX_PRIVATE_DATA];
 	struct cma_id_private	*id_priv;
 	struct cma_multicast	*mc;
+	struct cma_event	*next;
 };
 
+/*
+ * Acknowledged events are kept on a free list and reused by later
+ * rdma_get_cm_event calls, so a busy listener does not go through
+ * malloc and free for every connection request.
+ */
+#define CMA_EVENT_POOL_MAX 64
+
 static struct cma_device *cma_dev_array;
 static int cma_dev_cnt;
 static int cma_init_cnt;
+static int cma_open_cnt;
+static struct ibv_device **cma_dev_list;	/* until all devices are open */
 static pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
 static int abi_ver = RDMA_USER_CM_MAX_ABI_VERSION;
 int af_ib_support;
 static struct index_map ucma_idm;
 static fastlock_t idm_lock;
+static struct cma_event *evt_pool;
+static int evt_pool_cnt;
+static fastlock_t evt_lock;
 
 static int check_abi_version(void)
 {
@@ -202,6 +223,7 @@ int ucma_init(void)
 	}
 
 	fastlock_init(&idm_lock);
+	fastlock_init(&evt_lock);
 	ret = check_abi_version();
 	if (ret)
 		goto err1;
@@ -223,69 +245,72 @@ int ucma_init(void)
 		goto err2;
 	}
 
-	for (i = 0; dev_list[i]; i++)
+	for (i = 0; dev_list[i]; i++) {
+		cma_dev_array[i].dev = dev_list[i];
 		cma_dev_array[i].guid = ibv_get_device_guid(dev_list[i]);
+	}
 
+	/*
+	 * The ibv_device pointers are only valid while the list is held, so
+	 * it is kept until every device has been opened.
+	 */
+	cma_dev_list = dev_list;
 	cma_dev_cnt = dev_cnt;
 	ucma_set_af_ib_support();
 	pthread_mutex_unlock(&mut);
-	ibv_free_device_list(dev_list);
 	return 0;
 
 err2:
 	ibv_free_device_list(dev_list);
 err1:
+	fastlock_destroy(&evt_lock);
 	fastlock_destroy(&idm_lock);
 	pthread_mutex_unlock(&mut);
 	return ret;
 }
 
-static struct ibv_context *ucma_open_device(__be64 guid)
+/* Caller must hold mut */
+static int ucma_open_device(struct cma_device *cma_dev)
 {
-	struct ibv_device **dev_list;
-	struct ibv_context *verbs = NULL;
-	int i;
+	if (cma_dev->verbs)
+		return 0;
 
-	dev_list = ibv_get_device_list(NULL);
-	if (!dev_list) {
-		return NULL;
-	}
+	cma_dev->verbs = ibv_open_device(cma_dev->dev);
+	if (!cma_dev->verbs)
+		return ERR(ENODEV);
 
-	for (i = 0; dev_list[i]; i++) {
-		if (ibv_get_device_guid(dev_list[i]) == guid) {
-			verbs = ibv_open_device(dev_list[i]);
-			break;
-		}
+	cma_dev->dev = NULL;
+	if (++cma_open_cnt == cma_dev_cnt) {
+		ibv_free_device_list(cma_dev_list);
+		cma_dev_list = NULL;
 	}
-
-	ibv_free_device_list(dev_list);
-	return verbs;
+	return 0;
 }
 
+/*
+ * Caller must hold mut.  The verbs context is left open on failure, since
+ * it may already have been returned to the user by rdma_get_devices().
+ */
 static int ucma_init_device(struct cma_device *cma_dev)
 {
 	struct ibv_port_attr port_attr;
 	struct ibv_device_attr attr;
 	int i, ret;
 
-	if (cma_dev->verbs)
+	if (cma_dev->port)
 		return 0;
 
-	cma_dev->verbs = ucma_open_device(cma_dev->guid);
-	if (!cma_dev->verbs)
-		return ERR(ENODEV);
+	ret = ucma_open_device(cma_dev);
+	if (ret)
+		return ret;
 
 	ret = ibv_query_device(cma_dev->verbs, &attr);
-	if (ret) {
-		ret = ERR(ret);
-		goto err;
-	}
+	if (ret)
+		return ERR(ret);
 
 	cma_dev->port = malloc(sizeof(*cma_dev->port) * attr.phys_port_cnt);
-	if (!cma_dev->port) {
-		ret = ERR(ENOMEM);
-		goto err;
-	}
+	if (!cma_dev->port)
+		return ERR(ENOMEM);
 
 	for (i = 1; i <= attr.phys_port_cnt; i++) {
 		if (ibv_query_port(cma_dev->verbs, i, &port_attr))
@@ -300,11 +325,6 @@ static int ucma_init_device(struct cma_device *cma_dev)
 	cma_dev->max_responder_resources = (uint8_t) attr.max_qp_rd_atom;
 	cma_init_cnt++;
 	return 0;
-
-err:
-	ibv_close_device(cma_dev->verbs);
-	cma_dev->verbs = NULL;
-	return ret;
 }
 
 static int ucma_init_all(void)
@@ -330,12 +350,23 @@ static int ucma_init_all(void)
 	return ret;
 }
 
+/*
+ * The device list must hand out verbs contexts, but the devices are not
+ * queried and no PD is allocated until an id is bound to them.
+ */
 struct ibv_context **rdma_get_devices(int *num_devices)
 {
 	struct ibv_context **devs = NULL;
-	int i;
+	int i, ret = 0;
+
+	if (ucma_init())
+		goto out;
 
-	if (ucma_init_all())
+	pthread_mutex_lock(&mut);
+	for (i = 0; i < cma_dev_cnt && !ret; i++)
+		ret = ucma_open_device(&cma_dev_array[i]);
+	pthread_mutex_unlock(&mut);
+	if (ret)
 		goto out;
 
 	devs = malloc(sizeof(*devs) * (cma_dev_cnt + 1));
@@ -421,8 +452,11 @@ static void ucma_put_device(struct cma_device *cma_dev)
 	pthread_mutex_lock(&mut);
 	if (!--cma_dev->refcnt) {
 		ibv_dealloc_pd(cma_dev->pd);
-		if (cma_dev->xrcd)
+		cma_dev->pd = NULL;
+		if (cma_dev->xrcd) {
 			ibv_close_xrcd(cma_dev->xrcd);
+			cma_dev->xrcd = NULL;
+		}
 	}
 	pthread_mutex_unlock(&mut);
 }
@@ -1865,6 +1899,34 @@ static void ucma_complete_mc_event(struct cma_multicast *mc)
 	pthread_mutex_unlock(&mc->id_priv->mut);
 }
 
+static struct cma_event *ucma_alloc_event(void)
+{
+	struct cma_event *evt;
+
+	fastlock_acquire(&evt_lock);
+	evt = evt_pool;
+	if (evt) {
+		evt_pool = evt->next;
+		evt_pool_cnt--;
+	}
+	fastlock_release(&evt_lock);
+
+	return evt ? evt : malloc(sizeof(*evt));
+}
+
+static void ucma_free_event(struct cma_event *evt)
+{
+	fastlock_acquire(&evt_lock);
+	if (evt_pool_cnt < CMA_EVENT_POOL_MAX) {
+		evt->next = evt_pool;
+		evt_pool = evt;
+		evt_pool_cnt++;
+		evt = NULL;
+	}
+	fastlock_release(&evt_lock);
+	free(evt);
+}
+
 int rdma_ack_cm_event(struct rdma_cm_event *event)
 {
 	struct cma_event *evt;
@@ -1878,7 +1940,7 @@ int rdma_ack_cm_event(struct rdma_cm_event *event)
 		ucma_complete_mc_event(evt->mc);
 	else
 		ucma_complete_event(evt->id_priv);
-	free(evt);
+	ucma_free_event(evt);
 	return 0;
 }
 
@@ -1911,11 +1973,17 @@ static void ucma_process_route_resolved(struct cma_event *evt)
 		evt->event.event = RDMA_CM_EVENT_ROUTE_ERROR;
 }
 
-static int ucma_query_req_info(struct rdma_cm_id *id)
+/*
+ * The route query returns the addresses, GIDs, pkey and paths in a single
+ * call, but its address fields cannot hold an AF_IB address.  Only fall
+ * back to the separate address, GID and path queries when the listener
+ * uses AF_IB addressing.
+ */
+static int ucma_query_req_info(struct rdma_cm_id *id, sa_family_t family)
 {
 	int ret;
 
-	if (!af_ib_support)
+	if (!af_ib_support || family != AF_IB)
 		return ucma_query_route(id);
 
 	ret = ucma_query_addr(id);
@@ -1961,7 +2029,8 @@ static int ucma_process_conn_req(struct cma_event *evt,
 			goto err2;
 	}
 
-	ret = ucma_query_req_info(&id_priv->id);
+	ret = ucma_query_req_info(&id_priv->id,
+				  evt->id_priv->id.route.addr.src_addr.sa_family);
 	if (ret)
 		goto err2;
 
@@ -2052,33 +2121,36 @@ static void ucma_copy_ud_event(struct cma_event *event,
 	dst->qkey = src->qkey;
 }
 
-int rdma_get_cm_event(struct rdma_event_channel *channel,
-		      struct rdma_cm_event **event)
+static int ucma_event_ready(struct rdma_event_channel *channel)
+{
+	struct pollfd fds;
+
+	fds.fd = channel->fd;
+	fds.events = POLLIN;
+	fds.revents = 0;
+	return poll(&fds, 1, 0) > 0 && (fds.revents & POLLIN);
+}
+
+/*
+ * With nonblock set, EAGAIN is returned rather than waiting for an event,
+ * including after events that are consumed internally.
+ */
+static int ucma_get_event(struct rdma_event_channel *channel,
+			  struct cma_event *evt, int nonblock)
 {
 	struct ucma_abi_event_resp resp;
 	struct ucma_abi_get_event cmd;
-	struct cma_event *evt;
 	int ret;
 
-	ret = ucma_init();
-	if (ret)
-		return ret;
-
-	if (!event)
-		return ERR(EINVAL);
-
-	evt = malloc(sizeof(*evt));
-	if (!evt)
-		return ERR(ENOMEM);
-
 retry:
+	if (nonblock && !ucma_event_ready(channel))
+		return ERR(EAGAIN);
+
 	memset(evt, 0, sizeof(*evt));
 	CMA_INIT_CMD_RESP(&cmd, sizeof cmd, GET_EVENT, &resp, sizeof resp);
 	ret = write(channel->fd, &cmd, sizeof cmd);
-	if (ret != sizeof cmd) {
-		free(evt);
+	if (ret != sizeof cmd)
 		return (ret >= 0) ? ERR(ENODATA) : -1;
-	}
 	
 	VALGRIND_MAKE_MEM_DEFINED(&resp, sizeof resp);
 
@@ -2186,10 +2258,72 @@ retry:
 		break;
 	}
 
+	return 0;
+}
+
+int rdma_get_cm_event(struct rdma_event_channel *channel,
+		      struct rdma_cm_event **event)
+{
+	struct cma_event *evt;
+	int ret;
+
+	ret = ucma_init();
+	if (ret)
+		return ret;
+
+	if (!event)
+		return ERR(EINVAL);
+
+	evt = ucma_alloc_event();
+	if (!evt)
+		return ERR(ENOMEM);
+
+	ret = ucma_get_event(channel, evt, 0);
+	if (ret) {
+		ucma_free_event(evt);
+		return ret;
+	}
+
 	*event = &evt->event;
 	return 0;
 }
 
+int rdma_get_cm_events(struct rdma_event_channel *channel,
+		       struct rdma_cm_event **events, int count)
+{
+	struct cma_event *evt;
+	int ret, i;
+
+	ret = ucma_init();
+	if (ret)
+		return ret;
+
+	if (!events || count <= 0)
+		return ERR(EINVAL);
+
+	for (i = 0; i < count; i++) {
+		evt = ucma_alloc_event();
+		if (!evt) {
+			if (i)
+				break;
+			return ERR(ENOMEM);
+		}
+
+		/* Only the first event is waited for */
+		ret = ucma_get_event(channel, evt, i > 0);
+		if (ret) {
+			ucma_free_event(evt);
+			if (i)
+				break;
+			return ret;
+		}
+
+		events[i] = &evt->event;
+	}
+
+	return i;
+}
+
 const char *rdma_event_str(enum rdma_cm_event_type event)
 {
 	switch (event) {
@@ -2307,6 +2441,371 @@ int rdma_migrate_id(struct rdma_cm_id *id, struct rdma_event_channel *channel)
 	return 0;
 }
 
+/*
+ * Batch connection establishment.  All steps for every id are driven from
+ * a single event loop, so address resolution, route resolution, QP creation
+ * and connection setup of different ids overlap.  On InfiniBand, ids that
+ * resolve to the same source port and destination GID share a single SA
+ * route query; the resulting path is pushed to the other ids with
+ * RDMA_OPTION_IB_PATH.
+ */
+enum ucma_batch_state {
+	UCMA_BATCH_ADDR,
+	UCMA_BATCH_ROUTE,
+	UCMA_BATCH_CONNECT,
+	UCMA_BATCH_DONE
+};
+
+struct ucma_batch_route;
+
+struct ucma_batch_ent {
+	struct rdma_batch_conn	*conn;
+	struct rdma_event_channel *channel;	/* the caller's, restored after */
+	enum ucma_batch_state	state;
+	struct ucma_batch_route	*route;
+	struct ucma_batch_ent	*next_waiter;
+};
+
+struct ucma_batch_route {
+	struct cma_device	*cma_dev;
+	union ibv_gid		sgid;
+	union ibv_gid		dgid;
+	__be16			pkey;
+	uint8_t			port_num;
+	/* key ends here */
+	int			resolved;
+	struct ucma_batch_ent	*owner;
+	struct ucma_batch_ent	*waiters;
+	struct ibv_path_data	path;
+	struct ucma_batch_route	*next;
+};
+
+#define UCMA_BATCH_ROUTE_KEY_LEN offsetof(struct ucma_batch_route, resolved)
+
+struct ucma_batch {
+	struct ucma_batch_ent	*ents;
+	struct ucma_batch_ent	**sorted;
+	int			count;
+	int			pending;
+	int			timeout_ms;
+	void			*route_map;
+	struct ucma_batch_route	*route_list;
+};
+
+static int ucma_batch_compare_ent(const void *e1, const void *e2)
+{
+	uintptr_t id1 = (uintptr_t) (*(struct ucma_batch_ent **) e1)->conn->id;
+	uintptr_t id2 = (uintptr_t) (*(struct ucma_batch_ent **) e2)->conn->id;
+
+	return (id1 > id2) - (id1 < id2);
+}
+
+static int ucma_batch_compare_route(const void *r1, const void *r2)
+{
+	return memcmp(r1, r2, UCMA_BATCH_ROUTE_KEY_LEN);
+}
+
+static struct ucma_batch_ent *
+ucma_batch_lookup(struct ucma_batch *batch, struct rdma_cm_id *id)
+{
+	struct rdma_batch_conn conn = { .id = id };
+	struct ucma_batch_ent ent = { .conn = &conn }, *key = &ent, **found;
+
+	found = bsearch(&key, batch->sorted, batch->count, sizeof(*found),
+			ucma_batch_compare_ent);
+	return found ? *found : NULL;
+}
+
+static void ucma_batch_fail(struct ucma_batch *batch,
+			    struct ucma_batch_ent *ent, int status)
+{
+	if (ent->state == UCMA_BATCH_DONE)
+		return;
+
+	ent->conn->status = status ? status : EIO;
+	ent->state = UCMA_BATCH_DONE;
+	batch->pending--;
+}
+
+static void ucma_batch_connect(struct ucma_batch *batch,
+			       struct ucma_batch_ent *ent)
+{
+	ent->state = UCMA_BATCH_CONNECT;
+	if (rdma_connect(ent->conn->id, ent->conn->conn_param))
+		ucma_batch_fail(batch, ent, errno);
+}
+
+static void ucma_batch_resolve_route(struct ucma_batch *batch,
+				     struct ucma_batch_ent *ent)
+{
+	ent->state = UCMA_BATCH_ROUTE;
+	if (rdma_resolve_route(ent->conn->id, batch->timeout_ms))
+		ucma_batch_fail(batch, ent, errno);
+}
+
+static void ucma_batch_set_path(struct ucma_batch *batch,
+				struct ucma_batch_ent *ent,
+				struct ibv_path_data *path)
+{
+	ent->state = UCMA_BATCH_ROUTE;
+	if (rdma_set_option(ent->conn->id, RDMA_OPTION_IB, RDMA_OPTION_IB_PATH,
+			    path, sizeof(*path)))
+		ucma_batch_resolve_route(batch, ent);
+}
+
+/*
+ * Hand the route owner's result to all ids waiting on it.  If the owner
+ * failed, each waiter resolves its route on its own.
+ */
+static void ucma_batch_release_waiters(struct ucma_batch *batch,
+				       struct ucma_batch_route *route)
+{
+	struct ucma_batch_ent *ent;
+
+	while ((ent = route->waiters)) {
+		route->waiters = ent->next_waiter;
+		if (ent->state == UCMA_BATCH_DONE)
+			continue;
+		if (route->resolved)
+			ucma_batch_set_path(batch, ent, &route->path);
+		else
+			ucma_batch_resolve_route(batch, ent);
+	}
+	route->owner = NULL;
+}
+
+static void ucma_batch_addr_resolved(struct ucma_batch *batch,
+				     struct ucma_batch_ent *ent)
+{
+	struct rdma_batch_conn *conn = ent->conn;
+	struct cma_id_private *id_priv;
+	struct ucma_batch_route key, *route, **troute;
+
+	id_priv = container_of(conn->id, struct cma_id_private, id);
+	if (conn->qp_init_attr &&
+	    rdma_create_qp(conn->id, conn->pd, conn->qp_init_attr)) {
+		ucma_batch_fail(batch, ent, errno);
+		return;
+	}
+
+	if (!id_priv->cma_dev || !conn->id->port_num ||
+	    id_priv->cma_dev->port[conn->id->port_num - 1].link_layer !=
+	    IBV_LINK_LAYER_INFINIBAND) {
+		ucma_batch_resolve_route(batch, ent);
+		return;
+	}
+
+	memset(&key, 0, sizeof key);
+	key.cma_dev = id_priv->cma_dev;
+	key.sgid = conn->id->route.addr.addr.ibaddr.sgid;
+	key.dgid = conn->id->route.addr.addr.ibaddr.dgid;
+	key.pkey = conn->id->route.addr.addr.ibaddr.pkey;
+	key.port_num = conn->id->port_num;
+
+	troute = tfind(&key, &batch->route_map, ucma_batch_compare_route);
+	if (troute) {
+		route = *troute;
+		if (route->resolved) {
+			ucma_batch_set_path(batch, ent, &route->path);
+			return;
+		}
+		if (route->owner) {
+			ent->state = UCMA_BATCH_ROUTE;
+			ent->next_waiter = route->waiters;
+			route->waiters = ent;
+			return;
+		}
+		/* The previous owner failed, become the owner */
+	} else {
+		route = calloc(1, sizeof(*route));
+		if (!route) {
+			ucma_batch_resolve_route(batch, ent);
+			return;
+		}
+		memcpy(route, &key, UCMA_BATCH_ROUTE_KEY_LEN);
+		route->next = batch->route_list;
+		batch->route_list = route;
+		tsearch(route, &batch->route_map, ucma_batch_compare_route);
+	}
+
+	route->owner = ent;
+	ent->route = route;
+	ucma_batch_resolve_route(batch, ent);
+	if (ent->state == UCMA_BATCH_DONE)
+		ucma_batch_release_waiters(batch, route);
+}
+
+static void ucma_batch_route_resolved(struct ucma_batch *batch,
+				      struct ucma_batch_ent *ent)
+{
+	struct ucma_batch_route *route = ent->route;
+
+	if (route && route->owner == ent) {
+		if (ent->conn->id->route.num_paths) {
+			ucma_convert_sa_path(&ent->conn->id->route.path_rec[0],
+					     &route->path,
+					     IBV_PATH_FLAG_GMP |
+					     IBV_PATH_FLAG_PRIMARY |
+					     IBV_PATH_FLAG_BIDIRECTIONAL);
+			route->resolved = 1;
+		}
+		ucma_batch_release_waiters(batch, route);
+	}
+
+	ucma_batch_connect(batch, ent);
+}
+
+static int ucma_batch_event_status(struct rdma_cm_event *event)
+{
+	switch (event->event) {
+	case RDMA_CM_EVENT_REJECTED:
+		return ECONNREFUSED;
+	case RDMA_CM_EVENT_UNREACHABLE:
+		return event->status ? -event->status : EHOSTUNREACH;
+	case RDMA_CM_EVENT_DISCONNECTED:
+	case RDMA_CM_EVENT_DEVICE_REMOVAL:
+		return ECONNRESET;
+	default:
+		return event->status < 0 ? -event->status : EIO;
+	}
+}
+
+static void ucma_batch_process_event(struct ucma_batch *batch,
+				     struct ucma_batch_ent *ent,
+				     struct rdma_cm_event *event)
+{
+	if (ent->state == UCMA_BATCH_DONE)
+		return;
+
+	switch (event->event) {
+	case RDMA_CM_EVENT_ADDR_RESOLVED:
+		ucma_batch_addr_resolved(batch, ent);
+		break;
+	case RDMA_CM_EVENT_ROUTE_RESOLVED:
+		ucma_batch_route_resolved(batch, ent);
+		break;
+	case RDMA_CM_EVENT_ESTABLISHED:
+		ent->conn->status = 0;
+		ent->state = UCMA_BATCH_DONE;
+		batch->pending--;
+		break;
+	case RDMA_CM_EVENT_ADDR_ERROR:
+	case RDMA_CM_EVENT_ROUTE_ERROR:
+	case RDMA_CM_EVENT_CONNECT_ERROR:
+	case RDMA_CM_EVENT_UNREACHABLE:
+	case RDMA_CM_EVENT_REJECTED:
+	case RDMA_CM_EVENT_DISCONNECTED:
+	case RDMA_CM_EVENT_DEVICE_REMOVAL:
+		ucma_batch_fail(batch, ent, ucma_batch_event_status(event));
+		if (ent->route && ent->route->owner == ent)
+			ucma_batch_release_waiters(batch, ent->route);
+		break;
+	default:
+		break;
+	}
+}
+
+static void ucma_batch_noop_free(void *node)
+{
+}
+
+/*
+ * The ids are moved to a private event channel for the duration of the
+ * call, so events for other ids on the caller's channel are left alone.
+ */
+int rdma_connect_batch(struct rdma_batch_conn *conns, int count, int timeout_ms)
+{
+	struct rdma_event_channel *channel = NULL;
+	struct ucma_batch_route *route;
+	struct cma_id_private *id_priv;
+	struct rdma_cm_event *event;
+	struct ucma_batch_ent *ent;
+	struct ucma_batch batch;
+	int i, migrated = 0, ret = 0;
+
+	if (!conns || count <= 0)
+		return ERR(EINVAL);
+
+	for (i = 0; i < count; i++) {
+		if (!conns[i].id || !conns[i].dst_addr)
+			return ERR(EINVAL);
+		id_priv = container_of(conns[i].id, struct cma_id_private, id);
+		if (id_priv->sync)
+			return ERR(EINVAL);
+	}
+
+	memset(&batch, 0, sizeof batch);
+	batch.count = count;
+	batch.timeout_ms = timeout_ms;
+	batch.ents = calloc(count, sizeof(*batch.ents));
+	batch.sorted = calloc(count, sizeof(*batch.sorted));
+	if (!batch.ents || !batch.sorted) {
+		ret = ERR(ENOMEM);
+		goto out;
+	}
+
+	channel = rdma_create_event_channel();
+	if (!channel) {
+		ret = -1;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		batch.ents[i].conn = &conns[i];
+		batch.ents[i].channel = conns[i].id->channel;
+		batch.sorted[i] = &batch.ents[i];
+	}
+	qsort(batch.sorted, count, sizeof(*batch.sorted), ucma_batch_compare_ent);
+
+	for (migrated = 0; migrated < count; migrated++) {
+		if (rdma_migrate_id(conns[migrated].id, channel)) {
+			ret = -1;
+			goto out;
+		}
+	}
+
+	batch.pending = count;
+	for (i = 0; i < count; i++) {
+		conns[i].status = EINPROGRESS;
+		if (rdma_resolve_addr(conns[i].id, conns[i].src_addr,
+				      conns[i].dst_addr, timeout_ms))
+			ucma_batch_fail(&batch, &batch.ents[i], errno);
+	}
+
+	while (batch.pending) {
+		if (rdma_get_cm_event(channel, &event)) {
+			ret = -1;
+			break;
+		}
+
+		ent = ucma_batch_lookup(&batch, event->id);
+		if (ent)
+			ucma_batch_process_event(&batch, ent, event);
+		rdma_ack_cm_event(event);
+	}
+
+	for (i = 0; i < count && !ret; i++) {
+		if (conns[i].status)
+			ret = ERR(conns[i].status);
+	}
+out:
+	while (migrated--) {
+		if (rdma_migrate_id(conns[migrated].id,
+				    batch.ents[migrated].channel) && !ret)
+			ret = -1;
+	}
+	if (channel)
+		rdma_destroy_event_channel(channel);
+	tdestroy(batch.route_map, ucma_batch_noop_free);
+	while ((route = batch.route_list)) {
+		batch.route_list = route->next;
+		free(route);
+	}
+	free(batch.sorted);
+	free(batch.ents);
+	return ret;
+}
+
 static int ucma_passive_ep(struct rdma_cm_id *id, struct rdma_addrinfo *res,
 			   struct ibv_pd *pd, struct ibv_qp_init_attr *qp_init_attr)
 {
@@ -2435,6 +2934,47 @@ int ucma_max_qpsize(struct rdma_cm_id *id)
 	return max_size;
 }
 
+/*
+ * Pin the device and PD used by an id for the lifetime of the process, so
+ * memory registered against the PD can outlive the id.
+ */
+int ucma_hold_pd(struct rdma_cm_id *id)
+{
+	struct cma_id_private *id_priv;
+
+	id_priv = container_of(id, struct cma_id_private, id);
+	if (!id_priv->cma_dev || !id->pd)
+		return ERR(ENODEV);
+
+	pthread_mutex_lock(&mut);
+	id_priv->cma_dev->refcnt++;
+	pthread_mutex_unlock(&mut);
+	return 0;
+}
+
+/* Convert a path record to the RDMA_OPTION_IB_PATH format */
+void ucma_convert_sa_path(struct ibv_sa_path_rec *sa_path,
+			  struct ibv_path_data *path_data, uint32_t flags)
+{
+	memset(path_data, 0, sizeof(*path_data));
+	path_data->flags = flags;
+	path_data->path.dgid = sa_path->dgid;
+	path_data->path.sgid = sa_path->sgid;
+	path_data->path.dlid = sa_path->dlid;
+	path_data->path.slid = sa_path->slid;
+	path_data->path.flowlabel_hoplimit =
+		htobe32((be32toh(sa_path->flow_label) << 8) | sa_path->hop_limit);
+	path_data->path.tclass = sa_path->traffic_class;
+	path_data->path.reversible_numpath = (sa_path->reversible << 7) | 1;
+	path_data->path.pkey = sa_path->pkey;
+	path_data->path.qosclass_sl = htobe16(sa_path->sl & 0xF);
+	/* selector 2: exactly */
+	path_data->path.mtu = (2 << 6) | (sa_path->mtu & 0x3F);
+	path_data->path.rate = (2 << 6) | (sa_path->rate & 0x3F);
+	path_data->path.packetlifetime = (2 << 6) |
+					 (sa_path->packet_life_time & 0x3F);
+}
+
 __be16 ucma_get_port(struct sockaddr *addr)
 {
 	switch (addr->sa_family) {
@@ -72,6 +72,12 @@ static inline void fastlock_acquire(fastlock_t *lock)
 	if (atomic_fetch_add(&lock->cnt, 1) > 0)
 		sem_wait(&lock->sem);
 }
+static inline int fastlock_tryacquire(fastlock_t *lock)
+{
+	int cnt = 0;
+
+	return atomic_compare_exchange_strong(&lock->cnt, &cnt, 1);
+}
 static inline void fastlock_release(fastlock_t *lock)
 {
 	if (atomic_fetch_sub(&lock->cnt, 1) > 1)
@@ -83,8 +89,11 @@ int ucma_addrlen(struct sockaddr *addr);
 void ucma_set_sid(enum rdma_port_space ps, struct sockaddr *addr,
 		  struct sockaddr_ib *sib);
 int ucma_max_qpsize(struct rdma_cm_id *id);
+int ucma_hold_pd(struct rdma_cm_id *id);
 int ucma_complete(struct rdma_cm_id *id);
 int ucma_shutdown(struct rdma_cm_id *id);
+void ucma_convert_sa_path(struct ibv_sa_path_rec *sa_path,
+			  struct ibv_path_data *path_data, uint32_t flags);
 
 static inline int ERR(int err)
 {
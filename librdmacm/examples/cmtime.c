@@ -52,6 +52,7 @@ static char *dst_addr;
 static char *src_addr;
 static int timeout = 2000;
 static int retries = 2;
+static int batch;
 
 enum step {
 	STEP_CREATE_ID,
@@ -106,6 +107,10 @@ static volatile int started[STEP_CNT];
 static volatile int completed[STEP_CNT];
 static struct ibv_qp_init_attr init_qp_attr;
 static struct rdma_conn_param conn_param;
+static struct timeval accept_start;
+static int accepted;
+
+#define EVENT_BATCH 16
 
 #define start_perf(n, s)	gettimeofday(&((n)->times[s][0]), NULL)
 #define end_perf(n, s)		gettimeofday(&((n)->times[s][1]), NULL)
@@ -181,7 +186,7 @@ static void show_perf(void)
 
 	printf("step              total ms     max ms     min us  us / conn\n");
 	for (i = 0; i < STEP_CNT; i++) {
-		if (i == STEP_BIND && !src_addr)
+		if (zero_time(&times[i][0]))
 			continue;
 
 		us = diff_us(&times[i][1], &times[i][0]);
@@ -214,6 +219,29 @@ static void disc_handler(struct node *n)
 	completed[STEP_DISCONNECT]++;
 }
 
+/*
+ * Report the rate at which connection requests are accepted, once for
+ * every set of 'connections' requests.  Only the request thread updates
+ * the counters.
+ */
+static void accept_handler(void)
+{
+	struct timeval now;
+	float us;
+
+	if (!accepted++)
+		gettimeofday(&accept_start, NULL);
+
+	if (accepted < connections)
+		return;
+
+	gettimeofday(&now, NULL);
+	us = diff_us(&now, &accept_start);
+	printf("accepted %d connections in %.2f ms: %.0f conn/s\n",
+	       accepted, us / 1000., us ? accepted * 1000000. / us : 0.);
+	accepted = 0;
+}
+
 static void __req_handler(struct rdma_cm_id *id)
 {
 	int ret;
@@ -229,6 +257,7 @@ static void __req_handler(struct rdma_cm_id *id)
 		perror("failure accepting");
 		goto err;
 	}
+	accept_handler();
 	return;
 
 err:
@@ -410,6 +439,19 @@ static void *process_events(void *arg)
 	return NULL;
 }
 
+static void process_event_batches(void)
+{
+	struct rdma_cm_event *events[EVENT_BATCH];
+	int i, cnt;
+
+	do {
+		cnt = rdma_get_cm_events(channel, events, EVENT_BATCH);
+		for (i = 0; i < cnt; i++)
+			cma_handler(events[i]->id, events[i]);
+	} while (cnt > 0);
+	perror("failure in rdma_get_cm_events in process_event_batches");
+}
+
 static int run_server(void)
 {
 	pthread_t req_thread, disc_thread;
@@ -478,12 +520,59 @@ static int run_server(void)
 		goto out;
 	}
 
-	process_events(NULL);
+	if (batch)
+		process_event_batches();
+	else
+		process_events(NULL);
  out:
 	rdma_destroy_id(listen_id);
 	return ret;
 }
 
+/*
+ * Address resolution, route resolution, QP creation and connection setup
+ * are all driven by rdma_connect_batch, which handles the events of the
+ * ids itself.  The event thread is only started afterwards, to handle
+ * disconnects.  The whole batch is reported as the connect step.
+ */
+static int run_batch(void)
+{
+	struct rdma_batch_conn *conns;
+	int i, ret;
+
+	conns = calloc(connections, sizeof *conns);
+	if (!conns)
+		return -ENOMEM;
+
+	for (i = 0; i < connections; i++) {
+		conns[i].id = nodes[i].id;
+		conns[i].src_addr = rai->ai_src_addr;
+		conns[i].dst_addr = rai->ai_dst_addr;
+		conns[i].qp_init_attr = &init_qp_attr;
+		conns[i].conn_param = &conn_param;
+	}
+
+	printf("connecting batch\n");
+	start_time(STEP_CONNECT);
+	ret = rdma_connect_batch(conns, connections, timeout);
+	end_time(STEP_CONNECT);
+	if (ret)
+		perror("failure connecting batch");
+
+	for (i = 0; i < connections; i++) {
+		nodes[i].times[STEP_CONNECT][0] = times[STEP_CONNECT][0];
+		nodes[i].times[STEP_CONNECT][1] = times[STEP_CONNECT][1];
+		if (conns[i].status) {
+			printf("connection %d failed, error: %d\n", i,
+			       conns[i].status);
+			nodes[i].error = 1;
+		}
+	}
+
+	free(conns);
+	return ret;
+}
+
 static int run_client(void)
 {
 	pthread_t event_thread;
@@ -501,12 +590,21 @@ static int run_client(void)
 	conn_param.private_data = rai->ai_connect;
 	conn_param.private_data_len = rai->ai_connect_len;
 
+	if (batch) {
+		ret = run_batch();
+		if (ret == -ENOMEM)
+			return ret;
+	}
+
 	ret = pthread_create(&event_thread, NULL, process_events, NULL);
 	if (ret) {
 		perror("failure creating event thread");
 		return ret;
 	}
 
+	if (batch)
+		goto disconnect;
+
 	if (src_addr) {
 		printf("binding source address\n");
 		start_time(STEP_BIND);
@@ -593,6 +691,7 @@ static int run_client(void)
 	while (started[STEP_CONNECT] != completed[STEP_CONNECT]) sched_yield();
 	end_time(STEP_CONNECT);
 
+disconnect:
 	printf("disconnecting\n");
 	start_time(STEP_DISCONNECT);
 	for (i = 0; i < connections; i++) {
@@ -614,7 +713,7 @@ int main(int argc, char **argv)
 
 	hints.ai_port_space = RDMA_PS_TCP;
 	hints.ai_qp_type = IBV_QPT_RC;
-	while ((op = getopt(argc, argv, "s:b:c:p:r:t:")) != -1) {
+	while ((op = getopt(argc, argv, "s:b:c:p:r:t:B")) != -1) {
 		switch (op) {
 		case 's':
 			dst_addr = optarg;
@@ -634,6 +733,9 @@ int main(int argc, char **argv)
 		case 't':
 			timeout = atoi(optarg);
 			break;
+		case 'B':
+			batch = 1;
+			break;
 		default:
 			printf("usage: %s\n", argv[0]);
 			printf("\t[-s server_address]\n");
@@ -642,6 +744,8 @@ int main(int argc, char **argv)
 			printf("\t[-p port_number]\n");
 			printf("\t[-r retries]\n");
 			printf("\t[-t timeout_ms]\n");
+			printf("\t[-B use rdma_connect_batch (client) or\n");
+			printf("\t     rdma_get_cm_events (server)]\n");
 			exit(1);
 		}
 	}
@@ -1150,24 +1150,69 @@ int dup2(int oldfd, int newfd)
 	return newfd;
 }
 
+/*
+ * Files are sent in windows of SENDFILE_CHUNK bytes, so a large transfer
+ * never needs a mapping of the whole range.  Readahead of the next window
+ * is started before the current one is written, which overlaps page cache
+ * misses with the transfer of the previous window.
+ */
+#define SENDFILE_CHUNK (1 << 20)
+
 ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
 {
+	struct stat st;
 	void *file_addr;
+	off_t pos, end, map_off;
+	size_t map_len, len;
+	ssize_t ret = 0, total = 0;
 	int fd;
-	size_t ret;
 
 	if (fd_get(out_fd, &fd) != fd_rsocket)
 		return real.sendfile(fd, in_fd, offset, count);
 
-	file_addr = mmap(NULL, count, PROT_READ, 0, in_fd, offset ? *offset : 0);
-	if (file_addr == (void *) -1)
+	pos = offset ? *offset : lseek(in_fd, 0, SEEK_CUR);
+	if (pos < 0 || fstat(in_fd, &st))
 		return -1;
 
-	ret = rwrite(fd, file_addr, count);
-	if ((ret > 0) && offset)
-		lseek(in_fd, ret, SEEK_CUR);
-	munmap(file_addr, count);
-	return ret;
+	end = pos + count;
+	if (end > st.st_size)
+		end = st.st_size;
+
+	while (pos < end) {
+		map_off = pos & ~((off_t) SENDFILE_CHUNK - 1);
+		map_len = end - map_off < SENDFILE_CHUNK ?
+			  end - map_off : SENDFILE_CHUNK;
+		if (map_off + SENDFILE_CHUNK < end)
+			posix_fadvise(in_fd, map_off + SENDFILE_CHUNK,
+				      SENDFILE_CHUNK, POSIX_FADV_WILLNEED);
+
+		file_addr = mmap(NULL, map_len, PROT_READ, MAP_SHARED,
+				 in_fd, map_off);
+		if (file_addr == MAP_FAILED) {
+			ret = -1;
+			break;
+		}
+
+		len = map_len - (pos - map_off);
+		ret = rwrite(fd, file_addr + (pos - map_off), len);
+		munmap(file_addr, map_len);
+		if (ret <= 0)
+			break;
+
+		pos += ret;
+		total += ret;
+		if ((size_t) ret < len)
+			break;
+	}
+
+	if (!total)
+		return ret;
+
+	if (offset)
+		*offset = pos;
+	else
+		lseek(in_fd, pos, SEEK_SET);
+	return total;
 }
 
 int __fxstat(int ver, int socket, struct stat *buf)
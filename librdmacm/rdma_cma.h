@@ -573,6 +573,24 @@ int rdma_leave_multicast(struct rdma_cm_id *id, struct sockaddr *addr);
 int rdma_get_cm_event(struct rdma_event_channel *channel,
 		      struct rdma_cm_event **event);
 
+/**
+ * rdma_get_cm_events - Retrieves a set of pending communication events.
+ * @channel: Event channel to check for events.
+ * @events: Array that receives the retrieved events.
+ * @count: Maximum number of events to retrieve.
+ * Description:
+ *   Retrieves up to count communication events.  The call waits for the
+ *   first event in the same way as rdma_get_cm_event, then returns any
+ *   further events that are already pending without waiting for more.
+ * Notes:
+ *   Returns the number of events retrieved, or -1 on error.  Each returned
+ *   event must be acknowledged by calling rdma_ack_cm_event.
+ * See also:
+ *   rdma_get_cm_event, rdma_ack_cm_event
+ */
+int rdma_get_cm_events(struct rdma_event_channel *channel,
+		       struct rdma_cm_event **events, int count);
+
 /**
  * rdma_ack_cm_event - Free a communication event.
  * @event: Event to be released.
@@ -665,6 +683,47 @@ int rdma_set_option(struct rdma_cm_id *id, int level, int optname,
  */
 int rdma_migrate_id(struct rdma_cm_id *id, struct rdma_event_channel *channel);
 
+/**
+ * rdma_batch_conn - Connection request for rdma_connect_batch.
+ * @id: Asynchronous communication identifier to connect.
+ * @src_addr: Optional source address, as for rdma_resolve_addr.
+ * @dst_addr: Destination address.
+ * @pd: Optional protection domain for the QP.
+ * @qp_init_attr: Optional attributes of a QP to create on the id.
+ * @conn_param: Optional connection parameters, as for rdma_connect.
+ * @status: Set to 0 if the connection was established, otherwise an errno.
+ */
+struct rdma_batch_conn {
+	struct rdma_cm_id	*id;
+	struct sockaddr		*src_addr;
+	struct sockaddr		*dst_addr;
+	struct ibv_pd		*pd;
+	struct ibv_qp_init_attr	*qp_init_attr;
+	struct rdma_conn_param	*conn_param;
+	int			status;
+};
+
+/**
+ * rdma_connect_batch - Establish a set of connections in parallel.
+ * @conns: Array of connection requests.
+ * @count: Number of entries in %conns.
+ * @timeout_ms: Address and route resolution timeout.
+ * Description:
+ *   Resolves the address and route of every id, creates the requested QPs
+ *   and connects them, overlapping all steps across the ids.  On InfiniBand,
+ *   ids that share a source port and destination GID issue a single path
+ *   record query.
+ * Notes:
+ *   The ids are moved to a private event channel while the call runs and
+ *   are returned to their own channels afterwards.  The caller must have
+ *   acknowledged all events already retrieved for them.
+ *   Returns 0 if every connection was established, otherwise -1 with errno
+ *   set from the first failed entry.
+ * See also:
+ *   rdma_resolve_addr, rdma_resolve_route, rdma_create_qp, rdma_connect
+ */
+int rdma_connect_batch(struct rdma_batch_conn *conns, int count, int timeout_ms);
+
 /**
  * rdma_getaddrinfo - RDMA address and route resolution service.
  */
@@ -46,6 +46,8 @@
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <inttypes.h>
 #include <search.h>
 #include <byteswap.h>
 #include <util/compiler.h>
@@ -64,6 +66,17 @@
 #define RS_QP_CTRL_SIZE 4	/* must be power of 2 */
 #define RS_CONN_RETRIES 6
 #define RS_SGL_SIZE 2
+#define RS_TUNE_PERIOD 1000000	/* us */
+#define RS_TUNE_STALLS 4
+#define RS_TUNE_SAMPLE 64	/* sends between send buffer tuning checks */
+#define RS_SRQ_DEFAULT_SIZE 4096
+#define RS_MAX_RAILS 4
+#define RS_RAIL_CHUNK (1 << 16)
+#define RS_RAIL_TIMEOUT 2000	/* ms */
+#define RS_CORK_SIZE (1 << 14)
+#define RS_CORK_TIMEOUT 200000	/* us */
+#define RS_SBUF_ACCESS IBV_ACCESS_LOCAL_WRITE
+#define RS_RBUF_ACCESS (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE)
 static struct index_map idm;
 static pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
 
@@ -75,7 +88,11 @@ enum {
 	RS_SVC_REM_DGRAM,
 	RS_SVC_ADD_KEEPALIVE,
 	RS_SVC_REM_KEEPALIVE,
-	RS_SVC_MOD_KEEPALIVE
+	RS_SVC_MOD_KEEPALIVE,
+	RS_SVC_ADD_CORK,
+	RS_SVC_REM_CORK,
+	RS_SVC_ADD_TUNE,
+	RS_SVC_REM_TUNE
 };
 
 struct rs_svc_msg {
@@ -107,6 +124,16 @@ static struct rs_svc tcp_svc = {
 	.context_size = sizeof(*tcp_svc_timeouts),
 	.run = tcp_svc_run
 };
+static void *cork_svc_run(void *arg);
+static struct rs_svc cork_svc = {
+	.context_size = 0,
+	.run = cork_svc_run
+};
+static void *tune_svc_run(void *arg);
+static struct rs_svc tune_svc = {
+	.context_size = 0,
+	.run = tune_svc_run
+};
 
 static uint16_t def_iomap_size = 0;
 static uint16_t def_inline = 64;
@@ -115,6 +142,12 @@ static uint16_t def_rqsize = 384;
 static uint32_t def_mem = (1 << 17);
 static uint32_t def_wmem = (1 << 17);
 static uint32_t polling_time = 10;
+static uint32_t def_pool_mem = (1 << 25);
+static uint32_t def_mem_max = (1 << 22);
+static uint32_t def_wmem_max = (1 << 22);
+static uint32_t def_srq_size = 0;
+static uint32_t def_nagle_delay = 0;
+static struct rs_stats closed_stats;	/* protected by mut */
 
 /*
  * Immediate data format is determined by the upper bits
@@ -200,15 +233,20 @@ struct rs_iomap_mr {
 #define rs_host_is_net()   (__BYTE_ORDER == __BIG_ENDIAN)
 #define RS_CONN_FLAG_NET   (1 << 0)
 #define RS_CONN_FLAG_IOMAP (1 << 1)
+#define RS_CONN_FLAG_RAILS (1 << 2)	/* connection may be striped */
+#define RS_CONN_FLAG_RAIL  (1 << 3)	/* extra rail joining rail_id */
 
 struct rs_conn_data {
 	uint8_t		  version;
 	uint8_t		  flags;
 	__be16		  credits;
-	uint8_t		  reserved[3];
+	uint8_t		  rail_id[3];
 	uint8_t		  target_iomap_size;
 	struct rs_sge	  target_sgl;
 	struct rs_sge	  data_buf;
+	__be32		  rail_nonce;
+	uint8_t		  rail_cnt;	/* extra rails that will follow */
+	uint8_t		  reserved[3];
 };
 
 struct rs_conn_private_data {
@@ -249,6 +287,44 @@ enum rs_state {
  */
 #define RS_OPT_MSG_SEND   (1 << 1)
 #define RS_OPT_SVC_ACTIVE (1 << 2)
+/* Buffer sizes set by the user are not autotuned */
+#define RS_OPT_RBUF_LOCK  (1 << 3)
+#define RS_OPT_SBUF_LOCK  (1 << 4)
+#define RS_OPT_SRQ        (1 << 5)
+#define RS_OPT_CORK_SVC   (1 << 6)	/* held data is timed by cork_svc */
+#define RS_OPT_TUNE_SVC   (1 << 7)	/* grown rbuf is shrunk by tune_svc */
+
+/*
+ * Buffer autotuning samples.  A buffer grows when transfers repeatedly
+ * stall on it, and shrinks when a sampling period moves less than a
+ * quarter of its size.
+ */
+struct rs_tune {
+	uint64_t	  start;
+	uint64_t	  bytes;
+	int		  stalls;
+	int		  skip;		/* checks left before the next sample */
+};
+
+/*
+ * Connection statistics.  Each counter is only written under the lock noted,
+ * which the hot path already holds, so updates are plain increments.
+ */
+struct rs_stats {
+	uint64_t	  bytes_sent;		/* slock */
+	uint64_t	  writes;		/* slock */
+	uint64_t	  send_stalls;		/* slock */
+	uint64_t	  bytes_received;	/* rlock */
+	uint64_t	  recv_waits;		/* rlock */
+	uint64_t	  write_comps;		/* cq_lock */
+	uint64_t	  cq_polls;		/* cq_lock */
+	uint64_t	  cq_sleeps;		/* cq_wait_lock */
+	uint32_t	  retries;
+	uint32_t	  srtt;		/* us << 3 */
+	uint32_t	  rttvar;	/* us << 2 */
+	uint64_t	  rtt_start;
+	_Atomic(uint64_t) rtt_write;	/* write being timed, 0 if none */
+};
 
 union socket_addr {
 	struct sockaddr		sa;
@@ -256,6 +332,46 @@ union socket_addr {
 	struct sockaddr_in6	sin6;
 };
 
+/*
+ * A striped stream runs over several connected rsockets, or rails, to the
+ * same peer.  Data is split into chunks, each prefixed by a header and sent
+ * whole over one rail.  Rails deliver in order, so the receiver rebuilds
+ * the stream by taking chunks in sequence number order from whichever rail
+ * holds the next one.  rail[0] is the rsocket owning the group.
+ */
+struct rs_rail_hdr {
+	__be32		  seq;
+	__be32		  len;
+};
+
+struct rs_rails {
+	uint32_t	  id;
+	uint32_t	  nonce;	/* proves a joining rail knows the group */
+	_Atomic(int)	  refcnt;
+	_Atomic(int)	  cnt;
+	_Atomic(int)	  live;		/* bitmap of rails usable for sends */
+	struct rsocket	  *rail[RS_MAX_RAILS];
+	int		  epfd;
+	int		  evfd;		/* signals a new rail to waiters */
+	int		  addr_cnt;
+	union socket_addr addr[RS_MAX_RAILS - 1];
+
+	fastlock_t	  slock;
+	uint32_t	  sseq;
+	int		  snext;
+	int		  scur;
+	struct rs_rail_hdr shdr;
+	int		  shdr_left;
+	uint32_t	  sleft;
+
+	fastlock_t	  rlock;
+	uint32_t	  rseq;
+	int		  rcur;
+	uint32_t	  rleft;
+	struct rs_rail_hdr rhdr[RS_MAX_RAILS];
+	int		  rhdr_len[RS_MAX_RAILS];
+};
+
 struct ds_header {
 	uint8_t		  version;
 	uint8_t		  length;
@@ -272,6 +388,39 @@ struct ds_header {
 #define DS_IPV4_HDR_LEN  8
 #define DS_IPV6_HDR_LEN 24
 
+/*
+ * Datagrams that do not fit in a single RS_SNDLOWAT message are sent as
+ * segments.  Each segment sets DS_HDR_FRAG in the header version and
+ * carries a ds_frag_header after the address header.  The largest
+ * datagram must also fit in a UDP datagram, which is used until the
+ * address handle to the peer has been resolved.
+ */
+#define DS_HDR_FRAG	 0x80
+#define DS_MAX_MSG_SIZE	 (65507 - DS_UDP_IPV6_HDR_LEN)
+#define DS_REASM_TIMEOUT 1000000	/* us */
+#define DS_REASM_MAX	 16
+
+struct ds_frag_header {
+	__be32		  id;
+	__be32		  offset;
+	__be32		  total;
+};
+
+#define DS_FRAG_DATA_MIN (RS_SNDLOWAT - DS_IPV6_HDR_LEN - \
+			  sizeof(struct ds_frag_header))
+#define DS_MAX_FRAGS	 ((DS_MAX_MSG_SIZE + DS_FRAG_DATA_MIN - 1) / \
+			  DS_FRAG_DATA_MIN)
+
+struct ds_reasm {
+	struct ds_reasm	  *next;
+	struct ds_header  hdr;		/* source, DS_HDR_FRAG cleared */
+	uint32_t	  id;
+	uint32_t	  total;
+	uint32_t	  received;
+	uint64_t	  start;
+	uint8_t		  data[];
+};
+
 struct ds_dest {
 	union socket_addr addr;	/* must be first */
 	struct ds_qp	  *qp;
@@ -333,10 +482,18 @@ struct rsocket {
 			int		  rbuf_offset;
 			struct ibv_mr	  *rmr;
 			uint8_t		  *rbuf;
+			uint32_t	  rbuf_granted;
+			uint32_t	  rbuf_new_size;
+			struct rs_tune	  rtune;
 
 			int		  sbuf_bytes_avail;
+			uint32_t	  sbuf_pending;	/* held, not yet written */
+			uint64_t	  spend_start;
+			uint32_t	  spend_limit;	/* us, from spend_start */
 			struct ibv_mr	  *smr;
 			struct ibv_sge	  ssgl[2];
+			uint32_t	  sbuf_new_size;
+			struct rs_tune	  stune;
 		};
 		/* datagram */
 		struct {
@@ -348,11 +505,22 @@ struct rsocket {
 			int		  epfd;
 			int		  rqe_avail;
 			struct ds_smsg	  *smsg_free;
+			uint32_t	  frag_id;
+			int		  reasm_cnt;
+			struct ds_reasm	  *reasm_list;
+			struct ds_reasm	  *reasm_done;	/* complete, not yet read */
 		};
 	};
 
 	int		  opts;
 	int		  fd_flags;
+	struct rs_rails	  *rails;
+	uint32_t	  rail_id;	/* group joined by an extra rail */
+	uint32_t	  rail_nonce;
+	struct rsocket	  *accept_queue;	/* requests held back by raccept */
+	struct rsocket	  *accept_next;
+	struct rs_srq	  *srq;
+	struct rs_stats	  stats;
 	uint64_t	  so_opts;
 	uint64_t	  ipv6_opts;
 	void		  *optval;
@@ -558,6 +726,31 @@ static void rs_configure(void)
 			def_wmem = RS_SNDLOWAT << 1;
 	}
 
+	if ((f = fopen(RS_CONF_DIR "/mem_max", "r"))) {
+		failable_fscanf(f, "%u", &def_mem_max);
+		fclose(f);
+	}
+
+	if ((f = fopen(RS_CONF_DIR "/wmem_max", "r"))) {
+		failable_fscanf(f, "%u", &def_wmem_max);
+		fclose(f);
+	}
+
+	if ((f = fopen(RS_CONF_DIR "/srq_size", "r"))) {
+		failable_fscanf(f, "%u", &def_srq_size);
+		fclose(f);
+	}
+
+	if ((f = fopen(RS_CONF_DIR "/nagle_delay", "r"))) {
+		failable_fscanf(f, "%u", &def_nagle_delay);
+		fclose(f);
+	}
+
+	if ((f = fopen(RS_CONF_DIR "/bufpool_size", "r"))) {
+		failable_fscanf(f, "%u", &def_pool_mem);
+		fclose(f);
+	}
+
 	if ((f = fopen(RS_CONF_DIR "/iomap_size", "r"))) {
 		failable_fscanf(f, "%hu", &def_iomap_size);
 		fclose(f);
@@ -611,6 +804,9 @@ static struct rsocket *rs_alloc(struct rsocket *inherited_rs, int type)
 		if (type == SOCK_STREAM) {
 			rs->ctrl_max_seqno = inherited_rs->ctrl_max_seqno;
 			rs->target_iomap_size = inherited_rs->target_iomap_size;
+			rs->opts = inherited_rs->opts &
+				   (RS_OPT_RBUF_LOCK | RS_OPT_SBUF_LOCK |
+				    RS_OPT_SRQ);
 		}
 	} else {
 		rs->sbuf_size = def_wmem;
@@ -621,6 +817,8 @@ static struct rsocket *rs_alloc(struct rsocket *inherited_rs, int type)
 		if (type == SOCK_STREAM) {
 			rs->ctrl_max_seqno = RS_QP_CTRL_SIZE;
 			rs->target_iomap_size = def_iomap_size;
+			if (def_srq_size)
+				rs->opts |= RS_OPT_SRQ;
 		}
 	}
 	fastlock_init(&rs->slock);
@@ -698,6 +896,180 @@ static void ds_set_qp_size(struct rsocket *rs)
 		rs->sbuf_size = rs->sq_size * RS_SNDLOWAT;
 }
 
+/*
+ * Registered buffer pool.  When a stream rsocket is freed, its send buffer
+ * is kept registered and handed to the next rsocket on the same PD that
+ * asks for a buffer of the same size, so connection setup and teardown
+ * skip that registration.  Only buffers without remote access are pooled:
+ * the previous peer still holds the rkey of a receive buffer or target SGL,
+ * and giving one out again safely needs a new rkey, which costs as much
+ * as registering it from scratch.  Idle buffers are capped at def_pool_mem
+ * bytes; anything above that is deregistered and freed.  A zero
+ * bufpool_size disables the pool.
+ */
+struct rs_pool_buf {
+	struct rs_pool_buf *next;
+	struct ibv_mr	  *mr;
+};
+
+struct rs_pool_class {
+	struct rs_pool_class *next;
+	struct ibv_pd	  *pd;
+	size_t		  size;
+	int		  access;
+	struct rs_pool_buf *free_list;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rs_pool_class *pool_classes;
+static size_t pool_mem;
+
+static struct rs_pool_class *rs_pool_find(struct ibv_pd *pd, size_t size,
+					  int access)
+{
+	struct rs_pool_class *cls;
+
+	for (cls = pool_classes; cls; cls = cls->next) {
+		if (cls->pd == pd && cls->size == size && cls->access == access)
+			return cls;
+	}
+	return NULL;
+}
+
+static int rs_pool_has_pd(struct ibv_pd *pd)
+{
+	struct rs_pool_class *cls;
+
+	for (cls = pool_classes; cls; cls = cls->next) {
+		if (cls->pd == pd)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Buffers are pooled against the PD of the cm_id, which is freed with the
+ * last id on the device unless the pool holds a reference on it.
+ */
+static struct rs_pool_class *rs_pool_get_class(struct rdma_cm_id *cm_id,
+					       size_t size, int access)
+{
+	struct rs_pool_class *cls;
+
+	cls = rs_pool_find(cm_id->pd, size, access);
+	if (cls)
+		return cls;
+
+	if (!rs_pool_has_pd(cm_id->pd) && ucma_hold_pd(cm_id))
+		return NULL;
+
+	cls = calloc(1, sizeof(*cls));
+	if (!cls)
+		return NULL;
+
+	cls->pd = cm_id->pd;
+	cls->size = size;
+	cls->access = access;
+	cls->next = pool_classes;
+	pool_classes = cls;
+	return cls;
+}
+
+static inline int rs_pool_access(int access)
+{
+	return !(access & (IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ));
+}
+
+static struct ibv_mr *rs_get_buf(struct rsocket *rs, size_t size, int access)
+{
+	struct rs_pool_class *cls;
+	struct rs_pool_buf *buf;
+	struct ibv_mr *mr = NULL;
+	void *addr;
+
+	if (!def_pool_mem || !rs_pool_access(access))
+		goto reg;
+
+	pthread_mutex_lock(&pool_lock);
+	cls = rs_pool_get_class(rs->cm_id, size, access);
+	if (!cls) {
+		pthread_mutex_unlock(&pool_lock);
+		return NULL;
+	}
+
+	if ((buf = cls->free_list)) {
+		cls->free_list = buf->next;
+		pool_mem -= size;
+		mr = buf->mr;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	if (mr) {
+		free(buf);
+		memset(mr->addr, 0, size);
+		return mr;
+	}
+
+reg:
+	addr = calloc(size, 1);
+	if (!addr) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	mr = ibv_reg_mr(rs->cm_id->pd, addr, size, access);
+	if (!mr)
+		free(addr);
+	return mr;
+}
+
+static void rs_put_buf(struct ibv_mr *mr, int access)
+{
+	struct rs_pool_class *cls;
+	struct rs_pool_buf *buf;
+	void *addr = mr->addr;
+
+	pthread_mutex_lock(&pool_lock);
+	if (!rs_pool_access(access) || pool_mem + mr->length > def_pool_mem)
+		goto dereg;
+
+	cls = rs_pool_find(mr->pd, mr->length, access);
+	if (!cls)
+		goto dereg;
+
+	buf = malloc(sizeof(*buf));
+	if (!buf)
+		goto dereg;
+
+	buf->mr = mr;
+	buf->next = cls->free_list;
+	cls->free_list = buf;
+	pool_mem += mr->length;
+	pthread_mutex_unlock(&pool_lock);
+	return;
+
+dereg:
+	pthread_mutex_unlock(&pool_lock);
+	ibv_dereg_mr(mr);
+	free(addr);
+}
+
+static uint64_t rs_time_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Control messages that cannot be sent inline are staged after the sbuf */
+static uint32_t rs_total_sbuf_size(struct rsocket *rs, uint32_t sbuf_size)
+{
+	if (rs->sq_inline < RS_MAX_CTRL_MSG)
+		sbuf_size += RS_MAX_CTRL_MSG * RS_QP_CTRL_SIZE;
+	return sbuf_size;
+}
+
 static int rs_init_bufs(struct rsocket *rs)
 {
 	uint32_t total_rbuf_size, total_sbuf_size;
@@ -707,28 +1079,19 @@ static int rs_init_bufs(struct rsocket *rs)
 	if (!rs->rmsg)
 		return ERR(ENOMEM);
 
-	total_sbuf_size = rs->sbuf_size;
-	if (rs->sq_inline < RS_MAX_CTRL_MSG)
-		total_sbuf_size += RS_MAX_CTRL_MSG * RS_QP_CTRL_SIZE;
-	rs->sbuf = calloc(total_sbuf_size, 1);
-	if (!rs->sbuf)
-		return ERR(ENOMEM);
-
-	rs->smr = rdma_reg_msgs(rs->cm_id, rs->sbuf, total_sbuf_size);
+	total_sbuf_size = rs_total_sbuf_size(rs, rs->sbuf_size);
+	rs->smr = rs_get_buf(rs, total_sbuf_size, RS_SBUF_ACCESS);
 	if (!rs->smr)
 		return -1;
+	rs->sbuf = rs->smr->addr;
 
 	len = sizeof(*rs->target_sgl) * RS_SGL_SIZE +
 	      sizeof(*rs->target_iomap) * rs->target_iomap_size;
-	rs->target_buffer_list = malloc(len);
-	if (!rs->target_buffer_list)
-		return ERR(ENOMEM);
-
-	rs->target_mr = rdma_reg_write(rs->cm_id, rs->target_buffer_list, len);
+	rs->target_mr = rs_get_buf(rs, len, RS_RBUF_ACCESS);
 	if (!rs->target_mr)
 		return -1;
+	rs->target_buffer_list = rs->target_mr->addr;
 
-	memset(rs->target_buffer_list, 0, len);
 	rs->target_sgl = rs->target_buffer_list;
 	if (rs->target_iomap_size)
 		rs->target_iomap = (struct rs_iomap *) (rs->target_sgl + RS_SGL_SIZE);
@@ -736,13 +1099,10 @@ static int rs_init_bufs(struct rsocket *rs)
 	total_rbuf_size = rs->rbuf_size;
 	if (rs->opts & RS_OPT_MSG_SEND)
 		total_rbuf_size += rs->rq_size * RS_MSG_SIZE;
-	rs->rbuf = calloc(total_rbuf_size, 1);
-	if (!rs->rbuf)
-		return ERR(ENOMEM);
-
-	rs->rmr = rdma_reg_write(rs->cm_id, rs->rbuf, total_rbuf_size);
+	rs->rmr = rs_get_buf(rs, total_rbuf_size, RS_RBUF_ACCESS);
 	if (!rs->rmr)
 		return -1;
+	rs->rbuf = rs->rmr->addr;
 
 	rs->ssgl[0].addr = rs->ssgl[1].addr = (uintptr_t) rs->sbuf;
 	rs->sbuf_bytes_avail = rs->sbuf_size;
@@ -750,6 +1110,8 @@ static int rs_init_bufs(struct rsocket *rs)
 
 	rs->rbuf_free_offset = rs->rbuf_size >> 1;
 	rs->rbuf_bytes_avail = rs->rbuf_size >> 1;
+	rs->rbuf_granted = rs->rbuf_size >> 1;
+	rs->rtune.start = rs->stune.start = rs_time_us();
 	rs->sqe_avail = rs->sq_size - rs->ctrl_max_seqno;
 	rs->rseq_comp = rs->rq_size >> 1;
 	return 0;
@@ -773,6 +1135,153 @@ static int ds_init_bufs(struct ds_qp *qp)
 	return 0;
 }
 
+/*
+ * Shared receive queues.  In SRQ mode, stream rsockets on the same PD post
+ * receives to one SRQ instead of each keeping rq_size receives on its own
+ * QP.  The receives carry no buffer, since data arrives through RDMA write
+ * with immediate, so an idle connection holds no receive resources.
+ * Message mode (iWARP) receives need per-connection buffers and do not use
+ * an SRQ.
+ *
+ * The SRQ is topped up from the rsockets' CQ poll path.  posted counts the
+ * receives believed to be outstanding and drops as rs_poll_cq() reaps
+ * them; once it is a batch below size, the polling thread refills.  A
+ * refill posts until the SRQ is full, so it also makes up receives taken
+ * by sockets nobody is reading, or by QPs that were destroyed, and posted
+ * is exact again afterwards.  A thread about to sleep on its CQ refills
+ * unconditionally, so its peer is never starved by receives that idle
+ * sockets took.  The device's async events belong to the application and
+ * are not read.
+ *
+ * The credits each rsocket grants its peer are its share of the SRQ at
+ * connect time; senders that still outrun it are paced by RNR retry, which
+ * rsockets set to infinite.
+ */
+struct rs_srq {
+	struct rs_srq	  *next;
+	struct ibv_pd	  *pd;
+	struct ibv_srq	  *srq;
+	uint32_t	  size;
+	uint32_t	  batch;
+	_Atomic(int)	  posted;
+	pthread_mutex_t	  fill_lock;
+	int		  users;
+};
+
+/* Entries are only ever added, so pollers may walk the list without mut */
+static _Atomic(struct rs_srq *) srq_list;
+
+/* Post the SRQ's actual deficit: keep going until the device refuses */
+static void rs_fill_srq(struct rs_srq *rsrq)
+{
+	struct ibv_recv_wr wr, *bad;
+	uint32_t i;
+
+	if (pthread_mutex_trylock(&rsrq->fill_lock))
+		return;
+
+	wr.wr_id = rs_recv_wr_id(0);
+	wr.next = NULL;
+	wr.sg_list = NULL;
+	wr.num_sge = 0;
+	for (i = 0; i < rsrq->size; i++) {
+		if (ibv_post_srq_recv(rsrq->srq, &wr, &bad))
+			break;
+	}
+	atomic_store(&rsrq->posted, rsrq->size);
+	pthread_mutex_unlock(&rsrq->fill_lock);
+}
+
+static void rs_srq_reaped(struct rs_srq *rsrq, int cnt)
+{
+	int posted;
+
+	posted = atomic_fetch_sub(&rsrq->posted, cnt) - cnt;
+	if ((int) rsrq->size - posted >= (int) rsrq->batch)
+		rs_fill_srq(rsrq);
+}
+
+static struct rs_srq *rs_find_srq(struct ibv_pd *pd)
+{
+	struct rs_srq *rsrq;
+
+	for (rsrq = atomic_load(&srq_list); rsrq; rsrq = rsrq->next) {
+		if (rsrq->pd == pd)
+			break;
+	}
+	return rsrq;
+}
+
+static struct rs_srq *rs_create_srq(struct rsocket *rs)
+{
+	struct ibv_srq_init_attr attr;
+	struct rs_srq *rsrq;
+
+	rsrq = calloc(1, sizeof(*rsrq));
+	if (!rsrq)
+		return NULL;
+
+	memset(&attr, 0, sizeof attr);
+	attr.srq_context = rsrq;
+	attr.attr.max_wr = def_srq_size ? def_srq_size : RS_SRQ_DEFAULT_SIZE;
+	attr.attr.max_sge = 1;
+	rsrq->srq = ibv_create_srq(rs->cm_id->pd, &attr);
+	if (!rsrq->srq)
+		goto err1;
+
+	rsrq->size = attr.attr.max_wr;
+	rsrq->batch = max_t(uint32_t, rsrq->size / 8, 1);
+	pthread_mutex_init(&rsrq->fill_lock, NULL);
+	rs_fill_srq(rsrq);
+
+	/* The SRQ outlives the cm_id that created it */
+	if (ucma_hold_pd(rs->cm_id))
+		goto err2;
+
+	rsrq->pd = rs->cm_id->pd;
+	rsrq->next = atomic_load(&srq_list);
+	atomic_store(&srq_list, rsrq);
+	return rsrq;
+
+err2:
+	ibv_destroy_srq(rsrq->srq);
+err1:
+	free(rsrq);
+	return NULL;
+}
+
+/*
+ * Returns the SRQ for the rsocket's PD, creating it if needed, and lowers
+ * rq_size to the rsocket's share of it.
+ */
+static struct ibv_srq *rs_get_srq(struct rsocket *rs)
+{
+	struct rs_srq *rsrq;
+	uint32_t share;
+
+	pthread_mutex_lock(&mut);
+	rsrq = rs_find_srq(rs->cm_id->pd);
+	if (!rsrq)
+		rsrq = rs_create_srq(rs);
+	if (rsrq) {
+		share = max_t(uint32_t, rsrq->size / ++rsrq->users,
+			      RS_QP_MIN_SIZE);
+		if (rs->rq_size > share)
+			rs->rq_size = share;
+		rs->srq = rsrq;
+	}
+	pthread_mutex_unlock(&mut);
+	return rsrq ? rsrq->srq : NULL;
+}
+
+static void rs_put_srq(struct rsocket *rs)
+{
+	pthread_mutex_lock(&mut);
+	rs->srq->users--;
+	pthread_mutex_unlock(&mut);
+	rs->srq = NULL;
+}
+
 /*
  * If a user is waiting on a datagram rsocket through poll or select, then
  * we need the first completion to generate an event on the related epoll fd
@@ -877,6 +1386,12 @@ static int rs_create_ep(struct rsocket *rs)
 	qp_attr.cap.max_send_sge = 2;
 	qp_attr.cap.max_recv_sge = 1;
 	qp_attr.cap.max_inline_data = rs->sq_inline;
+	if ((rs->opts & RS_OPT_SRQ) && !(rs->opts & RS_OPT_MSG_SEND))
+		qp_attr.srq = rs_get_srq(rs);
+	if (qp_attr.srq) {
+		qp_attr.cap.max_recv_wr = 0;
+		qp_attr.cap.max_recv_sge = 0;
+	}
 
 	ret = rdma_create_qp(rs->cm_id, NULL, &qp_attr);
 	if (ret)
@@ -890,6 +1405,9 @@ static int rs_create_ep(struct rsocket *rs)
 	if (ret)
 		return ret;
 
+	if (rs->srq)
+		return 0;
+
 	for (i = 0; i < rs->rq_size; i++) {
 		ret = rs_post_recv(rs);
 		if (ret)
@@ -953,6 +1471,7 @@ static void ds_free_qp(struct ds_qp *qp)
 
 static void ds_free(struct rsocket *rs)
 {
+	struct ds_reasm *reasm;
 	struct ds_qp *qp;
 
 	if (rs->udp_sock >= 0)
@@ -964,6 +1483,12 @@ static void ds_free(struct rsocket *rs)
 	if (rs->dmsg)
 		free(rs->dmsg);
 
+	while ((reasm = rs->reasm_list)) {
+		rs->reasm_list = reasm->next;
+		free(reasm);
+	}
+	free(rs->reasm_done);
+
 	while ((qp = rs->qp_list)) {
 		ds_remove_qp(rs, qp);
 		ds_free_qp(qp);
@@ -984,6 +1509,45 @@ static void ds_free(struct rsocket *rs)
 	free(rs);
 }
 
+/*
+ * A QP attached to an SRQ should only be destroyed once the device reports
+ * that it will take no further receives from it, but that report is an
+ * async event, and those belong to the application.  Moving the QP to
+ * error and reaping what it flushes is as far as rsockets go; a receive
+ * the QP takes after that is made up by the next SRQ refill.
+ */
+static void rs_drain_srq(struct rsocket *rs)
+{
+	struct ibv_qp_attr attr;
+	struct ibv_wc wc[8];
+	int i, ret, cnt = 0;
+
+	attr.qp_state = IBV_QPS_ERR;
+	if (ibv_modify_qp(rs->cm_id->qp, &attr, IBV_QP_STATE))
+		return;
+
+	while ((ret = ibv_poll_cq(rs->cm_id->recv_cq, 8, wc)) > 0) {
+		for (i = 0; i < ret; i++)
+			cnt += rs_wr_is_recv(wc[i].wr_id);
+	}
+	rs_srq_reaped(rs->srq, cnt);
+}
+
+static void rs_stats_add(struct rs_stats *sum, struct rs_stats *stats)
+{
+	sum->bytes_sent += stats->bytes_sent;
+	sum->writes += stats->writes;
+	sum->send_stalls += stats->send_stalls;
+	sum->bytes_received += stats->bytes_received;
+	sum->recv_waits += stats->recv_waits;
+	sum->write_comps += stats->write_comps;
+	sum->cq_polls += stats->cq_polls;
+	sum->cq_sleeps += stats->cq_sleeps;
+	sum->retries += stats->retries;
+}
+
+static void rs_rails_free(struct rsocket *rs);
+
 static void rs_free(struct rsocket *rs)
 {
 	if (rs->type == SOCK_DGRAM) {
@@ -991,36 +1555,52 @@ static void rs_free(struct rsocket *rs)
 		return;
 	}
 
-	if (rs->rmsg)
-		free(rs->rmsg);
+	if (rs->opts & RS_OPT_CORK_SVC)
+		rs_notify_svc(&cork_svc, rs, RS_SVC_REM_CORK);
 
-	if (rs->sbuf) {
-		if (rs->smr)
-			rdma_dereg_mr(rs->smr);
-		free(rs->sbuf);
-	}
+	if (rs->opts & RS_OPT_TUNE_SVC)
+		rs_notify_svc(&tune_svc, rs, RS_SVC_REM_TUNE);
 
-	if (rs->rbuf) {
-		if (rs->rmr)
-			rdma_dereg_mr(rs->rmr);
-		free(rs->rbuf);
-	}
+	if (rs->rails)
+		rs_rails_free(rs);
 
-	if (rs->target_buffer_list) {
-		if (rs->target_mr)
-			rdma_dereg_mr(rs->target_mr);
-		free(rs->target_buffer_list);
+	while (rs->accept_queue) {
+		struct rsocket *new_rs = rs->accept_queue;
+
+		rs->accept_queue = new_rs->accept_next;
+		rs_free(new_rs);
 	}
 
+	if (rs->rmsg)
+		free(rs->rmsg);
+
+	/* The QP must be gone before its buffers can be reused */
 	if (rs->cm_id) {
 		rs_free_iomappings(rs);
 		if (rs->cm_id->qp) {
+			if (rs->srq)
+				rs_drain_srq(rs);
 			ibv_ack_cq_events(rs->cm_id->recv_cq, rs->unack_cqe);
 			rdma_destroy_qp(rs->cm_id);
 		}
+		if (rs->srq)
+			rs_put_srq(rs);
 		rdma_destroy_id(rs->cm_id);
 	}
 
+	if (rs->smr)
+		rs_put_buf(rs->smr, RS_SBUF_ACCESS);
+
+	if (rs->rmr)
+		rs_put_buf(rs->rmr, RS_RBUF_ACCESS);
+
+	if (rs->target_mr)
+		rs_put_buf(rs->target_mr, RS_RBUF_ACCESS);
+
+	pthread_mutex_lock(&mut);
+	rs_stats_add(&closed_stats, &rs->stats);
+	pthread_mutex_unlock(&mut);
+
 	if (rs->index >= 0)
 		rs_remove(rs);
 
@@ -1038,12 +1618,30 @@ static size_t rs_conn_data_offset(struct rsocket *rs)
 		sizeof(struct ib_connect_hdr) : 0;
 }
 
+static uint32_t rs_conn_rail_id(struct rs_conn_data *conn)
+{
+	return (conn->rail_id[0] << 16) | (conn->rail_id[1] << 8) |
+	       conn->rail_id[2];
+}
+
 static void rs_format_conn_data(struct rsocket *rs, struct rs_conn_data *conn)
 {
+	uint32_t id = 0, nonce = 0;
+
 	conn->version = 1;
 	conn->flags = RS_CONN_FLAG_IOMAP |
 		      (rs_host_is_net() ? RS_CONN_FLAG_NET : 0);
 	conn->credits = htobe16(rs->rq_size);
+	if (rs->rail_id || rs->rails) {
+		conn->flags |= rs->rail_id ? RS_CONN_FLAG_RAIL : RS_CONN_FLAG_RAILS;
+		id = rs->rail_id ? rs->rail_id : rs->rails->id;
+		nonce = rs->rail_id ? rs->rail_nonce : rs->rails->nonce;
+	}
+	conn->rail_id[0] = (uint8_t) (id >> 16);
+	conn->rail_id[1] = (uint8_t) (id >> 8);
+	conn->rail_id[2] = (uint8_t) id;
+	conn->rail_nonce = htobe32(nonce);
+	conn->rail_cnt = rs->rails ? (uint8_t) rs->rails->addr_cnt : 0;
 	memset(conn->reserved, 0, sizeof conn->reserved);
 	conn->target_iomap_size = (uint8_t) rs_value_to_scale(rs->target_iomap_size, 8);
 
@@ -1064,7 +1662,7 @@ static void rs_save_conn_data(struct rsocket *rs, struct rs_conn_data *conn)
 	rs->remote_sge = 1;
 	if ((rs_host_is_net() && !(conn->flags & RS_CONN_FLAG_NET)) ||
 	    (!rs_host_is_net() && (conn->flags & RS_CONN_FLAG_NET)))
-		rs->opts = RS_OPT_SWAP_SGL;
+		rs->opts |= RS_OPT_SWAP_SGL;
 
 	if (conn->flags & RS_CONN_FLAG_IOMAP) {
 		rs->remote_iomap.addr = rs->remote_sgl.addr +
@@ -1211,55 +1809,338 @@ int rlisten(int socket, int backlog)
 	return ret;
 }
 
-/*
- * Nonblocking is usually not inherited between sockets, but we need to
- * inherit it here to establish the connection only.  This is needed to
- * prevent rdma_accept from blocking until the remote side finishes
- * establishing the connection.  If we were to allow rdma_accept to block,
- * then a single thread cannot establish a connection with itself, or
- * two threads which try to connect to each other can deadlock trying to
- * form a connection.
- *
- * Data transfers on the new socket remain blocking unless the user
- * specifies otherwise through rfcntl.
- */
-int raccept(int socket, struct sockaddr *addr, socklen_t *addrlen)
+static int rs_rails_active(struct rsocket *rs)
 {
-	struct rsocket *rs, *new_rs;
-	struct rdma_conn_param param;
-	struct rs_conn_data *creq, cresp;
-	int ret;
+	return rs->rails && rs->rails->id;
+}
 
-	rs = idm_lookup(&idm, socket);
-	if (!rs)
-		return ERR(EBADF);
-	new_rs = rs_alloc(rs, rs->type);
-	if (!new_rs)
-		return ERR(ENOMEM);
+static int rs_rails_alloc(struct rsocket *rs)
+{
+	struct rs_rails *rails;
+	struct epoll_event event;
 
-	ret = rdma_get_request(rs->cm_id, &new_rs->cm_id);
-	if (ret)
-		goto err;
+	rails = calloc(1, sizeof(*rails));
+	if (!rails)
+		return ERR(ENOMEM);
 
-	ret = rs_insert(new_rs, new_rs->cm_id->channel->fd);
-	if (ret < 0)
-		goto err;
+	rails->epfd = epoll_create(RS_MAX_RAILS + 1);
+	if (rails->epfd < 0)
+		goto err1;
 
-	creq = (struct rs_conn_data *)
-	       (new_rs->cm_id->event->param.conn.private_data + rs_conn_data_offset(rs));
-	if (creq->version != 1) {
-		ret = ERR(ENOTSUP);
-		goto err;
-	}
+	rails->evfd = eventfd(0, EFD_NONBLOCK);
+	if (rails->evfd < 0)
+		goto err2;
 
-	if (rs->fd_flags & O_NONBLOCK)
-		fcntl(new_rs->cm_id->channel->fd, F_SETFL, O_NONBLOCK);
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (epoll_ctl(rails->epfd, EPOLL_CTL_ADD, rails->evfd, &event))
+		goto err3;
+
+	fastlock_init(&rails->slock);
+	fastlock_init(&rails->rlock);
+	atomic_init(&rails->refcnt, 1);
+	rs->rails = rails;
+	return 0;
 
-	ret = rs_create_ep(new_rs);
-	if (ret)
-		goto err;
+err3:
+	close(rails->evfd);
+err2:
+	close(rails->epfd);
+err1:
+	free(rails);
+	return -1;
+}
+
+static void rs_rails_put(struct rs_rails *rails)
+{
+	int i;
+
+	if (atomic_fetch_sub(&rails->refcnt, 1) > 1)
+		return;
+
+	for (i = 1; i < rails->cnt; i++)
+		rs_free(rails->rail[i]);
+
+	fastlock_destroy(&rails->rlock);
+	fastlock_destroy(&rails->slock);
+	close(rails->evfd);
+	close(rails->epfd);
+	free(rails);
+}
+
+/* rs_rails_get() looks groups up under mut, so detach under it as well. */
+static void rs_rails_free(struct rsocket *rs)
+{
+	struct rs_rails *rails = rs->rails;
+
+	pthread_mutex_lock(&mut);
+	rs->rails = NULL;
+	pthread_mutex_unlock(&mut);
+	rs_rails_put(rails);
+}
+
+/*
+ * Rails are only ever added, so the send and receive paths can walk the
+ * rail array up to cnt without holding a lock.  Waiters are kicked through
+ * the eventfd to pick up the new rail.
+ */
+static int rs_rails_attach(struct rs_rails *rails, struct rsocket *rail)
+{
+	struct epoll_event event;
+	uint64_t kick = 1;
+	int i, ret;
+
+	pthread_mutex_lock(&mut);
+	i = rails->cnt;
+	if (i == RS_MAX_RAILS) {
+		ret = ERR(ENOSPC);
+		goto out;
+	}
+
+	event.events = EPOLLIN;
+	event.data.ptr = rail;
+	ret = epoll_ctl(rails->epfd, EPOLL_CTL_ADD,
+			rail->cm_id->recv_cq_channel->fd, &event);
+	if (ret)
+		goto out;
+
+	rails->rail[i] = rail;
+	atomic_store(&rails->cnt, i + 1);
+	atomic_fetch_or(&rails->live, 1 << i);
+	if (write(rails->evfd, &kick, sizeof kick) != sizeof kick)
+		ret = -1;
+out:
+	pthread_mutex_unlock(&mut);
+	return ret;
+}
+
+static int rs_rails_nonce(uint32_t *nonce)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	len = read(fd, nonce, sizeof *nonce);
+	close(fd);
+	return len == sizeof *nonce ? 0 : ERR(EIO);
+}
+
+/*
+ * Rail group ids are the owning rsocket's index tagged with a generation.
+ * Ids are easy to guess, so a random nonce that only the connected peer
+ * learns must accompany them before a rail is let into the group.
+ */
+static int rs_rails_start(struct rsocket *rs)
+{
+	static uint8_t gen;
+	int ret;
+
+	ret = rs_rails_alloc(rs);
+	if (ret)
+		return ret;
+
+	ret = rs_rails_nonce(&rs->rails->nonce);
+	if (ret) {
+		rs_rails_free(rs);
+		return ret;
+	}
+
+	pthread_mutex_lock(&mut);
+	if (!++gen)
+		gen = 1;
+	rs->rails->id = (gen << 16) | rs->index;
+	pthread_mutex_unlock(&mut);
+
+	ret = rs_rails_attach(rs->rails, rs);
+	if (ret)
+		rs_rails_free(rs);
+	return ret;
+}
+
+static int rs_rails_match(struct rs_rails *rails, struct rs_conn_data *creq)
+{
+	return rails->id == rs_conn_rail_id(creq) &&
+	       rails->nonce == be32toh(creq->rail_nonce);
+}
+
+/*
+ * The leader may be closed while one of its rails is being accepted, so
+ * hold a reference on the group rather than on the leader itself.
+ */
+static struct rs_rails *rs_rails_get(struct rs_conn_data *creq)
+{
+	struct rs_rails *rails = NULL;
+	struct rsocket *rs;
+
+	pthread_mutex_lock(&mut);
+	rs = idm_lookup(&idm, rs_conn_rail_id(creq) & 0xFFFF);
+	if (rs && rs->type == SOCK_STREAM && rs->rails &&
+	    rs_rails_match(rs->rails, creq)) {
+		rails = rs->rails;
+		atomic_fetch_add(&rails->refcnt, 1);
+	}
+	pthread_mutex_unlock(&mut);
+	return rails;
+}
+
+static int rs_rails_add_addr(struct rsocket *rs, const struct sockaddr *addr,
+			     socklen_t addrlen)
+{
+	if (rs->type != SOCK_STREAM || addrlen < sizeof(*addr) ||
+	    (addr->sa_family != AF_INET && addr->sa_family != AF_INET6) ||
+	    addrlen < ucma_addrlen((struct sockaddr *) addr))
+		return ERR(EINVAL);
+
+	if (!rs->rails && rs_rails_alloc(rs))
+		return -1;
+
+	if (rs->rails->addr_cnt == RS_MAX_RAILS - 1)
+		return ERR(ENOSPC);
+
+	memcpy(&rs->rails->addr[rs->rails->addr_cnt++], addr,
+	       ucma_addrlen((struct sockaddr *) addr));
+	return 0;
+}
+
+/*
+ * Extra rails connect to the same peer address from their own source
+ * address, which selects the local device and port.  A rail that cannot
+ * be connected within RS_RAIL_TIMEOUT is skipped.
+ */
+static int rs_rails_join(struct rsocket *rs, union socket_addr *src)
+{
+	struct sockaddr *dst;
+	struct rsocket *rail;
+	struct pollfd fds;
+	int index, ret;
+
+	index = rsocket(src->sa.sa_family, SOCK_STREAM, 0);
+	if (index < 0)
+		return index;
+
+	rail = idm_lookup(&idm, index);
+	rail->sbuf_size = rs->sbuf_size;
+	rail->rbuf_size = rs->rbuf_size;
+	rail->sq_inline = rs->sq_inline;
+	rail->sq_size = rs->sq_size;
+	rail->rq_size = rs->rq_size;
+	rail->opts = (rail->opts & ~RS_OPT_SRQ) |
+		     (rs->opts & (RS_OPT_RBUF_LOCK | RS_OPT_SBUF_LOCK | RS_OPT_SRQ));
+	rail->rail_id = rs->rails->id;
+	rail->rail_nonce = rs->rails->nonce;
+
+	ret = rbind(index, &src->sa, ucma_addrlen(&src->sa));
+	if (ret)
+		goto err;
+
+	ret = rfcntl(index, F_SETFL, O_NONBLOCK);
+	if (ret)
+		goto err;
+
+	dst = rdma_get_peer_addr(rs->cm_id);
+	ret = rconnect(index, dst, ucma_addrlen(dst));
+	if (ret && errno != EINPROGRESS)
+		goto err;
+
+	fds.fd = index;
+	fds.events = POLLOUT;
+	ret = rpoll(&fds, 1, RS_RAIL_TIMEOUT);
+	if (ret <= 0 || !(rail->state & rs_connected)) {
+		ret = ERR(ETIMEDOUT);
+		goto err;
+	}
+
+	ret = rfcntl(index, F_SETFL, 0);
+	if (ret)
+		goto err;
+
+	ret = rs_rails_attach(rs->rails, rail);
+	if (ret)
+		goto err;
+	return 0;
+
+err:
+	rclose(index);
+	return ret;
+}
+
+/*
+ * Called once the connection is established.  Striping is only used when
+ * the peer supports it.  A non-blocking connect stays on a single rail.
+ */
+static void rs_rails_connect(struct rsocket *rs, struct rs_conn_data *cresp)
+{
+	int i;
+
+	if (!(cresp->flags & RS_CONN_FLAG_RAILS) || !rs_conn_rail_id(cresp)) {
+		rs_rails_free(rs);
+		return;
+	}
+
+	rs->rails->id = rs_conn_rail_id(cresp);
+	rs->rails->nonce = be32toh(cresp->rail_nonce);
+	if (rs_rails_attach(rs->rails, rs)) {
+		rs_rails_free(rs);
+		return;
+	}
+
+	if (rs->fd_flags & O_NONBLOCK)
+		return;
+
+	for (i = 0; i < rs->rails->addr_cnt; i++)
+		rs_rails_join(rs, &rs->rails->addr[i]);
+}
+
+static struct rsocket *rs_get_request(struct rsocket *rs)
+{
+	struct rsocket *new_rs;
+	int ret;
+
+	new_rs = rs_alloc(rs, rs->type);
+	if (!new_rs) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ret = rdma_get_request(rs->cm_id, &new_rs->cm_id);
+	if (ret)
+		goto err;
+
+	ret = rs_insert(new_rs, new_rs->cm_id->channel->fd);
+	if (ret < 0)
+		goto err;
+
+	return new_rs;
+
+err:
+	rs_free(new_rs);
+	return NULL;
+}
+
+static struct rs_conn_data *rs_get_creq(struct rsocket *rs,
+					 struct rsocket *new_rs)
+{
+	return (struct rs_conn_data *)
+	       (new_rs->cm_id->event->param.conn.private_data +
+		rs_conn_data_offset(rs));
+}
+
+static int rs_accept_ep(struct rsocket *new_rs, struct rs_conn_data *creq)
+{
+	struct rdma_conn_param param;
+	struct rs_conn_data cresp;
+	int ret;
+
+	ret = rs_create_ep(new_rs);
+	if (ret)
+		return ret;
 
 	rs_save_conn_data(new_rs, creq);
+	if (creq->flags & RS_CONN_FLAG_RAILS)
+		rs_rails_start(new_rs);
 	param = new_rs->cm_id->event->param.conn;
 	rs_format_conn_data(new_rs, &cresp);
 	param.private_data = &cresp;
@@ -1270,8 +2151,120 @@ int raccept(int socket, struct sockaddr *addr, socklen_t *addrlen)
 	else if (errno == EAGAIN || errno == EWOULDBLOCK)
 		new_rs->state = rs_accepting;
 	else
+		return ret;
+	return 0;
+}
+
+static void rs_rails_accept(struct rs_rails *rails, struct rsocket *rail,
+			    struct rs_conn_data *creq)
+{
+	if (rs_accept_ep(rail, creq) || rs_rails_attach(rails, rail))
+		rs_free(rail);
+}
+
+/*
+ * The peer connects the extra rails of a striped connection right after
+ * the leader, so collect them before handing the leader to the caller
+ * rather than leaving them until the next raccept.  Unrelated requests
+ * that show up meanwhile are queued for later calls.  As on the active
+ * side, a rail that does not arrive within RS_RAIL_TIMEOUT is skipped.
+ */
+static void rs_rails_collect(struct rsocket *rs, struct rsocket *leader, int cnt)
+{
+	struct rsocket *new_rs, **tail;
+	struct rs_conn_data *creq;
+	struct pollfd fds;
+
+	fds.fd = rs->cm_id->channel->fd;
+	fds.events = POLLIN;
+	while (cnt && poll(&fds, 1, RS_RAIL_TIMEOUT) > 0) {
+		new_rs = rs_get_request(rs);
+		if (!new_rs)
+			break;
+
+		creq = rs_get_creq(rs, new_rs);
+		if (creq->version == 1 && (creq->flags & RS_CONN_FLAG_RAIL) &&
+		    rs_rails_match(leader->rails, creq)) {
+			rs_rails_accept(leader->rails, new_rs, creq);
+			cnt--;
+			continue;
+		}
+
+		pthread_mutex_lock(&mut);
+		for (tail = &rs->accept_queue; *tail; tail = &(*tail)->accept_next)
+			;
+		*tail = new_rs;
+		pthread_mutex_unlock(&mut);
+	}
+}
+
+/*
+ * Nonblocking is usually not inherited between sockets, but we need to
+ * inherit it here to establish the connection only.  This is needed to
+ * prevent rdma_accept from blocking until the remote side finishes
+ * establishing the connection.  If we were to allow rdma_accept to block,
+ * then a single thread cannot establish a connection with itself, or
+ * two threads which try to connect to each other can deadlock trying to
+ * form a connection.
+ *
+ * Data transfers on the new socket remain blocking unless the user
+ * specifies otherwise through rfcntl.
+ */
+int raccept(int socket, struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct rsocket *rs, *new_rs;
+	struct rs_conn_data *creq;
+	struct rs_rails *rails;
+	int ret;
+
+	rs = idm_lookup(&idm, socket);
+	if (!rs)
+		return ERR(EBADF);
+next:
+	pthread_mutex_lock(&mut);
+	new_rs = rs->accept_queue;
+	if (new_rs) {
+		rs->accept_queue = new_rs->accept_next;
+		new_rs->accept_next = NULL;
+	}
+	pthread_mutex_unlock(&mut);
+
+	if (!new_rs) {
+		new_rs = rs_get_request(rs);
+		if (!new_rs)
+			return -1;
+	}
+
+	creq = rs_get_creq(rs, new_rs);
+	if (creq->version != 1) {
+		ret = ERR(ENOTSUP);
+		goto err;
+	}
+
+	/* A rail that missed its leader's raccept joins the group here. */
+	if (creq->flags & RS_CONN_FLAG_RAIL) {
+		rails = rs_rails_get(creq);
+		if (rails) {
+			rs_rails_accept(rails, new_rs, creq);
+			rs_rails_put(rails);
+		} else {
+			rdma_reject(new_rs->cm_id, NULL, 0);
+			rs_free(new_rs);
+		}
+		goto next;
+	}
+
+	if (rs->fd_flags & O_NONBLOCK)
+		fcntl(new_rs->cm_id->channel->fd, F_SETFL, O_NONBLOCK);
+
+	ret = rs_accept_ep(new_rs, creq);
+	if (ret)
 		goto err;
 
+	if (rs_rails_active(new_rs) && creq->rail_cnt &&
+	    !(rs->fd_flags & O_NONBLOCK))
+		rs_rails_collect(rs, new_rs, creq->rail_cnt);
+
 	if (addr && addrlen)
 		rgetpeername(new_rs->index, addr, addrlen);
 	return new_rs->index;
@@ -1303,8 +2296,10 @@ resolve_addr:
 	case rs_resolving_addr:
 		ret = ucma_complete(rs->cm_id);
 		if (ret) {
-			if (errno == ETIMEDOUT && rs->retries <= RS_CONN_RETRIES)
+			if (errno == ETIMEDOUT && rs->retries <= RS_CONN_RETRIES) {
+				rs->stats.retries++;
 				goto resolve_addr;
+			}
 			break;
 		}
 
@@ -1333,8 +2328,10 @@ resolve_route:
 resolving_route:
 		ret = ucma_complete(rs->cm_id);
 		if (ret) {
-			if (errno == ETIMEDOUT && rs->retries <= RS_CONN_RETRIES)
+			if (errno == ETIMEDOUT && rs->retries <= RS_CONN_RETRIES) {
+				rs->stats.retries++;
 				goto resolve_route;
+			}
 			break;
 		}
 do_connect:
@@ -1374,6 +2371,8 @@ connected:
 
 		rs_save_conn_data(rs, cresp);
 		rs->state = rs_connect_rdwr;
+		if (rs->rails)
+			rs_rails_connect(rs, cresp);
 		break;
 	case rs_accepting:
 		if (!(rs->fd_flags & O_NONBLOCK))
@@ -1749,6 +2748,43 @@ static int ds_post_send(struct rsocket *rs, struct ibv_sge *sge,
 	return rdma_seterrno(ibv_post_send(rs->conn_dest->qp->cm_id->qp, &wr, &bad));
 }
 
+/* Only one write at a time is timed for the round trip estimate */
+static void rs_stats_write(struct rsocket *rs, uint32_t length)
+{
+	rs->stats.bytes_sent += length;
+	rs->stats.writes++;
+	if (!atomic_load(&rs->stats.rtt_write)) {
+		rs->stats.rtt_start = rs_time_us();
+		atomic_store(&rs->stats.rtt_write, rs->stats.writes);
+	}
+}
+
+/*
+ * Writes complete in order, so the timed write is found by counting
+ * completions.  Posting to completion spans a round trip to the remote
+ * HCA.  The estimate is smoothed as TCP does (RFC 6298).
+ */
+static void rs_stats_write_comp(struct rsocket *rs)
+{
+	int64_t rtt, delta;
+
+	if (++rs->stats.write_comps != atomic_load(&rs->stats.rtt_write))
+		return;
+
+	rtt = rs_time_us() - rs->stats.rtt_start;
+	if (!rs->stats.srtt) {
+		rs->stats.srtt = rtt << 3;
+		rs->stats.rttvar = rtt << 1;
+	} else {
+		delta = rtt - (rs->stats.srtt >> 3);
+		rs->stats.srtt += delta;
+		if (delta < 0)
+			delta = -delta;
+		rs->stats.rttvar += delta - (rs->stats.rttvar >> 2);
+	}
+	atomic_store(&rs->stats.rtt_write, 0);
+}
+
 /*
  * Update target SGE before sending data.  Otherwise the remote side may
  * update the entry before we do.
@@ -1765,6 +2801,8 @@ static int rs_write_data(struct rsocket *rs,
 	if (rs->opts & RS_OPT_MSG_SEND)
 		rs->sqe_avail--;
 	rs->sbuf_bytes_avail -= length;
+	rs_stats_write(rs, length);
+	rs->stune.bytes += length;
 
 	addr = rs->target_sgl[rs->target_sge].addr;
 	rkey = rs->target_sgl[rs->target_sge].key;
@@ -1788,6 +2826,7 @@ static int rs_write_direct(struct rsocket *rs, struct rs_iomap *iom, uint64_t of
 
 	rs->sqe_avail--;
 	rs->sbuf_bytes_avail -= length;
+	rs_stats_write(rs, length);
 
 	addr = iom->sge.addr + offset - iom->offset;
 	return rs_post_write(rs, sgl, nsge, rs_msg_set(RS_OP_WRITE, length),
@@ -1816,6 +2855,16 @@ static uint32_t rs_sbuf_left(struct rsocket *rs)
 			   rs->ssgl[0].addr);
 }
 
+/*
+ * While the receive buffer is being resized, no new space is granted, so
+ * the remote side drains what it holds and the old buffer can be retired.
+ */
+static int rs_can_grant(struct rsocket *rs)
+{
+	return (rs->rbuf_bytes_avail >= (rs->rbuf_size >> 1)) &&
+	       !rs->rbuf_new_size;
+}
+
 static void rs_send_credits(struct rsocket *rs)
 {
 	struct ibv_sge ibsge;
@@ -1824,7 +2873,7 @@ static void rs_send_credits(struct rsocket *rs)
 
 	rs->ctrl_seqno++;
 	rs->rseq_comp = rs->rseq_no + (rs->rq_size >> 1);
-	if (rs->rbuf_bytes_avail >= (rs->rbuf_size >> 1)) {
+	if (rs_can_grant(rs)) {
 		if (rs->opts & RS_OPT_MSG_SEND)
 			rs->ctrl_seqno++;
 
@@ -1857,6 +2906,7 @@ static void rs_send_credits(struct rsocket *rs)
 			rs->remote_sgl.key);
 
 		rs->rbuf_bytes_avail -= rs->rbuf_size >> 1;
+		rs->rbuf_granted += rs->rbuf_size >> 1;
 		rs->rbuf_free_offset += rs->rbuf_size >> 1;
 		if (rs->rbuf_free_offset >= rs->rbuf_size)
 			rs->rbuf_free_offset = 0;
@@ -1881,11 +2931,11 @@ static inline int rs_2ctrl_avail(struct rsocket *rs)
 static int rs_give_credits(struct rsocket *rs)
 {
 	if (!(rs->opts & RS_OPT_MSG_SEND)) {
-		return ((rs->rbuf_bytes_avail >= (rs->rbuf_size >> 1)) ||
+		return (rs_can_grant(rs) ||
 			((short) ((short) rs->rseq_no - (short) rs->rseq_comp) >= 0)) &&
 		       rs_ctrl_avail(rs) && (rs->state & rs_connected);
 	} else {
-		return ((rs->rbuf_bytes_avail >= (rs->rbuf_size >> 1)) ||
+		return (rs_can_grant(rs) ||
 			((short) ((short) rs->rseq_no - (short) rs->rseq_comp) >= 0)) &&
 		       rs_2ctrl_avail(rs) && (rs->state & rs_connected);
 	}
@@ -1901,10 +2951,14 @@ static int rs_poll_cq(struct rsocket *rs)
 {
 	struct ibv_wc wc;
 	uint32_t msg;
-	int ret, rcnt = 0;
+	int ret, rcnt = 0, srq_cnt = 0;
 
+	rs->stats.cq_polls++;
 	while ((ret = ibv_poll_cq(rs->cm_id->recv_cq, 1, &wc)) > 0) {
 		if (rs_wr_is_recv(wc.wr_id)) {
+			/* Failed receives were taken from the SRQ all the same */
+			if (rs->srq)
+				srq_cnt++;
 			if (wc.status != IBV_WC_SUCCESS)
 				continue;
 			rcnt++;
@@ -1940,6 +2994,8 @@ static int rs_poll_cq(struct rsocket *rs)
 				/* We really shouldn't be here. */
 				break;
 			default:
+				rs->rbuf_granted -= min(rs->rbuf_granted,
+							rs_msg_data(msg));
 				rs->rmsg[rs->rmsg_tail].op = rs_msg_op(msg);
 				rs->rmsg[rs->rmsg_tail].data = rs_msg_data(msg);
 				if (++rs->rmsg_tail == rs->rq_size + 1)
@@ -1964,6 +3020,8 @@ static int rs_poll_cq(struct rsocket *rs)
 			default:
 				rs->sqe_avail++;
 				rs->sbuf_bytes_avail += rs_msg_data(rs_wr_data(wc.wr_id));
+				if (!rs_wr_is_msg_send(wc.wr_id))
+					rs_stats_write_comp(rs);
 				break;
 			}
 			if (wc.status != IBV_WC_SUCCESS && (rs->state & rs_connected)) {
@@ -1973,7 +3031,11 @@ static int rs_poll_cq(struct rsocket *rs)
 		}
 	}
 
-	if (rs->state & rs_connected) {
+	if (rs->srq) {
+		if (srq_cnt)
+			rs_srq_reaped(rs->srq, srq_cnt);
+		ret = 0;
+	} else if (rs->state & rs_connected) {
 		while (!ret && rcnt--)
 			ret = rs_post_recv(rs);
 
@@ -1996,6 +3058,7 @@ static int rs_get_cq_event(struct rsocket *rs)
 
 	ret = ibv_get_cq_event(rs->cm_id->recv_cq_channel, &cq, &context);
 	if (!ret) {
+		rs->stats.cq_sleeps++;
 		if (++rs->unack_cqe >= rs->sq_size + rs->rq_size) {
 			ibv_ack_cq_events(rs->cm_id->recv_cq, rs->unack_cqe);
 			rs->unack_cqe = 0;
@@ -2038,6 +3101,9 @@ static int rs_process_cq(struct rsocket *rs, int nonblock, int (*test)(struct rs
 		} else if (nonblock) {
 			ret = ERR(EWOULDBLOCK);
 		} else if (!rs->cq_armed) {
+			/* Don't sleep with the SRQ drained by idle sockets */
+			if (rs->srq)
+				rs_fill_srq(rs->srq);
 			ibv_req_notify_cq(rs->cm_id->recv_cq, 0);
 			rs->cq_armed = 1;
 		} else {
@@ -2082,11 +3148,19 @@ static int rs_get_comp(struct rsocket *rs, int nonblock, int (*test)(struct rsoc
 static int ds_valid_recv(struct ds_qp *qp, struct ibv_wc *wc)
 {
 	struct ds_header *hdr;
+	uint8_t version;
+	uint32_t len;
 
 	hdr = (struct ds_header *) (qp->rbuf + rs_wr_data(wc->wr_id));
+	version = hdr->version & ~DS_HDR_FRAG;
+	len = hdr->length;
+	if (hdr->version & DS_HDR_FRAG)
+		len += sizeof(struct ds_frag_header);
+
 	return ((wc->byte_len >= sizeof(struct ibv_grh) + DS_IPV4_HDR_LEN) &&
-		((hdr->version == 4 && hdr->length == DS_IPV4_HDR_LEN) ||
-		 (hdr->version == 6 && hdr->length == DS_IPV6_HDR_LEN)));
+		((version == 4 && hdr->length == DS_IPV4_HDR_LEN) ||
+		 (version == 6 && hdr->length == DS_IPV6_HDR_LEN)) &&
+		(wc->byte_len >= sizeof(struct ibv_grh) + len));
 }
 
 /*
@@ -2302,9 +3376,25 @@ static int rs_have_rdata(struct rsocket *rs)
 	return (rs->rmsg_head != rs->rmsg_tail);
 }
 
+static int ds_have_rdata(struct rsocket *rs)
+{
+	return rs_have_rdata(rs) || rs->reasm_done;
+}
+
+/*
+ * The receive buffer can be swapped once the remote side has filled all
+ * space granted to it and the application has read all of it.
+ */
+static int rs_rbuf_resize_ready(struct rsocket *rs)
+{
+	return rs->rbuf_new_size && !rs->rbuf_granted && !rs_have_rdata(rs);
+}
+
+/* A pending buffer resize is reported as readable so a reader performs it */
 static int rs_conn_have_rdata(struct rsocket *rs)
 {
-	return rs_have_rdata(rs) || !(rs->state & rs_readable);
+	return rs_have_rdata(rs) || !(rs->state & rs_readable) ||
+	       rs_rbuf_resize_ready(rs);
 }
 
 static int rs_conn_all_sends_done(struct rsocket *rs)
@@ -2339,25 +3429,150 @@ static void ds_set_src(struct sockaddr *addr, socklen_t *addrlen,
 	memcpy(addr, &sa, *addrlen);
 }
 
-static ssize_t ds_recvfrom(struct rsocket *rs, void *buf, size_t len, int flags,
-			   struct sockaddr *src_addr, socklen_t *addrlen)
+static void ds_consume_rmsg(struct rsocket *rs, struct ds_rmsg *rmsg)
 {
-	struct ds_rmsg *rmsg;
-	struct ds_header *hdr;
-	int ret;
+	ds_post_recv(rs, rmsg->qp, rmsg->offset);
+	if (++rs->rmsg_head == rs->rq_size + 1)
+		rs->rmsg_head = 0;
+	rs->rqe_avail++;
+}
+
+static void ds_reasm_expire(struct rsocket *rs, uint64_t now)
+{
+	struct ds_reasm **prev, *reasm;
+
+	for (prev = &rs->reasm_list; (reasm = *prev); ) {
+		if (now - reasm->start > DS_REASM_TIMEOUT) {
+			*prev = reasm->next;
+			rs->reasm_cnt--;
+			free(reasm);
+		} else {
+			prev = &reasm->next;
+		}
+	}
+}
+
+static int ds_reasm_match(struct ds_reasm *reasm, struct ds_header *hdr,
+			  uint32_t id)
+{
+	return reasm->id == id && reasm->hdr.length == hdr->length &&
+	       !memcmp(&reasm->hdr.port, &hdr->port, hdr->length - 2);
+}
+
+/*
+ * Copy a received segment into the reassembly buffer for its datagram,
+ * which is identified by the source address and the sender's message id.
+ * UD does not duplicate messages, so a datagram is complete once all of
+ * its bytes have arrived.  Datagrams missing segments are discarded after
+ * DS_REASM_TIMEOUT, and new datagrams are dropped while DS_REASM_MAX are
+ * already being reassembled.
+ */
+static void ds_reasm_frag(struct rsocket *rs, struct ds_rmsg *rmsg)
+{
+	struct ds_reasm **prev, *reasm;
+	struct ds_frag_header *frag;
+	struct ds_header *hdr;
+	uint32_t id, offset, total, len;
+	uint64_t now;
+
+	hdr = (struct ds_header *) (rmsg->qp->rbuf + rmsg->offset);
+	frag = (void *) hdr + hdr->length;
+	len = rmsg->length - hdr->length - sizeof(*frag);
+	id = be32toh(frag->id);
+	offset = be32toh(frag->offset);
+	total = be32toh(frag->total);
+	if (total > DS_MAX_MSG_SIZE || offset > total || len > total - offset)
+		return;
+
+	now = rs_time_us();
+	ds_reasm_expire(rs, now);
+	for (prev = &rs->reasm_list; (reasm = *prev); prev = &reasm->next) {
+		if (ds_reasm_match(reasm, hdr, id))
+			break;
+	}
+
+	if (!reasm) {
+		if (rs->reasm_cnt >= DS_REASM_MAX)
+			return;
+
+		reasm = malloc(sizeof(*reasm) + total);
+		if (!reasm)
+			return;
+
+		memcpy(&reasm->hdr, hdr, hdr->length);
+		reasm->hdr.version &= ~DS_HDR_FRAG;
+		reasm->id = id;
+		reasm->total = total;
+		reasm->received = 0;
+		reasm->start = now;
+		reasm->next = rs->reasm_list;
+		rs->reasm_list = reasm;
+		rs->reasm_cnt++;
+		prev = &rs->reasm_list;
+	} else if (reasm->total != total) {
+		return;
+	}
+
+	memcpy(reasm->data + offset, (void *) (frag + 1), len);
+	reasm->received += len;
+	if (reasm->received >= reasm->total) {
+		*prev = reasm->next;
+		rs->reasm_cnt--;
+		rs->reasm_done = reasm;
+	}
+}
+
+static ssize_t ds_recv_reasm(struct rsocket *rs, void *buf, size_t len,
+			     int flags, struct sockaddr *src_addr,
+			     socklen_t *addrlen)
+{
+	struct ds_reasm *reasm = rs->reasm_done;
+
+	if (len > reasm->total)
+		len = reasm->total;
+
+	memcpy(buf, reasm->data, len);
+	if (addrlen)
+		ds_set_src(src_addr, addrlen, &reasm->hdr);
+
+	if (!(flags & MSG_PEEK)) {
+		rs->reasm_done = NULL;
+		free(reasm);
+	}
+
+	return len;
+}
+
+static ssize_t ds_recvfrom(struct rsocket *rs, void *buf, size_t len, int flags,
+			   struct sockaddr *src_addr, socklen_t *addrlen)
+{
+	struct ds_rmsg *rmsg;
+	struct ds_header *hdr;
+	int ret;
 
 	if (!(rs->state & rs_readable))
 		return ERR(EINVAL);
 
-	if (!rs_have_rdata(rs)) {
-		ret = ds_get_comp(rs, rs_nonblocking(rs, flags),
-				  rs_have_rdata);
-		if (ret)
-			return ret;
+	while (!rs->reasm_done) {
+		if (!rs_have_rdata(rs)) {
+			ret = ds_get_comp(rs, rs_nonblocking(rs, flags),
+					  rs_have_rdata);
+			if (ret)
+				return ret;
+		}
+
+		rmsg = &rs->dmsg[rs->rmsg_head];
+		hdr = (struct ds_header *) (rmsg->qp->rbuf + rmsg->offset);
+		if (!(hdr->version & DS_HDR_FRAG))
+			break;
+
+		ds_reasm_frag(rs, rmsg);
+		ds_consume_rmsg(rs, rmsg);
 	}
 
-	rmsg = &rs->dmsg[rs->rmsg_head];
-	hdr = (struct ds_header *) (rmsg->qp->rbuf + rmsg->offset);
+	if (rs->reasm_done)
+		return ds_recv_reasm(rs, buf, len, flags, src_addr, addrlen);
+
 	if (len > rmsg->length - hdr->length)
 		len = rmsg->length - hdr->length;
 
@@ -2365,12 +3580,8 @@ static ssize_t ds_recvfrom(struct rsocket *rs, void *buf, size_t len, int flags,
 	if (addrlen)
 		ds_set_src(src_addr, addrlen, hdr);
 
-	if (!(flags & MSG_PEEK)) {
-		ds_post_recv(rs, rmsg->qp, rmsg->offset);
-		if (++rs->rmsg_head == rs->rq_size + 1)
-			rs->rmsg_head = 0;
-		rs->rqe_avail++;
-	}
+	if (!(flags & MSG_PEEK))
+		ds_consume_rmsg(rs, rmsg);
 
 	return len;
 }
@@ -2409,15 +3620,455 @@ static ssize_t rs_peek(struct rsocket *rs, void *buf, size_t len)
 	return len - left;
 }
 
+/*
+ * Consume up to len bytes of received data, copying them into buf unless
+ * buf is NULL.  The space is credited back to the remote side the next
+ * time credits are updated.
+ */
+static size_t rs_consume(struct rsocket *rs, void *buf, size_t len)
+{
+	size_t left = len;
+	uint32_t end_size, rsize;
+
+	for (; left && rs_have_rdata(rs); left -= rsize) {
+		if (left < rs->rmsg[rs->rmsg_head].data) {
+			rsize = left;
+			rs->rmsg[rs->rmsg_head].data -= left;
+		} else {
+			rs->rseq_no++;
+			rsize = rs->rmsg[rs->rmsg_head].data;
+			if (++rs->rmsg_head == rs->rq_size + 1)
+				rs->rmsg_head = 0;
+		}
+
+		end_size = rs->rbuf_size - rs->rbuf_offset;
+		if (rsize > end_size) {
+			if (buf) {
+				memcpy(buf, &rs->rbuf[rs->rbuf_offset], end_size);
+				buf += end_size;
+			}
+			rs->rbuf_offset = 0;
+			rsize -= end_size;
+			left -= end_size;
+			rs->rbuf_bytes_avail += end_size;
+		}
+		if (buf) {
+			memcpy(buf, &rs->rbuf[rs->rbuf_offset], rsize);
+			buf += rsize;
+		}
+		rs->rbuf_offset += rsize;
+		rs->rbuf_bytes_avail += rsize;
+	}
+
+	rs->rtune.bytes += len - left;
+	rs->stats.bytes_received += len - left;
+	return len - left;
+}
+
+/*
+ * Returns the new size a buffer should be resized to, or 0 to keep it.
+ */
+static uint32_t rs_tune_size(struct rs_tune *tune, uint32_t size,
+			     uint32_t min_size, uint32_t max_size, int stalled)
+{
+	uint64_t now = rs_time_us();
+	uint32_t new_size = 0;
+
+	if (now - tune->start >= RS_TUNE_PERIOD) {
+		if (!stalled && tune->bytes < (size >> 2) && size > min_size)
+			new_size = max(size >> 1, min_size);
+		tune->start = now;
+		tune->bytes = 0;
+		tune->stalls = 0;
+	}
+
+	if (!new_size && stalled && ++tune->stalls >= RS_TUNE_STALLS &&
+	    size < max_size) {
+		new_size = min(size << 1, max_size);
+		tune->start = now;
+		tune->bytes = 0;
+		tune->stalls = 0;
+	}
+	return new_size;
+}
+
+/*
+ * Called with rlock held, by a reader that found no data or by tune_svc.
+ * If the remote side has used up all granted space while a reader waits,
+ * the receive buffer is limiting the transfer.  tune_svc only shrinks
+ * buffers, since nobody may be reading.  The receive buffer cannot be
+ * resized in message mode, where posted receives point into it.
+ */
+static void rs_tune_rbuf(struct rsocket *rs, int reader)
+{
+	uint32_t new_size;
+
+	if ((rs->opts & (RS_OPT_RBUF_LOCK | RS_OPT_MSG_SEND)) ||
+	    rs->rbuf_new_size || def_mem_max <= def_mem ||
+	    !(rs->state & rs_connected))
+		return;
+
+	new_size = rs_tune_size(&rs->rtune, rs->rbuf_size, def_mem,
+				def_mem_max, reader && !rs->rbuf_granted);
+	if (new_size) {
+		fastlock_acquire(&rs->cq_lock);
+		rs->rbuf_new_size = new_size;
+		fastlock_release(&rs->cq_lock);
+	}
+}
+
+/*
+ * Called with rlock held.  Nothing is granted while a resize is pending,
+ * so once ready the buffer stays ready, and the new buffer is allocated
+ * and registered without holding cq_lock.  The old buffer is deregistered
+ * rather than pooled, since the remote side still knows its rkey.  If a
+ * new buffer cannot be allocated, the old one is reused from the start.
+ */
+static void rs_resize_rbuf(struct rsocket *rs)
+{
+	struct ibv_mr *mr, *old_mr = NULL;
+	uint32_t new_size;
+	void *addr;
+
+	fastlock_acquire(&rs->cq_lock);
+	new_size = rs_rbuf_resize_ready(rs) ? rs->rbuf_new_size : 0;
+	fastlock_release(&rs->cq_lock);
+	if (!new_size)
+		return;
+
+	mr = rs_get_buf(rs, new_size, RS_RBUF_ACCESS);
+
+	fastlock_acquire(&rs->cq_lock);
+	if (mr) {
+		old_mr = rs->rmr;
+		rs->rmr = mr;
+		rs->rbuf = mr->addr;
+		rs->rbuf_size = new_size;
+	}
+
+	rs->rbuf_new_size = 0;
+	rs->rbuf_offset = 0;
+	rs->rbuf_free_offset = 0;
+	rs->rbuf_bytes_avail = rs->rbuf_size;
+	while (rs_can_grant(rs) && rs_give_credits(rs))
+		rs_send_credits(rs);
+	fastlock_release(&rs->cq_lock);
+
+	if (old_mr) {
+		addr = old_mr->addr;
+		ibv_dereg_mr(old_mr);
+		free(addr);
+	}
+}
+
+static void rs_try_flush(struct rsocket *rs);
+static int rs_conn_recv_ready(struct rsocket *rs);
+
+static int rs_wait_rdata(struct rsocket *rs, int nonblock)
+{
+	int ret;
+
+	rs_tune_rbuf(rs, 1);
+	while (!rs_have_rdata(rs)) {
+		rs->stats.recv_waits++;
+		ret = rs_get_comp(rs, nonblock, rs_conn_recv_ready);
+		if (ret)
+			return ret;
+
+		rs_try_flush(rs);
+		if (!rs_conn_have_rdata(rs))
+			continue;
+
+		if (!rs_rbuf_resize_ready(rs))
+			break;
+		rs_resize_rbuf(rs);
+
+		/* A grown buffer is shrunk again even if the reader idles */
+		if (rs->rbuf_size > def_mem && !(rs->opts & RS_OPT_TUNE_SVC))
+			rs_notify_svc(&tune_svc, rs, RS_SVC_ADD_TUNE);
+	}
+	return 0;
+}
+
+/*
+ * Called by a sender before it writes, and whenever it has to wait.  The
+ * send buffer limits the transfer when it is full while the remote side has
+ * granted space.  It is swapped once every send has completed; blocking
+ * senders wait for that.
+ */
+static void rs_tune_sbuf(struct rsocket *rs, int nonblock)
+{
+	struct ibv_mr *mr, *old_mr;
+	uint32_t new_size;
+	int stalled;
+
+	if ((rs->opts & RS_OPT_SBUF_LOCK) || def_wmem_max <= def_wmem ||
+	    !(rs->state & rs_connected) || rs->sbuf_pending)
+		return;
+
+	if (!rs->sbuf_new_size) {
+		stalled = rs->sbuf_bytes_avail < RS_SNDLOWAT &&
+			  rs->target_sgl[rs->target_sge].length;
+		/* Sampling reads the clock, so only every few sends do it */
+		if (!stalled && --rs->stune.skip > 0)
+			return;
+		rs->stune.skip = RS_TUNE_SAMPLE;
+		rs->sbuf_new_size = rs_tune_size(&rs->stune, rs->sbuf_size,
+						 def_wmem, def_wmem_max,
+						 stalled);
+		if (!rs->sbuf_new_size)
+			return;
+	}
+
+	if (rs_process_cq(rs, nonblock, rs_conn_all_sends_done) ||
+	    !(rs->state & rs_connected))
+		return;
+
+	/* The caller holds slock, so no new send can be posted meanwhile */
+	new_size = rs->sbuf_new_size;
+	rs->sbuf_new_size = 0;
+	mr = rs_get_buf(rs, rs_total_sbuf_size(rs, new_size), RS_SBUF_ACCESS);
+	if (!mr)
+		return;
+
+	fastlock_acquire(&rs->cq_lock);
+	old_mr = rs->smr;
+	rs->smr = mr;
+	rs->sbuf = mr->addr;
+	rs->sbuf_size = new_size;
+	rs->sbuf_bytes_avail = new_size;
+	rs->ssgl[0].addr = rs->ssgl[1].addr = (uintptr_t) rs->sbuf;
+	rs->ssgl[0].lkey = rs->ssgl[1].lkey = rs->smr->lkey;
+	fastlock_release(&rs->cq_lock);
+
+	rs_put_buf(old_mr, RS_SBUF_ACCESS);
+}
+
+/*
+ * Number of received bytes that are contiguous in rbuf, starting at the
+ * current read offset.
+ */
+static size_t rs_contig_rdata(struct rsocket *rs)
+{
+	size_t len = 0, end_size;
+	int rmsg_head;
+
+	end_size = rs->rbuf_size - rs->rbuf_offset;
+	for (rmsg_head = rs->rmsg_head; rmsg_head != rs->rmsg_tail &&
+	     len < end_size;) {
+		len += rs->rmsg[rmsg_head].data;
+		if (++rmsg_head == rs->rq_size + 1)
+			rmsg_head = 0;
+	}
+
+	return min(len, end_size);
+}
+
+static int rs_can_flush(struct rsocket *rs)
+{
+	return (rs->sqe_avail >= ((rs->opts & RS_OPT_MSG_SEND) ? 2 : 1)) &&
+	       (rs->sseq_no != rs->sseq_comp);
+}
+
+static int rs_conn_can_flush(struct rsocket *rs)
+{
+	return rs_can_flush(rs) || !(rs->state & rs_writable);
+}
+
+/*
+ * Small writes may be held in the send buffer and sent later as a single
+ * RDMA write: while corked, when the caller passes MSG_MORE, or, if
+ * nagle_delay is configured and TCP_NODELAY is not set, while earlier
+ * sends are still outstanding.
+ */
+static int rs_hold_send(struct rsocket *rs, int flags)
+{
+	if ((flags & MSG_MORE) || (rs->tcp_opts & (1 << TCP_CORK)))
+		return 1;
+
+	return def_nagle_delay && !(rs->tcp_opts & (1 << TCP_NODELAY)) &&
+	       !rs_conn_all_sends_done(rs);
+}
+
+static uint32_t rs_hold_limit(struct rsocket *rs, int flags)
+{
+	return ((flags & MSG_MORE) || (rs->tcp_opts & (1 << TCP_CORK))) ?
+		RS_CORK_TIMEOUT : def_nagle_delay;
+}
+
+static int rs_hold_expired(struct rsocket *rs, int flags)
+{
+	return rs_time_us() - rs->spend_start >= rs_hold_limit(rs, flags);
+}
+
+/* Held data is always sent with one write to the current target SGE. */
+static int rs_can_hold(struct rsocket *rs, size_t len)
+{
+	return (rs->state & rs_writable) &&
+	       (rs->sbuf_pending + len <= RS_CORK_SIZE) &&
+	       (rs->sbuf_pending + len <= rs->target_sgl[rs->target_sge].length) &&
+	       (len <= rs->sbuf_bytes_avail);
+}
+
+/*
+ * Send any held data.  The held bytes were reserved from sbuf_bytes_avail
+ * when they were queued, so give them back before the write takes them.
+ */
+static int rs_flush(struct rsocket *rs, int nonblock)
+{
+	struct ibv_sge sgl[2];
+	uint32_t head, len;
+	int nsge, ret;
+
+	if (!rs->sbuf_pending)
+		return 0;
+
+	while (!rs_can_flush(rs)) {
+		ret = rs_get_comp(rs, nonblock, rs_conn_can_flush);
+		if (ret)
+			return ret;
+		if (!(rs->state & rs_writable))
+			return ERR(ECONNRESET);
+	}
+
+	len = rs->sbuf_pending;
+	head = (uint32_t) (rs->ssgl[0].addr - (uintptr_t) rs->sbuf);
+	sgl[0].lkey = sgl[1].lkey = rs->smr->lkey;
+	if (head >= len) {
+		sgl[0].addr = rs->ssgl[0].addr - len;
+		sgl[0].length = len;
+		nsge = 1;
+	} else {
+		sgl[0].length = len - head;
+		sgl[0].addr = (uintptr_t) &rs->sbuf[rs->sbuf_size] - sgl[0].length;
+		sgl[1].addr = (uintptr_t) rs->sbuf;
+		sgl[1].length = head;
+		nsge = head ? 2 : 1;
+	}
+
+	rs->sbuf_bytes_avail += len;
+	rs->sbuf_pending = 0;
+	return rs_write_data(rs, sgl, nsge, len,
+			     len <= rs->sq_inline ? IBV_SEND_INLINE : 0);
+}
+
+/* Flush held data before waiting on the connection. */
+static int rs_flush_pending(struct rsocket *rs, int nonblock)
+{
+	int ret;
+
+	if (!rs->sbuf_pending)
+		return 0;
+
+	fastlock_acquire(&rs->slock);
+	ret = rs_flush(rs, nonblock);
+	fastlock_release(&rs->slock);
+	return ret;
+}
+
+/*
+ * Send held data if it can go out right away.  Receivers and pollers use
+ * this rather than rs_flush_pending(), since a sender may be blocked
+ * waiting for credits with slock held, and the credits may only come
+ * once this thread has received.  The held data is then sent by that
+ * sender or by the cork service.
+ */
+static void rs_try_flush(struct rsocket *rs)
+{
+	if (rs->sbuf_pending && fastlock_tryacquire(&rs->slock)) {
+		rs_flush(rs, 1);
+		fastlock_release(&rs->slock);
+	}
+}
+
+/*
+ * The peer may be waiting for held data before it replies, so a receiver
+ * also wakes up once that data can be sent.
+ */
+static int rs_conn_recv_ready(struct rsocket *rs)
+{
+	return rs_conn_have_rdata(rs) || (rs->sbuf_pending && rs_can_flush(rs));
+}
+
+static void rs_copy_sbuf(struct rsocket *rs, const void *buf, size_t len)
+{
+	uint32_t left = rs_sbuf_left(rs);
+
+	if (len < left) {
+		memcpy((void *) (uintptr_t) rs->ssgl[0].addr, buf, len);
+		rs->ssgl[0].addr += len;
+	} else {
+		memcpy((void *) (uintptr_t) rs->ssgl[0].addr, buf, left);
+		memcpy(rs->sbuf, buf + left, len - left);
+		rs->ssgl[0].addr = (uintptr_t) rs->sbuf + len - left;
+	}
+}
+
+/*
+ * Returns 1 if buf was queued behind held data, 0 if it should be sent
+ * directly, after any held data has been flushed.
+ */
+static int rs_coalesce(struct rsocket *rs, const void *buf, size_t len, int flags)
+{
+	if (!rs_hold_send(rs, flags) || !rs_can_hold(rs, len))
+		return rs_flush(rs, rs_nonblocking(rs, flags));
+
+	/* Register once, so that held data is sent even if the caller idles */
+	if (!(rs->opts & RS_OPT_CORK_SVC) &&
+	    rs_notify_svc(&cork_svc, rs, RS_SVC_ADD_CORK))
+		return rs_flush(rs, rs_nonblocking(rs, flags));
+
+	if (!rs->sbuf_pending) {
+		rs->spend_start = rs_time_us();
+		rs->spend_limit = rs_hold_limit(rs, flags);
+	}
+	rs_copy_sbuf(rs, buf, len);
+	rs->sbuf_bytes_avail -= len;
+	rs->sbuf_pending += len;
+
+	/* The data is queued, so a failed flush is retried on the next call */
+	if (rs->sbuf_pending == RS_CORK_SIZE || rs_hold_expired(rs, flags))
+		rs_flush(rs, 1);
+	return 1;
+}
+
 /*
  * Continue to receive any queued data even if the remote side has disconnected.
  */
+static ssize_t rs_recv(struct rsocket *rs, void *buf, size_t len, int flags)
+{
+	size_t left = len, rsize;
+	int ret;
+
+	rs_try_flush(rs);
+	fastlock_acquire(&rs->rlock);
+	do {
+		if (!rs_have_rdata(rs)) {
+			ret = rs_wait_rdata(rs, rs_nonblocking(rs, flags));
+			if (ret)
+				break;
+		}
+
+		if (flags & MSG_PEEK) {
+			left = len - rs_peek(rs, buf, left);
+			break;
+		}
+
+		rsize = rs_consume(rs, buf, left);
+		buf += rsize;
+		left -= rsize;
+	} while (left && (flags & MSG_WAITALL) && (rs->state & rs_readable));
+
+	fastlock_release(&rs->rlock);
+	return (ret && left == len) ? ret : len - left;
+}
+
+static ssize_t rs_rails_recv(struct rsocket *rs, void *buf, size_t len, int flags);
+
 ssize_t rrecv(int socket, void *buf, size_t len, int flags)
 {
 	struct rsocket *rs;
-	size_t left = len;
-	uint32_t end_size, rsize;
-	int ret = 0;
+	int ret;
 
 	rs = idm_at(&idm, socket);
 	if (rs->type == SOCK_DGRAM) {
@@ -2435,50 +4086,80 @@ ssize_t rrecv(int socket, void *buf, size_t len, int flags)
 			return ret;
 		}
 	}
-	fastlock_acquire(&rs->rlock);
-	do {
-		if (!rs_have_rdata(rs)) {
-			ret = rs_get_comp(rs, rs_nonblocking(rs, flags),
-					  rs_conn_have_rdata);
-			if (ret)
-				break;
-		}
 
-		if (flags & MSG_PEEK) {
-			left = len - rs_peek(rs, buf, left);
-			break;
-		}
+	if (rs_rails_active(rs))
+		return rs_rails_recv(rs, buf, len, flags);
+	return rs_recv(rs, buf, len, flags);
+}
 
-		for (; left && rs_have_rdata(rs); left -= rsize) {
-			if (left < rs->rmsg[rs->rmsg_head].data) {
-				rsize = left;
-				rs->rmsg[rs->rmsg_head].data -= left;
-			} else {
-				rs->rseq_no++;
-				rsize = rs->rmsg[rs->rmsg_head].data;
-				if (++rs->rmsg_head == rs->rq_size + 1)
-					rs->rmsg_head = 0;
-			}
+/*
+ * Zero-copy receive.  Data is left in the receive buffer, and the space is
+ * not credited back to the remote side until the caller returns it.
+ */
+ssize_t rrecv_borrow(int socket, void **buf, size_t len, int flags)
+{
+	struct rsocket *rs;
+	size_t rsize;
+	int ret;
 
-			end_size = rs->rbuf_size - rs->rbuf_offset;
-			if (rsize > end_size) {
-				memcpy(buf, &rs->rbuf[rs->rbuf_offset], end_size);
-				rs->rbuf_offset = 0;
-				buf += end_size;
-				rsize -= end_size;
-				left -= end_size;
-				rs->rbuf_bytes_avail += end_size;
-			}
-			memcpy(buf, &rs->rbuf[rs->rbuf_offset], rsize);
-			rs->rbuf_offset += rsize;
-			buf += rsize;
-			rs->rbuf_bytes_avail += rsize;
+	rs = idm_lookup(&idm, socket);
+	if (!rs || rs->type != SOCK_STREAM)
+		return ERR(EBADF);
+
+	if (rs->state & rs_opening) {
+		ret = rs_do_connect(rs);
+		if (ret) {
+			if (errno == EINPROGRESS)
+				errno = EAGAIN;
+			return ret;
 		}
+	}
 
-	} while (left && (flags & MSG_WAITALL) && (rs->state & rs_readable));
+	/* Received data is not contiguous across rails */
+	if (rs_rails_active(rs))
+		return ERR(EOPNOTSUPP);
 
+	fastlock_acquire(&rs->rlock);
+	if (!rs_have_rdata(rs)) {
+		ret = rs_wait_rdata(rs, rs_nonblocking(rs, flags));
+		if (ret)
+			goto out;
+	}
+
+	rsize = rs_contig_rdata(rs);
+	if (rsize > len)
+		rsize = len;
+	*buf = &rs->rbuf[rs->rbuf_offset];
+	ret = rsize;
+out:
 	fastlock_release(&rs->rlock);
-	return (ret && left == len) ? ret : len - left;
+	return ret;
+}
+
+int rrecv_return(int socket, size_t len)
+{
+	struct rsocket *rs;
+	size_t rsize;
+
+	rs = idm_lookup(&idm, socket);
+	if (!rs || rs->type != SOCK_STREAM)
+		return ERR(EBADF);
+
+	fastlock_acquire(&rs->rlock);
+	if (len > rs_contig_rdata(rs)) {
+		fastlock_release(&rs->rlock);
+		return ERR(EINVAL);
+	}
+
+	rsize = rs_consume(rs, NULL, len);
+	fastlock_release(&rs->rlock);
+
+	if (rsize && rs_give_credits(rs)) {
+		fastlock_acquire(&rs->cq_lock);
+		rs_update_credits(rs);
+		fastlock_release(&rs->cq_lock);
+	}
+	return 0;
 }
 
 ssize_t rrecvfrom(int socket, void *buf, size_t len, int flags,
@@ -2647,6 +4328,75 @@ static ssize_t ds_send_udp(struct rsocket *rs, const void *buf, size_t len,
 	}
 }
 
+/*
+ * Send a datagram that does not fit in one send buffer as a set of
+ * segments.  The segments are posted together as a chain of work
+ * requests once enough send buffers are free for all of them, so a
+ * nonblocking send either queues the whole datagram or none of it.
+ */
+static ssize_t ds_send_frags(struct rsocket *rs, struct ds_header *hdr,
+			     const void *buf, size_t len, int nonblock)
+{
+	struct ibv_send_wr wr[DS_MAX_FRAGS], *bad;
+	struct ibv_sge sge[DS_MAX_FRAGS];
+	struct ds_frag_header frag;
+	struct ds_header fhdr;
+	struct ds_smsg *msg;
+	size_t seg, xfer;
+	uint64_t offset;
+	int i, cnt, ret;
+
+	seg = RS_SNDLOWAT - hdr->length - sizeof(frag);
+	cnt = (len + seg - 1) / seg;
+	if (cnt > rs->sq_size)
+		return ERR(EMSGSIZE);
+
+	if (rs->sqe_avail < cnt) {
+		ret = ds_get_comp(rs, nonblock, ds_all_sends_done);
+		if (ret)
+			return ret;
+	}
+
+	memcpy(&fhdr, hdr, hdr->length);
+	fhdr.version |= DS_HDR_FRAG;
+	frag.id = htobe32(rs->frag_id++);
+	frag.total = htobe32(len);
+
+	for (i = 0; i < cnt; i++) {
+		xfer = min(seg, len - i * seg);
+		frag.offset = htobe32(i * seg);
+
+		msg = rs->smsg_free;
+		rs->smsg_free = msg->next;
+		rs->sqe_avail--;
+
+		memcpy((void *) msg, &fhdr, fhdr.length);
+		memcpy((void *) msg + fhdr.length, &frag, sizeof frag);
+		memcpy((void *) msg + fhdr.length + sizeof frag,
+		       buf + i * seg, xfer);
+
+		sge[i].addr = (uintptr_t) msg;
+		sge[i].length = fhdr.length + sizeof(frag) + xfer;
+		sge[i].lkey = rs->conn_dest->qp->smr->lkey;
+
+		offset = (uint8_t *) msg - rs->sbuf;
+		wr[i].wr_id = rs_send_wr_id(offset);
+		wr[i].next = (i + 1 < cnt) ? &wr[i + 1] : NULL;
+		wr[i].sg_list = &sge[i];
+		wr[i].num_sge = 1;
+		wr[i].opcode = IBV_WR_SEND;
+		wr[i].send_flags = (sge[i].length <= rs->sq_inline) ?
+				   IBV_SEND_INLINE : 0;
+		wr[i].wr.ud.ah = rs->conn_dest->ah;
+		wr[i].wr.ud.remote_qpn = rs->conn_dest->qpn;
+		wr[i].wr.ud.remote_qkey = RDMA_UDP_QKEY;
+	}
+
+	ret = rdma_seterrno(ibv_post_send(rs->conn_dest->qp->cm_id->qp,
+					  wr, &bad));
+	return ret ? ret : len;
+}
+
 static ssize_t dsend(struct rsocket *rs, const void *buf, size_t len, int flags)
 {
 	struct ds_smsg *msg;
@@ -2654,9 +4404,16 @@ static ssize_t dsend(struct rsocket *rs, const void *buf, size_t len, int flags)
 	uint64_t offset;
 	int ret = 0;
 
+	if (len > DS_MAX_MSG_SIZE)
+		return ERR(EMSGSIZE);
+
 	if (!rs->conn_dest->ah)
 		return ds_send_udp(rs, buf, len, flags, RS_OP_DATA);
 
+	if (len > RS_SNDLOWAT - rs->conn_dest->qp->hdr.length)
+		return ds_send_frags(rs, &rs->conn_dest->qp->hdr, buf, len,
+				     rs_nonblocking(rs, flags));
+
 	if (!ds_can_send(rs)) {
 		ret = ds_get_comp(rs, rs_nonblocking(rs, flags), ds_can_send);
 		if (ret)
@@ -2682,39 +4439,33 @@ static ssize_t dsend(struct rsocket *rs, const void *buf, size_t len, int flags)
  * We overlap sending the data, by posting a small work request immediately,
  * then increasing the size of the send on each iteration.
  */
-ssize_t rsend(int socket, const void *buf, size_t len, int flags)
+static ssize_t rs_send(struct rsocket *rs, const void *buf, size_t len, int flags)
 {
-	struct rsocket *rs;
 	struct ibv_sge sge;
 	size_t left = len;
 	uint32_t xfer_size, olen = RS_OLAP_START_SIZE;
 	int ret = 0;
 
-	rs = idm_at(&idm, socket);
-	if (rs->type == SOCK_DGRAM) {
-		fastlock_acquire(&rs->slock);
-		ret = dsend(rs, buf, len, flags);
-		fastlock_release(&rs->slock);
-		return ret;
-	}
-
-	if (rs->state & rs_opening) {
-		ret = rs_do_connect(rs);
-		if (ret) {
-			if (errno == EINPROGRESS)
-				errno = EAGAIN;
-			return ret;
-		}
-	}
-
 	fastlock_acquire(&rs->slock);
 	if (rs->iomap_pending) {
 		ret = rs_send_iomaps(rs, flags);
 		if (ret)
 			goto out;
 	}
+	if (rs->sbuf_pending || rs_hold_send(rs, flags)) {
+		ret = rs_coalesce(rs, buf, len, flags);
+		if (ret > 0) {
+			left = 0;
+			ret = 0;
+		}
+		if (ret || !left)
+			goto out;
+	}
+	rs_tune_sbuf(rs, rs_nonblocking(rs, flags));
 	for (; left; left -= xfer_size, buf += xfer_size) {
 		if (!rs_can_send(rs)) {
+			rs->stats.send_stalls++;
+			rs_tune_sbuf(rs, rs_nonblocking(rs, flags));
 			ret = rs_get_comp(rs, rs_nonblocking(rs, flags),
 					  rs_conn_can_send);
 			if (ret)
@@ -2769,6 +4520,35 @@ out:
 	return (ret && left == len) ? ret : len - left;
 }
 
+static ssize_t rs_rails_send(struct rsocket *rs, const void *buf, size_t len, int flags);
+
+ssize_t rsend(int socket, const void *buf, size_t len, int flags)
+{
+	struct rsocket *rs;
+	int ret;
+
+	rs = idm_at(&idm, socket);
+	if (rs->type == SOCK_DGRAM) {
+		fastlock_acquire(&rs->slock);
+		ret = dsend(rs, buf, len, flags);
+		fastlock_release(&rs->slock);
+		return ret;
+	}
+
+	if (rs->state & rs_opening) {
+		ret = rs_do_connect(rs);
+		if (ret) {
+			if (errno == EINPROGRESS)
+				errno = EAGAIN;
+			return ret;
+		}
+	}
+
+	if (rs_rails_active(rs))
+		return rs_rails_send(rs, buf, len, flags);
+	return rs_send(rs, buf, len, flags);
+}
+
 ssize_t rsendto(int socket, const void *buf, size_t len, int flags,
 		const struct sockaddr *dest_addr, socklen_t addrlen)
 {
@@ -2822,24 +4602,14 @@ static void rs_copy_iov(void *dst, const struct iovec **iov, size_t *offset, siz
 	}
 }
 
-static ssize_t rsendv(int socket, const struct iovec *iov, int iovcnt, int flags)
+static ssize_t rs_sendv(struct rsocket *rs, const struct iovec *iov,
+			int iovcnt, int flags)
 {
-	struct rsocket *rs;
 	const struct iovec *cur_iov;
 	size_t left, len, offset = 0;
 	uint32_t xfer_size, olen = RS_OLAP_START_SIZE;
 	int i, ret = 0;
 
-	rs = idm_at(&idm, socket);
-	if (rs->state & rs_opening) {
-		ret = rs_do_connect(rs);
-		if (ret) {
-			if (errno == EINPROGRESS)
-				errno = EAGAIN;
-			return ret;
-		}
-	}
-
 	cur_iov = iov;
 	len = iov[0].iov_len;
 	for (i = 1; i < iovcnt; i++)
@@ -2852,8 +4622,14 @@ static ssize_t rsendv(int socket, const struct iovec *iov, int iovcnt, int flags
 		if (ret)
 			goto out;
 	}
+	ret = rs_flush(rs, rs_nonblocking(rs, flags));
+	if (ret)
+		goto out;
+	rs_tune_sbuf(rs, rs_nonblocking(rs, flags));
 	for (; left; left -= xfer_size) {
 		if (!rs_can_send(rs)) {
+			rs->stats.send_stalls++;
+			rs_tune_sbuf(rs, rs_nonblocking(rs, flags));
 			ret = rs_get_comp(rs, rs_nonblocking(rs, flags),
 					  rs_conn_can_send);
 			if (ret)
@@ -2906,6 +4682,37 @@ out:
 	return (ret && left == len) ? ret : len - left;
 }
 
+static ssize_t rsendv(int socket, const struct iovec *iov, int iovcnt, int flags)
+{
+	struct rsocket *rs;
+	size_t len;
+	int i, ret;
+
+	rs = idm_at(&idm, socket);
+	if (rs->state & rs_opening) {
+		ret = rs_do_connect(rs);
+		if (ret) {
+			if (errno == EINPROGRESS)
+				errno = EAGAIN;
+			return ret;
+		}
+	}
+
+	if (rs_rails_active(rs)) {
+		for (len = 0, i = 0; i < iovcnt; i++) {
+			ret = rs_rails_send(rs, iov[i].iov_base, iov[i].iov_len, flags);
+			if (ret < 0)
+				return len ? len : ret;
+			len += ret;
+			if ((size_t) ret < iov[i].iov_len)
+				break;
+		}
+		return len;
+	}
+
+	return rs_sendv(rs, iov, iovcnt, flags);
+}
+
 ssize_t rsendmsg(int socket, const struct msghdr *msg, int flags)
 {
 	if (msg->msg_control && msg->msg_controllen)
@@ -2933,11 +4740,88 @@ static struct pollfd *rs_fds_alloc(nfds_t nfds)
 		if (rfds)
 			free(rfds);
 
-		rfds = malloc(sizeof(*rfds) * nfds);
-		rnfds = rfds ? nfds : 0;
+		rfds = malloc(sizeof(*rfds) * nfds);
+		rnfds = rfds ? nfds : 0;
+	}
+
+	return rfds;
+}
+
+static int rs_rails_get_cq_events(struct rs_rails *rails, int timeout)
+{
+	struct epoll_event events[RS_MAX_RAILS + 1];
+	struct rsocket *rail;
+	uint64_t kick;
+	int i, ret;
+
+	ret = epoll_wait(rails->epfd, events, RS_MAX_RAILS + 1, timeout);
+	for (i = 0; i < ret; i++) {
+		rail = events[i].data.ptr;
+		if (!rail) {
+			/* Waiters rescan the rails after a kick */
+			if (read(rails->evfd, &kick, sizeof kick) < 0)
+				kick = 0;
+			continue;
+		}
+
+		fastlock_acquire(&rail->cq_wait_lock);
+		rs_get_cq_event(rail);
+		fastlock_release(&rail->cq_wait_lock);
+	}
+
+	return ret < 0 ? ret : 0;
+}
+
+/* The stream is readable if the rail carrying the next chunk has data. */
+static int rs_rails_readable(struct rs_rails *rails)
+{
+	int i, cnt;
+
+	if (rails->rleft)
+		return rs_conn_have_rdata(rails->rail[rails->rcur]);
+
+	cnt = atomic_load(&rails->cnt);
+	for (i = 0; i < cnt; i++) {
+		if (rails->rhdr_len[i] == sizeof(rails->rhdr[i])) {
+			if (be32toh(rails->rhdr[i].seq) == rails->rseq)
+				return 1;
+		} else if (rs_have_rdata(rails->rail[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int rs_rails_poll(struct rsocket *rs, int events, int nonblock,
+			 int (*test)(struct rsocket *rs))
+{
+	struct rs_rails *rails = rs->rails;
+	struct rsocket *rail;
+	int i, cnt, live, up = 0;
+	short revents = 0;
+
+	cnt = atomic_load(&rails->cnt);
+	live = atomic_load(&rails->live);
+	/* A partly sent chunk must complete on its rail */
+	if (rails->shdr_left || rails->sleft)
+		live &= 1 << rails->scur;
+	for (i = 0; i < cnt; i++) {
+		rail = rails->rail[i];
+		rs_process_cq(rail, nonblock, test);
+		if (!(rail->state & rs_connected))
+			continue;
+
+		up++;
+		if ((events & POLLOUT) && (live & (1 << i)) && rs_can_send(rail))
+			revents |= POLLOUT;
 	}
 
-	return rfds;
+	if ((events & POLLIN) && rs_rails_readable(rails))
+		revents |= POLLIN;
+	if (!up)
+		revents |= (rs->state & rs_error) ? POLLERR : POLLHUP;
+
+	return revents;
 }
 
 static int rs_poll_rs(struct rsocket *rs, int events,
@@ -2950,6 +4834,10 @@ static int rs_poll_rs(struct rsocket *rs, int events,
 check_cq:
 	if ((rs->type == SOCK_STREAM) && ((rs->state & rs_connected) ||
 	     (rs->state == rs_disconnected) || (rs->state & rs_error))) {
+		if (rs_rails_active(rs))
+			return rs_rails_poll(rs, events, nonblock, test);
+
+		rs_try_flush(rs);
 		rs_process_cq(rs, nonblock, test);
 
 		revents = 0;
@@ -2969,7 +4857,7 @@ check_cq:
 		ds_process_cqs(rs, nonblock, test);
 
 		revents = 0;
-		if ((events & POLLIN) && rs_have_rdata(rs))
+		if ((events & POLLIN) && ds_have_rdata(rs))
 			revents |= POLLIN;
 		if ((events & POLLOUT) && ds_can_send(rs))
 			revents |= POLLOUT;
@@ -3007,6 +4895,242 @@ check_cq:
 	return 0;
 }
 
+/*
+ * Wait until a rail that may hold the next chunk has data, or a rail is
+ * added.  Rails with a complete header queued cannot hold it.
+ */
+static int rs_rails_wait(struct rs_rails *rails)
+{
+	struct rsocket *rail;
+	int i, cnt;
+
+	cnt = atomic_load(&rails->cnt);
+	for (i = 0; i < cnt; i++) {
+		rail = rails->rail[i];
+		if (rails->rhdr_len[i] == sizeof(rails->rhdr[i]) ||
+		    !(rail->state & rs_readable))
+			continue;
+
+		if (rs_poll_rs(rail, POLLIN, 0, rs_is_cq_armed))
+			return 0;
+	}
+
+	return rs_rails_get_cq_events(rails, -1);
+}
+
+/* Returns true once the rail's next chunk header has been received. */
+static int rs_rails_read_hdr(struct rs_rails *rails, int i)
+{
+	ssize_t ret;
+
+	if (rails->rhdr_len[i] < sizeof(rails->rhdr[i])) {
+		ret = rs_recv(rails->rail[i],
+			      (void *) &rails->rhdr[i] + rails->rhdr_len[i],
+			      sizeof(rails->rhdr[i]) - rails->rhdr_len[i],
+			      MSG_DONTWAIT);
+		if (ret > 0)
+			rails->rhdr_len[i] += ret;
+	}
+	return rails->rhdr_len[i] == sizeof(rails->rhdr[i]);
+}
+
+/*
+ * Locate the rail holding the next chunk.  If every rail that could hold
+ * it has closed, the stream ends, and rcur is set to -1.  A lost chunk is
+ * reported as a reset.
+ */
+static int rs_rails_next_chunk(struct rs_rails *rails, int nonblock)
+{
+	int i, cnt, open, held;
+
+	for (;;) {
+		cnt = atomic_load(&rails->cnt);
+		for (i = 0, open = 0, held = 0; i < cnt; i++) {
+			if (!rs_rails_read_hdr(rails, i)) {
+				if (rails->rail[i]->state & rs_readable)
+					open++;
+				continue;
+			}
+
+			if (be32toh(rails->rhdr[i].seq) == rails->rseq) {
+				rails->rcur = i;
+				rails->rleft = be32toh(rails->rhdr[i].len);
+				rails->rhdr_len[i] = 0;
+				rails->rseq++;
+				return 0;
+			}
+			held++;
+		}
+
+		if (!open) {
+			if (held)
+				return ERR(ECONNRESET);
+			rails->rcur = -1;
+			return 0;
+		}
+
+		if (nonblock)
+			return ERR(EWOULDBLOCK);
+
+		if (rs_rails_wait(rails))
+			return -1;
+	}
+}
+
+static ssize_t rs_rails_recv(struct rsocket *rs, void *buf, size_t len, int flags)
+{
+	struct rs_rails *rails = rs->rails;
+	size_t left = len, rsize;
+	ssize_t ret = 0;
+	int rflags;
+
+	/* Rails are always blocking, so carry the caller's mode in the flags */
+	if (rs->fd_flags & O_NONBLOCK)
+		flags |= MSG_DONTWAIT;
+	rflags = flags;
+
+	fastlock_acquire(&rails->rlock);
+	while (left) {
+		if (!rails->rleft) {
+			ret = rs_rails_next_chunk(rails, rs_nonblocking(rs, rflags));
+			if (ret || rails->rcur < 0)
+				break;
+		}
+
+		rsize = min_t(size_t, left, rails->rleft);
+		ret = rs_recv(rails->rail[rails->rcur], buf, rsize, rflags);
+		if (ret <= 0) {
+			if (!ret)
+				ret = ERR(ECONNRESET);
+			break;
+		}
+
+		left -= ret;
+		if (flags & MSG_PEEK)
+			break;
+
+		buf += ret;
+		rails->rleft -= ret;
+		ret = 0;
+		if (!(flags & MSG_WAITALL))
+			rflags |= MSG_DONTWAIT;
+	}
+	fastlock_release(&rails->rlock);
+
+	return (ret && left == len) ? ret : len - left;
+}
+
+static void rs_rails_down(struct rs_rails *rails, int i)
+{
+	atomic_fetch_and(&rails->live, ~(1 << i));
+}
+
+/*
+ * Pick the next rail round robin, preferring one that can send now so that
+ * faster rails carry more chunks.  Returns -1 if no rail is left.
+ */
+static int rs_rails_pick(struct rs_rails *rails)
+{
+	struct rsocket *rail;
+	int i, n, cnt, live, ready, first = -1;
+
+	cnt = atomic_load(&rails->cnt);
+	for (n = 0; n < cnt; n++) {
+		i = (rails->snext + n) % cnt;
+		rail = rails->rail[i];
+		if (!(rail->state & rs_writable))
+			rs_rails_down(rails, i);
+
+		live = atomic_load(&rails->live);
+		if (!(live & (1 << i)))
+			continue;
+		if (first < 0)
+			first = i;
+
+		fastlock_acquire(&rail->slock);
+		ready = rs_can_send(rail);
+		fastlock_release(&rail->slock);
+		if (ready) {
+			first = i;
+			break;
+		}
+	}
+
+	if (first >= 0)
+		rails->snext = (first + 1) % cnt;
+	return first;
+}
+
+/*
+ * The rest of the chunk header goes out in the same send as the payload,
+ * so both share one RDMA write whenever the send buffer allows.
+ * A chunk is committed to a rail once any of its header has been sent.
+ * Until then, a failed rail is dropped and the chunk moves to another one.
+ * There is no failover beyond that: chunks are not kept until the peer
+ * has read them, so data already handed to a failed rail is lost and the
+ * peer sees the stream reset once it needs the missing chunk.
+ */
+static ssize_t rs_rails_send(struct rsocket *rs, const void *buf, size_t len, int flags)
+{
+	struct rs_rails *rails = rs->rails;
+	struct iovec iov[2];
+	size_t left = len, hdr_size;
+	ssize_t ret = 0;
+
+	if (rs->fd_flags & O_NONBLOCK)
+		flags |= MSG_DONTWAIT;
+
+	fastlock_acquire(&rails->slock);
+	while (left) {
+		if (!rails->shdr_left && !rails->sleft) {
+			ret = rs_rails_pick(rails);
+			if (ret < 0) {
+				ret = ERR(ECONNRESET);
+				break;
+			}
+
+			rails->scur = ret;
+			rails->sleft = min_t(size_t, left, RS_RAIL_CHUNK);
+			rails->shdr.seq = htobe32(rails->sseq++);
+			rails->shdr.len = htobe32(rails->sleft);
+			rails->shdr_left = sizeof(rails->shdr);
+		}
+
+		iov[0].iov_base = (void *) &rails->shdr + sizeof(rails->shdr) -
+				  rails->shdr_left;
+		iov[0].iov_len = rails->shdr_left;
+		iov[1].iov_base = (void *) buf;
+		iov[1].iov_len = min_t(size_t, left, rails->sleft);
+		ret = rails->shdr_left ?
+		      rs_sendv(rails->rail[rails->scur], iov, 2, flags) :
+		      rs_sendv(rails->rail[rails->scur], &iov[1], 1, flags);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			rs_rails_down(rails, rails->scur);
+			if (rails->shdr_left < sizeof(rails->shdr))
+				break;
+
+			rails->shdr_left = 0;
+			rails->sleft = 0;
+			rails->sseq--;
+			continue;
+		}
+
+		hdr_size = min_t(size_t, ret, rails->shdr_left);
+		rails->shdr_left -= hdr_size;
+		ret -= hdr_size;
+		buf += ret;
+		left -= ret;
+		rails->sleft -= ret;
+		ret = 0;
+	}
+	fastlock_release(&rails->slock);
+
+	return (ret && left == len) ? ret : len - left;
+}
+
 static int rs_poll_check(struct pollfd *fds, nfds_t nfds)
 {
 	struct rsocket *rs;
@@ -3038,7 +5162,9 @@ static int rs_poll_arm(struct pollfd *rfds, struct pollfd *fds, nfds_t nfds)
 				return 1;
 
 			if (rs->type == SOCK_STREAM) {
-				if (rs->state >= rs_connected)
+				if (rs_rails_active(rs))
+					rfds[i].fd = rs->rails->epfd;
+				else if (rs->state >= rs_connected)
 					rfds[i].fd = rs->cm_id->recv_cq_channel->fd;
 				else
 					rfds[i].fd = rs->cm_id->channel->fd;
@@ -3065,7 +5191,10 @@ static int rs_poll_events(struct pollfd *rfds, struct pollfd *fds, nfds_t nfds)
 			continue;
 
 		rs = idm_lookup(&idm, fds[i].fd);
-		if (rs) {
+		if (rs && rs_rails_active(rs)) {
+			rs_rails_get_cq_events(rs->rails, 0);
+			fds[i].revents = rs_poll_rs(rs, fds[i].events, 1, rs_poll_all);
+		} else if (rs) {
 			fastlock_acquire(&rs->cq_wait_lock);
 			if (rs->type == SOCK_STREAM)
 				rs_get_cq_event(rs);
@@ -3224,7 +5353,7 @@ int rselect(int nfds, fd_set *readfds, fd_set *writefds,
 int rshutdown(int socket, int how)
 {
 	struct rsocket *rs;
-	int ctrl, ret = 0;
+	int i, ctrl, ret = 0;
 
 	rs = idm_lookup(&idm, socket);
 	if (!rs)
@@ -3232,9 +5361,17 @@ int rshutdown(int socket, int how)
 	if (rs->opts & RS_OPT_SVC_ACTIVE)
 		rs_notify_svc(&tcp_svc, rs, RS_SVC_REM_KEEPALIVE);
 
+	if (rs_rails_active(rs)) {
+		for (i = 1; i < rs->rails->cnt; i++)
+			rshutdown(rs->rails->rail[i]->index, how);
+	}
+
 	if (rs->fd_flags & O_NONBLOCK)
 		rs_set_nonblocking(rs, 0);
 
+	if ((rs->state & rs_writable) && how != SHUT_RD)
+		rs_flush_pending(rs, 0);
+
 	if (rs->state & rs_connected) {
 		if (how == SHUT_RDWR) {
 			ctrl = RS_CTRL_DISCONNECT;
@@ -3300,7 +5437,7 @@ int rclose(int socket)
 	if (!rs)
 		return EBADF;
 	if (rs->type == SOCK_STREAM) {
-		if (rs->state & rs_connected)
+		if ((rs->state & rs_connected) || rs_rails_active(rs))
 			rshutdown(socket, SHUT_RDWR);
 		else if (rs->opts & RS_OPT_SVC_ACTIVE)
 			rs_notify_svc(&tcp_svc, rs, RS_SVC_REM_KEEPALIVE);
@@ -3418,13 +5555,17 @@ int rsetsockopt(int socket, int level, int optname,
 			break;
 		case SO_RCVBUF:
 			if ((rs->type == SOCK_STREAM && !rs->rbuf) ||
-			    (rs->type == SOCK_DGRAM && !rs->qp_list))
+			    (rs->type == SOCK_DGRAM && !rs->qp_list)) {
 				rs->rbuf_size = (*(uint32_t *) optval) << 1;
+				rs->opts |= RS_OPT_RBUF_LOCK;
+			}
 			ret = 0;
 			break;
 		case SO_SNDBUF:
-			if (!rs->sbuf)
+			if (!rs->sbuf) {
 				rs->sbuf_size = (*(uint32_t *) optval) << 1;
+				rs->opts |= RS_OPT_SBUF_LOCK;
+			}
 			if (rs->sbuf_size < RS_SNDLOWAT)
 				rs->sbuf_size = RS_SNDLOWAT << 1;
 			ret = 0;
@@ -3463,6 +5604,7 @@ int rsetsockopt(int socket, int level, int optname,
 			      rs_notify_svc(&tcp_svc, rs, RS_SVC_MOD_KEEPALIVE) : 0;
 			break;
 		case TCP_NODELAY:
+		case TCP_CORK:
 			opt_on = *(int *) optval;
 			ret = 0;
 			break;
@@ -3524,6 +5666,18 @@ int rsetsockopt(int socket, int level, int optname,
 				ret = ERR(ENOMEM);
 			}
 			break;
+		case RDMA_SRQ:
+			if (rs->type != SOCK_STREAM)
+				break;
+			if (*(int *) optval)
+				rs->opts |= RS_OPT_SRQ;
+			else
+				rs->opts &= ~RS_OPT_SRQ;
+			ret = 0;
+			break;
+		case RDMA_RAIL:
+			ret = rs_rails_add_addr(rs, optval, optlen);
+			break;
 		default:
 			break;
 		}
@@ -3539,29 +5693,43 @@ int rsetsockopt(int socket, int level, int optname,
 			*opts &= ~(1 << optname);
 	}
 
+	/* Uncorking pushes out held data, as does disabling Nagle */
+	if (!ret && level == IPPROTO_TCP && rs->type == SOCK_STREAM &&
+	    ((optname == TCP_CORK && !opt_on) ||
+	     (optname == TCP_NODELAY && opt_on)))
+		rs_flush_pending(rs, 1);
+
 	return ret;
 }
 
-static void rs_convert_sa_path(struct ibv_sa_path_rec *sa_path,
-			       struct ibv_path_data *path_data)
+static void rs_get_info(struct rsocket *rs, struct rsocket_info *info)
 {
-	uint32_t fl_hop;
+	int i;
+
+	memset(info, 0, sizeof(*info));
+	info->state = rs->state;
+	info->retries = rs->stats.retries;
+	info->rtt = rs->stats.srtt >> 3;
+	info->rttvar = rs->stats.rttvar >> 2;
+	info->sbuf_size = rs->sbuf_size;
+	info->rbuf_size = rs->rbuf_size;
+	info->bytes_sent = rs->stats.bytes_sent;
+	info->bytes_received = rs->stats.bytes_received;
+	info->writes = rs->stats.writes;
+	info->send_stalls = rs->stats.send_stalls;
+	info->recv_waits = rs->stats.recv_waits;
+	info->cq_polls = rs->stats.cq_polls;
+	info->cq_sleeps = rs->stats.cq_sleeps;
+
+	if (!rs->target_sgl)
+		return;
 
-	memset(path_data, 0, sizeof(*path_data));
-	path_data->path.dgid = sa_path->dgid;
-	path_data->path.sgid = sa_path->sgid;
-	path_data->path.dlid = sa_path->dlid;
-	path_data->path.slid = sa_path->slid;
-	fl_hop = be32toh(sa_path->flow_label) << 8;
-	path_data->path.flowlabel_hoplimit = htobe32(fl_hop | sa_path->hop_limit);
-	path_data->path.tclass = sa_path->traffic_class;
-	path_data->path.reversible_numpath = sa_path->reversible << 7 | 1;
-	path_data->path.pkey = sa_path->pkey;
-	path_data->path.qosclass_sl = htobe16(sa_path->sl);
-	path_data->path.mtu = sa_path->mtu | 2 << 6;	/* exactly */
-	path_data->path.rate = sa_path->rate | 2 << 6;
-	path_data->path.packetlifetime = sa_path->packet_life_time | 2 << 6;
-	path_data->flags= sa_path->preference;
+	info->sbuf_used = rs->sbuf_size - rs->sbuf_bytes_avail;
+	info->sqe_avail = rs->sqe_avail;
+	info->send_credits = (uint16_t) (rs->sseq_comp - rs->sseq_no);
+	info->remote_avail = rs->target_sgl[rs->target_sge].length;
+	for (i = rs->rmsg_head; i != rs->rmsg_tail; i = (i + 1) % (rs->rq_size + 1))
+		info->rbuf_used += rs->rmsg[i].data;
 }
 
 int rgetsockopt(int socket, int level, int optname,
@@ -3623,6 +5791,7 @@ int rgetsockopt(int socket, int level, int optname,
 			*optlen = sizeof(int);
 			break;
 		case TCP_NODELAY:
+		case TCP_CORK:
 			*((int *) optval) = !!(rs->tcp_opts & (1 << optname));
 			*optlen = sizeof(int);
 			break;
@@ -3666,6 +5835,25 @@ int rgetsockopt(int socket, int level, int optname,
 			*((int *) optval) = rs->target_iomap_size;
 			*optlen = sizeof(int);
 			break;
+		case RDMA_SRQ:
+			*((int *) optval) = rs->type == SOCK_STREAM &&
+					    (rs->opts & RS_OPT_SRQ);
+			*optlen = sizeof(int);
+			break;
+		case RDMA_RAIL:
+			*((int *) optval) = rs_rails_active(rs) ?
+				__builtin_popcount(atomic_load(&rs->rails->live)) : 1;
+			*optlen = sizeof(int);
+			break;
+		case RDMA_INFO:
+			if (rs->type != SOCK_STREAM ||
+			    *optlen < sizeof(struct rsocket_info)) {
+				ret = EINVAL;
+				break;
+			}
+			rs_get_info(rs, optval);
+			*optlen = sizeof(struct rsocket_info);
+			break;
 		case RDMA_ROUTE:
 			if (rs->optval) {
 				if (*optlen < rs->optlen) {
@@ -3684,7 +5872,8 @@ int rgetsockopt(int socket, int level, int optname,
 					num_paths = 0;
 					while (len + sizeof(path_data) <= *optlen &&
 					       num_paths < rs->cm_id->route.num_paths) {
-						rs_convert_sa_path(path_rec, &path_data);
+						ucma_convert_sa_path(path_rec, &path_data,
+								     path_rec->preference);
 						memcpy(opt, &path_data, sizeof(path_data));
 						len += sizeof(path_data);
 						opt += sizeof(path_data);
@@ -3709,6 +5898,48 @@ int rgetsockopt(int socket, int level, int optname,
 	return rdma_seterrno(ret);
 }
 
+static void rs_print_stats(int fd, const char *name, struct rs_stats *stats)
+{
+	dprintf(fd, "%s: sent %" PRIu64 " bytes in %" PRIu64 " writes, received %"
+		PRIu64 " bytes, send stalls %" PRIu64 ", receive waits %" PRIu64
+		", cq polls %" PRIu64 ", cq sleeps %" PRIu64 ", retries %u\n",
+		name, stats->bytes_sent, stats->writes, stats->bytes_received,
+		stats->send_stalls, stats->recv_waits, stats->cq_polls,
+		stats->cq_sleeps, stats->retries);
+}
+
+/*
+ * Write the statistics of every open stream rsocket, followed by totals
+ * for the process that include closed rsockets.  Holding mut keeps each
+ * rsocket in the index map allocated while its counters are read.
+ */
+int rdump_stats(int fd)
+{
+	struct rs_stats total;
+	struct rsocket *rs;
+	char name[32];
+	int i;
+
+	memset(&total, 0, sizeof total);
+	pthread_mutex_lock(&mut);
+	for (i = 0; i <= IDX_MAX_INDEX; i++) {
+		rs = idm_lookup(&idm, i);
+		if (!rs || rs->type != SOCK_STREAM)
+			continue;
+
+		snprintf(name, sizeof name, "rsocket %d", i);
+		rs_print_stats(fd, name, &rs->stats);
+		dprintf(fd, "rsocket %d: state 0x%x, rtt %u us, rttvar %u us\n",
+			i, rs->state, rs->stats.srtt >> 3, rs->stats.rttvar >> 2);
+		rs_stats_add(&total, &rs->stats);
+	}
+	rs_stats_add(&total, &closed_stats);
+	pthread_mutex_unlock(&mut);
+
+	rs_print_stats(fd, "total", &total);
+	return 0;
+}
+
 int rfcntl(int socket, int cmd, ... /* arg */ )
 {
 	struct rsocket *rs;
@@ -3874,6 +6105,10 @@ size_t riowrite(int socket, const void *buf, size_t count, off_t offset, int fla
 		if (ret)
 			goto out;
 	}
+	/* Held stream data must leave sbuf before it is reused */
+	ret = rs_flush(rs, rs_nonblocking(rs, flags));
+	if (ret)
+		goto out;
 	for (; left; left -= xfer_size, buf += xfer_size, offset += xfer_size) {
 		if (!iom || offset > iom->offset + iom->sge.length) {
 			iom = rs_find_iomap(rs, offset);
@@ -4134,6 +6369,12 @@ static void udp_svc_forward(struct rsocket *rs, void *buf, size_t len,
 	struct ibv_sge sge;
 	uint64_t offset;
 
+	ds_format_hdr(&hdr, src);
+	if (len > RS_SNDLOWAT - hdr.length) {
+		ds_send_frags(rs, &hdr, buf, len, 0);
+		return;
+	}
+
 	if (!ds_can_send(rs)) {
 		if (ds_get_comp(rs, 0, ds_can_send))
 			return;
@@ -4143,7 +6384,6 @@ static void udp_svc_forward(struct rsocket *rs, void *buf, size_t len,
 	rs->smsg_free = msg->next;
 	rs->sqe_avail--;
 
-	ds_format_hdr(&hdr, src);
 	memcpy((void *) msg, &hdr, hdr.length);
 	memcpy((void *) msg + hdr.length, buf, len);
 	sge.addr = (uintptr_t) msg;
@@ -4156,7 +6396,7 @@ static void udp_svc_forward(struct rsocket *rs, void *buf, size_t len,
 
 static void udp_svc_process_rs(struct rsocket *rs)
 {
-	static uint8_t buf[RS_SNDLOWAT];
+	static uint8_t buf[DS_UDP_IPV6_HDR_LEN + DS_MAX_MSG_SIZE];
 	struct ds_dest *dest, *cur_dest;
 	struct ds_udp_header *udp_hdr;
 	union socket_addr addr;
@@ -4341,3 +6581,155 @@ static void *tcp_svc_run(void *arg)
 
 	return NULL;
 }
+
+static void cork_svc_process_sock(struct rs_svc *svc)
+{
+	struct rs_svc_msg msg;
+
+	read_all(svc->sock[1], &msg, sizeof msg);
+	switch (msg.cmd) {
+	case RS_SVC_ADD_CORK:
+		msg.status = rs_svc_add_rs(svc, msg.rs);
+		if (!msg.status)
+			msg.rs->opts |= RS_OPT_CORK_SVC;
+		break;
+	case RS_SVC_REM_CORK:
+		msg.status = rs_svc_rm_rs(svc, msg.rs);
+		if (!msg.status)
+			msg.rs->opts &= ~RS_OPT_CORK_SVC;
+		break;
+	case RS_SVC_NOOP:
+		msg.status = 0;
+		break;
+	default:
+		break;
+	}
+	write_all(svc->sock[1], &msg, sizeof msg);
+}
+
+/*
+ * Send data that has been held past its deadline.  A socket whose send
+ * lock is busy is left alone, since its sender flushes on its own.
+ */
+static void cork_svc_flush(struct rsocket *rs)
+{
+	if (!rs->sbuf_pending || !fastlock_tryacquire(&rs->slock))
+		return;
+
+	if (rs->sbuf_pending &&
+	    rs_time_us() - rs->spend_start >= rs->spend_limit)
+		rs_flush(rs, 1);
+	fastlock_release(&rs->slock);
+}
+
+/*
+ * Sockets hold data without telling the service, so it checks them every
+ * half deadline.  Held data thus goes out at most 1.5 deadlines late.
+ */
+static int cork_svc_tick(void)
+{
+	uint32_t limit = RS_CORK_TIMEOUT;
+
+	if (def_nagle_delay && def_nagle_delay < limit)
+		limit = def_nagle_delay;
+	return max_t(int, limit / 2000, 1);
+}
+
+static void *cork_svc_run(void *arg)
+{
+	struct rs_svc *svc = arg;
+	struct rs_svc_msg msg;
+	struct pollfd fds;
+	int i, ret, timeout;
+
+	ret = rs_svc_grow_sets(svc, 16);
+	if (ret) {
+		msg.status = ret;
+		write_all(svc->sock[1], &msg, sizeof msg);
+		return (void *) (uintptr_t) ret;
+	}
+
+	fds.fd = svc->sock[1];
+	fds.events = POLLIN;
+	timeout = cork_svc_tick();
+	do {
+		poll(&fds, 1, timeout);
+		if (fds.revents)
+			cork_svc_process_sock(svc);
+
+		for (i = 1; i <= svc->cnt; i++)
+			cork_svc_flush(svc->rss[i]);
+	} while (svc->cnt >= 1);
+
+	return NULL;
+}
+
+static void tune_svc_process_sock(struct rs_svc *svc)
+{
+	struct rs_svc_msg msg;
+
+	read_all(svc->sock[1], &msg, sizeof msg);
+	switch (msg.cmd) {
+	case RS_SVC_ADD_TUNE:
+		msg.status = rs_svc_add_rs(svc, msg.rs);
+		if (!msg.status)
+			msg.rs->opts |= RS_OPT_TUNE_SVC;
+		break;
+	case RS_SVC_REM_TUNE:
+		msg.status = rs_svc_rm_rs(svc, msg.rs);
+		if (!msg.status)
+			msg.rs->opts &= ~RS_OPT_TUNE_SVC;
+		break;
+	case RS_SVC_NOOP:
+		msg.status = 0;
+		break;
+	default:
+		break;
+	}
+	write_all(svc->sock[1], &msg, sizeof msg);
+}
+
+/*
+ * Shrink the receive buffer of a socket that nobody is reading.  The swap
+ * still waits for the remote side to use up the space it was granted.  A
+ * socket whose receive lock is busy is left alone, since its reader tunes
+ * the buffer itself.
+ */
+static void tune_svc_shrink(struct rsocket *rs)
+{
+	if (!fastlock_tryacquire(&rs->rlock))
+		return;
+
+	rs_tune_rbuf(rs, 0);
+	if (rs_rbuf_resize_ready(rs))
+		rs_resize_rbuf(rs);
+	fastlock_release(&rs->rlock);
+}
+
+static void *tune_svc_run(void *arg)
+{
+	struct rs_svc *svc = arg;
+	struct rs_svc_msg msg;
+	struct pollfd fds;
+	int i, ret;
+
+	ret = rs_svc_grow_sets(svc, 16);
+	if (ret) {
+		msg.status = ret;
+		write_all(svc->sock[1], &msg, sizeof msg);
+		return (void *) (uintptr_t) ret;
+	}
+
+	fds.fd = svc->sock[1];
+	fds.events = POLLIN;
+	do {
+		poll(&fds, 1, RS_TUNE_PERIOD / 1000);
+		if (fds.revents)
+			tune_svc_process_sock(svc);
+
+		for (i = 1; i <= svc->cnt; i++)
+			tune_svc_shrink(svc->rss[i]);
+	} while (svc->cnt >= 1);
+
+	return NULL;
+}
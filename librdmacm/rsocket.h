@@ -79,7 +79,33 @@ enum {
 	RDMA_RQSIZE,
 	RDMA_INLINE,
 	RDMA_IOMAPSIZE,
-	RDMA_ROUTE
+	RDMA_ROUTE,
+	RDMA_SRQ,
+	RDMA_RAIL,
+	RDMA_INFO
+};
+
+/* Returned by rgetsockopt for RDMA_INFO on stream rsockets */
+struct rsocket_info {
+	uint32_t	state;
+	uint32_t	retries;	/* connection attempts retried */
+	uint32_t	rtt;		/* smoothed write round trip, usec */
+	uint32_t	rttvar;
+	uint32_t	sbuf_size;
+	uint32_t	sbuf_used;	/* bytes queued or in flight */
+	uint32_t	rbuf_size;
+	uint32_t	rbuf_used;	/* bytes received, not yet read */
+	uint32_t	sqe_avail;
+	uint32_t	send_credits;	/* messages the peer can accept */
+	uint32_t	remote_avail;	/* bytes the peer has granted */
+	uint32_t	reserved;
+	uint64_t	bytes_sent;
+	uint64_t	bytes_received;
+	uint64_t	writes;
+	uint64_t	send_stalls;	/* sends that waited for resources */
+	uint64_t	recv_waits;	/* receives that waited for data */
+	uint64_t	cq_polls;
+	uint64_t	cq_sleeps;	/* waits on the completion channel */
 };
 
 int rsetsockopt(int socket, int level, int optname,
@@ -92,6 +118,11 @@ off_t riomap(int socket, void *buf, size_t len, int prot, int flags, off_t offse
 int riounmap(int socket, void *buf, size_t len);
 size_t riowrite(int socket, const void *buf, size_t count, off_t offset, int flags);
 
+ssize_t rrecv_borrow(int socket, void **buf, size_t len, int flags);
+int rrecv_return(int socket, size_t len);
+
+int rdump_stats(int fd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -139,6 +139,7 @@ static int bnxt_re_init_context(struct verbs_device *vdev,
 	pthread_mutex_init(&cntx->shlock, NULL);
 
 	ibvctx->ops = bnxt_re_cntx_ops;
+	verbs_get_ctx(ibvctx)->create_cq_ex = verbs_create_cq_ex_emul;
 
 	return 0;
 failed:
@@ -221,7 +222,7 @@ found:
 	return &dev->vdev;
 }
 
-static __attribute__((constructor)) void bnxt_re_register_driver(void)
+PROVIDER_DRIVER(bnxt_re)
 {
 	verbs_register_driver("bnxt_re", bnxt_re_driver_init);
 }
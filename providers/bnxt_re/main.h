@@ -68,7 +68,10 @@ struct bnxt_re_pd {
 };
 
 struct bnxt_re_cq {
-	struct ibv_cq ibvcq;
+	union {
+		struct ibv_cq ibvcq;
+		struct verbs_cq vcq;
+	};
 	uint32_t cqid;
 	struct bnxt_re_queue cqq;
 	struct bnxt_re_dpi *udpi;
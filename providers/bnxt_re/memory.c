@@ -38,39 +38,32 @@
  */
 
 #include <string.h>
-#include <sys/mman.h>
+#include <errno.h>
 
 #include "main.h"
 
-int bnxt_re_alloc_aligned(struct bnxt_re_queue *que, uint32_t pg_size)
+int bnxt_re_alloc_aligned(struct ibv_device *device,
+			  struct bnxt_re_queue *que, uint32_t pg_size)
 {
-	int ret, bytes;
+	int bytes;
 
 	bytes = (que->depth * que->stride);
 	que->bytes = get_aligned(bytes, pg_size);
-	que->va = mmap(NULL, que->bytes, PROT_READ | PROT_WRITE,
-		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (que->va == MAP_FAILED) {
+	que->va = verbs_alloc_queue_buf(device, que->bytes);
+	if (!que->va) {
 		que->bytes = 0;
 		return errno;
 	}
 	/* Touch pages before proceeding. */
 	memset(que->va, 0, que->bytes);
 
-	ret = ibv_dontfork_range(que->va, que->bytes);
-	if (ret) {
-		munmap(que->va, que->bytes);
-		que->bytes = 0;
-	}
-
-	return ret;
+	return 0;
 }
 
 void bnxt_re_free_aligned(struct bnxt_re_queue *que)
 {
 	if (que->bytes) {
-		ibv_dofork_range(que->va, que->bytes);
-		munmap(que->va, que->bytes);
+		verbs_free_queue_buf(que->va, que->bytes);
 		que->bytes = 0;
 	}
 }
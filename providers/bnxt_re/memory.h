@@ -57,7 +57,7 @@ struct bnxt_re_queue {
 	 * and the consumer indices in the queue
 	 */
 	uint32_t diff;
-	pthread_spinlock_t qlock;
+	struct verbs_spinlock qlock;
 };
 
 static inline unsigned long get_aligned(uint32_t size, uint32_t al_size)
@@ -78,7 +78,8 @@ static inline unsigned long roundup_pow_of_two(unsigned long val)
 	return roundup;
 }
 
-int bnxt_re_alloc_aligned(struct bnxt_re_queue *que, uint32_t pg_size);
+int bnxt_re_alloc_aligned(struct ibv_device *device,
+			  struct bnxt_re_queue *que, uint32_t pg_size);
 void bnxt_re_free_aligned(struct bnxt_re_queue *que);
 
 static inline void iowrite64(__u64 *dst, __le64 *src)
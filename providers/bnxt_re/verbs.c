@@ -182,10 +182,10 @@ struct ibv_cq *bnxt_re_create_cq(struct ibv_context *ibvctx, int ncqe,
 	if (cq->cqq.depth > dev->max_cq_depth + 1)
 		cq->cqq.depth = dev->max_cq_depth + 1;
 	cq->cqq.stride = dev->cqe_size;
-	if (bnxt_re_alloc_aligned(&cq->cqq, dev->pg_size))
+	if (bnxt_re_alloc_aligned(&dev->vdev.device, &cq->cqq, dev->pg_size))
 		goto fail;
 
-	pthread_spin_init(&cq->cqq.qlock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&cq->cqq.qlock, !verbs_single_threaded(ibvctx));
 
 	cmd.cq_va = (uintptr_t)cq->cqq.va;
 	cmd.cq_handle = (uintptr_t)cq;
@@ -650,9 +650,9 @@ int bnxt_re_poll_cq(struct ibv_cq *ibvcq, int nwc, struct ibv_wc *wc)
 	struct bnxt_re_context *cntx = to_bnxt_re_context(ibvcq->context);
 	int dqed, left = 0;
 
-	pthread_spin_lock(&cq->cqq.qlock);
+	verbs_spin_lock(&cq->cqq.qlock);
 	dqed = bnxt_re_poll_one(cq, nwc, wc);
-	pthread_spin_unlock(&cq->cqq.qlock);
+	verbs_spin_unlock(&cq->cqq.qlock);
 	/* Check if anything is there to flush. */
 	pthread_spin_lock(&cntx->fqlock);
 	left = nwc - dqed;
@@ -675,7 +675,7 @@ static void bnxt_re_cleanup_cq(struct bnxt_re_qp *qp, struct bnxt_re_cq *cq)
 
 	cntx = to_bnxt_re_context(cq->ibvcq.context);
 
-	pthread_spin_lock(&que->qlock);
+	verbs_spin_lock(&que->qlock);
 	for (indx = 0; indx < que->depth; indx++) {
 		cqe = que->va + indx * bnxt_re_get_cqe_sz();
 		hdr = cqe + sizeof(struct bnxt_re_req_cqe);
@@ -696,7 +696,7 @@ static void bnxt_re_cleanup_cq(struct bnxt_re_qp *qp, struct bnxt_re_cq *cq)
 		}
 
 	}
-	pthread_spin_unlock(&que->qlock);
+	verbs_spin_unlock(&que->qlock);
 
 	pthread_spin_lock(&cntx->fqlock);
 	bnxt_re_fque_del_node(&qp->snode);
@@ -713,11 +713,11 @@ int bnxt_re_arm_cq(struct ibv_cq *ibvcq, int flags)
 {
 	struct bnxt_re_cq *cq = to_bnxt_re_cq(ibvcq);
 
-	pthread_spin_lock(&cq->cqq.qlock);
+	verbs_spin_lock(&cq->cqq.qlock);
 	flags = !flags ? BNXT_RE_QUE_TYPE_CQ_ARMALL :
 			 BNXT_RE_QUE_TYPE_CQ_ARMSE;
 	bnxt_re_ring_cq_arm_db(cq, flags);
-	pthread_spin_unlock(&cq->cqq.qlock);
+	verbs_spin_unlock(&cq->cqq.qlock);
 
 	return 0;
 }
@@ -776,18 +776,20 @@ static void bnxt_re_free_queues(struct bnxt_re_qp *qp)
 {
 	if (qp->rwrid)
 		free(qp->rwrid);
-	pthread_spin_destroy(&qp->rqq->qlock);
+	verbs_spinlock_destroy(&qp->rqq->qlock);
 	bnxt_re_free_aligned(qp->rqq);
 
 	if (qp->swrid)
 		free(qp->swrid);
-	pthread_spin_destroy(&qp->sqq->qlock);
+	verbs_spinlock_destroy(&qp->sqq->qlock);
 	bnxt_re_free_aligned(qp->sqq);
 }
 
-static int bnxt_re_alloc_queues(struct bnxt_re_qp *qp,
-				struct ibv_qp_init_attr *attr,
-				uint32_t pg_size) {
+static int bnxt_re_alloc_queues(struct bnxt_re_context *cntx,
+				struct bnxt_re_qp *qp,
+				struct ibv_qp_init_attr *attr) {
+	struct bnxt_re_dev *dev = to_bnxt_re_dev(cntx->ibvctx.device);
+	int need_lock = !verbs_single_threaded(&cntx->ibvctx);
 	struct bnxt_re_queue *que;
 	struct bnxt_re_psns *psns;
 	uint32_t psn_depth;
@@ -812,14 +814,14 @@ static int bnxt_re_alloc_queues(struct bnxt_re_qp *qp,
 	 * is UD-qp. UD-qp use this memory to maintain WC-opcode.
 	 * See definition of bnxt_re_fill_psns() for the use case.
 	 */
-	ret = bnxt_re_alloc_aligned(qp->sqq, pg_size);
+	ret = bnxt_re_alloc_aligned(&dev->vdev.device, qp->sqq, dev->pg_size);
 	if (ret)
 		return ret;
 	/* exclude psns depth*/
 	que->depth -= psn_depth;
 	/* start of spsn space sizeof(struct bnxt_re_psns) each. */
 	psns = (que->va + que->stride * que->depth);
-	pthread_spin_init(&que->qlock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&que->qlock, need_lock);
 	qp->swrid = calloc(que->depth, sizeof(struct bnxt_re_wrid));
 	if (!qp->swrid) {
 		ret = -ENOMEM;
@@ -835,10 +837,11 @@ static int bnxt_re_alloc_queues(struct bnxt_re_qp *qp,
 		que->stride = bnxt_re_get_rqe_sz();
 		que->depth = roundup_pow_of_two(attr->cap.max_recv_wr + 1);
 		que->diff = que->depth - attr->cap.max_recv_wr;
-		ret = bnxt_re_alloc_aligned(qp->rqq, pg_size);
+		ret = bnxt_re_alloc_aligned(&dev->vdev.device, qp->rqq,
+					    dev->pg_size);
 		if (ret)
 			goto fail;
-		pthread_spin_init(&que->qlock, PTHREAD_PROCESS_PRIVATE);
+		verbs_spinlock_init(&que->qlock, need_lock);
 		/* For RQ only bnxt_re_wri.wrid is used. */
 		qp->rwrid = calloc(que->depth, sizeof(struct bnxt_re_wrid));
 		if (!qp->rwrid) {
@@ -863,7 +866,6 @@ struct ibv_qp *bnxt_re_create_qp(struct ibv_pd *ibvpd,
 	struct bnxt_re_qpcap *cap;
 
 	struct bnxt_re_context *cntx = to_bnxt_re_context(ibvpd->context);
-	struct bnxt_re_dev *dev = to_bnxt_re_dev(cntx->ibvctx.device);
 
 	if (bnxt_re_check_qp_limits(cntx, attr))
 		return NULL;
@@ -875,7 +877,7 @@ struct ibv_qp *bnxt_re_create_qp(struct ibv_pd *ibvpd,
 	if (bnxt_re_alloc_queue_ptr(qp, attr))
 		goto fail;
 	/* alloc queues */
-	if (bnxt_re_alloc_queues(qp, attr, dev->pg_size))
+	if (bnxt_re_alloc_queues(cntx, qp, attr))
 		goto failq;
 	/* Fill ibv_cmd */
 	cap = &qp->cap;
@@ -1181,11 +1183,11 @@ int bnxt_re_post_send(struct ibv_qp *ibvqp, struct ibv_send_wr *wr,
 	int ret = 0, bytes = 0;
 	uint8_t is_inline = false;
 
-	pthread_spin_lock(&sq->qlock);
+	verbs_spin_lock(&sq->qlock);
 	while (wr) {
 		if ((qp->qpst != IBV_QPS_RTS) && (qp->qpst != IBV_QPS_SQD)) {
 			*bad = wr;
-			pthread_spin_unlock(&sq->qlock);
+			verbs_spin_unlock(&sq->qlock);
 			return EINVAL;
 		}
 
@@ -1193,14 +1195,14 @@ int bnxt_re_post_send(struct ibv_qp *ibvqp, struct ibv_send_wr *wr,
 		    (wr->opcode != IBV_WR_SEND &&
 		     wr->opcode != IBV_WR_SEND_WITH_IMM)) {
 			*bad = wr;
-			pthread_spin_unlock(&sq->qlock);
+			verbs_spin_unlock(&sq->qlock);
 			return EINVAL;
 		}
 
 		if (bnxt_re_is_que_full(sq) ||
 		    wr->num_sge > qp->cap.max_ssge) {
 			*bad = wr;
-			pthread_spin_unlock(&sq->qlock);
+			verbs_spin_unlock(&sq->qlock);
 			return ENOMEM;
 		}
 
@@ -1272,7 +1274,7 @@ int bnxt_re_post_send(struct ibv_qp *ibvqp, struct ibv_send_wr *wr,
 		}
 	}
 
-	pthread_spin_unlock(&sq->qlock);
+	verbs_spin_unlock(&sq->qlock);
 	return ret;
 }
 
@@ -1318,18 +1320,18 @@ int bnxt_re_post_recv(struct ibv_qp *ibvqp, struct ibv_recv_wr *wr,
 	void *rqe;
 	int ret;
 
-	pthread_spin_lock(&rq->qlock);
+	verbs_spin_lock(&rq->qlock);
 	while (wr) {
 		/* check QP state, abort if it is ERR or RST */
 		if (qp->qpst == IBV_QPS_RESET || qp->qpst == IBV_QPS_ERR) {
 			*bad = wr;
-			pthread_spin_unlock(&rq->qlock);
+			verbs_spin_unlock(&rq->qlock);
 			return EINVAL;
 		}
 
 		if (bnxt_re_is_que_full(rq) ||
 		    wr->num_sge > qp->cap.max_rsge) {
-			pthread_spin_unlock(&rq->qlock);
+			verbs_spin_unlock(&rq->qlock);
 			*bad = wr;
 			return ENOMEM;
 		}
@@ -1338,7 +1340,7 @@ int bnxt_re_post_recv(struct ibv_qp *ibvqp, struct ibv_recv_wr *wr,
 		memset(rqe, 0, bnxt_re_get_rqe_sz());
 		ret = bnxt_re_build_rqe(qp, wr, rqe);
 		if (ret < 0) {
-			pthread_spin_unlock(&rq->qlock);
+			verbs_spin_unlock(&rq->qlock);
 			*bad = wr;
 			return ENOMEM;
 		}
@@ -1347,7 +1349,7 @@ int bnxt_re_post_recv(struct ibv_qp *ibvqp, struct ibv_recv_wr *wr,
 		wr = wr->next;
 		bnxt_re_ring_rq_db(qp);
 	}
-	pthread_spin_unlock(&rq->qlock);
+	verbs_spin_unlock(&rq->qlock);
 
 	return 0;
 }
@@ -45,9 +45,9 @@ int iwch_arm_cq(struct ibv_cq *ibcq, int solicited)
 	int ret;
 	struct iwch_cq *chp = to_iwch_cq(ibcq);
 
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	ret = ibv_cmd_req_notify_cq(ibcq, solicited);
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 
 	return ret;
 }
@@ -275,7 +275,7 @@ static int iwch_poll_cq_one(struct iwch_device *rhp, struct iwch_cq *chp,
 	if (!qhp)
 		wq = NULL;
 	else {
-		pthread_spin_lock(&qhp->lock);
+		verbs_spin_lock(&qhp->lock);
 		wq = &(qhp->wq);
 	}
 	ret = cxio_poll_cq(wq, &(chp->cq), &cqe, &cqe_flushed, &cookie);
@@ -388,7 +388,7 @@ static int iwch_poll_cq_one(struct iwch_device *rhp, struct iwch_cq *chp,
 	}
 out:
 	if (wq)
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -407,7 +407,7 @@ int t3b_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 		iwch_flush_qps(rhp);
 	}
 
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	for (npolled = 0; npolled < num_entries; ++npolled) {
 
 		/*
@@ -421,7 +421,7 @@ int t3b_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 		if (err <= 0)
 			break;
 	}
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 
 	if (err < 0)
 		return err;
@@ -435,8 +435,8 @@ int t3a_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 	int ret;
 	struct iwch_cq *chp = to_iwch_cq(ibcq);
 	
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	ret = ibv_cmd_poll_cq(ibcq, num_entries, wc);
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 	return ret;
 }
@@ -282,7 +282,7 @@ err1:
 	return NULL;
 }
 
-static __attribute__((constructor)) void cxgb3_register_driver(void)
+PROVIDER_DRIVER(cxgb3)
 {
 	verbs_register_driver("cxgb3", cxgb3_driver_init);
 }
@@ -90,14 +90,14 @@ struct iwch_cq {
 	struct ibv_cq ibv_cq;
 	struct iwch_device *rhp;
 	struct t3_cq cq;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 };
 
 struct iwch_qp {
 	struct ibv_qp ibv_qp;
 	struct iwch_device *rhp;
 	struct t3_wq wq;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	int sq_sig_all;
 };
 
@@ -187,16 +187,16 @@ int t3b_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	struct t3_swsq *sqp;
 
 	qhp = to_iwch_qp(ibqp);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t3_wq_in_error(&qhp->wq)) {
 		iwch_flush_qp(qhp);
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		return -1;
 	}
 	num_wrs = Q_FREECNT(qhp->wq.sq_rptr, qhp->wq.sq_wptr, 
 		  qhp->wq.sq_size_log2);
 	if (num_wrs <= 0) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		return -1;
 	}
 	while (wr) {
@@ -264,7 +264,7 @@ int t3b_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 		++(qhp->wq.wptr);
 		++(qhp->wq.sq_wptr);
 	}
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	if (t3_wq_db_enabled(&qhp->wq))
 		RING_DOORBELL(qhp->wq.doorbell, qhp->wq.qpid);
 	return err;
@@ -276,9 +276,9 @@ int t3a_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	int ret;
 	struct iwch_qp *qhp = to_iwch_qp(ibqp);
 
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	ret = ibv_cmd_post_send(ibqp, wr, bad_wr);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -447,32 +447,32 @@ void iwch_flush_qp(struct iwch_qp *qhp)
 	/* take a ref on the qhp since we must release the lock */
 	atomic_inc(&qhp->refcnt);
 #endif
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 
 	/* locking heirarchy: cq lock first, then qp lock. */
-	pthread_spin_lock(&rchp->lock);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&rchp->lock);
+	verbs_spin_lock(&qhp->lock);
 	flush_hw_cq(&rchp->cq);
 	count_rcqes(&rchp->cq, &qhp->wq, &count);
 	flush_rq(&qhp->wq, &rchp->cq, count);
-	pthread_spin_unlock(&qhp->lock);
-	pthread_spin_unlock(&rchp->lock);
+	verbs_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&rchp->lock);
 
 	/* locking heirarchy: cq lock first, then qp lock. */
-	pthread_spin_lock(&schp->lock);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&schp->lock);
+	verbs_spin_lock(&qhp->lock);
 	flush_hw_cq(&schp->cq);
 	count_scqes(&schp->cq, &qhp->wq, &count);
 	flush_sq(&qhp->wq, &schp->cq, count);
-	pthread_spin_unlock(&qhp->lock);
-	pthread_spin_unlock(&schp->lock);
+	verbs_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&schp->lock);
 
 #ifdef notyet
 	/* deref */
 	if (atomic_dec_and_test(&qhp->refcnt))
                 wake_up(&qhp->wait);
 #endif
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 }
 
 void iwch_flush_qps(struct iwch_device *dev)
@@ -484,9 +484,9 @@ void iwch_flush_qps(struct iwch_device *dev)
 		struct iwch_qp *qhp = dev->qpid2ptr[i];
 		if (qhp) {
 			if (!qhp->wq.flushed && t3_wq_in_error(&qhp->wq)) {
-				pthread_spin_lock(&qhp->lock);
+				verbs_spin_lock(&qhp->lock);
 				iwch_flush_qp(qhp);
-				pthread_spin_unlock(&qhp->lock);
+				verbs_spin_unlock(&qhp->lock);
 			}
 		}
 	}
@@ -504,16 +504,16 @@ int t3b_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	uint32_t num_wrs;
 
 	qhp = to_iwch_qp(ibqp);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t3_wq_in_error(&qhp->wq)) {
 		iwch_flush_qp(qhp);
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		return -1;
 	}
 	num_wrs = Q_FREECNT(qhp->wq.rq_rptr, qhp->wq.rq_wptr, 
 			    qhp->wq.rq_size_log2) - 1;
 	if (!wr) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		return -1;
 	}
 	while (wr) {
@@ -541,7 +541,7 @@ int t3b_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 		wr = wr->next;
 		num_wrs--;
 	}
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	if (t3_wq_db_enabled(&qhp->wq))
 		RING_DOORBELL(qhp->wq.doorbell, qhp->wq.qpid);
 	return err;
@@ -553,8 +553,8 @@ int t3a_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	int ret;
 	struct iwch_qp *qhp = to_iwch_qp(ibqp);
 
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	ret = ibv_cmd_post_recv(ibqp, wr, bad_wr);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
@@ -186,7 +186,12 @@ struct ibv_cq *iwch_create_cq(struct ibv_context *context, int cqe,
 	if (ret)
 		goto err1;
 
-	pthread_spin_init(&chp->lock, PTHREAD_PROCESS_PRIVATE);
+	/*
+	 * Polling a CQ flushes every errored QP of the device, taking the
+	 * locks of those QPs and of their CQs, so no lock here is private
+	 * to one object and RDMAV_SINGLE_THREADED is not honoured.
+	 */
+	verbs_spinlock_init(&chp->lock, 1);
 	chp->rhp = dev;
 	chp->cq.cqid = resp.cqid;
 	chp->cq.size_log2 = resp.size_log2;
@@ -230,10 +235,10 @@ int iwch_resize_cq(struct ibv_cq *ibcq, int cqe)
 	struct ibv_resize_cq cmd;
 	struct iwch_cq *chp = to_iwch_cq(ibcq);
 
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	ret = ibv_cmd_resize_cq(ibcq, cqe, &cmd, sizeof cmd);
 	/* remap and realloc swcq here */
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 	return ret;
 #else
 	return -ENOSYS;
@@ -316,7 +321,7 @@ struct ibv_qp *iwch_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
 	qhp->wq.size_log2 = resp.size_log2;
 	qhp->wq.sq_size_log2 = resp.sq_size_log2;
 	qhp->wq.rq_size_log2 = resp.rq_size_log2;
-	pthread_spin_init(&qhp->lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qhp->lock, 1);
 	dbva = mmap(NULL, iwch_page_size, PROT_WRITE, MAP_SHARED, 
 		    pd->context->cmd_fd, resp.doorbell & ~(iwch_page_mask));
 	if (dbva == MAP_FAILED)
@@ -380,13 +385,13 @@ int iwch_modify_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
 	int ret;
 
 	PDBG("%s enter qp %p new state %d\n", __FUNCTION__, ibqp, attr_mask & IBV_QP_STATE ? attr->qp_state : -1);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t3b_device(qhp->rhp) && t3_wq_in_error(&qhp->wq))
 		iwch_flush_qp(qhp);
 	ret = ibv_cmd_modify_qp(ibqp, attr, attr_mask, &cmd, sizeof cmd);
 	if (!ret && (attr_mask & IBV_QP_STATE) && attr->qp_state == IBV_QPS_RESET)
 		reset_qp(qhp);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -400,9 +405,9 @@ int iwch_destroy_qp(struct ibv_qp *ibqp)
 
 	PDBG("%s enter qp %p\n", __FUNCTION__, ibqp);
 	if (t3b_device(dev)) {
-		pthread_spin_lock(&qhp->lock);
+		verbs_spin_lock(&qhp->lock);
 		iwch_flush_qp(qhp);
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 	}
 
 	dbva = (void *)((unsigned long)qhp->wq.doorbell & ~(iwch_page_mask));
@@ -465,9 +470,9 @@ void t3b_async_event(struct ibv_async_event *event)
 	case IBV_EVENT_QP_ACCESS_ERR:
 	case IBV_EVENT_PATH_MIG_ERR: {
 		struct iwch_qp *qhp = to_iwch_qp(event->element.qp);
-		pthread_spin_lock(&qhp->lock);
+		verbs_spin_lock(&qhp->lock);
 		iwch_flush_qp(qhp);
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		break;
 	}
 	case IBV_EVENT_SQ_DRAINED:
@@ -593,7 +593,7 @@ static int c4iw_poll_cq_one(struct c4iw_cq *chp, struct ibv_wc *wc)
 	if (!qhp)
 		wq = NULL;
 	else {
-		pthread_spin_lock(&qhp->lock);
+		verbs_spin_lock(&qhp->lock);
 		wq = &(qhp->wq);
 	}
 	ret = poll_cq(wq, &(chp->cq), &cqe, &cqe_flushed, &cookie, &credit);
@@ -705,7 +705,7 @@ static int c4iw_poll_cq_one(struct c4iw_cq *chp, struct ibv_wc *wc)
 			CQE_OPCODE(&cqe), CQE_STATUS(&cqe));
 out:
 	if (wq)
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -725,7 +725,7 @@ int c4iw_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 	if (!num_entries)
 		return t4_cq_notempty(&chp->cq);
 
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	for (npolled = 0; npolled < num_entries; ++npolled) {
 		do {
 			err = c4iw_poll_cq_one(chp, wc + npolled);
@@ -733,7 +733,7 @@ int c4iw_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 		if (err)
 			break;
 	}
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 	return !err || err == -ENODATA ? npolled : err;
 }
 
@@ -744,8 +744,8 @@ int c4iw_arm_cq(struct ibv_cq *ibcq, int solicited)
 
 	INC_STAT(arm);
 	chp = to_c4iw_cq(ibcq);
-	pthread_spin_lock(&chp->lock);
+	verbs_spin_lock(&chp->lock);
 	ret = t4_arm_cq(&chp->cq, solicited);
-	pthread_spin_unlock(&chp->lock);
+	verbs_spin_unlock(&chp->lock);
 	return ret;
 }
@@ -102,22 +102,17 @@ static struct ibv_context_ops c4iw_ctx_ops = {
 	.req_notify_cq = c4iw_arm_cq,
 };
 
-static struct ibv_context *c4iw_alloc_context(struct ibv_device *ibdev,
-					      int cmd_fd)
+static int c4iw_init_context(struct verbs_device *vdev,
+			     struct ibv_context *ibctx, int cmd_fd)
 {
-	struct c4iw_context *context;
+	struct c4iw_context *context = to_c4iw_context(ibctx);
 	struct ibv_get_context cmd;
 	struct c4iw_alloc_ucontext_resp resp;
-	struct c4iw_dev *rhp = to_c4iw_dev(ibdev);
+	struct c4iw_dev *rhp = to_c4iw_dev(&vdev->device);
 	struct ibv_query_device qcmd;
 	uint64_t raw_fw_ver;
 	struct ibv_device_attr attr;
 
-	context = malloc(sizeof *context);
-	if (!context)
-		return NULL;
-
-	memset(context, 0, sizeof *context);
 	context->ibv_ctx.cmd_fd = cmd_fd;
 
 	resp.status_page_size = 0;
@@ -139,8 +134,9 @@ static struct ibv_context *c4iw_alloc_context(struct ibv_device *ibdev,
 			goto err_free;
 	} 
 
-	context->ibv_ctx.device = ibdev;
+	context->ibv_ctx.device = &vdev->device;
 	context->ibv_ctx.ops = c4iw_ctx_ops;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 
 	switch (rhp->chip_version) {
 	case CHELSIO_T6:
@@ -158,6 +154,7 @@ static struct ibv_context *c4iw_alloc_context(struct ibv_device *ibdev,
 	default:
 		PDBG("%s unknown hca type %d\n", __FUNCTION__,
 		     rhp->chip_version);
+		errno = ENODEV;
 		goto err_unmap;
 		break;
 	}
@@ -196,7 +193,7 @@ static struct ibv_context *c4iw_alloc_context(struct ibv_device *ibdev,
 			goto err_unmap;
 	}
 
-	return &context->ibv_ctx;
+	return 0;
 
 err_unmap:
 	munmap(context->status_page, context->status_page_size);
@@ -207,22 +204,21 @@ err_free:
 		free(rhp->cqid2ptr);
 	if (rhp->mmid2ptr)
 		free(rhp->cqid2ptr);
-	free(context);
-	return NULL;
+	return errno ? errno : ENOMEM;
 }
 
-static void c4iw_free_context(struct ibv_context *ibctx)
+static void c4iw_uninit_context(struct verbs_device *vdev,
+				struct ibv_context *ibctx)
 {
 	struct c4iw_context *context = to_c4iw_context(ibctx);
 
 	if (context->status_page_size)
 		munmap(context->status_page, context->status_page_size);
-	free(context);
 }
 
 static struct verbs_device_ops c4iw_dev_ops = {
-	.alloc_context = c4iw_alloc_context,
-	.free_context = c4iw_free_context
+	.init_context = c4iw_init_context,
+	.uninit_context = c4iw_uninit_context
 };
 
 #ifdef STALL_DETECTION
@@ -471,6 +467,8 @@ found:
 
 	pthread_spin_init(&dev->lock, PTHREAD_PROCESS_PRIVATE);
 	dev->ibv_dev.ops = &c4iw_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct c4iw_context) -
+				       sizeof(struct ibv_context);
 	dev->chip_version = CHELSIO_CHIP_VERSION(hca_table[i].device >> 8);
 	dev->abi_version = abi_version;
 	list_node_init(&dev->list);
@@ -507,7 +505,7 @@ found:
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void cxgb4_register_driver(void)
+PROVIDER_DRIVER(cxgb4)
 {
 	c4iw_page_size = sysconf(_SC_PAGESIZE);
 	c4iw_page_shift = long_log2(c4iw_page_size);
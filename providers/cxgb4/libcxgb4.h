@@ -101,10 +101,13 @@ static inline u32 c4iw_mmid(u32 stag)
 }
 
 struct c4iw_cq {
-	struct ibv_cq ibv_cq;
+	union {
+		struct ibv_cq ibv_cq;
+		struct verbs_cq vcq;
+	};
 	struct c4iw_dev *rhp;
 	struct t4_cq cq;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 #ifdef STALL_DETECTION
 	struct timeval time;
 	int dumped;
@@ -115,7 +118,7 @@ struct c4iw_qp {
 	struct ibv_qp ibv_qp;
 	struct c4iw_dev *rhp;
 	struct t4_wq wq;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	int sq_sig_all;
 };
 
@@ -312,15 +312,15 @@ int c4iw_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	u16 idx = 0;
 
 	qhp = to_c4iw_qp(ibqp);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq)) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		*bad_wr = wr;
 		return -EINVAL;
 	}
 	num_wrs = t4_sq_avail(&qhp->wq);
 	if (num_wrs == 0) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		*bad_wr = wr;
 		return -ENOMEM;
 	}
@@ -402,7 +402,7 @@ int c4iw_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	qhp->wq.sq.queue[qhp->wq.sq.size].status.host_wq_pidx = \
 			(qhp->wq.sq.wq_pidx);
 
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return err;
 }
 
@@ -417,16 +417,16 @@ int c4iw_post_receive(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	u16 idx = 0;
 
 	qhp = to_c4iw_qp(ibqp);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq)) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		*bad_wr = wr;
 		return -EINVAL;
 	}
 	INC_STAT(recv);
 	num_wrs = t4_rq_avail(&qhp->wq);
 	if (num_wrs == 0) {
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		*bad_wr = wr;
 		return -ENOMEM;
 	}
@@ -470,7 +470,7 @@ int c4iw_post_receive(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 		ring_kernel_db(qhp, qhp->wq.rq.qid, idx);
 	qhp->wq.rq.queue[qhp->wq.rq.size].status.host_wq_pidx = \
 			(qhp->wq.rq.wq_pidx);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return err;
 }
 
@@ -506,26 +506,26 @@ void c4iw_flush_qp(struct c4iw_qp *qhp)
 
 	PDBG("%s qhp %p rchp %p schp %p\n", __func__, qhp, rchp, schp);
 	qhp->wq.flushed = 1;
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 
 	/* locking heirarchy: cq lock first, then qp lock. */
-	pthread_spin_lock(&rchp->lock);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&rchp->lock);
+	verbs_spin_lock(&qhp->lock);
 	c4iw_flush_hw_cq(rchp);
 	c4iw_count_rcqes(&rchp->cq, &qhp->wq, &count);
 	c4iw_flush_rq(&qhp->wq, &rchp->cq, count);
-	pthread_spin_unlock(&qhp->lock);
-	pthread_spin_unlock(&rchp->lock);
+	verbs_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&rchp->lock);
 
 	/* locking heirarchy: cq lock first, then qp lock. */
-	pthread_spin_lock(&schp->lock);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&schp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (schp != rchp)
 		c4iw_flush_hw_cq(schp);
 	c4iw_flush_sq(qhp);
-	pthread_spin_unlock(&qhp->lock);
-	pthread_spin_unlock(&schp->lock);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&schp->lock);
+	verbs_spin_lock(&qhp->lock);
 }
 
 void c4iw_flush_qps(struct c4iw_dev *dev)
@@ -537,9 +537,9 @@ void c4iw_flush_qps(struct c4iw_dev *dev)
 		struct c4iw_qp *qhp = dev->qpid2ptr[i];
 		if (qhp) {
 			if (!qhp->wq.flushed && t4_wq_in_error(&qhp->wq)) {
-				pthread_spin_lock(&qhp->lock);
+				verbs_spin_lock(&qhp->lock);
 				c4iw_flush_qp(qhp);
-				pthread_spin_unlock(&qhp->lock);
+				verbs_spin_unlock(&qhp->lock);
 			}
 		}
 	}
@@ -190,7 +190,12 @@ struct ibv_cq *c4iw_create_cq(struct ibv_context *context, int cqe,
 		PDBG("%s c4iw_create_cq_resp reserved field modified by kernel\n",
 		     __FUNCTION__);
 
-	pthread_spin_init(&chp->lock, PTHREAD_PROCESS_PRIVATE);
+	/*
+	 * Polling a CQ flushes every errored QP of the device, taking the
+	 * locks of those QPs and of their CQs, so no lock here is private
+	 * to one object and RDMAV_SINGLE_THREADED is not honoured.
+	 */
+	verbs_spinlock_init(&chp->lock, 1);
 #ifdef STALL_DETECTION
 	gettimeofday(&chp->time, NULL);
 #endif
@@ -337,7 +342,7 @@ static struct ibv_qp *create_qp_v0(struct ibv_pd *pd,
 	qhp->wq.rq.qid = resp.rqid;
 	qhp->wq.rq.size = resp.rq_size;
 	qhp->wq.rq.memsize = resp.rq_memsize;
-	pthread_spin_init(&qhp->lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qhp->lock, 1);
 
 	dbva = mmap(NULL, c4iw_page_size, PROT_WRITE, MAP_SHARED,
 		    pd->context->cmd_fd, resp.sq_db_gts_key);
@@ -448,7 +453,7 @@ static struct ibv_qp *create_qp(struct ibv_pd *pd,
 		fprintf(stderr, "libcxgb4 warning - downlevel iw_cxgb4 driver. "
 			"MA workaround disabled.\n");
 	}
-	pthread_spin_init(&qhp->lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qhp->lock, 1);
 
 	dbva = mmap(NULL, c4iw_page_size, PROT_WRITE, MAP_SHARED,
 		    pd->context->cmd_fd, resp.sq_db_gts_key);
@@ -585,13 +590,13 @@ int c4iw_modify_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
 	int ret;
 
 	PDBG("%s enter qp %p new state %d\n", __func__, ibqp, attr_mask & IBV_QP_STATE ? attr->qp_state : -1);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq))
 		c4iw_flush_qp(qhp);
 	ret = ibv_cmd_modify_qp(ibqp, attr, attr_mask, &cmd, sizeof cmd);
 	if (!ret && (attr_mask & IBV_QP_STATE) && attr->qp_state == IBV_QPS_RESET)
 		reset_qp(qhp);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -602,9 +607,9 @@ int c4iw_destroy_qp(struct ibv_qp *ibqp)
 	struct c4iw_dev *dev = to_c4iw_dev(ibqp->context->device);
 
 	PDBG("%s enter qp %p\n", __func__, ibqp);
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	c4iw_flush_qp(qhp);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 
 	ret = ibv_cmd_destroy_qp(ibqp);
 	if (ret) {
@@ -636,11 +641,11 @@ int c4iw_query_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
 	struct c4iw_qp *qhp = to_c4iw_qp(ibqp);
 	int ret;
 
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq))
 		c4iw_flush_qp(qhp);
 	ret = ibv_cmd_query_qp(ibqp, attr, attr_mask, init_attr, &cmd, sizeof cmd);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -660,11 +665,11 @@ int c4iw_attach_mcast(struct ibv_qp *ibqp, const union ibv_gid *gid,
 	struct c4iw_qp *qhp = to_c4iw_qp(ibqp);
 	int ret;
 
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq))
 		c4iw_flush_qp(qhp);
 	ret = ibv_cmd_attach_mcast(ibqp, gid, lid);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -674,11 +679,11 @@ int c4iw_detach_mcast(struct ibv_qp *ibqp, const union ibv_gid *gid,
 	struct c4iw_qp *qhp = to_c4iw_qp(ibqp);
 	int ret;
 
-	pthread_spin_lock(&qhp->lock);
+	verbs_spin_lock(&qhp->lock);
 	if (t4_wq_in_error(&qhp->wq))
 		c4iw_flush_qp(qhp);
 	ret = ibv_cmd_detach_mcast(ibqp, gid, lid);
-	pthread_spin_unlock(&qhp->lock);
+	verbs_spin_unlock(&qhp->lock);
 	return ret;
 }
 
@@ -695,9 +700,9 @@ void c4iw_async_event(struct ibv_async_event *event)
 	case IBV_EVENT_QP_ACCESS_ERR:
 	case IBV_EVENT_PATH_MIG_ERR: {
 		struct c4iw_qp *qhp = to_c4iw_qp(event->element.qp);
-		pthread_spin_lock(&qhp->lock);
+		verbs_spin_lock(&qhp->lock);
 		c4iw_flush_qp(qhp);
-		pthread_spin_unlock(&qhp->lock);
+		verbs_spin_unlock(&qhp->lock);
 		break;
 	}
 	case IBV_EVENT_SQ_DRAINED:
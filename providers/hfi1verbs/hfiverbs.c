@@ -217,7 +217,7 @@ found:
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void hfi1_register_driver(void)
+PROVIDER_DRIVER(hfi1verbs)
 {
 	verbs_register_driver("hfi1verbs", hfi1_driver_init);
 }
@@ -107,7 +107,7 @@ struct hfi1_cq_wc {
 struct hfi1_cq {
 	struct ibv_cq		ibv_cq;
 	struct hfi1_cq_wc	*queue;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 };
 
 /*
@@ -138,7 +138,7 @@ struct hfi1_rwq {
 
 struct hfi1_rq {
 	struct hfi1_rwq       *rwq;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 	uint32_t		size;
 	uint32_t		max_sge;
 };
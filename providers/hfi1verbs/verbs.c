@@ -196,7 +196,7 @@ struct ibv_cq *hfi1_create_cq(struct ibv_context *context, int cqe,
 		return NULL;
 	}
 
-	pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&cq->lock, !verbs_single_threaded(context));
 	return &cq->ibv_cq;
 }
 
@@ -232,14 +232,14 @@ int hfi1_resize_cq(struct ibv_cq *ibcq, int cqe)
 	int				ret;
 
 	memset(&resp, 0, sizeof(resp));
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	/* Save the old size so we can unmmap the queue. */
 	size = sizeof(struct hfi1_cq_wc) +
 		(sizeof(struct hfi1_wc) * cq->ibv_cq.cqe);
 	ret = ibv_cmd_resize_cq(ibcq, cqe, &cmd, sizeof cmd,
 				&resp.ibv_resp, sizeof resp);
 	if (ret) {
-		pthread_spin_unlock(&cq->lock);
+		verbs_spin_unlock(&cq->lock);
 		return ret;
 	}
 	(void) munmap(cq->queue, size);
@@ -248,7 +248,7 @@ int hfi1_resize_cq(struct ibv_cq *ibcq, int cqe)
 	cq->queue = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
 			 ibcq->context->cmd_fd, resp.offset);
 	ret = errno;
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 	if ((void *) cq->queue == MAP_FAILED)
 		return ret;
 	return 0;
@@ -295,7 +295,7 @@ int hfi1_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 	int npolled;
 	uint32_t tail;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	q = cq->queue;
 	tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
 	for (npolled = 0; npolled < ne; ++npolled, ++wc) {
@@ -310,7 +310,7 @@ int hfi1_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 			tail++;
 	}
 	atomic_store(&q->tail, tail);
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return npolled;
 }
@@ -356,7 +356,7 @@ struct ibv_qp *hfi1_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
 		}
 	}
 
-	pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qp->rq.lock, !verbs_single_threaded(pd->context));
 	return &qp->ibv_qp;
 }
 
@@ -475,7 +475,7 @@ static int post_recv(struct hfi1_rq *rq, struct ibv_recv_wr *wr,
 	uint32_t head;
 	int n, ret;
 
-	pthread_spin_lock(&rq->lock);
+	verbs_spin_lock(&rq->lock);
 	rwq = rq->rwq;
 	head = atomic_load_explicit(&rwq->head, memory_order_relaxed);
 	for (i = wr; i; i = i->next) {
@@ -506,7 +506,7 @@ bad:
 	if (bad_wr)
 		*bad_wr = i;
 done:
-	pthread_spin_unlock(&rq->lock);
+	verbs_spin_unlock(&rq->lock);
 	return ret;
 }
 
@@ -552,7 +552,7 @@ struct ibv_srq *hfi1_create_srq(struct ibv_pd *pd,
 		return NULL;
 	}
 
-	pthread_spin_init(&srq->rq.lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&srq->rq.lock, !verbs_single_threaded(pd->context));
 	return &srq->ibv_srq;
 }
 
@@ -589,7 +589,7 @@ int hfi1_modify_srq(struct ibv_srq *ibsrq,
 	int                          ret;
 
 	if (attr_mask & IBV_SRQ_MAX_WR) {
-		pthread_spin_lock(&srq->rq.lock);
+		verbs_spin_lock(&srq->rq.lock);
 		/* Save the old size so we can unmmap the queue. */
 		size = sizeof(struct hfi1_rwq) +
 			(sizeof(struct hfi1_rwqe) +
@@ -601,7 +601,7 @@ int hfi1_modify_srq(struct ibv_srq *ibsrq,
 				 &cmd.ibv_cmd, sizeof cmd);
 	if (ret) {
 		if (attr_mask & IBV_SRQ_MAX_WR)
-			pthread_spin_unlock(&srq->rq.lock);
+			verbs_spin_unlock(&srq->rq.lock);
 		return ret;
 	}
 	if (attr_mask & IBV_SRQ_MAX_WR) {
@@ -614,7 +614,7 @@ int hfi1_modify_srq(struct ibv_srq *ibsrq,
 		srq->rq.rwq = mmap(NULL, size,
 				   PROT_READ | PROT_WRITE, MAP_SHARED,
 				   ibsrq->context->cmd_fd, offset);
-		pthread_spin_unlock(&srq->rq.lock);
+		verbs_spin_unlock(&srq->rq.lock);
 		/* XXX Now we have no receive queue. */
 		if ((void *) srq->rq.rwq == MAP_FAILED)
 			return errno;
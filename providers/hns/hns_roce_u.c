@@ -62,19 +62,15 @@ static const struct {
 	{},
 };
 
-static struct ibv_context *hns_roce_alloc_context(struct ibv_device *ibdev,
-						  int cmd_fd)
+static int hns_roce_init_context(struct verbs_device *vdev,
+				 struct ibv_context *ibctx, int cmd_fd)
 {
 	int i;
 	struct ibv_get_context cmd;
 	struct ibv_device_attr dev_attrs;
-	struct hns_roce_context *context;
+	struct hns_roce_context *context = to_hr_ctx(ibctx);
 	struct hns_roce_alloc_ucontext_resp resp;
-	struct hns_roce_device *hr_dev = to_hr_dev(ibdev);
-
-	context = calloc(1, sizeof(*context));
-	if (!context)
-		return NULL;
+	struct hns_roce_device *hr_dev = to_hr_dev(&vdev->device);
 
 	context->ibv_ctx.cmd_fd = cmd_fd;
 	if (ibv_cmd_get_context(&context->ibv_ctx, &cmd, sizeof(cmd),
@@ -90,7 +86,7 @@ static struct ibv_context *hns_roce_alloc_context(struct ibv_device *ibdev,
 	for (i = 0; i < HNS_ROCE_QP_TABLE_SIZE; ++i)
 		context->qp_table[i].refcnt = 0;
 
-	context->uar = mmap(NULL, to_hr_dev(ibdev)->page_size,
+	context->uar = mmap(NULL, hr_dev->page_size,
 			    PROT_READ | PROT_WRITE, MAP_SHARED, cmd_fd, 0);
 	if (context->uar == MAP_FAILED) {
 		fprintf(stderr, PFX "Warning: failed to mmap() uar page.\n");
@@ -133,6 +129,7 @@ static struct ibv_context *hns_roce_alloc_context(struct ibv_device *ibdev,
 	context->ibv_ctx.ops.destroy_qp    = hr_dev->u_hw->destroy_qp;
 	context->ibv_ctx.ops.post_send     = hr_dev->u_hw->post_send;
 	context->ibv_ctx.ops.post_recv     = hr_dev->u_hw->post_recv;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 
 	if (hns_roce_u_query_device(&context->ibv_ctx, &dev_attrs))
 		goto tptr_free;
@@ -141,7 +138,7 @@ static struct ibv_context *hns_roce_alloc_context(struct ibv_device *ibdev,
 	context->max_sge = dev_attrs.max_sge;
 	context->max_cqe = dev_attrs.max_cqe;
 
-	return &context->ibv_ctx;
+	return 0;
 
 tptr_free:
 	if (hr_dev->hw_version == HNS_ROCE_HW_VER1) {
@@ -151,31 +148,29 @@ tptr_free:
 	}
 
 db_free:
-	munmap(context->uar, to_hr_dev(ibdev)->page_size);
+	munmap(context->uar, hr_dev->page_size);
 	context->uar = NULL;
 
 err_free:
-	free(context);
-	return NULL;
+	return errno ? errno : ENOMEM;
 }
 
-static void hns_roce_free_context(struct ibv_context *ibctx)
+static void hns_roce_uninit_context(struct verbs_device *vdev,
+				    struct ibv_context *ibctx)
 {
 	struct hns_roce_context *context = to_hr_ctx(ibctx);
+	struct hns_roce_device *hr_dev = to_hr_dev(&vdev->device);
 
-	munmap(context->uar, to_hr_dev(ibctx->device)->page_size);
-	if (to_hr_dev(ibctx->device)->hw_version == HNS_ROCE_HW_VER1)
+	munmap(context->uar, hr_dev->page_size);
+	if (hr_dev->hw_version == HNS_ROCE_HW_VER1)
 		munmap(context->cq_tptr_base, HNS_ROCE_CQ_DB_BUF_SIZE);
 
 	context->uar = NULL;
-
-	free(context);
-	context = NULL;
 }
 
 static struct verbs_device_ops hns_roce_dev_ops = {
-	.alloc_context = hns_roce_alloc_context,
-	.free_context	= hns_roce_free_context
+	.init_context	= hns_roce_init_context,
+	.uninit_context	= hns_roce_uninit_context
 };
 
 static struct verbs_device *hns_roce_driver_init(const char *uverbs_sys_path,
@@ -216,13 +211,15 @@ found:
 	}
 
 	dev->ibv_dev.ops = &hns_roce_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct hns_roce_context) -
+				       sizeof(struct ibv_context);
 	dev->u_hw = (struct hns_roce_u_hw *)u_hw;
 	dev->hw_version = hw_version;
 	dev->page_size   = sysconf(_SC_PAGESIZE);
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void hns_roce_register_driver(void)
+PROVIDER_DRIVER(hns)
 {
 	verbs_register_driver("hns", hns_roce_driver_init);
 }
@@ -119,9 +119,12 @@ struct hns_roce_pd {
 };
 
 struct hns_roce_cq {
-	struct ibv_cq			ibv_cq;
+	union {
+		struct ibv_cq		ibv_cq;
+		struct verbs_cq		vcq;
+	};
 	struct hns_roce_buf		buf;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	unsigned int			cqn;
 	unsigned int			cq_depth;
 	unsigned int			cons_index;
@@ -133,7 +136,7 @@ struct hns_roce_cq {
 struct hns_roce_srq {
 	struct ibv_srq			ibv_srq;
 	struct hns_roce_buf		buf;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	unsigned long			*wrid;
 	unsigned int			srqn;
 	int				max;
@@ -147,7 +150,7 @@ struct hns_roce_srq {
 
 struct hns_roce_wq {
 	unsigned long			*wrid;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	unsigned int			wqe_cnt;
 	int				max_post;
 	unsigned int			head;
@@ -241,8 +244,8 @@ struct ibv_qp *hns_roce_u_create_qp(struct ibv_pd *pd,
 int hns_roce_u_query_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
 			int attr_mask, struct ibv_qp_init_attr *init_attr);
 
-int hns_roce_alloc_buf(struct hns_roce_buf *buf, unsigned int size,
-		       int page_size);
+int hns_roce_alloc_buf(struct ibv_device *device, struct hns_roce_buf *buf,
+		       unsigned int size, int page_size);
 void hns_roce_free_buf(struct hns_roce_buf *buf);
 
 void hns_roce_init_qp_indices(struct hns_roce_qp *qp);
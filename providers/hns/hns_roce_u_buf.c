@@ -31,31 +31,21 @@
  */
 
 #include <errno.h>
-#include <sys/mman.h>
 
 #include "hns_roce_u.h"
 
-int hns_roce_alloc_buf(struct hns_roce_buf *buf, unsigned int size,
-		       int page_size)
+int hns_roce_alloc_buf(struct ibv_device *device, struct hns_roce_buf *buf,
+		       unsigned int size, int page_size)
 {
-	int ret;
-
 	buf->length = align(size, page_size);
-	buf->buf = mmap(NULL, buf->length, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (buf->buf == MAP_FAILED)
+	buf->buf = verbs_alloc_queue_buf(device, buf->length);
+	if (!buf->buf)
 		return errno;
 
-	ret = ibv_dontfork_range(buf->buf, size);
-	if (ret)
-		munmap(buf->buf, buf->length);
-
-	return ret;
+	return 0;
 }
 
 void hns_roce_free_buf(struct hns_roce_buf *buf)
 {
-	ibv_dofork_range(buf->buf, buf->length);
-
-	munmap(buf->buf, buf->length);
+	verbs_free_queue_buf(buf->buf, buf->length);
 }
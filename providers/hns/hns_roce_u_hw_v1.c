@@ -213,9 +213,9 @@ static int hns_roce_wq_overflow(struct hns_roce_wq *wq, int nreq,
 		return 0;
 
 	/* While the num of wqe exceeds cap of the device, cq will be locked */
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	cur = wq->head - wq->tail;
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	printf("wq:(head = %d, tail = %d, max_post = %d), nreq = 0x%x\n",
 		wq->head, wq->tail, wq->max_post, nreq);
@@ -400,7 +400,7 @@ static int hns_roce_u_v1_poll_cq(struct ibv_cq *ibvcq, int ne,
 	struct hns_roce_context *ctx = to_hr_ctx(ibvcq->context);
 	struct hns_roce_device *dev = to_hr_dev(ibvcq->context->device);
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	for (npolled = 0; npolled < ne; ++npolled) {
 		err = hns_roce_v1_poll_one(cq, &qp, wc + npolled);
@@ -418,7 +418,7 @@ static int hns_roce_u_v1_poll_cq(struct ibv_cq *ibvcq, int ne,
 		hns_roce_update_cq_cons_index(ctx, cq);
 	}
 
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return err == CQ_POLL_ERR ? err : npolled;
 }
@@ -472,7 +472,7 @@ static int hns_roce_u_v1_post_send(struct ibv_qp *ibvqp, struct ibv_send_wr *wr,
 	struct hns_roce_qp *qp = to_hr_qp(ibvqp);
 	struct hns_roce_context *ctx = to_hr_ctx(ibvqp->context);
 
-	pthread_spin_lock(&qp->sq.lock);
+	verbs_spin_lock(&qp->sq.lock);
 
 	/* check that state is OK to post send */
 	ind = qp->sq.head;
@@ -591,7 +591,7 @@ out:
 				qp->sq.head & ((qp->sq.wqe_cnt << 1) - 1));
 	}
 
-	pthread_spin_unlock(&qp->sq.lock);
+	verbs_spin_unlock(&qp->sq.lock);
 
 	return ret;
 }
@@ -636,9 +636,9 @@ static void __hns_roce_v1_cq_clean(struct hns_roce_cq *cq, uint32_t qpn,
 static void hns_roce_v1_cq_clean(struct hns_roce_cq *cq, unsigned int qpn,
 				 struct hns_roce_srq *srq)
 {
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	__hns_roce_v1_cq_clean(cq, qpn, srq);
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 }
 
 static int hns_roce_u_v1_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
@@ -677,13 +677,13 @@ static void hns_roce_lock_cqs(struct ibv_qp *qp)
 	struct hns_roce_cq *recv_cq = to_hr_cq(qp->recv_cq);
 
 	if (send_cq == recv_cq) {
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	} else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_lock(&send_cq->lock);
-		pthread_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
 	} else {
-		pthread_spin_lock(&recv_cq->lock);
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	}
 }
 
@@ -693,13 +693,13 @@ static void hns_roce_unlock_cqs(struct ibv_qp *qp)
 	struct hns_roce_cq *recv_cq = to_hr_cq(qp->recv_cq);
 
 	if (send_cq == recv_cq) {
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_unlock(&recv_cq->lock);
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else {
-		pthread_spin_unlock(&send_cq->lock);
-		pthread_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
 	}
 }
 
@@ -750,7 +750,7 @@ static int hns_roce_u_v1_post_recv(struct ibv_qp *ibvqp, struct ibv_recv_wr *wr,
 	struct hns_roce_qp *qp = to_hr_qp(ibvqp);
 	struct hns_roce_context *ctx = to_hr_ctx(ibvqp->context);
 
-	pthread_spin_lock(&qp->rq.lock);
+	verbs_spin_lock(&qp->rq.lock);
 
 	/* check that state is OK to post receive */
 	ind = qp->rq.head & (qp->rq.wqe_cnt - 1);
@@ -823,7 +823,7 @@ out:
 				    qp->rq.head & ((qp->rq.wqe_cnt << 1) - 1));
 	}
 
-	pthread_spin_unlock(&qp->rq.lock);
+	verbs_spin_unlock(&qp->rq.lock);
 
 	return ret;
 }
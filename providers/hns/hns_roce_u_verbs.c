@@ -211,7 +211,7 @@ static int hns_roce_verify_cq(int *cqe, struct hns_roce_context *context)
 static int hns_roce_alloc_cq_buf(struct hns_roce_device *dev,
 				 struct hns_roce_buf *buf, int nent)
 {
-	if (hns_roce_alloc_buf(buf,
+	if (hns_roce_alloc_buf(&dev->ibv_dev.device, buf,
 			align(nent * HNS_ROCE_CQE_ENTRY_SIZE, dev->page_size),
 			dev->page_size))
 		return -1;
@@ -249,7 +249,7 @@ struct ibv_cq *hns_roce_u_create_cq(struct ibv_context *context, int cqe,
 
 	cq->cons_index = 0;
 
-	if (pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&cq->lock, !verbs_single_threaded(context)))
 		goto err;
 
 	cqe = align_cq_size(cqe);
@@ -380,7 +380,8 @@ static int hns_roce_alloc_qp_buf(struct ibv_pd *pd, struct ibv_qp_cap *cap,
 		qp->sq.offset = 0;
 	}
 
-	if (hns_roce_alloc_buf(&qp->buf, align(qp->buf_size, 0x1000),
+	if (hns_roce_alloc_buf(pd->context->device, &qp->buf,
+			       align(qp->buf_size, 0x1000),
 			       to_hr_dev(pd->context->device)->page_size)) {
 		free(qp->sq.wrid);
 		free(qp->rq.wrid);
@@ -441,8 +442,10 @@ struct ibv_qp *hns_roce_u_create_qp(struct ibv_pd *pd,
 
 	hns_roce_init_qp_indices(qp);
 
-	if (pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE) ||
-	    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE)) {
+	if (verbs_spinlock_init(&qp->sq.lock,
+				!verbs_single_threaded(pd->context)) ||
+	    verbs_spinlock_init(&qp->rq.lock,
+				!verbs_single_threaded(pd->context))) {
 		fprintf(stderr, "pthread_spin_init failed!\n");
 		goto err_free;
 	}
@@ -98,8 +98,8 @@ static struct {
 #endif
 };
 
-static struct ibv_context *i40iw_ualloc_context(struct ibv_device *, int);
-static void i40iw_ufree_context(struct ibv_context *);
+static int i40iw_uinit_context(struct verbs_device *, struct ibv_context *, int);
+static void i40iw_uuninit_context(struct verbs_device *, struct ibv_context *);
 
 static struct ibv_context_ops i40iw_uctx_ops = {
 	.query_device	= i40iw_uquery_device,
@@ -133,26 +133,23 @@ static struct ibv_context_ops i40iw_uctx_ops = {
 };
 
 /**
- * i40iw_ualloc_context - allocate context for user app
- * @ibdev: pointer to device created during i40iw_driver_init
+ * i40iw_uinit_context - initialize context for user app
+ * @vdev: pointer to device created during i40iw_driver_init
+ * @ibctx: context allocated by libibverbs
  * @cmd_fd: save fd for the device
  *
- * Returns callback routines table and calls driver for allocating
- * context and getting back resource information to return as ibv_context.
+ * Sets the callback routines table and calls driver for getting back
+ * resource information for the context.
  */
 
-static struct ibv_context *i40iw_ualloc_context(struct ibv_device *ibdev, int cmd_fd)
+static int i40iw_uinit_context(struct verbs_device *vdev,
+			       struct ibv_context *ibctx, int cmd_fd)
 {
 	struct ibv_pd *ibv_pd;
-	struct i40iw_uvcontext *iwvctx;
+	struct i40iw_uvcontext *iwvctx = to_i40iw_uctx(ibctx);
 	struct i40iw_get_context cmd;
 	struct i40iw_ualloc_ucontext_resp resp;
 
-	iwvctx = malloc(sizeof(*iwvctx));
-	if (!iwvctx)
-		return NULL;
-
-	memset(iwvctx, 0, sizeof(*iwvctx));
 	iwvctx->ibv_ctx.cmd_fd = cmd_fd;
 	cmd.userspace_ver = I40IW_ABI_VER;
 	memset(&resp, 0, sizeof(resp));
@@ -169,11 +166,13 @@ static struct ibv_context *i40iw_ualloc_context(struct ibv_device *ibdev, int cm
 	if (resp.kernel_ver > I40IW_ABI_VER) {
 		fprintf(stderr, PFX "%s: incompatible kernel driver version: %d.  Need version %d\n",
 			__func__, resp.kernel_ver, I40IW_ABI_VER);
+		errno = EINVAL;
 		goto err_free;
 	}
 
-	iwvctx->ibv_ctx.device = ibdev;
+	iwvctx->ibv_ctx.device = &vdev->device;
 	iwvctx->ibv_ctx.ops = i40iw_uctx_ops;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 	iwvctx->max_pds = resp.max_pds;
 	iwvctx->max_qps = resp.max_qps;
 	iwvctx->wq_size = resp.wq_size;
@@ -186,31 +185,30 @@ static struct ibv_context *i40iw_ualloc_context(struct ibv_device *ibdev, int cm
 	ibv_pd->context = &iwvctx->ibv_ctx;
 	iwvctx->iwupd = to_i40iw_upd(ibv_pd);
 
-	return &iwvctx->ibv_ctx;
+	return 0;
 
 err_free:
 	fprintf(stderr, PFX "%s: failed to allocate context for device.\n", __func__);
-	free(iwvctx);
 
-	return NULL;
+	return errno ? errno : ENOMEM;
 }
 
 /**
- * i40iw_ufree_context - free context that was allocated
+ * i40iw_uuninit_context - release context resources
+ * @vdev: pointer to device created during i40iw_driver_init
  * @ibctx: context allocated ptr
  */
-static void i40iw_ufree_context(struct ibv_context *ibctx)
+static void i40iw_uuninit_context(struct verbs_device *vdev,
+				  struct ibv_context *ibctx)
 {
 	struct i40iw_uvcontext *iwvctx = to_i40iw_uctx(ibctx);
 
 	i40iw_ufree_pd(&iwvctx->iwupd->ibv_pd);
-
-	free(iwvctx);
 }
 
 static struct verbs_device_ops i40iw_udev_ops = {
-	.alloc_context	= i40iw_ualloc_context,
-	.free_context	= i40iw_ufree_context
+	.init_context	= i40iw_uinit_context,
+	.uninit_context	= i40iw_uuninit_context
 };
 
 /**
@@ -249,12 +247,14 @@ found:
 	}
 
 	dev->ibv_dev.ops = &i40iw_udev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct i40iw_uvcontext) -
+				       sizeof(struct ibv_context);
 	dev->hca_type = hca_table[i].type;
 	dev->page_size = I40IW_HW_PAGE_SIZE;
 	return &dev->ibv_dev;
 }
 
-static __attribute__ ((constructor)) void i40iw_register_driver(void)
+PROVIDER_DRIVER(i40iw)
 {
 	verbs_register_driver("i40iw", i40iw_driver_init);
 }
@@ -95,16 +95,20 @@ struct i40iw_uvcontext {
 struct i40iw_uqp;
 
 struct i40iw_ucq {
-	struct ibv_cq ibv_cq;
+	union {
+		struct ibv_cq ibv_cq;
+		struct verbs_cq vcq;
+	};
 	struct ibv_mr mr;
 	struct ibv_mr mr_shadow_area;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	uint8_t is_armed;
 	uint8_t skip_arm;
 	int arm_sol;
 	int skip_sol;
 	int comp_vector;
 	struct i40iw_uqp *udqp;
+	size_t buf_size;
 	struct i40iw_cq_uk cq;
 };
 
@@ -114,7 +118,7 @@ struct i40iw_uqp {
 	struct i40iw_ucq *recv_cq;
 	struct ibv_mr mr;
 	uint32_t i40iw_drv_opt;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	u32 *push_db;      /* mapped as uncached memory*/
 	u64 *push_wqe;     /* mapped as write combined memory*/
 	uint16_t sq_sig_all;
@@ -122,6 +126,7 @@ struct i40iw_uqp {
 	uint16_t rsvd;
 	uint32_t pending_rcvs;
 	uint32_t wq_size;
+	size_t buf_size;
 	struct ibv_recv_wr *pend_rx_wr;
 	struct i40iw_qp_uk qp;
 
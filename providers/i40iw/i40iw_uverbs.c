@@ -234,7 +234,8 @@ struct ibv_cq *i40iw_ucreate_cq(struct ibv_context *context, int cqe,
 		return NULL;
 	memset(iwucq, 0, sizeof(*iwucq));
 
-	if (pthread_spin_init(&iwucq->lock, PTHREAD_PROCESS_PRIVATE)) {
+	if (verbs_spinlock_init(&iwucq->lock,
+				!verbs_single_threaded(context))) {
 		free(iwucq);
 		return NULL;
 	}
@@ -247,12 +248,12 @@ struct ibv_cq *i40iw_ucreate_cq(struct ibv_context *context, int cqe,
 	cq_pages = i40iw_num_of_pages(info.cq_size * cqe_struct_size);
 	totalsize = (cq_pages << 12) + I40E_DB_SHADOW_AREA_SIZE;
 
-	info.cq_base = memalign(I40IW_HW_PAGE_SIZE, totalsize);
+	info.cq_base = verbs_alloc_queue_buf(context->device, totalsize);
 
 	if (!info.cq_base)
 		goto err;
 
-	memset(info.cq_base, 0, totalsize);
+	iwucq->buf_size = totalsize;
 	info.shadow_area = (u64 *)((u8 *)info.cq_base + (cq_pages << 12));
 	reg_mr_cmd.reg_type = I40IW_UMEMREG_TYPE_CQ;
 
@@ -288,8 +289,8 @@ struct ibv_cq *i40iw_ucreate_cq(struct ibv_context *context, int cqe,
 		fprintf(stderr, PFX "%s: failed to initialize CQ, status %d\n", __func__, ret);
 err:
 	if (info.cq_base)
-		free(info.cq_base);
-	if (pthread_spin_destroy(&iwucq->lock))
+		verbs_free_queue_buf(info.cq_base, totalsize);
+	if (verbs_spinlock_destroy(&iwucq->lock))
 		return NULL;
 	free(iwucq);
 	return NULL;
@@ -304,7 +305,7 @@ int i40iw_udestroy_cq(struct ibv_cq *cq)
 	struct i40iw_ucq *iwucq = to_i40iw_ucq(cq);
 	int ret;
 
-	ret = pthread_spin_destroy(&iwucq->lock);
+	ret = verbs_spinlock_destroy(&iwucq->lock);
 	if (ret)
 		return ret;
 
@@ -314,7 +315,7 @@ int i40iw_udestroy_cq(struct ibv_cq *cq)
 
 	ibv_cmd_dereg_mr(&iwucq->mr);
 
-	free(iwucq->cq.cq_base);
+	verbs_free_queue_buf(iwucq->cq.cq_base, iwucq->buf_size);
 	free(iwucq);
 
 	return 0;
@@ -335,7 +336,7 @@ int i40iw_upoll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *entry)
 
 	iwucq = to_i40iw_ucq(cq);
 
-	ret = pthread_spin_lock(&iwucq->lock);
+	ret = verbs_spin_lock(&iwucq->lock);
 	if (ret)
 		return ret;
 	while (cqe_count < num_entries) {
@@ -388,7 +389,7 @@ int i40iw_upoll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *entry)
 		entry++;
 		cqe_count++;
 	}
-	pthread_spin_unlock(&iwucq->lock);
+	verbs_spin_unlock(&iwucq->lock);
 	return cqe_count;
 }
 
@@ -422,7 +423,7 @@ int i40iw_uarm_cq(struct ibv_cq *cq, int solicited)
 	if (solicited)
 		cq_notify = IW_CQ_COMPL_SOLICITED;
 
-	ret = pthread_spin_lock(&iwucq->lock);
+	ret = verbs_spin_lock(&iwucq->lock);
 	if (ret)
 		return ret;
 
@@ -437,7 +438,7 @@ int i40iw_uarm_cq(struct ibv_cq *cq, int solicited)
 		i40iw_arm_cq(iwucq, cq_notify);
 	}
 
-	pthread_spin_unlock(&iwucq->lock);
+	verbs_spin_unlock(&iwucq->lock);
 
 	return 0;
 }
@@ -451,7 +452,7 @@ void i40iw_cq_event(struct ibv_cq *cq)
 	struct i40iw_ucq *iwucq;
 
 	iwucq = to_i40iw_ucq(cq);
-	if (pthread_spin_lock(&iwucq->lock))
+	if (verbs_spin_lock(&iwucq->lock))
 		return;
 
 	if (iwucq->skip_arm)
@@ -459,7 +460,7 @@ void i40iw_cq_event(struct ibv_cq *cq)
 	else
 		iwucq->is_armed = 0;
 
-	pthread_spin_unlock(&iwucq->lock);
+	verbs_spin_unlock(&iwucq->lock);
 }
 
 static int i40iw_destroy_vmapped_qp(struct i40iw_uqp *iwuqp,
@@ -477,7 +478,7 @@ static int i40iw_destroy_vmapped_qp(struct i40iw_uqp *iwuqp,
 		munmap(iwuqp->push_wqe, I40IW_HW_PAGE_SIZE);
 
 	ibv_cmd_dereg_mr(&iwuqp->mr);
-	free((void *)sq_base);
+	verbs_free_queue_buf((void *)sq_base, iwuqp->buf_size);
 
 	return 0;
 }
@@ -513,14 +514,14 @@ static int i40iw_vmapped_qp(struct i40iw_uqp *iwuqp, struct ibv_pd *pd,
 	sqsize = sq_pages << 12;
 	rqsize = rq_pages << 12;
 	totalqpsize = rqsize + sqsize + I40E_DB_SHADOW_AREA_SIZE;
-	info->sq = memalign(I40IW_HW_PAGE_SIZE, totalqpsize);
+	info->sq = verbs_alloc_queue_buf(pd->context->device, totalqpsize);
 
 	if (!info->sq) {
 		fprintf(stderr, PFX "%s: failed to allocate memory for SQ\n", __func__);
 		return 0;
 	}
 
-	memset(info->sq, 0, totalqpsize);
+	iwuqp->buf_size = totalqpsize;
 	info->rq = &info->sq[sqsize / I40IW_QP_WQE_MIN_SIZE];
 	info->shadow_area = info->rq[rqsize / I40IW_QP_WQE_MIN_SIZE].elem;
 
@@ -533,7 +534,7 @@ static int i40iw_vmapped_qp(struct i40iw_uqp *iwuqp, struct ibv_pd *pd,
 			     sizeof(reg_mr_cmd), &reg_mr_resp, sizeof(reg_mr_resp));
 	if (ret) {
 		fprintf(stderr, PFX "%s: failed to pin memory for SQ\n", __func__);
-		free(info->sq);
+		verbs_free_queue_buf(info->sq, totalqpsize);
 		return 0;
 	}
 	cmd.user_wqe_buffers = (__u64)((uintptr_t)info->sq);
@@ -544,7 +545,7 @@ static int i40iw_vmapped_qp(struct i40iw_uqp *iwuqp, struct ibv_pd *pd,
 	if (ret) {
 		fprintf(stderr, PFX "%s: failed to create QP, status %d\n", __func__, ret);
 		ibv_cmd_dereg_mr(&iwuqp->mr);
-		free(info->sq);
+		verbs_free_queue_buf(info->sq, totalqpsize);
 		return 0;
 	}
 
@@ -680,7 +681,8 @@ struct ibv_qp *i40iw_ucreate_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr
 		return NULL;
 	memset(iwuqp, 0, sizeof(*iwuqp));
 
-	if (pthread_spin_init(&iwuqp->lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&iwuqp->lock,
+				!verbs_single_threaded(pd->context)))
 		goto err_free_qp;
 
 	memset(&info, 0, sizeof(info));
@@ -734,7 +736,7 @@ err_free_rq_wrid:
 err_free_sq_wrtrk:
 	free(info.sq_wrtrk_array);
 err_destroy_lock:
-	pthread_spin_destroy(&iwuqp->lock);
+	verbs_spinlock_destroy(&iwuqp->lock);
 err_free_qp:
 	free(iwuqp);
 	return NULL;
@@ -777,7 +779,7 @@ int i40iw_udestroy_qp(struct ibv_qp *qp)
 	struct i40iw_uqp *iwuqp = to_i40iw_uqp(qp);
 	int ret;
 
-	ret = pthread_spin_destroy(&iwuqp->lock);
+	ret = verbs_spinlock_destroy(&iwuqp->lock);
 	if (ret)
 		return ret;
 
@@ -834,7 +836,7 @@ int i40iw_upost_send(struct ibv_qp *ib_qp, struct ibv_send_wr *ib_wr, struct ibv
 
 	iwuqp = (struct i40iw_uqp *)ib_qp;
 
-	err = pthread_spin_lock(&iwuqp->lock);
+	err = verbs_spin_lock(&iwuqp->lock);
 	if (err)
 		return err;
 	while (ib_wr) {
@@ -938,7 +940,7 @@ int i40iw_upost_send(struct ibv_qp *ib_qp, struct ibv_send_wr *ib_wr, struct ibv
 	else
 		iwuqp->qp.ops.iw_qp_post_wr(&iwuqp->qp);
 
-	pthread_spin_unlock(&iwuqp->lock);
+	verbs_spin_unlock(&iwuqp->lock);
 
 	return err;
 }
@@ -957,7 +959,7 @@ int i40iw_upost_recv(struct ibv_qp *ib_qp, struct ibv_recv_wr *ib_wr, struct ibv
 	struct i40iw_sge sg_list[I40IW_MAX_WQ_FRAGMENT_COUNT];
 
 	memset(&post_recv, 0, sizeof(post_recv));
-	err = pthread_spin_lock(&iwuqp->lock);
+	err = verbs_spin_lock(&iwuqp->lock);
 	if (err)
 		return err;
 	while (ib_wr) {
@@ -979,7 +981,7 @@ int i40iw_upost_recv(struct ibv_qp *ib_qp, struct ibv_recv_wr *ib_wr, struct ibv
 	}
 
 error:
-	pthread_spin_unlock(&iwuqp->lock);
+	verbs_spin_unlock(&iwuqp->lock);
 	return err;
 }
 
@@ -216,7 +216,7 @@ found:
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void ipath_register_driver(void)
+PROVIDER_DRIVER(ipathverbs)
 {
 	verbs_register_driver("ipathverbs", ipath_driver_init);
 }
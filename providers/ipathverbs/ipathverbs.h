@@ -87,7 +87,7 @@ struct ipath_cq_wc {
 struct ipath_cq {
 	struct ibv_cq		ibv_cq;
 	struct ipath_cq_wc	*queue;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 };
 
 /*
@@ -118,7 +118,7 @@ struct ipath_rwq {
 
 struct ipath_rq {
 	struct ipath_rwq       *rwq;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 	uint32_t		size;
 	uint32_t		max_sge;
 };
@@ -34,31 +34,22 @@
 
 #include <stdlib.h>
 #include <errno.h>
-#include <sys/mman.h>
 
 #include "mlx4.h"
 
-int mlx4_alloc_buf(struct mlx4_buf *buf, size_t size, int page_size)
+int mlx4_alloc_buf(struct ibv_device *device, struct mlx4_buf *buf,
+		   size_t size, int page_size)
 {
-	int ret;
-
 	buf->length = align(size, page_size);
-	buf->buf = mmap(NULL, buf->length, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (buf->buf == MAP_FAILED)
+	buf->buf = verbs_alloc_queue_buf(device, buf->length);
+	if (!buf->buf)
 		return errno;
 
-	ret = ibv_dontfork_range(buf->buf, size);
-	if (ret)
-		munmap(buf->buf, buf->length);
-
-	return ret;
+	return 0;
 }
 
 void mlx4_free_buf(struct mlx4_buf *buf)
 {
-	if (buf->length) {
-		ibv_dofork_range(buf->buf, buf->length);
-		munmap(buf->buf, buf->length);
-	}
+	if (buf->length)
+		verbs_free_queue_buf(buf->buf, buf->length);
 }
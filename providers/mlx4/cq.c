@@ -402,7 +402,7 @@ int mlx4_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 	int npolled;
 	int err = CQ_OK;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	for (npolled = 0; npolled < ne; ++npolled) {
 		err = mlx4_poll_one(cq, &qp, wc + npolled);
@@ -413,7 +413,7 @@ int mlx4_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 	if (npolled || err == CQ_POLL_ERR)
 		mlx4_update_cons_index(cq);
 
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return err == CQ_POLL_ERR ? err : npolled;
 }
@@ -427,7 +427,7 @@ static inline void _mlx4_end_poll(struct ibv_cq_ex *ibcq, int lock)
 	mlx4_update_cons_index(cq);
 
 	if (lock)
-		pthread_spin_unlock(&cq->lock);
+		verbs_spin_unlock(&cq->lock);
 }
 
 static inline int _mlx4_start_poll(struct ibv_cq_ex *ibcq,
@@ -446,20 +446,20 @@ static inline int _mlx4_start_poll(struct ibv_cq_ex *ibcq,
 		return EINVAL;
 
 	if (lock)
-		pthread_spin_lock(&cq->lock);
+		verbs_spin_lock(&cq->lock);
 
 	cq->cur_qp = NULL;
 
 	err = mlx4_get_next_cqe(cq, &cqe);
 	if (err == CQ_EMPTY) {
 		if (lock)
-			pthread_spin_unlock(&cq->lock);
+			verbs_spin_unlock(&cq->lock);
 		return ENOENT;
 	}
 
 	err = mlx4_parse_lazy_cqe(cq, cqe);
 	if (lock && err)
-		pthread_spin_unlock(&cq->lock);
+		verbs_spin_unlock(&cq->lock);
 
 	return err;
 }
@@ -770,9 +770,9 @@ void __mlx4_cq_clean(struct mlx4_cq *cq, uint32_t qpn, struct mlx4_srq *srq)
 
 void mlx4_cq_clean(struct mlx4_cq *cq, uint32_t qpn, struct mlx4_srq *srq)
 {
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	__mlx4_cq_clean(cq, qpn, srq);
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 }
 
 int mlx4_get_outstanding_cqes(struct mlx4_cq *cq)
@@ -811,7 +811,8 @@ void mlx4_cq_resize_copy_cqes(struct mlx4_cq *cq, void *buf, int old_cqe)
 int mlx4_alloc_cq_buf(struct mlx4_device *dev, struct mlx4_buf *buf, int nent,
 		      int entry_size)
 {
-	if (mlx4_alloc_buf(buf, align(nent * entry_size, dev->page_size),
+	if (mlx4_alloc_buf(&dev->verbs_dev.device, buf,
+			   align(nent * entry_size, dev->page_size),
 			   dev->page_size))
 		return -1;
 	memset(buf->buf, 0, nent * entry_size);
@@ -38,6 +38,19 @@
 
 #include "mlx4.h"
 
+/*
+ * Doorbell records are carved out of page sized buffers.  The first
+ * records of every page are never handed out, they hold a pointer back to
+ * the page's bookkeeping so mlx4_free_db() finds it by masking the
+ * record's address instead of searching.  context->db_list[type] only
+ * links the pages that still have free records, so allocation takes the
+ * first one without walking past full pages.
+ *
+ * One empty page per type is kept around so that a loop creating and
+ * destroying a single QP does not allocate and free a page every time;
+ * mlx4_free_db_pages() releases it when the context goes away.
+ */
+
 struct mlx4_db_page {
 	struct mlx4_db_page	       *prev, *next;
 	struct mlx4_buf			buf;
@@ -51,35 +64,59 @@ static const int db_size[] = {
 	[MLX4_DB_TYPE_RQ] = 4,
 };
 
+static void link_page(struct mlx4_context *context, enum mlx4_db_type type,
+		      struct mlx4_db_page *page)
+{
+	page->prev = NULL;
+	page->next = context->db_list[type];
+	context->db_list[type] = page;
+	if (page->next)
+		page->next->prev = page;
+}
+
+static void unlink_page(struct mlx4_context *context, enum mlx4_db_type type,
+			struct mlx4_db_page *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		context->db_list[type] = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+}
+
 static struct mlx4_db_page *__add_page(struct mlx4_context *context,
 				       enum mlx4_db_type type)
 {
 	struct mlx4_db_page *page;
 	int ps = to_mdev(context->ibv_ctx.device)->page_size;
 	int pp;
+	int rsvd;
 	int i;
 
 	pp = ps / db_size[type];
+	rsvd = (sizeof(struct mlx4_db_page *) + db_size[type] - 1) /
+	       db_size[type];
 
 	page = malloc(sizeof *page + pp / 8);
 	if (!page)
 		return NULL;
 
-	if (mlx4_alloc_buf(&page->buf, ps, ps)) {
+	if (mlx4_alloc_buf(context->ibv_ctx.device, &page->buf, ps, ps)) {
 		free(page);
 		return NULL;
 	}
 
-	page->num_db  = pp;
+	/* The first rsvd records hold the back pointer */
+	*(struct mlx4_db_page **)page->buf.buf = page;
+
+	page->num_db  = pp - rsvd;
 	page->use_cnt = 0;
 	for (i = 0; i < pp / (sizeof (long) * 8); ++i)
 		page->free[i] = ~0;
+	page->free[0] &= ~((1UL << rsvd) - 1);
 
-	page->prev = NULL;
-	page->next = context->db_list[type];
-	context->db_list[type] = page;
-	if (page->next)
-		page->next->prev = page;
+	link_page(context, type, page);
 
 	return page;
 }
@@ -92,16 +129,15 @@ uint32_t *mlx4_alloc_db(struct mlx4_context *context, enum mlx4_db_type type)
 
 	pthread_mutex_lock(&context->db_list_mutex);
 
-	for (page = context->db_list[type]; page; page = page->next)
-		if (page->use_cnt < page->num_db)
-			goto found;
-
-	page = __add_page(context, type);
-	if (!page)
-		goto out;
+	page = context->db_list[type];
+	if (!page) {
+		page = __add_page(context, type);
+		if (!page)
+			goto out;
+	}
 
-found:
-	++page->use_cnt;
+	if (++page->use_cnt == page->num_db)
+		unlink_page(context, type, page);
 
 	for (i = 0; !page->free[i]; ++i)
 		/* nothing */;
@@ -122,30 +158,38 @@ void mlx4_free_db(struct mlx4_context *context, enum mlx4_db_type type, uint32_t
 	uintptr_t ps = to_mdev(context->ibv_ctx.device)->page_size;
 	int i;
 
-	pthread_mutex_lock(&context->db_list_mutex);
+	if (!db)
+		return;
 
-	for (page = context->db_list[type]; page; page = page->next)
-		if (((uintptr_t) db & ~(ps - 1)) == (uintptr_t) page->buf.buf)
-			break;
+	page = *(struct mlx4_db_page **)((uintptr_t) db & ~(ps - 1));
 
-	if (!page)
-		goto out;
+	pthread_mutex_lock(&context->db_list_mutex);
 
 	i = ((void *) db - page->buf.buf) / db_size[type];
 	page->free[i / (8 * sizeof (long))] |= 1UL << (i % (8 * sizeof (long)));
 
-	if (!--page->use_cnt) {
-		if (page->prev)
-			page->prev->next = page->next;
-		else
-			context->db_list[type] = page->next;
-		if (page->next)
-			page->next->prev = page->prev;
+	if (page->use_cnt-- == page->num_db)
+		link_page(context, type, page);
 
+	if (!page->use_cnt && (page->prev || page->next)) {
+		unlink_page(context, type, page);
 		mlx4_free_buf(&page->buf);
 		free(page);
 	}
 
-out:
 	pthread_mutex_unlock(&context->db_list_mutex);
 }
+
+void mlx4_free_db_pages(struct mlx4_context *context)
+{
+	struct mlx4_db_page *page;
+	int i;
+
+	for (i = 0; i < MLX4_NUM_DB_TYPE; ++i) {
+		while ((page = context->db_list[i])) {
+			context->db_list[i] = page->next;
+			mlx4_free_buf(&page->buf);
+			free(page);
+		}
+	}
+}
@@ -255,6 +255,7 @@ static void mlx4_uninit_context(struct verbs_device *v_device,
 {
 	struct mlx4_context *context = to_mctx(ibv_ctx);
 
+	mlx4_free_db_pages(context);
 	munmap(context->uar, to_mdev(&v_device->device)->page_size);
 	if (context->bf_page)
 		munmap(context->bf_page, to_mdev(&v_device->device)->page_size);
@@ -321,7 +322,7 @@ found:
 	return &dev->verbs_dev;
 }
 
-static __attribute__((constructor)) void mlx4_register_driver(void)
+PROVIDER_DRIVER(mlx4)
 {
 	verbs_register_driver("mlx4", mlx4_driver_init);
 }
@@ -181,7 +181,7 @@ struct mlx4_cq {
 	struct ibv_cq_ex		ibv_cq;
 	struct mlx4_buf			buf;
 	struct mlx4_buf			resize_buf;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	uint32_t			cqn;
 	uint32_t			cons_index;
 	uint32_t		       *set_ci_db;
@@ -196,7 +196,7 @@ struct mlx4_cq {
 struct mlx4_srq {
 	struct verbs_srq		verbs_srq;
 	struct mlx4_buf			buf;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	uint64_t		       *wrid;
 	uint32_t			srqn;
 	int				max;
@@ -211,7 +211,7 @@ struct mlx4_srq {
 
 struct mlx4_wq {
 	uint64_t		       *wrid;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	int				wqe_cnt;
 	int				max_post;
 	unsigned			head;
@@ -351,11 +351,13 @@ static inline void mlx4_update_cons_index(struct mlx4_cq *cq)
 	*cq->set_ci_db = htobe32(cq->cons_index & 0xffffff);
 }
 
-int mlx4_alloc_buf(struct mlx4_buf *buf, size_t size, int page_size);
+int mlx4_alloc_buf(struct ibv_device *device, struct mlx4_buf *buf,
+		   size_t size, int page_size);
 void mlx4_free_buf(struct mlx4_buf *buf);
 
 uint32_t *mlx4_alloc_db(struct mlx4_context *context, enum mlx4_db_type type);
 void mlx4_free_db(struct mlx4_context *context, enum mlx4_db_type type, uint32_t *db);
+void mlx4_free_db_pages(struct mlx4_context *context);
 
 int mlx4_query_device(struct ibv_context *context,
 		       struct ibv_device_attr *attr);
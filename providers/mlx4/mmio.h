@@ -65,13 +65,6 @@ static inline long mmio_read(const unsigned long mmio_addr,
 	return syscall(__NR_s390_pci_mmio_read, mmio_addr, val, length);
 }
 
-static inline void mlx4_bf_copy(unsigned long *dst,
-				unsigned long *src,
-				unsigned bytecnt)
-{
-	mmio_write((unsigned long)dst, src, bytecnt);
-}
-
 #else
 
 #define mmio_writeb(addr, value) \
@@ -95,22 +88,6 @@ static inline void mlx4_bf_copy(unsigned long *dst,
 	(value = *((volatile uint64_t *)addr))
 #define mmio_read(addr, value, length) \
 	memcpy(value, addr, length)
-
-/*
- * Avoid using memcpy() to copy to BlueFlame page, since memcpy()
- * implementations may use move-string-buffer assembler instructions,
- * which do not guarantee order of copying.
- */
-static inline void mlx4_bf_copy(unsigned long *dst,
-				unsigned long *src,
-				unsigned bytecnt)
-{
-	while (bytecnt > 0) {
-		*dst++ = *src++;
-		*dst++ = *src++;
-		bytecnt -= 2 * sizeof(long);
-	}
-}
 #endif
 
 #endif
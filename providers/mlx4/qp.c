@@ -39,6 +39,7 @@
 #include <string.h>
 #include <errno.h>
 #include <util/compiler.h>
+#include <util/mmio.h>
 
 #include "mlx4.h"
 #include "doorbell.h"
@@ -112,9 +113,9 @@ static int wq_overflow(struct mlx4_wq *wq, int nreq, struct mlx4_cq *cq)
 	if (cur + nreq < wq->max_post)
 		return 0;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	cur = wq->head - wq->tail;
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return cur + nreq >= wq->max_post;
 }
@@ -225,7 +226,7 @@ int mlx4_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	int size = 0;
 	int i;
 
-	pthread_spin_lock(&qp->sq.lock);
+	verbs_spin_lock(&qp->sq.lock);
 
 	/* XXX check that state is OK to post send */
 
@@ -480,7 +481,7 @@ out:
 		 */
 		mmio_wc_spinlock(&ctx->bf_lock);
 
-		mlx4_bf_copy(ctx->bf_page + ctx->bf_offset, (unsigned long *) ctrl,
+		mmio_wc_copy(ctx->bf_page + ctx->bf_offset, ctrl,
 			     align(size * 16, 64));
 		/* Flush before toggling bf_offset to be latency oriented */
 		mmio_flush_writes();
@@ -505,7 +506,7 @@ out:
 		stamp_send_wqe(qp, (ind + qp->sq_spare_wqes - 1) &
 			       (qp->sq.wqe_cnt - 1));
 
-	pthread_spin_unlock(&qp->sq.lock);
+	verbs_spin_unlock(&qp->sq.lock);
 
 	return ret;
 }
@@ -520,7 +521,7 @@ int mlx4_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	int ind;
 	int i;
 
-	pthread_spin_lock(&qp->rq.lock);
+	verbs_spin_lock(&qp->rq.lock);
 
 	/* XXX check that state is OK to post receive */
 
@@ -568,7 +569,7 @@ out:
 		*qp->db = htobe32(qp->rq.head & 0xffff);
 	}
 
-	pthread_spin_unlock(&qp->rq.lock);
+	verbs_spin_unlock(&qp->rq.lock);
 
 	return ret;
 }
@@ -686,7 +687,7 @@ int mlx4_alloc_qp_buf(struct ibv_context *context, struct ibv_qp_cap *cap,
 	}
 
 	if (qp->buf_size) {
-		if (mlx4_alloc_buf(&qp->buf,
+		if (mlx4_alloc_buf(context->device, &qp->buf,
 				   align(qp->buf_size, to_mdev(context->device)->page_size),
 				   to_mdev(context->device)->page_size)) {
 			free(qp->sq.wrid);
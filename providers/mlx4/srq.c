@@ -50,13 +50,13 @@ void mlx4_free_srq_wqe(struct mlx4_srq *srq, int ind)
 {
 	struct mlx4_wqe_srq_next_seg *next;
 
-	pthread_spin_lock(&srq->lock);
+	verbs_spin_lock(&srq->lock);
 
 	next = get_wqe(srq, srq->tail);
 	next->next_wqe_index = htobe16(ind);
 	srq->tail = ind;
 
-	pthread_spin_unlock(&srq->lock);
+	verbs_spin_unlock(&srq->lock);
 }
 
 int mlx4_post_srq_recv(struct ibv_srq *ibsrq,
@@ -70,7 +70,7 @@ int mlx4_post_srq_recv(struct ibv_srq *ibsrq,
 	int nreq;
 	int i;
 
-	pthread_spin_lock(&srq->lock);
+	verbs_spin_lock(&srq->lock);
 
 	for (nreq = 0; wr; ++nreq, wr = wr->next) {
 		if (wr->num_sge > srq->max_gs) {
@@ -117,7 +117,7 @@ int mlx4_post_srq_recv(struct ibv_srq *ibsrq,
 		*srq->db = htobe32(srq->counter);
 	}
 
-	pthread_spin_unlock(&srq->lock);
+	verbs_spin_unlock(&srq->lock);
 
 	return err;
 }
@@ -143,7 +143,7 @@ int mlx4_alloc_srq_buf(struct ibv_pd *pd, struct ibv_srq_attr *attr,
 
 	buf_size = srq->max << srq->wqe_shift;
 
-	if (mlx4_alloc_buf(&srq->buf, buf_size,
+	if (mlx4_alloc_buf(pd->context->device, &srq->buf, buf_size,
 			   to_mdev(pd->context->device)->page_size)) {
 		free(srq->wrid);
 		return -1;
@@ -248,7 +248,8 @@ struct ibv_srq *mlx4_create_xrc_srq(struct ibv_context *context,
 	if (!srq)
 		return NULL;
 
-	if (pthread_spin_init(&srq->lock, PTHREAD_PROCESS_PRIVATE))
+	/* taken by poll_cq on any CQ attached to the SRQ */
+	if (verbs_spinlock_init(&srq->lock, 1))
 		goto err;
 
 	srq->max     = align_queue_size(attr_ex->attr.max_wr + 1);
@@ -304,15 +305,15 @@ int mlx4_destroy_xrc_srq(struct ibv_srq *srq)
 
 	mcq = to_mcq(msrq->verbs_srq.cq);
 	mlx4_cq_clean(mcq, 0, msrq);
-	pthread_spin_lock(&mcq->lock);
+	verbs_spin_lock(&mcq->lock);
 	mlx4_clear_xsrq(&mctx->xsrq_table, msrq->verbs_srq.srq_num);
-	pthread_spin_unlock(&mcq->lock);
+	verbs_spin_unlock(&mcq->lock);
 
 	ret = ibv_cmd_destroy_srq(srq);
 	if (ret) {
-		pthread_spin_lock(&mcq->lock);
+		verbs_spin_lock(&mcq->lock);
 		mlx4_store_xsrq(&mctx->xsrq_table, msrq->verbs_srq.srq_num, msrq);
-		pthread_spin_unlock(&mcq->lock);
+		verbs_spin_unlock(&mcq->lock);
 		return ret;
 	}
 
@@ -454,6 +454,7 @@ static struct ibv_cq_ex *create_cq(struct ibv_context *context,
 {
 	struct mlx4_cq      *cq;
 	int                  ret;
+	int                  need_lock;
 	struct mlx4_context *mctx = to_mctx(context);
 
 	/* Sanity check CQ size before proceeding */
@@ -491,7 +492,12 @@ static struct ibv_cq_ex *create_cq(struct ibv_context *context,
 
 	cq->cons_index = 0;
 
-	if (pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE))
+	need_lock = !verbs_single_threaded(context);
+	if (cq_attr->comp_mask & IBV_CQ_INIT_ATTR_MASK_FLAGS &&
+	    cq_attr->flags & IBV_CREATE_CQ_ATTR_SINGLE_THREADED)
+		need_lock = 0;
+
+	if (verbs_spinlock_init(&cq->lock, need_lock))
 		goto err;
 
 	cq_attr->cqe = align_queue_size(cq_attr->cqe + 1);
@@ -583,7 +589,7 @@ int mlx4_resize_cq(struct ibv_cq *ibcq, int cqe)
 	if (cqe > 0x3fffff)
 		return EINVAL;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	cqe = align_queue_size(cqe + 1);
 	if (cqe == ibcq->cqe + 1) {
@@ -619,7 +625,7 @@ int mlx4_resize_cq(struct ibv_cq *ibcq, int cqe)
 	mlx4_update_cons_index(cq);
 
 out:
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 	return ret;
 }
 
@@ -654,7 +660,8 @@ struct ibv_srq *mlx4_create_srq(struct ibv_pd *pd,
 	if (!srq)
 		return NULL;
 
-	if (pthread_spin_init(&srq->lock, PTHREAD_PROCESS_PRIVATE))
+	/* taken by poll_cq on any CQ attached to the SRQ */
+	if (verbs_spinlock_init(&srq->lock, 1))
 		goto err;
 
 	srq->max     = align_queue_size(attr->attr.max_wr + 1);
@@ -841,8 +848,9 @@ struct ibv_qp *mlx4_create_qp_ex(struct ibv_context *context,
 
 	mlx4_init_qp_indices(qp);
 
-	if (pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE) ||
-	    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&qp->sq.lock,
+				!verbs_single_threaded(context)) ||
+	    verbs_spinlock_init(&qp->rq.lock, !verbs_single_threaded(context)))
 		goto err_free;
 
 	if (attr->cap.max_recv_sge) {
@@ -1046,17 +1054,17 @@ static void mlx4_lock_cqs(struct ibv_qp *qp)
 
 	if (!qp->send_cq || !qp->recv_cq) {
 		if (qp->send_cq)
-			pthread_spin_lock(&send_cq->lock);
+			verbs_spin_lock(&send_cq->lock);
 		else if (qp->recv_cq)
-			pthread_spin_lock(&recv_cq->lock);
+			verbs_spin_lock(&recv_cq->lock);
 	} else if (send_cq == recv_cq) {
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	} else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_lock(&send_cq->lock);
-		pthread_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
 	} else {
-		pthread_spin_lock(&recv_cq->lock);
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	}
 }
 
@@ -1068,17 +1076,17 @@ static void mlx4_unlock_cqs(struct ibv_qp *qp)
 
 	if (!qp->send_cq || !qp->recv_cq) {
 		if (qp->send_cq)
-			pthread_spin_unlock(&send_cq->lock);
+			verbs_spin_unlock(&send_cq->lock);
 		else if (qp->recv_cq)
-			pthread_spin_unlock(&recv_cq->lock);
+			verbs_spin_unlock(&recv_cq->lock);
 	} else if (send_cq == recv_cq) {
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_unlock(&recv_cq->lock);
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else {
-		pthread_spin_unlock(&send_cq->lock);
-		pthread_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
 	}
 }
 
@@ -187,7 +187,8 @@ static int bitmap_alloc_range(struct mlx5_bitmap *bitmap, int cnt,
 	return obj;
 }
 
-static struct mlx5_hugetlb_mem *alloc_huge_mem(size_t size)
+static struct mlx5_hugetlb_mem *alloc_huge_mem(struct ibv_device *device,
+					       size_t size)
 {
 	struct mlx5_hugetlb_mem *hmem;
 	size_t shm_len;
@@ -209,6 +210,8 @@ static struct mlx5_hugetlb_mem *alloc_huge_mem(size_t size)
 		goto out_rmid;
 	}
 
+	verbs_bind_queue_buf(device, hmem->shmaddr, shm_len);
+
 	if (mlx5_bitmap_init(&hmem->bitmap, shm_len / MLX5_Q_CHUNK_SIZE,
 			     shm_len / MLX5_Q_CHUNK_SIZE - 1)) {
 		mlx5_dbg(stderr, MLX5_DBG_CONTIG, "%s\n", strerror(errno));
@@ -259,7 +262,7 @@ static int alloc_huge_buf(struct mlx5_context *mctx, struct mlx5_buf *buf,
 	mlx5_spin_unlock(&mctx->hugetlb_lock);
 
 	if (!found) {
-		hmem = alloc_huge_mem(buf->length);
+		hmem = alloc_huge_mem(mctx->ibv_ctx.device, buf->length);
 		if (!hmem)
 			return -1;
 
@@ -362,7 +365,7 @@ int mlx5_alloc_prefered_buf(struct mlx5_context *mctx,
 			 "Contig allocation failed, fallback to default mode\n");
 	}
 
-	return mlx5_alloc_buf(buf, size, page_size);
+	return mlx5_alloc_buf(mctx->ibv_ctx.device, buf, size, page_size);
 
 }
 
@@ -542,30 +545,20 @@ void mlx5_free_buf_contig(struct mlx5_context *mctx, struct mlx5_buf *buf)
 	munmap(buf->buf, buf->length);
 }
 
-int mlx5_alloc_buf(struct mlx5_buf *buf, size_t size, int page_size)
+int mlx5_alloc_buf(struct ibv_device *device, struct mlx5_buf *buf,
+		   size_t size, int page_size)
 {
-	int ret;
-	int al_size;
-
-	al_size = align(size, page_size);
-	ret = posix_memalign(&buf->buf, page_size, al_size);
-	if (ret)
-		return ret;
+	buf->length = align(size, page_size);
+	buf->buf = verbs_alloc_queue_buf(device, buf->length);
+	if (!buf->buf)
+		return errno;
 
-	ret = ibv_dontfork_range(buf->buf, al_size);
-	if (ret)
-		free(buf->buf);
-
-	if (!ret) {
-		buf->length = al_size;
-		buf->type = MLX5_ALLOC_TYPE_ANON;
-	}
-
-	return ret;
+	buf->type = MLX5_ALLOC_TYPE_ANON;
+	return 0;
 }
 
 void mlx5_free_buf(struct mlx5_buf *buf)
 {
-	ibv_dofork_range(buf->buf, buf->length);
-	free(buf->buf);
+	if (buf->length)
+		verbs_free_queue_buf(buf->buf, buf->length);
 }
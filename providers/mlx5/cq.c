@@ -99,6 +99,72 @@ static void *next_cqe_sw(struct mlx5_cq *cq)
 	return get_sw_cqe(cq, cq->cons_index);
 }
 
+static struct mlx5_cqe64 *get_cqe64(struct mlx5_cq *cq, uint32_t n)
+{
+	void *cqe = get_cqe(cq, n & cq->ibv_cq.cqe);
+
+	return (cq->cqe_sz == 64) ? cqe : cqe + 64;
+}
+
+/*
+ * A compressed CQE session starts with a title CQE whose byte_cnt holds
+ * the number of completions in the session.  Only the fields that differ
+ * between the completions are written, as arrays of eight mini CQEs: the
+ * first array in the slot after the title and the next ones every eight
+ * slots from there.  The session still takes one slot per completion, so
+ * rebuild each completion in its own slot from the title and the rest of
+ * the CQ code never has to know about compression.
+ *
+ * n is the index of the title, which must already be in SW ownership.
+ */
+static void mlx5_decompress_cqes(struct mlx5_cq *cq, uint32_t n)
+{
+	struct mlx5_mini_cqe8 mini[MLX5_MINI_CQE_ARRAY_SIZE];
+	struct mlx5_cqe64 title;
+	struct mlx5_cqe64 *cqe64;
+	struct mlx5_mini_cqe8 *mcqe;
+	uint32_t count;
+	uint16_t wqe_ctr;
+	uint32_t i;
+
+	/* The mini CQE arrays are only valid once the title is ours */
+	udma_from_device_barrier();
+
+	title = *get_cqe64(cq, n);
+	count = be32toh(title.byte_cnt);
+	wqe_ctr = be16toh(title.wqe_counter);
+	/* Keep the opcode, the CQEs we build are in the plain format */
+	title.op_own &= 0xf0;
+
+	memcpy(mini, get_cqe64(cq, n + 1), sizeof(mini));
+
+	for (i = 0; i < count; ++i) {
+		cqe64 = get_cqe64(cq, n + i);
+
+		/* Read the slot's array before the slot is overwritten */
+		if (i >= MLX5_MINI_CQE_ARRAY_SIZE &&
+		    !(i % MLX5_MINI_CQE_ARRAY_SIZE))
+			memcpy(mini, cqe64, sizeof(mini));
+		mcqe = &mini[i % MLX5_MINI_CQE_ARRAY_SIZE];
+
+		*cqe64 = title;
+		cqe64->byte_cnt = mcqe->byte_cnt;
+		if (cq->cqe_comp_format == MLX5DV_CQE_RES_FORMAT_HASH)
+			cqe64->rx_hash_res = mcqe->rx_hash_res;
+		else
+			cqe64->checksum = mcqe->checksum;
+		cqe64->wqe_counter = htobe16(wqe_ctr + i);
+		cqe64->op_own |= !!((n + i) & (cq->ibv_cq.cqe + 1));
+	}
+}
+
+static inline void mlx5_decompress_sw_cqe(struct mlx5_cq *cq, uint32_t n,
+					  struct mlx5_cqe64 *cqe64)
+{
+	if (unlikely(mlx5dv_get_cqe_format(cqe64) == MLX5_CQE_FORMAT_COMPRESSED))
+		mlx5_decompress_cqes(cq, n);
+}
+
 static void update_cons_index(struct mlx5_cq *cq)
 {
 	cq->dbrec[MLX5_CQ_SET_CI] = htobe32(cq->cons_index & 0xffffff);
@@ -488,6 +554,8 @@ static inline int mlx5_get_next_cqe(struct mlx5_cq *cq,
 	 */
 	udma_from_device_barrier();
 
+	mlx5_decompress_sw_cqe(cq, cq->cons_index - 1, cqe64);
+
 #ifdef MLX5_DEBUG
 	{
 		struct mlx5_context *mctx = to_mctx(cq->ibv_cq.context);
@@ -1380,9 +1448,12 @@ void __mlx5_cq_clean(struct mlx5_cq *cq, uint32_t rsn, struct mlx5_srq *srq)
 	 * about is already in RESET, so the new entries won't come
 	 * from our QP and therefore don't need to be checked.
 	 */
-	for (prod_index = cq->cons_index; get_sw_cqe(cq, prod_index); ++prod_index)
+	for (prod_index = cq->cons_index; get_sw_cqe(cq, prod_index); ++prod_index) {
 		if (prod_index == cq->cons_index + cq->ibv_cq.cqe)
 			break;
+		mlx5_decompress_sw_cqe(cq, prod_index,
+				       get_cqe64(cq, prod_index));
+	}
 
 	/*
 	 * Now sweep backwards through the CQ, removing CQ entries
@@ -1457,6 +1528,7 @@ void mlx5_cq_resize_copy_cqes(struct mlx5_cq *cq)
 	}
 
 	while ((scqe64->op_own >> 4) != MLX5_CQE_RESIZE_CQ) {
+		mlx5_decompress_sw_cqe(cq, i, scqe64);
 		dcqe = get_buf_cqe(cq->resize_buf, (i + 1) & (cq->resize_cqes - 1), dsize);
 		dcqe64 = dsize == 64 ? dcqe : dcqe + 64;
 		sw_own = sw_ownership_bit(i + 1, cq->resize_cqes);
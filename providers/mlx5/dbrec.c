@@ -38,6 +38,20 @@
 
 #include "mlx5.h"
 
+/*
+ * Doorbell records are carved out of page sized buffers.  The first
+ * record of every page is never handed out, it holds a pointer back to
+ * the page's bookkeeping so mlx5_free_db() finds it by masking the
+ * record's address instead of searching.  context->db_list only links
+ * the pages that still have free records, so allocation takes the first
+ * one without walking past full pages.  Both operations are O(1) and
+ * hold db_list_mutex for a few instructions only.
+ *
+ * One empty page is kept around so that a loop creating and destroying
+ * a single QP does not allocate and free a page every time;
+ * mlx5_free_db_pages() releases it when the context goes away.
+ */
+
 struct mlx5_db_page {
 	struct mlx5_db_page	       *prev, *next;
 	struct mlx5_buf			buf;
@@ -46,6 +60,26 @@ struct mlx5_db_page {
 	unsigned long			free[0];
 };
 
+static void link_page(struct mlx5_context *context, struct mlx5_db_page *page)
+{
+	page->prev = NULL;
+	page->next = context->db_list;
+	context->db_list = page;
+	if (page->next)
+		page->next->prev = page;
+}
+
+static void unlink_page(struct mlx5_context *context,
+			struct mlx5_db_page *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		context->db_list = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+}
+
 static struct mlx5_db_page *__add_page(struct mlx5_context *context)
 {
 	struct mlx5_db_page *page;
@@ -61,21 +95,21 @@ static struct mlx5_db_page *__add_page(struct mlx5_context *context)
 	if (!page)
 		return NULL;
 
-	if (mlx5_alloc_buf(&page->buf, ps, ps)) {
+	if (mlx5_alloc_buf(context->ibv_ctx.device, &page->buf, ps, ps)) {
 		free(page);
 		return NULL;
 	}
 
-	page->num_db  = pp;
+	/* Record 0 holds the back pointer */
+	*(struct mlx5_db_page **)page->buf.buf = page;
+
+	page->num_db  = pp - 1;
 	page->use_cnt = 0;
 	for (i = 0; i < nlong; ++i)
 		page->free[i] = ~0;
+	page->free[0] &= ~1UL;
 
-	page->prev = NULL;
-	page->next = context->db_list;
-	context->db_list = page;
-	if (page->next)
-		page->next->prev = page;
+	link_page(context, page);
 
 	return page;
 }
@@ -88,16 +122,15 @@ uint32_t *mlx5_alloc_dbrec(struct mlx5_context *context)
 
 	pthread_mutex_lock(&context->db_list_mutex);
 
-	for (page = context->db_list; page; page = page->next)
-		if (page->use_cnt < page->num_db)
-			goto found;
-
-	page = __add_page(context);
-	if (!page)
-		goto out;
+	page = context->db_list;
+	if (!page) {
+		page = __add_page(context);
+		if (!page)
+			goto out;
+	}
 
-found:
-	++page->use_cnt;
+	if (++page->use_cnt == page->num_db)
+		unlink_page(context, page);
 
 	for (i = 0; !page->free[i]; ++i)
 		/* nothing */;
@@ -119,30 +152,35 @@ void mlx5_free_db(struct mlx5_context *context, uint32_t *db)
 	uintptr_t ps = to_mdev(context->ibv_ctx.device)->page_size;
 	int i;
 
-	pthread_mutex_lock(&context->db_list_mutex);
+	if (!db)
+		return;
 
-	for (page = context->db_list; page; page = page->next)
-		if (((uintptr_t) db & ~(ps - 1)) == (uintptr_t) page->buf.buf)
-			break;
+	page = *(struct mlx5_db_page **)((uintptr_t) db & ~(ps - 1));
 
-	if (!page)
-		goto out;
+	pthread_mutex_lock(&context->db_list_mutex);
 
 	i = ((void *) db - page->buf.buf) / context->cache_line_size;
 	page->free[i / (8 * sizeof(long))] |= 1UL << (i % (8 * sizeof(long)));
 
-	if (!--page->use_cnt) {
-		if (page->prev)
-			page->prev->next = page->next;
-		else
-			context->db_list = page->next;
-		if (page->next)
-			page->next->prev = page->prev;
+	if (page->use_cnt-- == page->num_db)
+		link_page(context, page);
 
+	if (!page->use_cnt && (page->prev || page->next)) {
+		unlink_page(context, page);
 		mlx5_free_buf(&page->buf);
 		free(page);
 	}
 
-out:
 	pthread_mutex_unlock(&context->db_list_mutex);
 }
+
+void mlx5_free_db_pages(struct mlx5_context *context)
+{
+	struct mlx5_db_page *page;
+
+	while ((page = context->db_list)) {
+		context->db_list = page->next;
+		mlx5_free_buf(&page->buf);
+		free(page);
+	}
+}
@@ -204,6 +204,7 @@ struct mlx5_db_page;
 struct mlx5_spinlock {
 	pthread_spinlock_t		lock;
 	int				in_use;
+	int				need_lock;
 };
 
 struct mlx5_context {
@@ -313,6 +314,26 @@ enum {
 	MLX5_CQ_FLAGS_DV_OWNED = 1 << 5,
 };
 
+enum {
+	MLX5_CQE_FORMAT_COMPRESSED	= 0x3,
+	MLX5_MINI_CQE_ARRAY_SIZE	= 8,
+};
+
+/*
+ * Per completion part of a compressed CQE, the rest of the completion
+ * is taken from the session's title CQE.
+ */
+struct mlx5_mini_cqe8 {
+	union {
+		uint32_t	rx_hash_res;	/* MLX5DV_CQE_RES_FORMAT_HASH */
+		struct {			/* MLX5DV_CQE_RES_FORMAT_CSUM */
+			uint16_t	checksum;
+			uint16_t	stridx;
+		};
+	};
+	uint32_t	byte_cnt;
+};
+
 struct mlx5_cq {
 	/* ibv_cq should always be subset of ibv_cq_ex */
 	struct ibv_cq_ex		ibv_cq;
@@ -339,6 +360,7 @@ struct mlx5_cq {
 	struct mlx5_cqe64		*cqe64;
 	uint32_t			flags;
 	int			umr_opcode;
+	uint8_t				cqe_comp_format;
 };
 
 struct mlx5_srq {
@@ -419,6 +441,8 @@ struct mlx5_qp {
 	uint32_t			max_tso;
 	uint16_t			max_tso_header;
 	int                             rss_qp;
+	int (*post_send)(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
+			 struct ibv_send_wr **bad_wr);
 };
 
 struct mlx5_ah {
@@ -546,7 +570,8 @@ static inline struct mlx5_rwq *rsc_to_mrwq(struct mlx5_resource *rsc)
 	return (struct mlx5_rwq *)rsc;
 }
 
-int mlx5_alloc_buf(struct mlx5_buf *buf, size_t size, int page_size);
+int mlx5_alloc_buf(struct ibv_device *device, struct mlx5_buf *buf,
+		   size_t size, int page_size);
 void mlx5_free_buf(struct mlx5_buf *buf);
 int mlx5_alloc_buf_contig(struct mlx5_context *mctx, struct mlx5_buf *buf,
 			  size_t size, int page_size, const char *component);
@@ -564,6 +589,7 @@ int mlx5_use_huge(const char *key);
 
 uint32_t *mlx5_alloc_dbrec(struct mlx5_context *context);
 void mlx5_free_db(struct mlx5_context *context, uint32_t *db);
+void mlx5_free_db_pages(struct mlx5_context *context);
 
 int mlx5_query_device(struct ibv_context *context,
 		       struct ibv_device_attr *attr);
@@ -631,6 +657,7 @@ int mlx5_modify_qp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
 		   int attr_mask);
 int mlx5_destroy_qp(struct ibv_qp *qp);
 void mlx5_init_qp_indices(struct mlx5_qp *qp);
+void mlx5_qp_fill_pfns(struct mlx5_qp *qp, enum ibv_qp_type qp_type);
 void mlx5_init_rwq_indices(struct mlx5_rwq *rwq);
 int mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 			  struct ibv_send_wr **bad_wr);
@@ -690,13 +717,14 @@ static inline void *mlx5_find_uidx(struct mlx5_context *ctx, uint32_t uidx)
 
 static inline int mlx5_spin_lock(struct mlx5_spinlock *lock)
 {
-	if (!mlx5_single_threaded)
+	if (lock->need_lock)
 		return pthread_spin_lock(&lock->lock);
 
 	if (unlikely(lock->in_use)) {
 		fprintf(stderr, "*** ERROR: multithreading vilation ***\n"
 			"You are running a multithreaded application but\n"
-			"you set MLX5_SINGLE_THREADED=1. Please unset it.\n");
+			"you set MLX5_SINGLE_THREADED=1 or\n"
+			"RDMAV_SINGLE_THREADED=1. Please unset it.\n");
 		abort();
 	} else {
 		lock->in_use = 1;
@@ -712,7 +740,7 @@ static inline int mlx5_spin_lock(struct mlx5_spinlock *lock)
 
 static inline int mlx5_spin_unlock(struct mlx5_spinlock *lock)
 {
-	if (!mlx5_single_threaded)
+	if (lock->need_lock)
 		return pthread_spin_unlock(&lock->lock);
 
 	lock->in_use = 0;
@@ -720,12 +748,25 @@ static inline int mlx5_spin_unlock(struct mlx5_spinlock *lock)
 	return 0;
 }
 
-static inline int mlx5_spinlock_init(struct mlx5_spinlock *lock)
+static inline int mlx5_spinlock_init(struct mlx5_spinlock *lock, int need_lock)
 {
 	lock->in_use = 0;
+	lock->need_lock = need_lock;
 	return pthread_spin_init(&lock->lock, PTHREAD_PROCESS_PRIVATE);
 }
 
+/*
+ * Locks of QPs, SRQs, WQs and CQs.  RDMAV_SINGLE_THREADED drops only
+ * these; the locks shared by the whole context (BlueFlame registers,
+ * lock32) are dropped by MLX5_SINGLE_THREADED alone.
+ */
+static inline int mlx5_obj_spinlock_init(struct mlx5_spinlock *lock,
+					 struct ibv_context *context)
+{
+	return mlx5_spinlock_init(lock, !mlx5_single_threaded &&
+				  !verbs_single_threaded(context));
+}
+
 static inline int mlx5_spinlock_destroy(struct mlx5_spinlock *lock)
 {
 	return pthread_spin_destroy(&lock->lock);
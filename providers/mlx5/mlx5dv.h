@@ -282,9 +282,12 @@ struct mlx5_err_cqe {
 };
 
 struct mlx5_cqe64 {
-	uint8_t		rsvd0[17];
+	uint8_t		rsvd0[12];
+	uint32_t	rx_hash_res;
+	uint8_t		rx_hash_type;
 	uint8_t		ml_path;
-	uint8_t		rsvd20[4];
+	uint8_t		rsvd18[2];
+	uint16_t	checksum;
 	uint16_t	slid;
 	uint32_t	flags_rqpn;
 	uint8_t		hds_ip_ext;
@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <util/compiler.h>
+#include <util/mmio.h>
 
 #include "mlx5.h"
 #include "doorbell.h"
@@ -240,14 +241,9 @@ static void mlx5_bf_copy(unsigned long long *dst, unsigned long long *src,
 			 unsigned bytecnt, struct mlx5_qp *qp)
 {
 	while (bytecnt > 0) {
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
-		*dst++ = *src++;
+		mmio_wc_copy64(dst, src);
+		dst += 8;
+		src += 8;
 		bytecnt -= 8 * sizeof(unsigned long long);
 		if (unlikely(src == qp->sq.qend))
 			src = qp->sq_start;
@@ -610,7 +606,12 @@ static inline int set_tso_eth_seg(void **seg, struct ibv_send_wr *wr,
 }
 
 static inline int _mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
-				  struct ibv_send_wr **bad_wr)
+				  struct ibv_send_wr **bad_wr,
+				  enum ibv_qp_type qpt, int use_sig)
+				  ALWAYS_INLINE;
+static inline int _mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
+				  struct ibv_send_wr **bad_wr,
+				  enum ibv_qp_type qpt, int use_sig)
 {
 	struct mlx5_context *ctx;
 	struct mlx5_qp *qp = to_mqp(ibqp);
@@ -682,7 +683,7 @@ static inline int _mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 		seg += sizeof *ctrl;
 		size = sizeof *ctrl / 16;
 
-		switch (ibqp->qp_type) {
+		switch (qpt) {
 		case IBV_QPT_XRC_SEND:
 			if (unlikely(wr->opcode != IBV_WR_BIND_MW &&
 				     wr->opcode != IBV_WR_LOCAL_INV)) {
@@ -903,7 +904,7 @@ static inline int _mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 					       (opmod << 24));
 		ctrl->qpn_ds = htobe32(size | (ibqp->qp_num << 8));
 
-		if (unlikely(qp->wq_sig))
+		if (unlikely(use_sig))
 			ctrl->signature = wq_sig(ctrl);
 
 		qp->sq.wrid[idx] = wr->wr_id;
@@ -966,6 +967,56 @@ out:
 	return err;
 }
 
+/*
+ * RC, UD and raw packet QPs post through a copy of _mlx5_post_send()
+ * built for their type, so the per-WR switch on the QP type folds away.
+ * Every other QP type, and any QP with WQE signatures (a debug option),
+ * goes through the generic copy.  Each copy costs about 1.5-2KB of text,
+ * so only the types latency-sensitive senders use get one.  The choice
+ * is made once at create time by mlx5_qp_fill_pfns().
+ */
+#define POST_SEND_FN(type)						\
+static int mlx5_post_send_##type(struct ibv_qp *ibqp,			\
+				 struct ibv_send_wr *wr,		\
+				 struct ibv_send_wr **bad_wr)		\
+{									\
+	return _mlx5_post_send(ibqp, wr, bad_wr, IBV_QPT_##type, 0);	\
+}
+
+POST_SEND_FN(RC)
+POST_SEND_FN(UD)
+POST_SEND_FN(RAW_PACKET)
+
+static int mlx5_post_send_generic(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
+				  struct ibv_send_wr **bad_wr)
+{
+	return _mlx5_post_send(ibqp, wr, bad_wr, ibqp->qp_type,
+			       to_mqp(ibqp)->wq_sig);
+}
+
+void mlx5_qp_fill_pfns(struct mlx5_qp *qp, enum ibv_qp_type qp_type)
+{
+	if (qp->wq_sig) {
+		qp->post_send = mlx5_post_send_generic;
+		return;
+	}
+
+	switch (qp_type) {
+	case IBV_QPT_RC:
+		qp->post_send = mlx5_post_send_RC;
+		break;
+	case IBV_QPT_UD:
+		qp->post_send = mlx5_post_send_UD;
+		break;
+	case IBV_QPT_RAW_PACKET:
+		qp->post_send = mlx5_post_send_RAW_PACKET;
+		break;
+	default:
+		qp->post_send = mlx5_post_send_generic;
+		break;
+	}
+}
+
 int mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 		   struct ibv_send_wr **bad_wr)
 {
@@ -984,7 +1035,7 @@ int mlx5_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	}
 #endif
 
-	return _mlx5_post_send(ibqp, wr, bad_wr);
+	return to_mqp(ibqp)->post_send(ibqp, wr, bad_wr);
 }
 
 int mlx5_bind_mw(struct ibv_qp *qp, struct ibv_mw *mw,
@@ -1025,7 +1076,7 @@ int mlx5_bind_mw(struct ibv_qp *qp, struct ibv_mw *mw,
 	wr.bind_mw.mw = mw;
 	wr.bind_mw.rkey = ibv_inc_rkey(mw->rkey);
 
-	ret = _mlx5_post_send(qp, &wr, &bad_wr);
+	ret = to_mqp(qp)->post_send(qp, &wr, &bad_wr);
 	if (ret)
 		return ret;
 
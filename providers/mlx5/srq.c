@@ -182,14 +182,12 @@ int mlx5_alloc_srq_buf(struct ibv_context *context, struct mlx5_srq *srq)
 
 	buf_size = srq->max * size;
 
-	if (mlx5_alloc_buf(&srq->buf, buf_size,
+	if (mlx5_alloc_buf(context->device, &srq->buf, buf_size,
 			   to_mdev(context->device)->page_size)) {
 		free(srq->wrid);
 		return -1;
 	}
 
-	memset(srq->buf.buf, 0, buf_size);
-
 	/*
 	 * Now initialize the SRQ buffer so that all of the WQEs are
 	 * linked into the list of free WQEs.
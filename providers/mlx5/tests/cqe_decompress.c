@@ -0,0 +1,113 @@
+/* Licensed under the OpenIB.org BSD license (FreeBSD Variant) - See COPYING.md
+ */
+
+/*
+ * Feeds mlx5_decompress_cqes() synthetic compressed CQE sessions and checks
+ * every expanded CQE against the title CQE and its mini CQE.  Sessions start
+ * at various ring positions so that both the mini CQE array layout and the
+ * ownership bit are checked across a wrap of the ring.
+ */
+
+#include "../cq.c"
+
+#define RING_SIZE 64
+
+static int failed;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: cqe_sz %d start %u "	\
+				"count %u: %s\n", __FILE__, __LINE__,	\
+				cqe_sz, start, count, #cond);		\
+			failed = 1;					\
+			goto out;					\
+		}							\
+	} while (0)
+
+static void check_session(int cqe_sz, uint32_t start, uint32_t count,
+			  int format)
+{
+	struct mlx5_cq cq = {};
+	struct mlx5_buf buf = {};
+	struct mlx5_mini_cqe8 *mini;
+	struct mlx5_cqe64 *title, *cqe;
+	uint32_t i, slot;
+
+	buf.buf = aligned_alloc(64, RING_SIZE * cqe_sz);
+	if (!buf.buf) {
+		failed = 1;
+		return;
+	}
+	memset(buf.buf, 0xa5, RING_SIZE * cqe_sz);
+	cq.active_buf = &buf;
+	cq.cqe_sz = cqe_sz;
+	cq.ibv_cq.cqe = RING_SIZE - 1;
+	cq.cqe_comp_format = format;
+
+	title = get_cqe64(&cq, start);
+	memset(title, 0, sizeof(*title));
+	title->sop_drop_qpn = htobe32(0x123456);
+	title->srqn_uidx = htobe32(77);
+	title->byte_cnt = htobe32(count);
+	title->wqe_counter = htobe16(0xfffe);
+	title->op_own = MLX5_CQE_RESP_SEND << 4 |
+			MLX5_CQE_FORMAT_COMPRESSED << 2 |
+			!!(start & RING_SIZE);
+
+	/* Eight mini CQEs per CQE slot, the first array right after the title */
+	for (i = 0; i < count; i++) {
+		slot = i < 8 ? start + 1 : start + (i & ~7u);
+		mini = (struct mlx5_mini_cqe8 *)get_cqe64(&cq, slot) + i % 8;
+		mini->byte_cnt = htobe32(1000 + i);
+		mini->rx_hash_res = htobe32(0xabc00000 + i);
+	}
+
+	mlx5_decompress_cqes(&cq, start);
+
+	for (i = 0; i < count; i++) {
+		cqe = get_cqe64(&cq, start + i);
+		CHECK(get_sw_cqe(&cq, start + i));
+		CHECK(mlx5dv_get_cqe_format(cqe) == 0);
+		CHECK(mlx5dv_get_cqe_opcode(cqe) == MLX5_CQE_RESP_SEND);
+		CHECK(be32toh(cqe->byte_cnt) == 1000 + i);
+		CHECK(be16toh(cqe->wqe_counter) == (uint16_t)(0xfffe + i));
+		CHECK((be32toh(cqe->sop_drop_qpn) & 0xffffff) == 0x123456);
+		CHECK(be32toh(cqe->srqn_uidx) == 77);
+		if (format == MLX5DV_CQE_RES_FORMAT_HASH)
+			CHECK(be32toh(cqe->rx_hash_res) == 0xabc00000 + i);
+		else
+			CHECK(be16toh(cqe->checksum) == 0xabc0);
+	}
+
+	/* Nothing past the session may look like a software owned CQE */
+	cqe = get_cqe64(&cq, start + count);
+	CHECK(!get_sw_cqe(&cq, start + count) ||
+	      mlx5dv_get_cqe_format(cqe) != 0);
+out:
+	free(buf.buf);
+}
+
+int main(void)
+{
+	static const int formats[] = {
+		MLX5DV_CQE_RES_FORMAT_HASH, MLX5DV_CQE_RES_FORMAT_CSUM
+	};
+	int i, format, cqe_sz;
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		format = formats[i];
+		for (cqe_sz = 64; cqe_sz <= 128; cqe_sz += 64) {
+			check_session(cqe_sz, 0, 1, format);
+			check_session(cqe_sz, 0, 8, format);
+			check_session(cqe_sz, 3, 9, format);
+			/* wraps the ring */
+			check_session(cqe_sz, 50, 30, format);
+			/* second pass over the ring, a full session */
+			check_session(cqe_sz, RING_SIZE + 60, RING_SIZE, format);
+		}
+	}
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
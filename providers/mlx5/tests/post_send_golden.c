@@ -0,0 +1,282 @@
+/* Licensed under the OpenIB.org BSD license (FreeBSD Variant) - See COPYING.md
+ */
+
+/*
+ * Posts the same work requests through each QP type specialized copy of
+ * post_send and through mlx5_post_send_generic(), on QPs whose send queue,
+ * doorbell record and BlueFlame register are plain memory, and checks that
+ * both copies leave identical bytes and queue state behind.  The send queue
+ * starts three WQEs before its end, so every case also crosses the wrap.
+ */
+
+#include "../qp.c"
+
+#define WQE_CNT 64
+#define REG_SIZE 4096
+
+struct env {
+	struct mlx5_context	ctx;
+	struct mlx5_cq		cq;
+	struct mlx5_qp		qp;
+	struct mlx5_bf		bf;
+	uint32_t		db[2];
+	uint64_t		*wrid;
+	unsigned int		*wqe_head;
+	char			*sq;
+	char			*reg;
+};
+
+typedef int (*post_send_fn)(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
+			    struct ibv_send_wr **bad_wr);
+
+static int env_init(struct env *e, enum ibv_qp_type type)
+{
+	memset(e, 0, sizeof(*e));
+	e->sq = aligned_alloc(REG_SIZE, WQE_CNT * MLX5_SEND_WQE_BB);
+	e->reg = aligned_alloc(REG_SIZE, REG_SIZE);
+	e->wrid = calloc(WQE_CNT, sizeof(*e->wrid));
+	e->wqe_head = calloc(WQE_CNT, sizeof(*e->wqe_head));
+	if (!e->sq || !e->reg || !e->wrid || !e->wqe_head)
+		return -1;
+
+	memset(e->sq, 0xa5, WQE_CNT * MLX5_SEND_WQE_BB);
+	memset(e->reg, 0, REG_SIZE);
+
+	e->ctx.prefer_bf = 1;
+	e->bf.reg = e->reg;
+	e->bf.buf_size = 256;
+	e->bf.uuarn = 1;
+
+	e->qp.ibv_qp = &e->qp.verbs_qp.qp;
+	e->qp.ibv_qp->context = &e->ctx.ibv_ctx;
+	e->qp.ibv_qp->qp_type = type;
+	e->qp.ibv_qp->qp_num = 0x1234;
+	e->qp.ibv_qp->send_cq = ibv_cq_ex_to_cq(&e->cq.ibv_cq);
+	e->qp.ibv_qp->state = IBV_QPS_RTS;
+	e->qp.sq_start = e->sq;
+	e->qp.bf = &e->bf;
+	e->qp.db = e->db;
+	e->qp.max_inline_data = 256;
+	e->qp.atomics_enabled = 1;
+	e->qp.qp_cap_cache = MLX5_CSUM_SUPPORT_RAW_OVER_ETH;
+	e->qp.max_tso = 8192;
+	e->qp.max_tso_header = 128;
+	e->qp.sq.wrid = e->wrid;
+	e->qp.sq.wqe_head = e->wqe_head;
+	e->qp.sq.wqe_cnt = WQE_CNT;
+	e->qp.sq.max_post = WQE_CNT;
+	e->qp.sq.max_gs = 8;
+	e->qp.sq.qend = e->sq + WQE_CNT * MLX5_SEND_WQE_BB;
+	e->qp.sq.cur_post = WQE_CNT - 3;
+	e->qp.sq.head = e->qp.sq.tail = WQE_CNT - 3;
+	e->qp.sq_signal_bits = MLX5_WQE_CTRL_CQ_UPDATE;
+	return 0;
+}
+
+static void env_cleanup(struct env *e)
+{
+	free(e->sq);
+	free(e->reg);
+	free(e->wrid);
+	free(e->wqe_head);
+}
+
+/* Returns 1 if the copies differ, 0 if they match, -1 on setup failure */
+static int compare(enum ibv_qp_type type, struct ibv_send_wr *wr,
+		   post_send_fn fn)
+{
+	struct ibv_send_wr *bad_a = NULL, *bad_b = NULL;
+	struct env a = {}, b = {};
+	int ret_a, ret_b, differ = -1;
+
+	if (env_init(&a, type) || env_init(&b, type))
+		goto out;
+
+	ret_a = fn(a.qp.ibv_qp, wr, &bad_a);
+	ret_b = mlx5_post_send_generic(b.qp.ibv_qp, wr, &bad_b);
+
+	differ = ret_a != ret_b || bad_a != bad_b ||
+		 memcmp(a.sq, b.sq, WQE_CNT * MLX5_SEND_WQE_BB) ||
+		 memcmp(a.reg, b.reg, REG_SIZE) ||
+		 memcmp(a.db, b.db, sizeof(a.db)) ||
+		 memcmp(a.wrid, b.wrid, WQE_CNT * sizeof(*a.wrid)) ||
+		 memcmp(a.wqe_head, b.wqe_head,
+			WQE_CNT * sizeof(*a.wqe_head)) ||
+		 a.qp.sq.cur_post != b.qp.sq.cur_post ||
+		 a.qp.sq.head != b.qp.sq.head;
+
+	/* A successful post that rang no doorbell compared nothing */
+	if (!ret_a && !a.db[MLX5_SND_DBR])
+		differ = 1;
+out:
+	env_cleanup(&a);
+	env_cleanup(&b);
+	return differ;
+}
+
+static int failed;
+
+static void check(enum ibv_qp_type type, struct ibv_send_wr *wr,
+		  post_send_fn fn, const char *name)
+{
+	if (compare(type, wr, fn)) {
+		fprintf(stderr, "%s: specialized post_send differs\n", name);
+		failed = 1;
+	}
+}
+
+static char payload[512];
+static char eth[64];
+
+static void check_rc(void)
+{
+	struct ibv_send_wr wr[4];
+	struct ibv_sge sge[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		sge[i].addr = (uintptr_t)payload + i * 40;
+		sge[i].length = 40 + i;
+		sge[i].lkey = 0x100 + i;
+	}
+
+	memset(wr, 0, sizeof(wr));
+	wr[0].wr_id = 1;
+	wr[0].opcode = IBV_WR_SEND;
+	wr[0].sg_list = sge;
+	wr[0].num_sge = 3;
+	wr[0].send_flags = IBV_SEND_SIGNALED;
+	check(IBV_QPT_RC, wr, mlx5_post_send_RC, "RC send 3 sge");
+
+	wr[0].send_flags = IBV_SEND_INLINE;
+	check(IBV_QPT_RC, wr, mlx5_post_send_RC, "RC send inline");
+
+	wr[0].opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+	wr[0].imm_data = htobe32(5);
+	wr[0].wr.rdma.remote_addr = 0x1000;
+	wr[0].wr.rdma.rkey = 0x77;
+	wr[0].send_flags = IBV_SEND_FENCE | IBV_SEND_SOLICITED;
+	wr[0].next = &wr[1];
+	wr[1] = wr[0];
+	wr[1].opcode = IBV_WR_RDMA_READ;
+	wr[1].send_flags = 0;
+	wr[1].next = &wr[2];
+	wr[2] = wr[0];
+	wr[2].opcode = IBV_WR_ATOMIC_FETCH_AND_ADD;
+	wr[2].wr.atomic.remote_addr = 0x2000;
+	wr[2].wr.atomic.rkey = 0x78;
+	wr[2].wr.atomic.compare_add = 3;
+	wr[2].num_sge = 1;
+	wr[2].next = &wr[3];
+	wr[3] = wr[0];
+	wr[3].opcode = IBV_WR_SEND_WITH_INV;
+	wr[3].imm_data = htobe32(0x55);
+	wr[3].next = NULL;
+	check(IBV_QPT_RC, wr, mlx5_post_send_RC,
+	      "RC write_imm, read, fetch_add, send_inv chain");
+
+	wr[0].num_sge = 9;
+	wr[0].next = NULL;
+	check(IBV_QPT_RC, wr, mlx5_post_send_RC, "RC too many sge");
+
+	wr[0].opcode = 99;
+	check(IBV_QPT_RC, wr, mlx5_post_send_RC, "RC bad opcode");
+}
+
+static void check_ud(void)
+{
+	struct ibv_send_wr wr[2];
+	struct ibv_sge sge[2];
+	struct mlx5_ah ah = {};
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		sge[i].addr = (uintptr_t)payload + i * 40;
+		sge[i].length = 40 + i;
+		sge[i].lkey = 0x100 + i;
+	}
+	ah.av.dqp_dct = htobe32(MLX5_EXTENDED_UD_AV);
+	ah.av.rlid = htobe16(7);
+
+	memset(wr, 0, sizeof(wr));
+	wr[0].wr_id = 2;
+	wr[0].opcode = IBV_WR_SEND_WITH_IMM;
+	wr[0].sg_list = sge;
+	wr[0].num_sge = 2;
+	wr[0].send_flags = IBV_SEND_SIGNALED;
+	wr[0].wr.ud.ah = &ah.ibv_ah;
+	wr[0].wr.ud.remote_qpn = 0x42;
+	wr[0].wr.ud.remote_qkey = 0x11111111;
+	check(IBV_QPT_UD, wr, mlx5_post_send_UD, "UD send_imm 2 sge");
+
+	wr[0].send_flags = IBV_SEND_INLINE;
+	check(IBV_QPT_UD, wr, mlx5_post_send_UD, "UD send inline");
+
+	wr[0].next = &wr[1];
+	wr[1] = wr[0];
+	wr[1].opcode = IBV_WR_SEND;
+	wr[1].next = NULL;
+	check(IBV_QPT_UD, wr, mlx5_post_send_UD, "UD chain of 2");
+
+	/* Negative control: the RC copy must not build a UD WQE */
+	memset(wr, 0, sizeof(wr));
+	wr[0].opcode = IBV_WR_SEND;
+	wr[0].sg_list = sge;
+	wr[0].num_sge = 1;
+	wr[0].wr.ud.ah = &ah.ibv_ah;
+	if (compare(IBV_QPT_UD, wr, mlx5_post_send_RC) != 1) {
+		fprintf(stderr, "RC copy on a UD QP matched, "
+			"the comparison is not effective\n");
+		failed = 1;
+	}
+}
+
+static void check_raw_packet(void)
+{
+	struct ibv_send_wr wr;
+	struct ibv_sge sge;
+
+	sge.addr = (uintptr_t)eth;
+	sge.length = sizeof(eth);
+	sge.lkey = 0x200;
+
+	memset(&wr, 0, sizeof(wr));
+	wr.wr_id = 3;
+	wr.opcode = IBV_WR_SEND;
+	wr.sg_list = &sge;
+	wr.num_sge = 1;
+	wr.send_flags = IBV_SEND_SIGNALED | IBV_SEND_IP_CSUM;
+	check(IBV_QPT_RAW_PACKET, &wr, mlx5_post_send_RAW_PACKET,
+	      "RAW_PACKET send csum");
+
+	wr.send_flags = IBV_SEND_INLINE;
+	check(IBV_QPT_RAW_PACKET, &wr, mlx5_post_send_RAW_PACKET,
+	      "RAW_PACKET send inline");
+
+	wr.opcode = IBV_WR_TSO;
+	wr.send_flags = 0;
+	wr.tso.hdr = eth;
+	wr.tso.hdr_sz = 54;
+	wr.tso.mss = 1000;
+	sge.addr = (uintptr_t)payload;
+	sge.length = 400;
+	check(IBV_QPT_RAW_PACKET, &wr, mlx5_post_send_RAW_PACKET,
+	      "RAW_PACKET tso");
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = i * 7;
+	for (i = 0; i < sizeof(eth); i++)
+		eth[i] = 0x40 + i;
+
+	check_rc();
+	check_ud();
+	check_raw_packet();
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
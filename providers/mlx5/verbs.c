@@ -390,7 +390,7 @@ static struct ibv_cq_ex *create_cq(struct ibv_context *context,
 	memset(&cmd, 0, sizeof cmd);
 	cq->cons_index = 0;
 
-	if (mlx5_spinlock_init(&cq->lock))
+	if (mlx5_obj_spinlock_init(&cq->lock, context))
 		goto err;
 
 	ncqe = align_queue_size(cq_attr->cqe + 1);
@@ -445,6 +445,7 @@ static struct ibv_cq_ex *create_cq(struct ibv_context *context,
 			     mctx->cqe_comp_caps.supported_format)) {
 				cmd.cqe_comp_en = 1;
 				cmd.cqe_comp_res_format = mlx5cq_attr->cqe_comp_res_format;
+				cq->cqe_comp_format = mlx5cq_attr->cqe_comp_res_format;
 			} else {
 				mlx5_dbg(fp, MLX5_DBG_CQ, "CQE Compression is not supported\n");
 				errno = EINVAL;
@@ -631,7 +632,8 @@ struct ibv_srq *mlx5_create_srq(struct ibv_pd *pd,
 	ibsrq = &srq->vsrq.srq;
 
 	memset(&cmd, 0, sizeof cmd);
-	if (mlx5_spinlock_init(&srq->lock)) {
+	/* mlx5_poll_cq() frees SRQ WQEs, so this lock is always kept */
+	if (mlx5_spinlock_init(&srq->lock, !mlx5_single_threaded)) {
 		fprintf(stderr, "%s-%d:\n", __func__, __LINE__);
 		goto err;
 	}
@@ -1260,6 +1262,9 @@ static struct ibv_qp *create_qp(struct ibv_context *context,
 	memset(&resp, 0, sizeof(resp));
 	memset(&resp_ex, 0, sizeof(resp_ex));
 
+	qp->wq_sig = qp_sig_enabled();
+	mlx5_qp_fill_pfns(qp, attr->qp_type);
+
 	if (attr->comp_mask & IBV_QP_INIT_ATTR_RX_HASH) {
 		ret = mlx5_cmd_create_rss_qp(context, attr, qp);
 		if (ret)
@@ -1268,7 +1273,6 @@ static struct ibv_qp *create_qp(struct ibv_context *context,
 		return ibqp;
 	}
 
-	qp->wq_sig = qp_sig_enabled();
 	if (qp->wq_sig)
 		cmd.flags |= MLX5_QP_FLAG_SIGNATURE;
 
@@ -1307,8 +1311,8 @@ static struct ibv_qp *create_qp(struct ibv_context *context,
 
 	mlx5_init_qp_indices(qp);
 
-	if (mlx5_spinlock_init(&qp->sq.lock) ||
-	    mlx5_spinlock_init(&qp->rq.lock))
+	if (mlx5_obj_spinlock_init(&qp->sq.lock, context) ||
+	    mlx5_obj_spinlock_init(&qp->rq.lock, context))
 		goto err_free_qp_buf;
 
 	qp->db = mlx5_alloc_dbrec(ctx);
@@ -1814,7 +1818,7 @@ mlx5_create_xrc_srq(struct ibv_context *context,
 	memset(&cmd, 0, sizeof(cmd));
 	memset(&resp, 0, sizeof(resp));
 
-	if (mlx5_spinlock_init(&msrq->lock)) {
+	if (mlx5_obj_spinlock_init(&msrq->lock, context)) {
 		fprintf(stderr, "%s-%d:\n", __func__, __LINE__);
 		goto err;
 	}
@@ -2065,7 +2069,7 @@ struct ibv_wq *mlx5_create_wq(struct ibv_context *context,
 
 	mlx5_init_rwq_indices(rwq);
 
-	if (mlx5_spinlock_init(&rwq->rq.lock))
+	if (mlx5_obj_spinlock_init(&rwq->rq.lock, context))
 		goto err_free_rwq_buf;
 
 	rwq->db = mlx5_alloc_dbrec(ctx);
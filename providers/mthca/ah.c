@@ -56,7 +56,8 @@ static struct mthca_ah_page *__add_page(struct mthca_pd *pd, int page_size, int
 	if (!page)
 		return NULL;
 
-	if (mthca_alloc_buf(&page->buf, page_size, page_size)) {
+	if (mthca_alloc_buf(pd->ibv_pd.context->device, &page->buf,
+			    page_size, page_size)) {
 		free(page);
 		return NULL;
 	}
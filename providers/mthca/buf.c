@@ -33,30 +33,22 @@
 #include <config.h>
 
 #include <stdlib.h>
-#include <sys/mman.h>
 #include <errno.h>
 
 #include "mthca.h"
 
-int mthca_alloc_buf(struct mthca_buf *buf, size_t size, int page_size)
+int mthca_alloc_buf(struct ibv_device *device, struct mthca_buf *buf,
+		    size_t size, int page_size)
 {
-	int ret;
-
 	buf->length = align(size, page_size);
-	buf->buf = mmap(NULL, buf->length, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (buf->buf == MAP_FAILED)
+	buf->buf = verbs_alloc_queue_buf(device, buf->length);
+	if (!buf->buf)
 		return errno;
 
-	ret = ibv_dontfork_range(buf->buf, size);
-	if (ret)
-		munmap(buf->buf, buf->length);
-
-	return ret;
+	return 0;
 }
 
 void mthca_free_buf(struct mthca_buf *buf)
 {
-	ibv_dofork_range(buf->buf, buf->length);
-	munmap(buf->buf, buf->length);
+	verbs_free_queue_buf(buf->buf, buf->length);
 }
@@ -463,7 +463,7 @@ int mthca_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 	int err = CQ_OK;
 	int freed = 0;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	for (npolled = 0; npolled < ne; ++npolled) {
 		err = mthca_poll_one(cq, &qp, &freed, wc + npolled);
@@ -476,7 +476,7 @@ int mthca_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 		update_cons_index(cq, freed);
 	}
 
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return err == CQ_POLL_ERR ? err : npolled;
 }
@@ -590,9 +590,9 @@ void __mthca_cq_clean(struct mthca_cq *cq, uint32_t qpn, struct mthca_srq *srq)
 
 void mthca_cq_clean(struct mthca_cq *cq, uint32_t qpn, struct mthca_srq *srq)
 {
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	__mthca_cq_clean(cq, qpn, srq);
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 }
 
 void mthca_cq_resize_copy_cqes(struct mthca_cq *cq, void *buf, int old_cqe)
@@ -620,8 +620,9 @@ int mthca_alloc_cq_buf(struct mthca_device *dev, struct mthca_buf *buf, int nent
 {
 	int i;
 
-	if (mthca_alloc_buf(buf, align(nent * MTHCA_CQ_ENTRY_SIZE, dev->page_size),
-		    dev->page_size))
+	if (mthca_alloc_buf(&dev->ibv_dev.device, buf,
+			    align(nent * MTHCA_CQ_ENTRY_SIZE, dev->page_size),
+			    dev->page_size))
 		return -1;
 
 	for (i = 0; i < nent; ++i)
@@ -48,6 +48,7 @@ struct mthca_db_page {
 };
 
 struct mthca_db_table {
+	struct ibv_device   *device;
 	int 	       	     npages;
 	int 	       	     max_group1;
 	int 	       	     min_group2;
@@ -98,7 +99,7 @@ int mthca_alloc_db(struct mthca_db_table *db_tab, enum mthca_db_type type,
 		goto out;
 	}
 
-	if (mthca_alloc_buf(&db_tab->page[i].db_rec,
+	if (mthca_alloc_buf(db_tab->device, &db_tab->page[i].db_rec,
 			    MTHCA_DB_REC_PAGE_SIZE,
 			    MTHCA_DB_REC_PAGE_SIZE)) {
 		ret = -1;
@@ -166,7 +167,8 @@ void mthca_free_db(struct mthca_db_table *db_tab, enum mthca_db_type type, int d
 	pthread_mutex_unlock(&db_tab->mutex);
 }
 
-struct mthca_db_table *mthca_alloc_db_tab(int uarc_size)
+struct mthca_db_table *mthca_alloc_db_tab(struct ibv_device *device,
+					  int uarc_size)
 {
 	struct mthca_db_table *db_tab;
 	int npages;
@@ -178,6 +180,7 @@ struct mthca_db_table *mthca_alloc_db_tab(int uarc_size)
 
 	pthread_mutex_init(&db_tab->mutex, NULL);
 
+	db_tab->device     = device;
 	db_tab->npages     = npages;
 	db_tab->max_group1 = 0;
 	db_tab->min_group2 = npages - 1;
@@ -147,7 +147,7 @@ static struct ibv_context *mthca_alloc_context(struct ibv_device *ibdev, int cmd
 	context->ibv_ctx.device = ibdev;
 
 	if (mthca_is_memfree(&context->ibv_ctx)) {
-		context->db_tab = mthca_alloc_db_tab(resp.uarc_size);
+		context->db_tab = mthca_alloc_db_tab(ibdev, resp.uarc_size);
 		if (!context->db_tab)
 			goto err_free;
 	} else
@@ -260,7 +260,7 @@ found:
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void mthca_register_driver(void)
+PROVIDER_DRIVER(mthca)
 {
 	verbs_register_driver("mthca", mthca_driver_init);
 }
@@ -127,7 +127,7 @@ struct mthca_pd {
 struct mthca_cq {
 	struct ibv_cq  	   ibv_cq;
 	struct mthca_buf   buf;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	struct ibv_mr  	  *mr;
 	uint32_t       	   cqn;
 	uint32_t       	   cons_index;
@@ -144,7 +144,7 @@ struct mthca_srq {
 	struct ibv_srq     ibv_srq;
 	struct mthca_buf   buf;
 	void           	  *last;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	struct ibv_mr 	  *mr;
 	uint64_t      	  *wrid;
 	uint32_t       	   srqn;
@@ -162,7 +162,7 @@ struct mthca_srq {
 };
 
 struct mthca_wq {
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	int            	   max;
 	unsigned       	   next_ind;
 	unsigned       	   last_comp;
@@ -264,14 +264,16 @@ static inline int mthca_is_memfree(struct ibv_context *ibctx)
 	return to_mdev(ibctx->device)->hca_type == MTHCA_ARBEL;
 }
 
-int mthca_alloc_buf(struct mthca_buf *buf, size_t size, int page_size);
+int mthca_alloc_buf(struct ibv_device *device, struct mthca_buf *buf,
+		    size_t size, int page_size);
 void mthca_free_buf(struct mthca_buf *buf);
 
 int mthca_alloc_db(struct mthca_db_table *db_tab, enum mthca_db_type type,
 		   uint32_t **db);
 void mthca_set_db_qn(uint32_t *db, enum mthca_db_type type, uint32_t qn);
 void mthca_free_db(struct mthca_db_table *db_tab, enum mthca_db_type type, int db_index);
-struct mthca_db_table *mthca_alloc_db_tab(int uarc_size);
+struct mthca_db_table *mthca_alloc_db_tab(struct ibv_device *device,
+					  int uarc_size);
 void mthca_free_db_tab(struct mthca_db_table *db_tab);
 
 int mthca_query_device(struct ibv_context *context,
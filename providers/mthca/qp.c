@@ -90,9 +90,9 @@ static inline int wq_overflow(struct mthca_wq *wq, int nreq, struct mthca_cq *cq
 	if (cur + nreq < wq->max)
 		return 0;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	cur = wq->head - wq->tail;
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return cur + nreq >= wq->max;
 }
@@ -111,7 +111,7 @@ int mthca_tavor_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	uint32_t uninitialized_var(f0);
 	uint32_t uninitialized_var(op0);
 
-	pthread_spin_lock(&qp->sq.lock);
+	verbs_spin_lock(&qp->sq.lock);
 	udma_to_device_barrier();
 
 	ind = qp->sq.next_ind;
@@ -321,7 +321,7 @@ out:
 	qp->sq.next_ind = ind;
 	qp->sq.head    += nreq;
 
-	pthread_spin_unlock(&qp->sq.lock);
+	verbs_spin_unlock(&qp->sq.lock);
 	return ret;
 }
 
@@ -339,7 +339,7 @@ int mthca_tavor_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	void *wqe;
 	void *prev_wqe;
 
-	pthread_spin_lock(&qp->rq.lock);
+	verbs_spin_lock(&qp->rq.lock);
 
 	ind = qp->rq.next_ind;
 
@@ -429,7 +429,7 @@ out:
 	qp->rq.next_ind = ind;
 	qp->rq.head    += nreq;
 
-	pthread_spin_unlock(&qp->rq.lock);
+	verbs_spin_unlock(&qp->rq.lock);
 	return ret;
 }
 
@@ -448,7 +448,7 @@ int mthca_arbel_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 	uint32_t uninitialized_var(f0);
 	uint32_t uninitialized_var(op0);
 
-	pthread_spin_lock(&qp->sq.lock);
+	verbs_spin_lock(&qp->sq.lock);
 
 	/* XXX check that state is OK to post send */
 
@@ -687,7 +687,7 @@ out:
 		mthca_write64(doorbell, to_mctx(ibqp->context), MTHCA_SEND_DOORBELL);
 	}
 
-	pthread_spin_unlock(&qp->sq.lock);
+	verbs_spin_unlock(&qp->sq.lock);
 	return ret;
 }
 
@@ -701,7 +701,7 @@ int mthca_arbel_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	int i;
 	void *wqe;
 
-	pthread_spin_lock(&qp->rq.lock);
+	verbs_spin_lock(&qp->rq.lock);
 
 	/* XXX check that state is OK to post receive */
 
@@ -760,7 +760,7 @@ out:
 		*qp->rq.db = htobe32(qp->rq.head & 0xffff);
 	}
 
-	pthread_spin_unlock(&qp->rq.lock);
+	verbs_spin_unlock(&qp->rq.lock);
 	return ret;
 }
 
@@ -835,7 +835,7 @@ int mthca_alloc_qp_buf(struct ibv_pd *pd, struct ibv_qp_cap *cap,
 
 	qp->buf_size = qp->send_wqe_offset + (qp->sq.max << qp->sq.wqe_shift);
 
-	if (mthca_alloc_buf(&qp->buf,
+	if (mthca_alloc_buf(pd->context->device, &qp->buf,
 			    align(qp->buf_size, to_mdev(pd->context->device)->page_size),
 			    to_mdev(pd->context->device)->page_size)) {
 		free(qp->wrid);
@@ -64,7 +64,7 @@ void mthca_free_srq_wqe(struct mthca_srq *srq, int ind)
 {
 	struct mthca_next_seg *last_free;
 
-	pthread_spin_lock(&srq->lock);
+	verbs_spin_lock(&srq->lock);
 
 	last_free = get_wqe(srq, srq->last_free);
 	*wqe_to_link(last_free) = ind;
@@ -72,7 +72,7 @@ void mthca_free_srq_wqe(struct mthca_srq *srq, int ind)
 	*wqe_to_link(get_wqe(srq, ind)) = -1;
 	srq->last_free = ind;
 
-	pthread_spin_unlock(&srq->lock);
+	verbs_spin_unlock(&srq->lock);
 }
 
 int mthca_tavor_post_srq_recv(struct ibv_srq *ibsrq,
@@ -90,7 +90,7 @@ int mthca_tavor_post_srq_recv(struct ibv_srq *ibsrq,
 	void *wqe;
 	void *prev_wqe;
 
-	pthread_spin_lock(&srq->lock);
+	verbs_spin_lock(&srq->lock);
 
 	first_ind = srq->first_free;
 
@@ -173,7 +173,7 @@ int mthca_tavor_post_srq_recv(struct ibv_srq *ibsrq,
 		mthca_write64(doorbell, to_mctx(ibsrq->context), MTHCA_RECV_DOORBELL);
 	}
 
-	pthread_spin_unlock(&srq->lock);
+	verbs_spin_unlock(&srq->lock);
 	return err;
 }
 
@@ -189,7 +189,7 @@ int mthca_arbel_post_srq_recv(struct ibv_srq *ibsrq,
 	int i;
 	void *wqe;
 
-	pthread_spin_lock(&srq->lock);
+	verbs_spin_lock(&srq->lock);
 
 	for (nreq = 0; wr; ++nreq, wr = wr->next) {
 		ind	  = srq->first_free;
@@ -244,7 +244,7 @@ int mthca_arbel_post_srq_recv(struct ibv_srq *ibsrq,
 		*srq->db = htobe32(srq->counter);
 	}
 
-	pthread_spin_unlock(&srq->lock);
+	verbs_spin_unlock(&srq->lock);
 	return err;
 }
 
@@ -268,7 +268,7 @@ int mthca_alloc_srq_buf(struct ibv_pd *pd, struct ibv_srq_attr *attr,
 
 	srq->buf_size = srq->max << srq->wqe_shift;
 
-	if (mthca_alloc_buf(&srq->buf,
+	if (mthca_alloc_buf(pd->context->device, &srq->buf,
 			    align(srq->buf_size, to_mdev(pd->context->device)->page_size),
 			    to_mdev(pd->context->device)->page_size)) {
 		free(srq->wrid);
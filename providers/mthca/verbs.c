@@ -192,7 +192,7 @@ struct ibv_cq *mthca_create_cq(struct ibv_context *context, int cqe,
 
 	cq->cons_index = 0;
 
-	if (pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&cq->lock, !verbs_single_threaded(context)))
 		goto err;
 
 	cqe = align_cq_size(cqe);
@@ -283,7 +283,7 @@ int mthca_resize_cq(struct ibv_cq *ibcq, int cqe)
 	if (cqe > 131072)
 		return EINVAL;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	cqe = align_cq_size(cqe);
 	if (cqe == ibcq->cqe + 1) {
@@ -326,7 +326,7 @@ int mthca_resize_cq(struct ibv_cq *ibcq, int cqe)
 	cq->mr  = mr;
 
 out:
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 	return ret;
 }
 
@@ -388,7 +388,8 @@ struct ibv_srq *mthca_create_srq(struct ibv_pd *pd,
 	if (!srq)
 		return NULL;
 
-	if (pthread_spin_init(&srq->lock, PTHREAD_PROCESS_PRIVATE))
+	/* taken by poll_cq on any CQ attached to the SRQ */
+	if (verbs_spinlock_init(&srq->lock, 1))
 		goto err;
 
 	srq->max     = align_queue_size(pd->context, attr->attr.max_wr, 1);
@@ -514,8 +515,10 @@ struct ibv_qp *mthca_create_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
 
 	mthca_init_qp_indices(qp);
 
-	if (pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE) ||
-	    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&qp->sq.lock,
+				!verbs_single_threaded(pd->context)) ||
+	    verbs_spinlock_init(&qp->rq.lock,
+				!verbs_single_threaded(pd->context)))
 		goto err_free;
 
 	qp->mr = __mthca_reg_mr(pd, qp->buf.buf, qp->buf_size, 0, 0, 0);
@@ -642,13 +645,13 @@ static void mthca_lock_cqs(struct ibv_qp *qp)
 	struct mthca_cq *recv_cq = to_mcq(qp->recv_cq);
 
 	if (send_cq == recv_cq)
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_lock(&send_cq->lock);
-		pthread_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
 	} else {
-		pthread_spin_lock(&recv_cq->lock);
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	}
 }
 
@@ -658,13 +661,13 @@ static void mthca_unlock_cqs(struct ibv_qp *qp)
 	struct mthca_cq *recv_cq = to_mcq(qp->recv_cq);
 
 	if (send_cq == recv_cq)
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_unlock(&recv_cq->lock);
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else {
-		pthread_spin_unlock(&send_cq->lock);
-		pthread_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
 	}
 }
 
@@ -249,7 +249,7 @@ found:
 /**
  * nes_register_driver
  */
-static __attribute__((constructor)) void nes_register_driver(void)
+PROVIDER_DRIVER(nes)
 {
 	/* fprintf(stderr, PFX "nes_register_driver: call ibv_register_driver()\n"); */
 
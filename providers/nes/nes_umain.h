@@ -277,7 +277,7 @@ struct nes_ucq {
 	struct ibv_cq ibv_cq;
 	struct nes_hw_cqe volatile *cqes;
 	struct ibv_mr mr;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	uint32_t cq_id;
 	uint16_t size;
 	uint16_t head;
@@ -294,12 +294,13 @@ struct nes_uqp {
 	struct ibv_qp ibv_qp;
 	struct nes_hw_qp_wqe volatile *sq_vbase;
 	struct nes_hw_qp_wqe volatile *rq_vbase;
+	size_t vmap_size;	/* length of the NES_QP_VMAP buffer */
 	uint32_t qp_id;
 	struct nes_ucq *send_cq;
 	struct nes_ucq *recv_cq;
 	struct	ibv_mr mr;
 	uint32_t nes_drv_opt;
-	pthread_spinlock_t lock;
+	struct verbs_spinlock lock;
 	uint16_t sq_db_index;
 	uint16_t sq_head;
 	uint16_t sq_tail;
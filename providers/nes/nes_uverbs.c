@@ -224,7 +224,8 @@ struct ibv_cq *nes_ucreate_cq(struct ibv_context *context, int cqe,
 	}
 	memset(nesucq, 0, sizeof(*nesucq));
 
-	if (pthread_spin_init(&nesucq->lock, PTHREAD_PROCESS_PRIVATE)) {
+	if (verbs_spinlock_init(&nesucq->lock,
+				!verbs_single_threaded(context))) {
 		free(nesucq);
 		return NULL;
 	}
@@ -234,7 +235,8 @@ struct ibv_cq *nes_ucreate_cq(struct ibv_context *context, int cqe,
 	nesucq->size = cqe + 1;
 	nesucq->comp_vector = comp_vector;
 
-	nesucq->cqes = memalign(page_size, nesucq->size*sizeof(struct nes_hw_cqe));
+	nesucq->cqes = verbs_alloc_queue_buf(context->device,
+			nesucq->size*sizeof(struct nes_hw_cqe));
 	if (!nesucq->cqes)
 		goto err;
 
@@ -248,7 +250,8 @@ struct ibv_cq *nes_ucreate_cq(struct ibv_context *context, int cqe,
 			&reg_mr_resp, sizeof reg_mr_resp);
 	if (ret) {
 		/* fprintf(stderr, "ibv_cmd_reg_mr failed (ret = %d).\n", ret); */
-		free((struct nes_hw_cqe *)nesucq->cqes);
+		verbs_free_queue_buf((struct nes_hw_cqe *)nesucq->cqes,
+				     nesucq->size*sizeof(struct nes_hw_cqe));
 		goto err;
 	}
 
@@ -272,7 +275,7 @@ struct ibv_cq *nes_ucreate_cq(struct ibv_context *context, int cqe,
 
 err:
  	/* fprintf(stderr, PFX "%s: Error Creating CQ.\n", __FUNCTION__); */
-	pthread_spin_destroy(&nesucq->lock);
+	verbs_spinlock_destroy(&nesucq->lock);
 	free(nesucq);
 
 	return NULL;
@@ -305,8 +308,9 @@ int nes_udestroy_cq(struct ibv_cq *cq)
 		fprintf(stderr, PFX "%s: Failed to deregister CQ Memory Region.\n", __FUNCTION__);
 
 	/* Free CQ the memory */
-	free((struct nes_hw_cqe *)nesucq->cqes);
-	pthread_spin_destroy(&nesucq->lock);
+	verbs_free_queue_buf((struct nes_hw_cqe *)nesucq->cqes,
+			     nesucq->size*sizeof(struct nes_hw_cqe));
+	verbs_spinlock_destroy(&nesucq->lock);
 	free(nesucq);
 
 	return 0;
@@ -463,7 +467,7 @@ int nes_upoll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *entry)
 	if (nesucq->cq_id < 64)
 		return nes_ima_upoll_cq(cq, num_entries, entry);
 
-	pthread_spin_lock(&nesucq->lock);
+	verbs_spin_lock(&nesucq->lock);
 
 	head = nesucq->head;
 	cq_size = nesucq->size;
@@ -597,7 +601,7 @@ nes_upoll_cq_update:
 	}
 	nesucq->head = head;
 
-	pthread_spin_unlock(&nesucq->lock);
+	verbs_spin_unlock(&nesucq->lock);
 
 	return cqe_count;
 }
@@ -628,7 +632,7 @@ int nes_upoll_cq_no_db_read(struct ibv_cq *cq, int num_entries, struct ibv_wc *e
 	if (nesucq->cq_id < 64)
 		return nes_ima_upoll_cq(cq, num_entries, entry);
 
-	pthread_spin_lock(&nesucq->lock);
+	verbs_spin_lock(&nesucq->lock);
 
 	head = nesucq->head;
 	cq_size = nesucq->size;
@@ -751,7 +755,7 @@ int nes_upoll_cq_no_db_read(struct ibv_cq *cq, int num_entries, struct ibv_wc *e
 	}
 	nesucq->head = head;
 
-	pthread_spin_unlock(&nesucq->lock);
+	verbs_spin_unlock(&nesucq->lock);
 
 	return cqe_count;
 }
@@ -788,7 +792,7 @@ int nes_uarm_cq(struct ibv_cq *cq, int solicited)
 	nesucq = to_nes_ucq(cq);
 	nesvctx = to_nes_uctx(cq->context);
 
-	pthread_spin_lock(&nesucq->lock);
+	verbs_spin_lock(&nesucq->lock);
 
 	if (nesucq->is_armed) {
 	/* don't arm again unless... */
@@ -803,7 +807,7 @@ int nes_uarm_cq(struct ibv_cq *cq, int solicited)
 		nes_arm_cq(nesucq, nesvctx, solicited);
 	}
 
-	pthread_spin_unlock(&nesucq->lock);
+	verbs_spin_unlock(&nesucq->lock);
 
 	return 0;
 }
@@ -818,7 +822,7 @@ void nes_cq_event(struct ibv_cq *cq)
 
 	nesucq = to_nes_ucq(cq);
 
-	pthread_spin_lock(&nesucq->lock);
+	verbs_spin_lock(&nesucq->lock);
 
 	if (nesucq->skip_arm) {
 		struct nes_uvcontext *nesvctx;
@@ -828,7 +832,7 @@ void nes_cq_event(struct ibv_cq *cq)
 		nesucq->is_armed = 0;
 	}
 
-	pthread_spin_unlock(&nesucq->lock);
+	verbs_spin_unlock(&nesucq->lock);
 }
 
 
@@ -943,7 +947,9 @@ static int nes_vmapped_qp(struct nes_uqp *nesuqp, struct ibv_pd *pd, struct ibv_
 
 	// fprintf(stderr, PFX "%s\n", __FUNCTION__);
 	totalqpsize = (sqdepth + rqdepth) * sizeof (struct nes_hw_qp_wqe) ;
-	nesuqp->sq_vbase = memalign(page_size, totalqpsize);
+	nesuqp->vmap_size = totalqpsize;
+	nesuqp->sq_vbase = verbs_alloc_queue_buf(pd->context->device,
+						 totalqpsize);
 	if (!nesuqp->sq_vbase) {
 	//	fprintf(stderr, PFX "CREATE_QP could not allocate mem of size %d\n", totalqpsize);
 		return 0;
@@ -962,7 +968,7 @@ static int nes_vmapped_qp(struct nes_uqp *nesuqp, struct ibv_pd *pd, struct ibv_
 			     &reg_mr_resp, sizeof reg_mr_resp);
         if (ret) {
                 // fprintf(stderr, PFX "%s ibv_cmd_reg_mr failed (ret = %d).\n", __FUNCTION__, ret);
-		free((void *) nesuqp->sq_vbase);
+		verbs_free_queue_buf((void *) nesuqp->sq_vbase, totalqpsize);
 		return 0;
         }
 	// So now the memory has been registered..
@@ -973,7 +979,7 @@ static int nes_vmapped_qp(struct nes_uqp *nesuqp, struct ibv_pd *pd, struct ibv_
 				&resp->ibv_resp, sizeof (struct nes_ucreate_qp_resp) );
 	if (ret) {
 		ibv_cmd_dereg_mr(&nesuqp->mr);
-		free((void *)nesuqp->sq_vbase);
+		verbs_free_queue_buf((void *)nesuqp->sq_vbase, totalqpsize);
 		return 0;
 	}
 	*((unsigned int *)nesuqp->rq_vbase) = 0;
@@ -1047,7 +1053,8 @@ struct ibv_qp *nes_ucreate_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
 		return NULL;
 	memset(nesuqp, 0, sizeof(*nesuqp));
 
-	if (pthread_spin_init(&nesuqp->lock, PTHREAD_PROCESS_PRIVATE)) {
+	if (verbs_spinlock_init(&nesuqp->lock,
+				!verbs_single_threaded(pd->context))) {
 		free(nesuqp);
 		return NULL;
 	}
@@ -1066,7 +1073,7 @@ struct ibv_qp *nes_ucreate_qp(struct ibv_pd *pd, struct ibv_qp_init_attr *attr)
 	}
 
 	if (!status) {
-		pthread_spin_destroy(&nesuqp->lock);
+		verbs_spinlock_destroy(&nesuqp->lock);
 		free(nesuqp);
 		return NULL;
 	}
@@ -1121,7 +1128,7 @@ static void nes_clean_cq(struct nes_uqp *nesuqp, struct nes_ucq *nesucq)
 	uint32_t hi;
 	uint64_t u64temp;
 
-	pthread_spin_lock(&nesucq->lock);
+	verbs_spin_lock(&nesucq->lock);
 
 	cq_head = nesucq->head;
 	while (le32toh(nesucq->cqes[cq_head].cqe_words[NES_CQE_OPCODE_IDX]) & NES_CQE_VALID) {
@@ -1140,7 +1147,7 @@ static void nes_clean_cq(struct nes_uqp *nesuqp, struct nes_ucq *nesucq)
 			cq_head = 0;
 	}
 
-	pthread_spin_unlock(&nesucq->lock);
+	verbs_spin_unlock(&nesucq->lock);
 }
 
 
@@ -1158,7 +1165,8 @@ int nes_udestroy_qp(struct ibv_qp *qp)
 		ret = ibv_cmd_dereg_mr(&nesuqp->mr);
 		if (ret)
 	 		fprintf(stderr, PFX "%s dereg_mr FAILED\n", __FUNCTION__);
-		free((void *)nesuqp->sq_vbase);
+		verbs_free_queue_buf((void *)nesuqp->sq_vbase,
+				     nesuqp->vmap_size);
 	}
 
 	if (nesuqp->mapping == NES_QP_MMAP) {
@@ -1172,7 +1180,7 @@ int nes_udestroy_qp(struct ibv_qp *qp)
 		return ret;
 	}
 
-	pthread_spin_destroy(&nesuqp->lock);
+	verbs_spinlock_destroy(&nesuqp->lock);
 
 	/* Clean any pending completions from the cq(s) */
 	if (nesuqp->send_cq)
@@ -1204,7 +1212,7 @@ int nes_upost_send(struct ibv_qp *ib_qp, struct ibv_send_wr *ib_wr,
 	uint32_t total_payload_length = 0;
 	int sge_index;
 
-	pthread_spin_lock(&nesuqp->lock);
+	verbs_spin_lock(&nesuqp->lock);
 	udma_to_device_barrier();
 
 	head = nesuqp->sq_head;
@@ -1371,7 +1379,7 @@ int nes_upost_send(struct ibv_qp *ib_qp, struct ibv_send_wr *ib_wr,
 	if (err)
 		*bad_wr = ib_wr;
 
-	pthread_spin_unlock(&nesuqp->lock);
+	verbs_spin_unlock(&nesuqp->lock);
 
 	return err;
 }
@@ -1400,7 +1408,7 @@ int nes_upost_recv(struct ibv_qp *ib_qp, struct ibv_recv_wr *ib_wr,
 		return -EINVAL;
 	}
 
-	pthread_spin_lock(&nesuqp->lock);
+	verbs_spin_lock(&nesuqp->lock);
 	udma_to_device_barrier();
 
 	head = nesuqp->rq_head;
@@ -1464,7 +1472,7 @@ int nes_upost_recv(struct ibv_qp *ib_qp, struct ibv_recv_wr *ib_wr,
 	if (err)
 		*bad_wr = ib_wr;
 
-	pthread_spin_unlock(&nesuqp->lock);
+	verbs_spin_unlock(&nesuqp->lock);
 
 	return err;
 }
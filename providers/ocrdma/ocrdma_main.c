@@ -69,8 +69,9 @@ static struct {
 static LIST_HEAD(ocrdma_dev_list);
 static pthread_mutex_t ocrdma_dev_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static struct ibv_context *ocrdma_alloc_context(struct ibv_device *, int);
-static void ocrdma_free_context(struct ibv_context *);
+static int ocrdma_init_context(struct verbs_device *, struct ibv_context *,
+			       int);
+static void ocrdma_uninit_context(struct verbs_device *, struct ibv_context *);
 
 static struct ibv_context_ops ocrdma_ctx_ops = {
 	.query_device = ocrdma_query_device,
@@ -104,23 +105,21 @@ static struct ibv_context_ops ocrdma_ctx_ops = {
 };
 
 static struct verbs_device_ops ocrdma_dev_ops = {
-	.alloc_context = ocrdma_alloc_context,
-	.free_context = ocrdma_free_context
+	.init_context = ocrdma_init_context,
+	.uninit_context = ocrdma_uninit_context
 };
 
 /*
- * ocrdma_alloc_context
+ * ocrdma_init_context
  */
-static struct ibv_context *ocrdma_alloc_context(struct ibv_device *ibdev,
-						int cmd_fd)
+static int ocrdma_init_context(struct verbs_device *vdev,
+			       struct ibv_context *ibctx, int cmd_fd)
 {
-	struct ocrdma_devctx *ctx;
+	struct ibv_device *ibdev = &vdev->device;
+	struct ocrdma_devctx *ctx = get_ocrdma_ctx(ibctx);
 	struct ocrdma_get_context cmd;
 	struct ocrdma_alloc_ucontext_resp resp;
 
-	ctx = calloc(1, sizeof(struct ocrdma_devctx));
-	if (!ctx)
-		return NULL;
 	memset(&resp, 0, sizeof(resp));
 
 	ctx->ibv_ctx.cmd_fd = cmd_fd;
@@ -132,6 +131,7 @@ static struct ibv_context *ocrdma_alloc_context(struct ibv_device *ibdev,
 
 	ctx->ibv_ctx.device = ibdev;
 	ctx->ibv_ctx.ops = ocrdma_ctx_ops;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 	get_ocrdma_dev(ibdev)->id = resp.dev_id;
 	get_ocrdma_dev(ibdev)->max_inline_data = resp.max_inline_data;
 	get_ocrdma_dev(ibdev)->wqe_size = resp.wqe_size;
@@ -143,30 +143,30 @@ static struct ibv_context *ocrdma_alloc_context(struct ibv_device *ibdev,
 	    mmap(NULL, resp.ah_tbl_len, PROT_READ | PROT_WRITE, MAP_SHARED,
 		 cmd_fd, resp.ah_tbl_page);
 
-	if (ctx->ah_tbl == MAP_FAILED)
+	if (ctx->ah_tbl == MAP_FAILED) {
+		ctx->ah_tbl = NULL;
 		goto cmd_err;
+	}
 	ctx->ah_tbl_len = resp.ah_tbl_len;
 	ocrdma_init_ahid_tbl(ctx);
 
-	return &ctx->ibv_ctx;
+	return 0;
 
 cmd_err:
 	ocrdma_err("%s: Failed to allocate context for device.\n", __func__);
-	free(ctx);
-	return NULL;
+	return errno ? errno : ENOMEM;
 }
 
 /*
- * ocrdma_free_context
+ * ocrdma_uninit_context
  */
-static void ocrdma_free_context(struct ibv_context *ibctx)
+static void ocrdma_uninit_context(struct verbs_device *vdev,
+				  struct ibv_context *ibctx)
 {
 	struct ocrdma_devctx *ctx = get_ocrdma_ctx(ibctx);
 
 	if (ctx->ah_tbl)
 		munmap((void *)ctx->ah_tbl, ctx->ah_tbl_len);
-
-	free(ctx);
 }
 
 /**
@@ -221,6 +221,8 @@ found:
 	pthread_mutex_init(&dev->dev_lock, NULL);
 	pthread_spin_init(&dev->flush_q_lock, PTHREAD_PROCESS_PRIVATE);
 	dev->ibv_dev.ops = &ocrdma_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct ocrdma_devctx) -
+				       sizeof(struct ibv_context);
 	list_node_init(&dev->entry);
 	pthread_mutex_lock(&ocrdma_dev_list_lock);
 	list_add_tail(&ocrdma_dev_list, &dev->entry);
@@ -234,8 +236,7 @@ qp_err:
 /*
  * ocrdma_register_driver
  */
-static __attribute__ ((constructor))
-void ocrdma_register_driver(void)
+PROVIDER_DRIVER(ocrdma)
 {
 	verbs_register_driver("ocrdma", ocrdma_driver_init);
 }
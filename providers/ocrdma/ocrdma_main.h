@@ -87,12 +87,15 @@ struct ocrdma_mr {
 };
 
 struct ocrdma_cq {
-	struct ibv_cq ibv_cq;
+	union {
+		struct ibv_cq ibv_cq;
+		struct verbs_cq vcq;
+	};
 	struct ocrdma_device *dev;
 	uint16_t cq_id;
 	uint16_t cq_dbid;
 	uint16_t getp;
-	pthread_spinlock_t cq_lock;
+	struct verbs_spinlock cq_lock;
 	uint32_t max_hw_cqe;
 	uint32_t cq_mem_size;
 	struct ocrdma_cqe *va;
@@ -142,7 +145,7 @@ struct ocrdma_srq {
 	struct ocrdma_device *dev;
 	void *db_va;
 	uint32_t db_size;
-	pthread_spinlock_t q_lock;
+	struct verbs_spinlock q_lock;
 
 	struct ocrdma_qp_hwq_info rq;
 	uint32_t max_rq_sges;
@@ -171,7 +174,7 @@ enum ocrdma_qp_state {
 struct ocrdma_qp {
 	struct ibv_qp ibv_qp;
 	struct ocrdma_device *dev;
-	pthread_spinlock_t q_lock;
+	struct verbs_spinlock q_lock;
 
 	struct ocrdma_qp_hwq_info sq;
 	struct ocrdma_cq *sq_cq;
@@ -248,7 +248,7 @@ static struct ibv_cq *ocrdma_create_cq_common(struct ibv_context *context,
 	if (status)
 		goto cq_err1;
 
-	pthread_spin_init(&cq->cq_lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&cq->cq_lock, !verbs_single_threaded(context));
 	cq->dev = dev;
 	cq->cq_id = resp.cq_id;
 	cq->cq_dbid = resp.cq_id;
@@ -362,7 +362,8 @@ struct ibv_srq *ocrdma_create_srq(struct ibv_pd *pd,
 	if (!srq)
 		return NULL;
 
-	pthread_spin_init(&srq->q_lock, PTHREAD_PROCESS_PRIVATE);
+	/* taken by ocrdma_poll_cq() on any CQ attached to the SRQ */
+	verbs_spinlock_init(&srq->q_lock, 1);
 	status = ibv_cmd_create_srq(pd, &srq->ibv_srq, init_attr, &cmd.ibv_cmd,
 				    sizeof cmd, &resp.ibv_resp, sizeof resp);
 	if (status)
@@ -410,7 +411,7 @@ map_err:
 	return NULL;
 
 cmd_err:
-	pthread_spin_destroy(&srq->q_lock);
+	verbs_spinlock_destroy(&srq->q_lock);
 	free(srq);
 	return NULL;
 }
@@ -452,7 +453,7 @@ int ocrdma_destroy_srq(struct ibv_srq *ibsrq)
 		munmap(srq->rq.va, srq->rq.len);
 		srq->rq.va = NULL;
 	}
-	pthread_spin_destroy(&srq->q_lock);
+	verbs_spinlock_destroy(&srq->q_lock);
 	free(srq);
 	return status;
 }
@@ -478,7 +479,7 @@ struct ibv_qp *ocrdma_create_qp(struct ibv_pd *pd,
 	memset(&cmd, 0, sizeof(cmd));
 
 	qp->qp_type = attrs->qp_type;
-	pthread_spin_init(&qp->q_lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qp->q_lock, !verbs_single_threaded(pd->context));
 
 #ifdef DPP_CQ_SUPPORT
 	if (attrs->cap.max_inline_data) {
@@ -594,7 +595,7 @@ map_err:
 	ocrdma_destroy_qp(&qp->ibv_qp);
 	return NULL;
 mbx_err:
-	pthread_spin_destroy(&qp->q_lock);
+	verbs_spinlock_destroy(&qp->q_lock);
 	free(qp);
 	return NULL;
 }
@@ -703,10 +704,10 @@ static int ocrdma_qp_state_machine(struct ocrdma_qp *qp,
 	enum ocrdma_qp_state new_state;
 	new_state = get_ocrdma_qp_state(new_ib_state);
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 
 	if (new_state == qp->state) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		return 1;
 	}
 
@@ -812,7 +813,7 @@ static int ocrdma_qp_state_machine(struct ocrdma_qp *qp,
 	if (!status)
 		qp->state = new_state;
 
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 	return status;
 }
 
@@ -972,10 +973,10 @@ static inline void ocrdma_srq_inc_tail(struct ocrdma_qp *qp,
 	if (wqe_idx < 1)
 		assert(0);
 
-	pthread_spin_lock(&qp->srq->q_lock);
+	verbs_spin_lock(&qp->srq->q_lock);
 	ocrdma_hwq_inc_tail(&qp->srq->rq);
 	ocrdma_srq_toggle_bit(qp->srq, wqe_idx - 1);
-	pthread_spin_unlock(&qp->srq->q_lock);
+	verbs_spin_unlock(&qp->srq->q_lock);
 }
 
 static void ocrdma_discard_cqes(struct ocrdma_qp *qp, struct ocrdma_cq *cq)
@@ -986,7 +987,7 @@ static void ocrdma_discard_cqes(struct ocrdma_qp *qp, struct ocrdma_cq *cq)
 	uint32_t qpn = 0;
 	int wqe_idx;
 
-	pthread_spin_lock(&cq->cq_lock);
+	verbs_spin_lock(&cq->cq_lock);
 
 	/* traverse through the CQEs in the hw CQ,
 	 * find the matching CQE for a given qp,
@@ -1035,7 +1036,7 @@ skip_cqe:
 		cur_getp = (cur_getp + 1) % cq->max_hw_cqe;
 
 	} while (cur_getp != stop_getp);
-	pthread_spin_unlock(&cq->cq_lock);
+	verbs_spin_unlock(&cq->cq_lock);
 }
 
 /*
@@ -1053,17 +1054,17 @@ int ocrdma_destroy_qp(struct ibv_qp *ibqp)
 	 * acquire CQ lock while destroy is in progress, in order to
 	 * protect against proessing in-flight CQEs for this QP.
 	 */
-	pthread_spin_lock(&qp->sq_cq->cq_lock);
+	verbs_spin_lock(&qp->sq_cq->cq_lock);
 
 	if (qp->rq_cq && (qp->rq_cq != qp->sq_cq))
-		pthread_spin_lock(&qp->rq_cq->cq_lock);
+		verbs_spin_lock(&qp->rq_cq->cq_lock);
 
 	_ocrdma_del_qpn_map(qp->dev, qp);
 
 	if (qp->rq_cq && (qp->rq_cq != qp->sq_cq))
-		pthread_spin_unlock(&qp->rq_cq->cq_lock);
+		verbs_spin_unlock(&qp->rq_cq->cq_lock);
 
-	pthread_spin_unlock(&qp->sq_cq->cq_lock);
+	verbs_spin_unlock(&qp->sq_cq->cq_lock);
 
 	if (qp->db_va)
 		munmap((void *)qp->db_va, qp->db_size);
@@ -1085,7 +1086,7 @@ int ocrdma_destroy_qp(struct ibv_qp *ibqp)
 
 	ocrdma_del_flush_qp(qp);
 
-	pthread_spin_destroy(&qp->q_lock);
+	verbs_spinlock_destroy(&qp->q_lock);
 	if (qp->rqe_wr_id_tbl)
 		free(qp->rqe_wr_id_tbl);
 	if (qp->wqe_wr_id_tbl)
@@ -1364,9 +1365,9 @@ int ocrdma_post_send(struct ibv_qp *ib_qp, struct ibv_send_wr *wr,
 
 	qp = get_ocrdma_qp(ib_qp);
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 	if (qp->state != OCRDMA_QPS_RTS && qp->state != OCRDMA_QPS_SQD) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		*bad_wr = wr;
 		return EINVAL;
 	}
@@ -1445,7 +1446,7 @@ int ocrdma_post_send(struct ibv_qp *ib_qp, struct ibv_send_wr *wr,
 		ocrdma_hwq_inc_head(&qp->sq);
 		wr = wr->next;
 	}
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 
 	return status;
 }
@@ -1483,9 +1484,9 @@ int ocrdma_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 
 	qp = get_ocrdma_qp(ibqp);
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 	if (qp->state == OCRDMA_QPS_RST || qp->state == OCRDMA_QPS_ERR) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		*bad_wr = wr;
 		return EINVAL;
 	}
@@ -1506,7 +1507,7 @@ int ocrdma_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 		ocrdma_hwq_inc_head(&qp->rq);
 		wr = wr->next;
 	}
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 
 	return status;
 }
@@ -1804,9 +1805,9 @@ static void ocrdma_update_free_srq_cqe(struct ibv_wc *ibwc,
 		assert(0);
 	ibwc->wr_id = srq->rqe_wr_id_tbl[wqe_idx];
 
-	pthread_spin_lock(&srq->q_lock);
+	verbs_spin_lock(&srq->q_lock);
 	ocrdma_srq_toggle_bit(srq, wqe_idx - 1);
-	pthread_spin_unlock(&srq->q_lock);
+	verbs_spin_unlock(&srq->q_lock);
 
 	ocrdma_hwq_inc_tail(&srq->rq);
 }
@@ -2011,9 +2012,9 @@ int ocrdma_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 	struct ocrdma_qp *qp_tmp;
 
 	cq = get_ocrdma_cq(ibcq);
-	pthread_spin_lock(&cq->cq_lock);
+	verbs_spin_lock(&cq->cq_lock);
 	num_os_cqe = ocrdma_poll_hwcq(cq, num_entries, wc);
-	pthread_spin_unlock(&cq->cq_lock);
+	verbs_spin_unlock(&cq->cq_lock);
 	cqes_to_poll -= num_os_cqe;
 
 	if (cqes_to_poll) {
@@ -2040,7 +2041,7 @@ int ocrdma_arm_cq(struct ibv_cq *ibcq, int solicited)
 	struct ocrdma_cq *cq;
 
 	cq = get_ocrdma_cq(ibcq);
-	pthread_spin_lock(&cq->cq_lock);
+	verbs_spin_lock(&cq->cq_lock);
 
 	if (cq->first_arm) {
 		ocrdma_ring_cq_db(cq, 1, solicited, 0);
@@ -2050,7 +2051,7 @@ int ocrdma_arm_cq(struct ibv_cq *ibcq, int solicited)
 	cq->deferred_arm = 1;
 	cq->deferred_sol = solicited;
 
-	pthread_spin_unlock(&cq->cq_lock);
+	verbs_spin_unlock(&cq->cq_lock);
 
 	return 0;
 }
@@ -2067,7 +2068,7 @@ int ocrdma_post_srq_recv(struct ibv_srq *ibsrq, struct ibv_recv_wr *wr,
 	struct ocrdma_hdr_wqe *rqe;
 
 	srq = get_ocrdma_srq(ibsrq);
-	pthread_spin_lock(&srq->q_lock);
+	verbs_spin_lock(&srq->q_lock);
 	while (wr) {
 		if (ocrdma_hwq_free_cnt(&srq->rq) == 0 ||
 		    wr->num_sge > srq->rq.max_sges) {
@@ -2086,7 +2087,7 @@ int ocrdma_post_srq_recv(struct ibv_srq *ibsrq, struct ibv_recv_wr *wr,
 		ocrdma_hwq_inc_head(&srq->rq);
 		wr = wr->next;
 	}
-	pthread_spin_unlock(&srq->q_lock);
+	verbs_spin_unlock(&srq->q_lock);
 	return status;
 }
 
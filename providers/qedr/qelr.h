@@ -148,7 +148,10 @@ union db_prod64 {
 };
 
 struct qelr_cq {
-	struct ibv_cq		ibv_cq;	/* must be first */
+	union {				/* must be first */
+		struct ibv_cq	ibv_cq;
+		struct verbs_cq	vcq;
+	};
 
 	struct qelr_chain	chain;
 
@@ -220,7 +223,7 @@ struct qelr_edpm {
 
 struct qelr_qp {
 	struct ibv_qp				ibv_qp;
-	pthread_spinlock_t			q_lock;
+	struct verbs_spinlock			q_lock;
 	enum qelr_qp_state			state;   /*  QP state */
 
 	struct qelr_qp_hwq_info			sq;
@@ -31,7 +31,6 @@
  */
 
 #include <sys/types.h>
-#include <sys/mman.h>
 #include <stdio.h>
 #include <string.h>
 #include <endian.h>
@@ -62,29 +61,18 @@ void qelr_chain_reset(struct qelr_chain *p_chain)
 	p_chain->p_prod_elem	= p_chain->first_addr;
 }
 
-#define QELR_ANON_FD		(-1)	/* MAP_ANONYMOUS => file desc.= -1  */
-#define QELR_ANON_OFFSET	(0)	/* MAP_ANONYMOUS => offset    = d/c */
-
-int qelr_chain_alloc(struct qelr_chain *chain, int chain_size, int page_size,
-		     uint16_t elem_size)
+int qelr_chain_alloc(struct ibv_device *device, struct qelr_chain *chain,
+		     int chain_size, int page_size, uint16_t elem_size)
 {
-	int ret, a_chain_size;
+	int a_chain_size;
 	void *addr;
 
 	/* alloc aligned page aligned chain */
 	a_chain_size = (chain_size + page_size - 1) & ~(page_size - 1);
-	addr = mmap(NULL, a_chain_size, PROT_READ | PROT_WRITE,
-			 MAP_PRIVATE | MAP_ANONYMOUS, QELR_ANON_FD,
-			 QELR_ANON_OFFSET);
-	if (addr == MAP_FAILED)
+	addr = verbs_alloc_queue_buf(device, a_chain_size);
+	if (!addr)
 		return errno;
 
-	ret = ibv_dontfork_range(addr, a_chain_size);
-	if (ret) {
-		munmap(addr, a_chain_size);
-		return ret;
-	}
-
 	/* init chain */
 	memset(chain, 0, sizeof(*chain));
 	chain->first_addr = addr;
@@ -96,15 +84,13 @@ int qelr_chain_alloc(struct qelr_chain *chain, int chain_size, int page_size,
 	chain->last_addr = (void *)
 			((uint8_t *)addr + (elem_size * (chain->n_elems -1)));
 
-	/* Note: since we are using MAP_ANONYMOUS the chain is zeroed for us */
+	/* Note: verbs_alloc_queue_buf() hands out zeroed memory */
 
 	return 0;
 }
 
 void qelr_chain_free(struct qelr_chain *chain)
 {
-	if (chain->size) {
-		ibv_dofork_range(chain->first_addr, chain->size);
-		munmap(chain->first_addr, chain->size);
-	}
+	if (chain->size)
+		verbs_free_queue_buf(chain->first_addr, chain->size);
 }
@@ -161,8 +161,8 @@ static inline void qelr_chain_set_prod(
 
 void *qelr_chain_get_last_elem(struct qelr_chain *p_chain);
 void qelr_chain_reset(struct qelr_chain *p_chain);
-int qelr_chain_alloc(struct qelr_chain *chain, int chain_size, int page_size,
-		     uint16_t elem_size);
+int qelr_chain_alloc(struct ibv_device *device, struct qelr_chain *chain,
+		     int chain_size, int page_size, uint16_t elem_size);
 void qelr_chain_free(struct qelr_chain *buf);
 
 #endif /* __QELR_CHAIN_H__ */
@@ -84,8 +84,8 @@ static const struct {
 	QHCA(AH_IOV),
 };
 
-static struct ibv_context *qelr_alloc_context(struct ibv_device *, int);
-static void qelr_free_context(struct ibv_context *);
+static int qelr_init_context(struct verbs_device *, struct ibv_context *, int);
+static void qelr_uninit_context(struct verbs_device *, struct ibv_context *);
 
 static struct ibv_context_ops qelr_ctx_ops = {
 	.query_device = qelr_query_device,
@@ -109,8 +109,8 @@ static struct ibv_context_ops qelr_ctx_ops = {
 };
 
 static struct verbs_device_ops qelr_dev_ops = {
-	.alloc_context = qelr_alloc_context,
-	.free_context = qelr_free_context
+	.init_context = qelr_init_context,
+	.uninit_context = qelr_uninit_context
 };
 
 static void qelr_open_debug_file(struct qelr_devctx *ctx)
@@ -160,16 +160,13 @@ static void qelr_set_debug_mask(void)
 		qelr_dp_module = atoi(env);
 }
 
-static struct ibv_context *qelr_alloc_context(struct ibv_device *ibdev,
-					      int cmd_fd)
+static int qelr_init_context(struct verbs_device *vdev,
+			     struct ibv_context *ibctx, int cmd_fd)
 {
-	struct qelr_devctx *ctx;
+	struct qelr_devctx *ctx = get_qelr_ctx(ibctx);
 	struct qelr_get_context cmd;
 	struct qelr_alloc_ucontext_resp resp;
 
-	ctx = calloc(1, sizeof(struct qelr_devctx));
-	if (!ctx)
-		return NULL;
 	memset(&resp, 0, sizeof(resp));
 
 	ctx->ibv_ctx.cmd_fd = cmd_fd;
@@ -183,8 +180,9 @@ static struct ibv_context *qelr_alloc_context(struct ibv_device *ibdev,
 		goto cmd_err;
 
 	ctx->kernel_page_size = sysconf(_SC_PAGESIZE);
-	ctx->ibv_ctx.device = ibdev;
+	ctx->ibv_ctx.device = &vdev->device;
 	ctx->ibv_ctx.ops = qelr_ctx_ops;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 	ctx->db_pa = resp.db_pa;
 	ctx->db_size = resp.db_size;
 	ctx->max_send_wr = resp.max_send_wr;
@@ -205,16 +203,16 @@ static struct ibv_context *qelr_alloc_context(struct ibv_device *ibdev,
 		goto cmd_err;
 	}
 
-	return &ctx->ibv_ctx;
+	return 0;
 
 cmd_err:
 	qelr_err("%s: Failed to allocate context for device.\n", __func__);
 	qelr_close_debug_file(ctx);
-	free(ctx);
-	return NULL;
+	return errno ? errno : EINVAL;
 }
 
-static void qelr_free_context(struct ibv_context *ibctx)
+static void qelr_uninit_context(struct verbs_device *vdev,
+				struct ibv_context *ibctx)
 {
 	struct qelr_devctx *ctx = get_qelr_ctx(ibctx);
 
@@ -222,7 +220,6 @@ static void qelr_free_context(struct ibv_context *ibctx)
 		munmap(ctx->db_addr, ctx->db_size);
 
 	qelr_close_debug_file(ctx);
-	free(ctx);
 }
 
 static struct verbs_device *qelr_driver_init(const char *uverbs_sys_path,
@@ -267,12 +264,13 @@ found:
 	}
 
 	dev->ibv_dev.ops = &qelr_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct qelr_devctx) -
+				       sizeof(struct ibv_context);
 
 	return &dev->ibv_dev;
 }
 
-static __attribute__ ((constructor))
-void qelr_register_driver(void)
+PROVIDER_DRIVER(qedr)
 {
 	verbs_register_driver("qelr", qelr_driver_init);
 }
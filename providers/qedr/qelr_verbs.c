@@ -245,8 +245,8 @@ struct ibv_cq *qelr_create_cq(struct ibv_context *context, int cqe,
 
 	/* allocate CQ buffer */
 	chain_size = qelr_cq_entries(cqe) * QELR_CQE_SIZE;
-	rc = qelr_chain_alloc(&cq->chain, chain_size, cxt->kernel_page_size,
-			      QELR_CQE_SIZE);
+	rc = qelr_chain_alloc(context->device, &cq->chain, chain_size,
+			      cxt->kernel_page_size, QELR_CQE_SIZE);
 	if (rc)
 		goto err_0;
 
@@ -346,8 +346,8 @@ static inline int qelr_create_qp_buffers_sq(struct qelr_devctx *cxt,
 	max_send_buf = max_send_sges * QELR_SQE_ELEMENT_SIZE;
 
 	chain_size = max_send_buf;
-	rc = qelr_chain_alloc(&qp->sq.chain, chain_size, cxt->kernel_page_size,
-			      QELR_SQE_ELEMENT_SIZE);
+	rc = qelr_chain_alloc(cxt->ibv_ctx.device, &qp->sq.chain, chain_size,
+			      cxt->kernel_page_size, QELR_SQE_ELEMENT_SIZE);
 	if (rc)
 		DP_ERR(cxt->dbg_fp, "create qp: failed to map SQ chain, got %d", rc);
 
@@ -373,8 +373,8 @@ static inline int qelr_create_qp_buffers_rq(struct qelr_devctx *cxt,
 	max_recv_buf = max_recv_sges * QELR_RQE_ELEMENT_SIZE;
 
 	chain_size = max_recv_buf;
-	rc = qelr_chain_alloc(&qp->rq.chain, chain_size, cxt->kernel_page_size,
-			      QELR_RQE_ELEMENT_SIZE);
+	rc = qelr_chain_alloc(cxt->ibv_ctx.device, &qp->rq.chain, chain_size,
+			      cxt->kernel_page_size, QELR_RQE_ELEMENT_SIZE);
 	if (rc)
 		DP_ERR(cxt->dbg_fp, "create qp: failed to map RQ chain, got %d", rc);
 
@@ -455,7 +455,7 @@ static inline int qelr_configure_qp(struct qelr_devctx *cxt, struct qelr_qp *qp,
 	int rc;
 
 	/* general */
-	pthread_spin_init(&qp->q_lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qp->q_lock, !verbs_single_threaded(&cxt->ibv_ctx));
 	qp->qp_id = resp->qp_id;
 	qp->state = QELR_QPS_RST;
 	qp->sq_sig_all = attrs->sq_sig_all;
@@ -650,10 +650,10 @@ static int qelr_update_qp_state(struct qelr_qp *qp,
 
 	new_state = get_qelr_qp_state(new_ib_state);
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 
 	if (new_state == qp->state) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		return 0;
 	}
 
@@ -757,7 +757,7 @@ static int qelr_update_qp_state(struct qelr_qp *qp,
 	if (!status)
 		qp->state = new_state;
 
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 
 	return status;
 }
@@ -1403,11 +1403,11 @@ int qelr_post_send(struct ibv_qp *ib_qp, struct ibv_send_wr *wr,
 	*bad_wr = NULL;
 	int rc = 0;
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 
 	if ((qp->state != QELR_QPS_RTS && qp->state != QELR_QPS_ERR &&
 	     qp->state != QELR_QPS_SQD)) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		*bad_wr = wr;
 		return -EINVAL;
 	}
@@ -1433,7 +1433,7 @@ int qelr_post_send(struct ibv_qp *ib_qp, struct ibv_send_wr *wr,
 	if (doorbell_required)
 		doorbell_qp(qp);
 
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 
 	return rc;
 }
@@ -1446,10 +1446,10 @@ int qelr_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 	struct qelr_devctx *cxt = get_qelr_ctx(ibqp->context);
 	uint16_t db_val;
 
-	pthread_spin_lock(&qp->q_lock);
+	verbs_spin_lock(&qp->q_lock);
 
 	if (qp->state == QELR_QPS_RST) {
-		pthread_spin_unlock(&qp->q_lock);
+		verbs_spin_unlock(&qp->q_lock);
 		*bad_wr = wr;
 		return -EINVAL;
 	}
@@ -1520,7 +1520,7 @@ int qelr_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 		wr = wr->next;
 	}
 
-	pthread_spin_unlock(&qp->q_lock);
+	verbs_spin_unlock(&qp->q_lock);
 
 	return status;
 }
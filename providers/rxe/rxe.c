@@ -183,7 +183,7 @@ static struct ibv_cq *rxe_create_cq(struct ibv_context *context, int cqe,
 	}
 
 	cq->mmap_info = resp.mi;
-	pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&cq->lock, !verbs_single_threaded(context));
 
 	return &cq->ibv_cq;
 }
@@ -195,12 +195,12 @@ static int rxe_resize_cq(struct ibv_cq *ibcq, int cqe)
 	struct rxe_resize_cq_resp resp;
 	int ret;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	ret = ibv_cmd_resize_cq(ibcq, cqe, &cmd, sizeof cmd,
 				&resp.ibv_resp, sizeof resp);
 	if (ret) {
-		pthread_spin_unlock(&cq->lock);
+		verbs_spin_unlock(&cq->lock);
 		return ret;
 	}
 
@@ -211,7 +211,7 @@ static int rxe_resize_cq(struct ibv_cq *ibcq, int cqe)
 			 ibcq->context->cmd_fd, resp.mi.offset);
 
 	ret = errno;
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	if ((void *)cq->queue == MAP_FAILED) {
 		cq->queue = NULL;
@@ -247,7 +247,7 @@ static int rxe_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 	int npolled;
 	uint8_t *src;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	q = cq->queue;
 
 	for (npolled = 0; npolled < ne; ++npolled, ++wc) {
@@ -260,7 +260,7 @@ static int rxe_poll_cq(struct ibv_cq *ibcq, int ne, struct ibv_wc *wc)
 		advance_consumer(q);
 	}
 
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 	return npolled;
 }
 
@@ -295,7 +295,7 @@ static struct ibv_srq *rxe_create_srq(struct ibv_pd *pd,
 
 	srq->mmap_info = resp.mi;
 	srq->rq.max_sge = attr->attr.max_sge;
-	pthread_spin_init(&srq->rq.lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&srq->rq.lock, !verbs_single_threaded(pd->context));
 
 	return &srq->ibv_srq;
 }
@@ -312,7 +312,7 @@ static int rxe_modify_srq(struct ibv_srq *ibsrq,
 	mi.size = 0;
 
 	if (attr_mask & IBV_SRQ_MAX_WR)
-		pthread_spin_lock(&srq->rq.lock);
+		verbs_spin_lock(&srq->rq.lock);
 
 	cmd.mmap_info_addr = (__u64)(uintptr_t) & mi;
 	rc = ibv_cmd_modify_srq(ibsrq, attr, attr_mask,
@@ -338,7 +338,7 @@ static int rxe_modify_srq(struct ibv_srq *ibsrq,
 
 out:
 	if (attr_mask & IBV_SRQ_MAX_WR)
-		pthread_spin_unlock(&srq->rq.lock);
+		verbs_spin_unlock(&srq->rq.lock);
 	return rc;
 }
 
@@ -414,7 +414,7 @@ static int rxe_post_srq_recv(struct ibv_srq *ibvsrq,
 	struct rxe_srq *srq = to_rsrq(ibvsrq);
 	int rc = 0;
 
-	pthread_spin_lock(&srq->rq.lock);
+	verbs_spin_lock(&srq->rq.lock);
 
 	while (recv_wr) {
 		rc = rxe_post_one_recv(&srq->rq, recv_wr);
@@ -426,7 +426,7 @@ static int rxe_post_srq_recv(struct ibv_srq *ibvsrq,
 		recv_wr = recv_wr->next;
 	}
 
-	pthread_spin_unlock(&srq->rq.lock);
+	verbs_spin_unlock(&srq->rq.lock);
 
 	return rc;
 }
@@ -467,7 +467,8 @@ static struct ibv_qp *rxe_create_qp(struct ibv_pd *pd,
 		}
 
 		qp->rq_mmap_info = resp.rq_mi;
-		pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE);
+		verbs_spinlock_init(&qp->rq.lock,
+				    !verbs_single_threaded(pd->context));
 	}
 
 	qp->sq.max_sge = attr->cap.max_send_sge;
@@ -484,7 +485,7 @@ static struct ibv_qp *rxe_create_qp(struct ibv_pd *pd,
 	}
 
 	qp->sq_mmap_info = resp.sq_mi;
-	pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE);
+	verbs_spinlock_init(&qp->sq.lock, !verbs_single_threaded(pd->context));
 
 	return &qp->ibv_qp;
 }
@@ -700,7 +701,7 @@ static int rxe_post_send(struct ibv_qp *ibqp,
 	if (!sq || !wr_list || !sq->queue)
 	 	return EINVAL;
 
-	pthread_spin_lock(&sq->lock);
+	verbs_spin_lock(&sq->lock);
 
 	while (wr_list) {
 		rc = post_one_send(qp, sq, wr_list);
@@ -712,7 +713,7 @@ static int rxe_post_send(struct ibv_qp *ibqp,
 		wr_list = wr_list->next;
 	}
 
-	pthread_spin_unlock(&sq->lock);
+	verbs_spin_unlock(&sq->lock);
 
 	err =  post_send_db(ibqp);
 	return err ? err : rc;
@@ -734,7 +735,7 @@ static int rxe_post_recv(struct ibv_qp *ibqp,
 	if (!rq || !recv_wr || !rq->queue)
 		return EINVAL;
 
-	pthread_spin_lock(&rq->lock);
+	verbs_spin_lock(&rq->lock);
 
 	while (recv_wr) {
 		rc = rxe_post_one_recv(rq, recv_wr);
@@ -746,7 +747,7 @@ static int rxe_post_recv(struct ibv_qp *ibqp,
 		recv_wr = recv_wr->next;
 	}
 
-	pthread_spin_unlock(&rq->lock);
+	verbs_spin_unlock(&rq->lock);
 
 	return rc;
 }
@@ -852,43 +853,31 @@ static struct ibv_context_ops rxe_ctx_ops = {
 	.detach_mcast = ibv_cmd_detach_mcast
 };
 
-static struct ibv_context *rxe_alloc_context(struct ibv_device *ibdev,
-					     int cmd_fd)
+static int rxe_init_context(struct verbs_device *vdev,
+			    struct ibv_context *ibctx, int cmd_fd)
 {
-	struct rxe_context *context;
 	struct ibv_get_context cmd;
 	struct ibv_get_context_resp resp;
 
-	context = malloc(sizeof *context);
-	if (!context)
-		return NULL;
-
-	memset(context, 0, sizeof *context);
-	context->ibv_ctx.cmd_fd = cmd_fd;
-
-	if (ibv_cmd_get_context(&context->ibv_ctx, &cmd,
-				sizeof cmd, &resp, sizeof resp))
-		goto out;
+	ibctx->cmd_fd = cmd_fd;
 
-	context->ibv_ctx.ops = rxe_ctx_ops;
+	if (ibv_cmd_get_context(ibctx, &cmd, sizeof cmd, &resp, sizeof resp))
+		return errno;
 
-	return &context->ibv_ctx;
+	ibctx->ops = rxe_ctx_ops;
+	verbs_get_ctx(ibctx)->create_cq_ex = verbs_create_cq_ex_emul;
 
-out:
-	free(context);
-	return NULL;
+	return 0;
 }
 
-static void rxe_free_context(struct ibv_context *ibctx)
+static void rxe_uninit_context(struct verbs_device *vdev,
+			       struct ibv_context *ibctx)
 {
-	struct rxe_context *context = to_rctx(ibctx);
-
-	free(context);
 }
 
 static struct verbs_device_ops rxe_dev_ops = {
-	.alloc_context = rxe_alloc_context,
-	.free_context = rxe_free_context,
+	.init_context = rxe_init_context,
+	.uninit_context = rxe_uninit_context,
 };
 
 static struct verbs_device *rxe_driver_init(const char *uverbs_sys_path,
@@ -914,13 +903,14 @@ static struct verbs_device *rxe_driver_init(const char *uverbs_sys_path,
 	}
 
 	dev->ibv_dev.ops = &rxe_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct rxe_context) -
+				       sizeof(struct ibv_context);
 	dev->abi_version = abi_version;
 
 	return &dev->ibv_dev;
 }
 
-static __attribute__ ((constructor))
-void rxe_register_driver(void)
+PROVIDER_DRIVER(rxe)
 {
 	verbs_register_driver("rxe", rxe_driver_init);
 }
@@ -58,10 +58,13 @@ struct rxe_context {
 };
 
 struct rxe_cq {
-	struct ibv_cq		ibv_cq;
+	union {
+		struct ibv_cq	ibv_cq;
+		struct verbs_cq	vcq;
+	};
 	struct mmap_info	mmap_info;
 	struct rxe_queue		*queue;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 };
 
 struct rxe_ah {
@@ -71,7 +74,7 @@ struct rxe_ah {
 
 struct rxe_wq {
 	struct rxe_queue	*queue;
-	pthread_spinlock_t	lock;
+	struct verbs_spinlock	lock;
 	unsigned int		max_sge;
 	unsigned int		max_inline;
 };
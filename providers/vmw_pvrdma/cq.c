@@ -61,7 +61,7 @@ enum {
 int pvrdma_alloc_cq_buf(struct pvrdma_device *dev, struct pvrdma_cq *cq,
 			struct pvrdma_buf *buf, int entries)
 {
-	if (pvrdma_alloc_buf(buf, cq->offset +
+	if (pvrdma_alloc_buf(&dev->ibv_dev.device, buf, cq->offset +
 			     entries * (sizeof(struct pvrdma_cqe)),
 			     dev->page_size))
 		return -1;
@@ -145,14 +145,14 @@ int pvrdma_poll_cq(struct ibv_cq *ibcq, int num_entries, struct ibv_wc *wc)
 	if (num_entries < 1 || wc == NULL)
 		return 0;
 
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 
 	for (npolled = 0; npolled < num_entries; ++npolled) {
 		if (pvrdma_poll_one(cq, &qp, wc + npolled) != CQ_OK)
 			break;
 	}
 
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 
 	return npolled;
 }
@@ -204,9 +204,9 @@ void pvrdma_cq_clean_int(struct pvrdma_cq *cq, uint32_t qpn)
 
 void pvrdma_cq_clean(struct pvrdma_cq *cq, uint32_t qpn)
 {
-	pthread_spin_lock(&cq->lock);
+	verbs_spin_lock(&cq->lock);
 	pvrdma_cq_clean_int(cq, qpn);
-	pthread_spin_unlock(&cq->lock);
+	verbs_spin_unlock(&cq->lock);
 }
 
 struct ibv_cq *pvrdma_create_cq(struct ibv_context *context, int cqe,
@@ -229,7 +229,7 @@ struct ibv_cq *pvrdma_create_cq(struct ibv_context *context, int cqe,
 	/* Extra page for shared ring state */
 	cq->offset = dev->page_size;
 
-	if (pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&cq->lock, !verbs_single_threaded(context)))
 		goto err;
 
 	cqe = align_next_power2(cqe);
@@ -125,10 +125,13 @@ struct pvrdma_pd {
 };
 
 struct pvrdma_cq {
-	struct ibv_cq			ibv_cq;
+	union {
+		struct ibv_cq		ibv_cq;
+		struct verbs_cq		vcq;
+	};
 	struct pvrdma_buf		buf;
 	struct pvrdma_buf		resize_buf;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	struct pvrdma_ring_state	*ring_state;
 	uint32_t			cqe_cnt;
 	uint32_t			offset;
@@ -137,7 +140,7 @@ struct pvrdma_cq {
 
 struct pvrdma_wq {
 	uint64_t			*wrid;
-	pthread_spinlock_t		lock;
+	struct verbs_spinlock		lock;
 	int				wqe_cnt;
 	int				wqe_size;
 	struct pvrdma_ring		*ring_state;
@@ -246,7 +249,8 @@ static inline int pvrdma_wc_flags_to_ibv(int flags)
 	return flags;
 }
 
-int pvrdma_alloc_buf(struct pvrdma_buf *buf, size_t size, int page_size);
+int pvrdma_alloc_buf(struct ibv_device *device, struct pvrdma_buf *buf,
+		     size_t size, int page_size);
 void pvrdma_free_buf(struct pvrdma_buf *buf);
 
 int pvrdma_query_device(struct ibv_context *context,
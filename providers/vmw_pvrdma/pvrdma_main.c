@@ -75,27 +75,20 @@ static struct ibv_context_ops pvrdma_ctx_ops = {
 	.destroy_ah = pvrdma_destroy_ah,
 };
 
-int pvrdma_alloc_buf(struct pvrdma_buf *buf, size_t size, int page_size)
+int pvrdma_alloc_buf(struct ibv_device *device, struct pvrdma_buf *buf,
+		     size_t size, int page_size)
 {
-	int ret;
-
 	buf->length = align(size, page_size);
-	buf->buf = mmap(NULL, buf->length, PROT_READ | PROT_WRITE,
-			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (buf->buf == MAP_FAILED)
+	buf->buf = verbs_alloc_queue_buf(device, buf->length);
+	if (!buf->buf)
 		return errno;
 
-	ret = ibv_dontfork_range(buf->buf, size);
-	if (ret)
-		munmap(buf->buf, buf->length);
-
-	return ret;
+	return 0;
 }
 
 void pvrdma_free_buf(struct pvrdma_buf *buf)
 {
-	ibv_dofork_range(buf->buf, buf->length);
-	munmap(buf->buf, buf->length);
+	verbs_free_queue_buf(buf->buf, buf->length);
 }
 
 static int pvrdma_init_context_shared(struct pvrdma_context *context,
@@ -113,7 +106,7 @@ static int pvrdma_init_context_shared(struct pvrdma_context *context,
 	context->qp_tbl = calloc(resp.udata.qp_tab_size & 0xFFFF,
 				 sizeof(struct pvrdma_qp *));
 	if (!context->qp_tbl)
-		return -ENOMEM;
+		return ENOMEM;
 
 	context->uar = mmap(NULL, to_vdev(ibdev)->page_size, PROT_WRITE,
 			    MAP_SHARED, cmd_fd, 0);
@@ -124,6 +117,7 @@ static int pvrdma_init_context_shared(struct pvrdma_context *context,
 
 	pthread_spin_init(&context->uar_lock, PTHREAD_PROCESS_PRIVATE);
 	context->ibv_ctx.ops = pvrdma_ctx_ops;
+	verbs_get_ctx(&context->ibv_ctx)->create_cq_ex = verbs_create_cq_ex_emul;
 
 	return 0;
 }
@@ -135,36 +129,22 @@ static void pvrdma_free_context_shared(struct pvrdma_context *context,
 	free(context->qp_tbl);
 }
 
-static struct ibv_context *pvrdma_alloc_context(struct ibv_device *ibdev,
-						int cmd_fd)
+static int pvrdma_init_context(struct verbs_device *vdev,
+			       struct ibv_context *ibctx, int cmd_fd)
 {
-	struct pvrdma_context *context;
-
-	context = malloc(sizeof(*context));
-	if (!context)
-		return NULL;
-
-	memset(context, 0, sizeof(*context));
-
-	if (pvrdma_init_context_shared(context, ibdev, cmd_fd)) {
-		free(context);
-		return NULL;
-	}
-
-	return &context->ibv_ctx;
+	return pvrdma_init_context_shared(to_vctx(ibctx), &vdev->device,
+					  cmd_fd);
 }
 
-static void pvrdma_free_context(struct ibv_context *ibctx)
+static void pvrdma_uninit_context(struct verbs_device *vdev,
+				  struct ibv_context *ibctx)
 {
-	struct pvrdma_context *context = to_vctx(ibctx);
-
-	pvrdma_free_context_shared(context, to_vdev(ibctx->device));
-	free(context);
+	pvrdma_free_context_shared(to_vctx(ibctx), to_vdev(&vdev->device));
 }
 
 static struct verbs_device_ops pvrdma_dev_ops = {
-	.alloc_context = pvrdma_alloc_context,
-	.free_context  = pvrdma_free_context
+	.init_context	= pvrdma_init_context,
+	.uninit_context	= pvrdma_uninit_context
 };
 
 static struct pvrdma_device *pvrdma_driver_init_shared(
@@ -208,6 +188,8 @@ static struct pvrdma_device *pvrdma_driver_init_shared(
 	dev->abi_version = abi_version;
 	dev->page_size   = sysconf(_SC_PAGESIZE);
 	dev->ibv_dev.ops = &pvrdma_dev_ops;
+	dev->ibv_dev.size_of_context = sizeof(struct pvrdma_context) -
+				       sizeof(struct ibv_context);
 
 	return dev;
 }
@@ -223,7 +205,7 @@ static struct verbs_device *pvrdma_driver_init(const char *uverbs_sys_path,
 	return &dev->ibv_dev;
 }
 
-static __attribute__((constructor)) void pvrdma_register_driver(void)
+PROVIDER_DRIVER(vmw_pvrdma)
 {
 	verbs_register_driver("pvrdma", pvrdma_driver_init);
 }
@@ -69,13 +69,15 @@ int pvrdma_alloc_qp_buf(struct pvrdma_device *dev, struct ibv_qp_cap *cap,
 				dev->page_size);
 	qp->buf_size = qp->rbuf.length + qp->sbuf.length;
 
-	if (pvrdma_alloc_buf(&qp->rbuf, qp->rbuf.length, dev->page_size)) {
+	if (pvrdma_alloc_buf(&dev->ibv_dev.device, &qp->rbuf,
+			     qp->rbuf.length, dev->page_size)) {
 		free(qp->sq.wrid);
 		free(qp->rq.wrid);
 		return -1;
 	}
 
-	if (pvrdma_alloc_buf(&qp->sbuf, qp->sbuf.length, dev->page_size)) {
+	if (pvrdma_alloc_buf(&dev->ibv_dev.device, &qp->sbuf,
+			     qp->sbuf.length, dev->page_size)) {
 		free(qp->sq.wrid);
 		free(qp->rq.wrid);
 		pvrdma_free_buf(&qp->rbuf);
@@ -147,8 +149,10 @@ struct ibv_qp *pvrdma_create_qp(struct ibv_pd *pd,
 	qp->rq.ring_state = (struct pvrdma_ring *)&qp->sq.ring_state[1];
 	pvrdma_init_qp_queue(qp);
 
-	if (pthread_spin_init(&qp->sq.lock, PTHREAD_PROCESS_PRIVATE) ||
-	    pthread_spin_init(&qp->rq.lock, PTHREAD_PROCESS_PRIVATE))
+	if (verbs_spinlock_init(&qp->sq.lock,
+				!verbs_single_threaded(pd->context)) ||
+	    verbs_spinlock_init(&qp->rq.lock,
+				!verbs_single_threaded(pd->context)))
 		goto err_free;
 
 	memset(&cmd, 0, sizeof(cmd));
@@ -241,13 +245,13 @@ static void pvrdma_lock_cqs(struct ibv_qp *qp)
 	struct pvrdma_cq *recv_cq = to_vcq(qp->recv_cq);
 
 	if (send_cq == recv_cq)
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_lock(&send_cq->lock);
-		pthread_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
 	} else {
-		pthread_spin_lock(&recv_cq->lock);
-		pthread_spin_lock(&send_cq->lock);
+		verbs_spin_lock(&recv_cq->lock);
+		verbs_spin_lock(&send_cq->lock);
 	}
 }
 
@@ -257,13 +261,13 @@ static void pvrdma_unlock_cqs(struct ibv_qp *qp)
 	struct pvrdma_cq *recv_cq = to_vcq(qp->recv_cq);
 
 	if (send_cq == recv_cq)
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	else if (send_cq->cqn < recv_cq->cqn) {
-		pthread_spin_unlock(&recv_cq->lock);
-		pthread_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
 	} else {
-		pthread_spin_unlock(&send_cq->lock);
-		pthread_spin_unlock(&recv_cq->lock);
+		verbs_spin_unlock(&send_cq->lock);
+		verbs_spin_unlock(&recv_cq->lock);
 	}
 }
 
@@ -327,10 +331,10 @@ int pvrdma_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
 		return EINVAL;
 	}
 
-	pthread_spin_lock(&qp->sq.lock);
+	verbs_spin_lock(&qp->sq.lock);
 	ind = pvrdma_idx(&(qp->sq.ring_state->prod_tail), qp->sq.wqe_cnt);
 	if (ind < 0) {
-		pthread_spin_unlock(&qp->sq.lock);
+		verbs_spin_unlock(&qp->sq.lock);
 		ret = EINVAL;
 		goto out;
 	}
@@ -421,7 +425,7 @@ out:
 				    PVRDMA_UAR_QP_SEND | ibqp->qp_num);
 	}
 
-	pthread_spin_unlock(&qp->sq.lock);
+	verbs_spin_unlock(&qp->sq.lock);
 
 	return ret;
 }
@@ -450,11 +454,11 @@ int pvrdma_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
 		return EINVAL;
 	}
 
-	pthread_spin_lock(&qp->rq.lock);
+	verbs_spin_lock(&qp->rq.lock);
 
 	ind = pvrdma_idx(&(qp->rq.ring_state->prod_tail), qp->rq.wqe_cnt);
 	if (ind < 0) {
-		pthread_spin_unlock(&qp->rq.lock);
+		verbs_spin_unlock(&qp->rq.lock);
 		*bad_wr = wr;
 		return EINVAL;
 	}
@@ -500,6 +504,6 @@ out:
 		pvrdma_write_uar_qp(ctx->uar,
 				    PVRDMA_UAR_QP_RECV | ibqp->qp_num);
 
-	pthread_spin_unlock(&qp->rq.lock);
+	verbs_spin_unlock(&qp->rq.lock);
 	return ret;
 }
@@ -0,0 +1,98 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+#ifndef UTIL_MMIO_H
+#define UTIL_MMIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__s390x__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Copy a 64 byte block to write combining memory, eg a BlueFlame buffer,
+ * using the widest stores the target has so the CPU can emit the block as
+ * a single PCI-E MemWr TLP.  All of src is loaded before the first store
+ * so the stores go out back to back.
+ *
+ * Do not use memcpy() for this, its implementations may use string move
+ * instructions that do not guarantee the order of the stores.
+ *
+ * dst must be 64 byte aligned.  The copy has no barriers of its own: it
+ * has to be preceded by mmio_wc_start() (or mmio_wc_spinlock()) and
+ * followed by mmio_flush_writes() from udma_barrier.h.
+ */
+static inline void mmio_wc_copy64(void *dst, const void *src)
+{
+#if defined(__s390x__)
+	syscall(__NR_s390_pci_mmio_write, (unsigned long)dst, src, 64);
+#elif defined(__AVX__)
+	const __m256i *s = src;
+	__m256i *d = dst;
+	__m256i v0, v1;
+
+	v0 = _mm256_loadu_si256(s);
+	v1 = _mm256_loadu_si256(s + 1);
+	_mm256_store_si256(d, v0);
+	_mm256_store_si256(d + 1, v1);
+#elif defined(__SSE2__)
+	const __m128i *s = src;
+	__m128i *d = dst;
+	__m128i v0, v1, v2, v3;
+
+	v0 = _mm_loadu_si128(s);
+	v1 = _mm_loadu_si128(s + 1);
+	v2 = _mm_loadu_si128(s + 2);
+	v3 = _mm_loadu_si128(s + 3);
+	_mm_store_si128(d, v0);
+	_mm_store_si128(d + 1, v1);
+	_mm_store_si128(d + 2, v2);
+	_mm_store_si128(d + 3, v3);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const uint64_t *s = src;
+	uint64_t *d = dst;
+	uint64x2_t v0, v1, v2, v3;
+
+	v0 = vld1q_u64(s);
+	v1 = vld1q_u64(s + 2);
+	v2 = vld1q_u64(s + 4);
+	v3 = vld1q_u64(s + 6);
+	vst1q_u64(d, v0);
+	vst1q_u64(d + 2, v1);
+	vst1q_u64(d + 4, v2);
+	vst1q_u64(d + 6, v3);
+#else
+	const uint64_t *s = src;
+	volatile uint64_t *d = dst;
+
+	d[0] = s[0];
+	d[1] = s[1];
+	d[2] = s[2];
+	d[3] = s[3];
+	d[4] = s[4];
+	d[5] = s[5];
+	d[6] = s[6];
+	d[7] = s[7];
+#endif
+}
+
+/* bytecnt must be a non-zero multiple of 64 */
+static inline void mmio_wc_copy(void *dst, const void *src, size_t bytecnt)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+
+	do {
+		mmio_wc_copy64(d, s);
+		d += 64;
+		s += 64;
+		bytecnt -= 64;
+	} while (bytecnt);
+}
+
+#endif